@@ -0,0 +1,75 @@
+import json
+import socket
+import sys
+
+
+def render(socket_path, options):
+    """Sends one render request to a `knight --serve` socket.
+
+    options maps long option names to values, e.g. {"lat": 51.5, "bloom": True}.
+    Returns (content_type, image_bytes); raises RuntimeError on a server error.
+    """
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as s:
+        s.connect(socket_path)
+        s.sendall(json.dumps(options).encode())
+        s.shutdown(socket.SHUT_WR)
+
+        data = b""
+        while b"\n" not in data:
+            chunk = s.recv(4096)
+            if not chunk:
+                raise RuntimeError("Connection closed without a response")
+            data += chunk
+        status, _, body = data.partition(b"\n")
+        fields = status.decode().split(" ", 2)
+        if fields[0] != "OK":
+            raise RuntimeError(status.decode()[4:] if fields[0] == "ERR" else status.decode())
+
+        content_type, size = fields[1], int(fields[2])
+        chunks = [body]
+        received = len(body)
+        while received < size:
+            chunk = s.recv(1 << 16)
+            if not chunk:
+                raise RuntimeError(f"Short response: {received} of {size} bytes")
+            chunks.append(chunk)
+            received += len(chunk)
+        return content_type, b"".join(chunks)
+
+
+def parse_value(text):
+    if text in ("true", "false"):
+        return text == "true"
+    try:
+        return float(text) if any(c in text for c in ".eE") else int(text)
+    except ValueError:
+        return text
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("Usage: python3 knight_client.py <socket> <output.pfm|output.png> [key=value | flag ...]")
+        print("A .png output asks the server for a PNG (format=png); anything else gets a PFM.")
+        print("Example: python3 knight_client.py /tmp/knight.sock sky.png lat=51.5 date=2026-03-01 time=21:00 bloom")
+        sys.exit(1)
+
+    options = {}
+    if sys.argv[2].lower().endswith(".png"):
+        options["format"] = "png"
+    for arg in sys.argv[3:]:
+        key, eq, value = arg.lstrip("-").partition("=")
+        options[key] = parse_value(value) if eq else True
+
+    try:
+        content_type, image = render(sys.argv[1], options)
+    except (OSError, RuntimeError) as e:
+        print(f"Error: {e}")
+        sys.exit(1)
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(image)
+    print(f"Saved {len(image)} bytes ({content_type}) to {sys.argv[2]}")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,5 +1,10 @@
 #include "atmosphere.h"
 #include "atmosphere_math.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 void atmosphere_init_default(Atmosphere* atm, float turbidity) {
     atm->earth_radius = EARTH_RADIUS;
@@ -28,6 +33,7 @@ bool ray_sphere_intersect(Vec3 ray_origin, Vec3 ray_dir, float radius, float* t0
 
 Spectrum atmosphere_render(
     const Atmosphere* atm,
+    const AtmosphereLUT* lut,
     Vec3 ray_origin,
     Vec3 ray_dir,
     Vec3 sun_dir,
@@ -36,9 +42,220 @@ Spectrum atmosphere_render(
     const Spectrum* moon_intensity,
     float* out_alpha
 ) {
-    return atmosphere_render_radiance(atm, ray_origin, ray_dir, sun_dir, sun_intensity, moon_dir, moon_intensity, out_alpha);
+    return atmosphere_render_radiance(atm, lut, ray_origin, ray_dir, sun_dir, sun_intensity, moon_dir, moon_intensity, out_alpha);
 }
 
-Spectrum atmosphere_transmittance(const Atmosphere* atm, Vec3 p, Vec3 dir) {
-    return atmosphere_compute_transmittance(atm, p, dir);
+void atmosphere_scattering(const Atmosphere* atm, const AtmosphereLUT* lut, Vec3 ray_origin, Vec3 ray_dir,
+                           Vec3 body_dir, Spectrum* rayleigh, Spectrum* mie, float* out_alpha) {
+    spectrum_zero(rayleigh);
+    spectrum_zero(mie);
+    *out_alpha = 0.0f;
+    float t0, t1;
+    if (!ray_sphere_intersect_math(ray_origin, ray_dir, atm->atmosphere_radius, &t0, &t1)) return;
+    float t_earth0, t_earth1;
+    if (ray_sphere_intersect_math(ray_origin, ray_dir, atm->earth_radius, &t_earth0, &t_earth1)) {
+        if (t_earth0 < t1) t1 = t_earth0;
+    }
+
+    // The same march as atmosphere_render_radiance
+    int steps = 16;
+    float dt = (t1 - t0) / steps;
+    float tau_r = 0.0f, tau_m = 0.0f;
+    for (int i = 0; i < steps; i++) {
+        float t = t0 + (i + 0.5f) * dt;
+        Vec3 p = vec3_add(ray_origin, vec3_mul(ray_dir, t));
+        float h = vec3_length(p) - atm->earth_radius;
+        if (h < 0) h = 0;
+        float rho_r = expf(-h / atm->rayleigh_scale_height);
+        float rho_m = expf(-h / atm->mie_scale_height);
+        Spectrum T_body = atmosphere_transmittance(atm, lut, p, body_dir);
+        float view_r = (tau_r + rho_r * dt * 0.5f), view_m = (tau_m + rho_m * dt * 0.5f);
+        for (int k = 0; k < SPECTRUM_BANDS; k++) {
+            float T_view = expf(-(view_r * atm->beta_rayleigh.s[k] + view_m * atm->beta_mie.s[k]));
+            float lit = T_body.s[k] * T_view * dt;
+            rayleigh->s[k] += rho_r * atm->beta_rayleigh.s[k] * lit;
+            mie->s[k] += rho_m * atm->beta_mie.s[k] * lit;
+        }
+        tau_r += rho_r * dt;
+        tau_m += rho_m * dt;
+    }
+    int idx = 17;
+    *out_alpha = expf(-(tau_r * atm->beta_rayleigh.s[idx] + tau_m * atm->beta_mie.s[idx]));
+}
+
+Spectrum atmosphere_transmittance(const Atmosphere* atm, const AtmosphereLUT* lut, Vec3 p, Vec3 dir) {
+    return lut ? atmosphere_lut_sample(atm, lut, p, dir) : atmosphere_compute_transmittance(atm, p, dir);
+}
+
+#define LUT_MAGIC "KNIGHTAT"
+#define LUT_VERSION 1
+#define LUT_HEADER_SIZE 64
+#define LUT_FLOATS ((size_t)ATM_LUT_ALTITUDES * ATM_LUT_ZENITHS * SPECTRUM_BANDS)
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t bands, altitudes, zeniths;
+    uint64_t key;
+    uint64_t checksum;
+} LUTHeader;
+
+// FNV-1a, fed field by field so struct padding stays out
+static void hash_bytes(uint64_t* h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) {
+        *h ^= p[i];
+        *h *= 1099511628211ULL;
+    }
+}
+
+#define HASH_FIELD(h, field) hash_bytes(h, &(field), sizeof(field))
+
+uint64_t atmosphere_lut_key(const Atmosphere* atm) {
+    uint64_t h = 14695981039346656037ULL;
+    uint32_t sizes[4] = {LUT_VERSION, SPECTRUM_BANDS, ATM_LUT_ALTITUDES, ATM_LUT_ZENITHS};
+    HASH_FIELD(&h, sizes);
+    HASH_FIELD(&h, atm->rayleigh_scale_height);
+    HASH_FIELD(&h, atm->mie_scale_height);
+    HASH_FIELD(&h, atm->beta_rayleigh);
+    HASH_FIELD(&h, atm->beta_mie);
+    HASH_FIELD(&h, atm->mie_g);
+    HASH_FIELD(&h, atm->earth_radius);
+    HASH_FIELD(&h, atm->atmosphere_radius);
+    return h;
+}
+
+// A word at a time, so checking a cached table costs little next to building it
+static uint64_t table_checksum(const float* table) {
+    const uint32_t* words = (const uint32_t*)table;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < LUT_FLOATS; i++) {
+        h ^= words[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+const char* atmosphere_cache_dir(char* buf, size_t size) {
+    const char* dir = getenv("KNIGHT_CACHE_DIR");
+    if (dir) {
+        if (!dir[0]) return NULL;
+        snprintf(buf, size, "%s", dir);
+        return buf;
+    }
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if (xdg && xdg[0]) {
+        snprintf(buf, size, "%s/knight", xdg);
+    } else if (home && home[0]) {
+        snprintf(buf, size, "%s/.cache/knight", home);
+    } else {
+        return NULL;
+    }
+    return buf;
+}
+
+static void build_table(float* table, const Atmosphere* atm) {
+    const int half = ATM_LUT_ZENITHS / 2;
+    float top = atm->atmosphere_radius - atm->earth_radius;
+    for (int a = 0; a < ATM_LUT_ALTITUDES; a++) {
+        float u = (float)a / (ATM_LUT_ALTITUDES - 1);
+        Vec3 p = {0.0f, atm->earth_radius + u * u * top, 0.0f};
+        float mu_h = atmosphere_horizon_mu(atm, p.y);
+        for (int z = 0; z < ATM_LUT_ZENITHS; z++) {
+            // Both halves end on the horizon, so the drop there is kept
+            float mu;
+            if (z >= half) {
+                float t = (float)(z - half) / (half - 1);
+                mu = mu_h + (1.0f - mu_h) * t * t;
+            } else {
+                float t = (float)(half - 1 - z) / (half - 1);
+                mu = mu_h - (1.0f + mu_h) * t * t;
+            }
+            Vec3 dir = {sqrtf(fmaxf(0.0f, 1.0f - mu * mu)), mu, 0.0f};
+            Spectrum t = atmosphere_compute_transmittance(atm, p, dir);
+            memcpy(table + ((size_t)a * ATM_LUT_ZENITHS + z) * SPECTRUM_BANDS, t.s, sizeof(t.s));
+        }
+    }
+}
+
+// Maps path if it holds the table for key
+static bool map_cached(AtmosphereLUT* lut, const char* path, uint64_t key) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    size_t size = LUT_HEADER_SIZE + sizeof(float) * LUT_FLOATS;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == size) {
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    const LUTHeader* header = (const LUTHeader*)map;
+    const float* table = (const float*)((const char*)map + LUT_HEADER_SIZE);
+    if (memcmp(header->magic, LUT_MAGIC, 8) != 0 || header->version != LUT_VERSION ||
+        header->bands != SPECTRUM_BANDS || header->altitudes != ATM_LUT_ALTITUDES ||
+        header->zeniths != ATM_LUT_ZENITHS || header->key != key || header->checksum != table_checksum(table)) {
+        munmap(map, size);
+        return false;
+    }
+    lut->table = table;
+    lut->map = map;
+    lut->map_size = size;
+    return true;
+}
+
+// Writes a new file and renames it into place, so other processes never see
+// a partial table
+static void save_cached(const char* dir, const char* path, uint64_t key, const float* table) {
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        // $HOME/.cache may not exist yet
+        char parent[1024];
+        snprintf(parent, sizeof(parent), "%s", dir);
+        char* slash = strrchr(parent, '/');
+        if (!slash || slash == parent) return;
+        *slash = '\0';
+        if (mkdir(parent, 0777) != 0 && errno != EEXIST) return;
+        if (mkdir(dir, 0777) != 0 && errno != EEXIST) return;
+    }
+    char tmp[1200];
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return;
+    LUTHeader header = {{0}, LUT_VERSION, SPECTRUM_BANDS, ATM_LUT_ALTITUDES, ATM_LUT_ZENITHS, key, table_checksum(table)};
+    memcpy(header.magic, LUT_MAGIC, 8);
+    unsigned char pad[LUT_HEADER_SIZE] = {0};
+    memcpy(pad, &header, sizeof(header));
+    bool ok = fwrite(pad, 1, sizeof(pad), f) == sizeof(pad) &&
+              fwrite(table, sizeof(float), LUT_FLOATS, f) == LUT_FLOATS;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, path) != 0) {
+        printf("Warning: Could not save atmosphere table to %s\n", path);
+        remove(tmp);
+    }
+}
+
+bool atmosphere_lut_open(AtmosphereLUT* lut, const Atmosphere* atm, const char* cache_dir) {
+    memset(lut, 0, sizeof(AtmosphereLUT));
+    uint64_t key = atmosphere_lut_key(atm);
+    char path[1100];
+    if (cache_dir) {
+        snprintf(path, sizeof(path), "%s/atm-%016llx.lut", cache_dir, (unsigned long long)key);
+        if (map_cached(lut, path, key)) return true;
+    }
+    float* table = (float*)malloc(sizeof(float) * LUT_FLOATS);
+    if (!table) return false;
+    build_table(table, atm);
+    if (cache_dir) save_cached(cache_dir, path, key, table);
+    lut->table = table;
+    return true;
+}
+
+void atmosphere_lut_close(AtmosphereLUT* lut) {
+    if (lut->map) {
+        munmap(lut->map, lut->map_size);
+    } else {
+        free((float*)lut->table);
+    }
+    memset(lut, 0, sizeof(AtmosphereLUT));
 }
@@ -1,6 +1,7 @@
 #ifndef ATMOSPHERE_H
 #define ATMOSPHERE_H
 
+#include <stdint.h>
 #include "core.h"
 
 // Math constants
@@ -20,6 +21,36 @@ typedef struct {
 // Setup default Earth atmosphere with optional turbidity multiplier (default 1.0)
 void atmosphere_init_default(Atmosphere* atm, float turbidity);
 
+// Transmittance to space per band, tabulated over altitude and the cosine of
+// the zenith angle. It stands in for the two optical depth integrals (toward
+// the Sun and the Moon) at every step of the ray march. Altitudes are spaced
+// by the square of the index and zenith cosines by its signed square, so the
+// cells are finest near the ground and the horizon.
+#define ATM_LUT_ALTITUDES 64
+#define ATM_LUT_ZENITHS 512
+
+typedef struct {
+    const float* table; // [altitude][zenith][band]
+    void* map;          // Mapped cache file holding table, or NULL if built in memory
+    size_t map_size;
+} AtmosphereLUT;
+
+// Tables are kept across runs in a cache directory as atm-<key>.lut, where
+// the key hashes the atmosphere parameters, band count and table size. A file
+// is a 64 byte header (magic, version, sizes, key and a checksum of the
+// table) and the table; files that do not match are rebuilt.
+uint64_t atmosphere_lut_key(const Atmosphere* atm);
+
+// $KNIGHT_CACHE_DIR, else $XDG_CACHE_HOME/knight, else $HOME/.cache/knight,
+// written into buf. Returns NULL if KNIGHT_CACHE_DIR is set but empty, which
+// turns the cache off.
+const char* atmosphere_cache_dir(char* buf, size_t size);
+
+// Maps the table for atm from cache_dir, or builds it and saves it there.
+// cache_dir may be NULL for no cache. Returns false if out of memory.
+bool atmosphere_lut_open(AtmosphereLUT* lut, const Atmosphere* atm, const char* cache_dir);
+void atmosphere_lut_close(AtmosphereLUT* lut);
+
 // Computes intersection distances with a sphere
 // Returns true if hit. t0 is near, t1 is far.
 bool ray_sphere_intersect(Vec3 ray_origin, Vec3 ray_dir, float radius, float* t0, float* t1);
@@ -31,10 +62,12 @@ bool ray_sphere_intersect(Vec3 ray_origin, Vec3 ray_dir, float radius, float* t0
 // moon_dir: direction TO moon (for moon light)
 // sun_intensity: Extraterrestrial solar irradiance (spectral)
 // moon_intensity: Extraterrestrial lunar irradiance (spectral)
+// lut: transmittance table for atm, or NULL to integrate it along the way
 // out_transmittance: Transmittance to space (or infinity)
 // Returns: In-scattered radiance
 Spectrum atmosphere_render(
     const Atmosphere* atm,
+    const AtmosphereLUT* lut,
     Vec3 ray_origin,
     Vec3 ray_dir,
     Vec3 sun_dir,
@@ -45,7 +78,16 @@ Spectrum atmosphere_render(
     // We will return a float alpha (luminance transmittance or green channel) for star composition.
 );
 
-// Calculates transmittance from point p to space along direction dir
-Spectrum atmosphere_transmittance(const Atmosphere* atm, Vec3 p, Vec3 dir);
+// Single scattering of light from one body along a ray, split by scatterer
+// and without the phase functions, which are constant along the ray: the
+// radiance atmosphere_render returns for that body is
+// (phase_rayleigh * rayleigh + phase_mie * mie) * intensity, band by band.
+// out_alpha is as for atmosphere_render.
+void atmosphere_scattering(const Atmosphere* atm, const AtmosphereLUT* lut, Vec3 ray_origin, Vec3 ray_dir,
+                           Vec3 body_dir, Spectrum* rayleigh, Spectrum* mie, float* out_alpha);
+
+// Calculates transmittance from point p to space along direction dir, from
+// lut if not NULL
+Spectrum atmosphere_transmittance(const Atmosphere* atm, const AtmosphereLUT* lut, Vec3 p, Vec3 dir);
 
 #endif
@@ -56,8 +56,43 @@ static inline HD void get_optical_depth_math(const Atmosphere* atm, Vec3 p, Vec3
     }
 }
 
+// Cosine of the zenith angle of the horizon at radius r
+static inline HD float atmosphere_horizon_mu(const Atmosphere* atm, float r) {
+    float ratio = atm->earth_radius / r;
+    return -sqrtf(fmaxf(0.0f, 1.0f - ratio * ratio));
+}
+
+// Transmittance from p to space along dir, interpolated from lut
+static inline HD Spectrum atmosphere_lut_sample(const Atmosphere* atm, const AtmosphereLUT* lut, Vec3 p, Vec3 dir) {
+    const int half = ATM_LUT_ZENITHS / 2;
+    float r = vec3_length(p);
+    float fa = (r - atm->earth_radius) / (atm->atmosphere_radius - atm->earth_radius);
+    fa = fa > 0.0f ? (fa < 1.0f ? sqrtf(fa) : 1.0f) : 0.0f;
+    float mu = fmaxf(-1.0f, fminf(1.0f, vec3_dot(p, dir) / r));
+    float mu_h = atmosphere_horizon_mu(atm, r);
+    float fz = mu >= mu_h ? half + sqrtf((mu - mu_h) / (1.0f - mu_h)) * (half - 1)
+                          : (half - 1) * (1.0f - sqrtf((mu_h - mu) / (1.0f + mu_h)));
+    fa *= ATM_LUT_ALTITUDES - 1;
+    int ia = (int)fa, iz = (int)fz;
+    if (ia > ATM_LUT_ALTITUDES - 2) ia = ATM_LUT_ALTITUDES - 2;
+    if (iz > ATM_LUT_ZENITHS - 2) iz = ATM_LUT_ZENITHS - 2;
+    float wa = fa - ia, wz = fz - iz;
+    const float* c00 = lut->table + ((size_t)ia * ATM_LUT_ZENITHS + iz) * SPECTRUM_BANDS;
+    const float* c01 = c00 + SPECTRUM_BANDS;
+    const float* c10 = c00 + ATM_LUT_ZENITHS * SPECTRUM_BANDS;
+    const float* c11 = c10 + SPECTRUM_BANDS;
+    float w00 = (1.0f - wa) * (1.0f - wz), w01 = (1.0f - wa) * wz;
+    float w10 = wa * (1.0f - wz), w11 = wa * wz;
+    Spectrum t;
+    for (int k = 0; k < SPECTRUM_BANDS; k++) {
+        t.s[k] = w00 * c00[k] + w01 * c01[k] + w10 * c10[k] + w11 * c11[k];
+    }
+    return t;
+}
+
 static inline HD Spectrum atmosphere_render_radiance(
     const Atmosphere* atm,
+    const AtmosphereLUT* lut,
     Vec3 ray_origin,
     Vec3 ray_dir,
     Vec3 sun_dir,
@@ -107,23 +142,31 @@ static inline HD Spectrum atmosphere_render_radiance(
         float d_tau_r = rho_r * dt;
         float d_tau_m = rho_m * dt;
         
-        Spectrum tau_sun_r, tau_sun_m;
-        spectrum_zero(&tau_sun_r); spectrum_zero(&tau_sun_m);
-        Spectrum tau_moon_r, tau_moon_m;
-        spectrum_zero(&tau_moon_r); spectrum_zero(&tau_moon_m);
-        
-        float t_sun0 = 0, t_sun1 = 0;
-        ray_sphere_intersect_math(p, sun_dir, atm->atmosphere_radius, &t_sun0, &t_sun1);
-        get_optical_depth_math(atm, p, sun_dir, t_sun1, &tau_sun_r, &tau_sun_m);
+        Spectrum T_sun, T_moon;
+        if (lut) {
+            T_sun = atmosphere_lut_sample(atm, lut, p, sun_dir);
+            T_moon = atmosphere_lut_sample(atm, lut, p, moon_dir);
+        } else {
+            Spectrum tau_sun_r, tau_sun_m;
+            spectrum_zero(&tau_sun_r); spectrum_zero(&tau_sun_m);
+            Spectrum tau_moon_r, tau_moon_m;
+            spectrum_zero(&tau_moon_r); spectrum_zero(&tau_moon_m);
+
+            float t_sun0 = 0, t_sun1 = 0;
+            ray_sphere_intersect_math(p, sun_dir, atm->atmosphere_radius, &t_sun0, &t_sun1);
+            get_optical_depth_math(atm, p, sun_dir, t_sun1, &tau_sun_r, &tau_sun_m);
 
-        float t_moon0 = 0, t_moon1 = 0;
-        ray_sphere_intersect_math(p, moon_dir, atm->atmosphere_radius, &t_moon0, &t_moon1);
-        get_optical_depth_math(atm, p, moon_dir, t_moon1, &tau_moon_r, &tau_moon_m);
+            float t_moon0 = 0, t_moon1 = 0;
+            ray_sphere_intersect_math(p, moon_dir, atm->atmosphere_radius, &t_moon0, &t_moon1);
+            get_optical_depth_math(atm, p, moon_dir, t_moon1, &tau_moon_r, &tau_moon_m);
+
+            for (int k = 0; k < SPECTRUM_BANDS; k++) {
+                T_sun.s[k] = expf(-(tau_sun_r.s[k] + tau_sun_m.s[k]));
+                T_moon.s[k] = expf(-(tau_moon_r.s[k] + tau_moon_m.s[k]));
+            }
+        }
         
         for (int k = 0; k < SPECTRUM_BANDS; k++) {
-            float T_sun = expf(-(tau_sun_r.s[k] + tau_sun_m.s[k]));
-            float T_moon = expf(-(tau_moon_r.s[k] + tau_moon_m.s[k]));
-            
             float current_view_tau = (tau_view_r.s[k] + d_tau_r * 0.5f) * atm->beta_rayleigh.s[k]
                                    + (tau_view_m.s[k] + d_tau_m * 0.5f) * atm->beta_mie.s[k];
             
@@ -132,8 +175,8 @@ static inline HD Spectrum atmosphere_render_radiance(
             float beta_r = rho_r * atm->beta_rayleigh.s[k];
             float beta_m = rho_m * atm->beta_mie.s[k];
             
-            float S_sun = (beta_r * pr_sun + beta_m * pm_sun) * sun_intensity->s[k] * T_sun;
-            float S_moon = (beta_r * pr_moon + beta_m * pm_moon) * moon_intensity->s[k] * T_moon;
+            float S_sun = (beta_r * pr_sun + beta_m * pm_sun) * sun_intensity->s[k] * T_sun.s[k];
+            float S_moon = (beta_r * pr_moon + beta_m * pm_moon) * moon_intensity->s[k] * T_moon.s[k];
             
             result.s[k] += (S_sun + S_moon) * T_view * dt;
             
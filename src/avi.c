@@ -0,0 +1,176 @@
+#include "avi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define AVI_MAX_BYTES (1u << 30)
+#define AVIF_HASINDEX 0x10
+#define AVIIF_KEYFRAME 0x10
+
+typedef struct {
+    uint32_t offset; // From the 'movi' fourcc
+    uint32_t size;
+} AviIndexEntry;
+
+struct AviWriter {
+    FILE* f;
+    int width, height;
+    double fps;
+    long movi_pos;   // Position of the 'movi' list size field
+    AviIndexEntry* index;
+    int num_frames;
+    int capacity;
+    uint32_t max_frame;
+    bool ok;
+};
+
+static void put_u32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static void put_u16(unsigned char* p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void write_bytes(AviWriter* avi, const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, avi->f) != size) avi->ok = false;
+}
+
+static void write_u32(AviWriter* avi, uint32_t v) {
+    unsigned char b[4];
+    put_u32(b, v);
+    write_bytes(avi, b, 4);
+}
+
+static void patch_u32(AviWriter* avi, long pos, uint32_t v) {
+    if (fseek(avi->f, pos, SEEK_SET) != 0) avi->ok = false;
+    write_u32(avi, v);
+}
+
+// Header layout; sizes and counts not known yet are written as 0 and patched
+#define AVI_HDRL_SIZE (4 + 8 + 56 + 12 + 8 + 56 + 8 + 40)
+#define AVI_POS_RIFF_SIZE 4
+#define AVI_POS_TOTAL_FRAMES 48
+#define AVI_POS_SUGGESTED_BUFFER 60
+#define AVI_POS_STREAM_LENGTH 140
+#define AVI_POS_STREAM_BUFFER 144
+
+static void write_headers(AviWriter* avi) {
+    unsigned char h[12 + 8 + AVI_HDRL_SIZE + 12];
+    memset(h, 0, sizeof(h));
+    unsigned char* p = h;
+    memcpy(p, "RIFF", 4); memcpy(p + 8, "AVI ", 4); p += 12;
+    memcpy(p, "LIST", 4); put_u32(p + 4, AVI_HDRL_SIZE); memcpy(p + 8, "hdrl", 4); p += 12;
+
+    // Main header
+    memcpy(p, "avih", 4); put_u32(p + 4, 56); p += 8;
+    put_u32(p, (uint32_t)(1e6 / avi->fps + 0.5)); // Microseconds per frame
+    put_u32(p + 12, AVIF_HASINDEX);
+    put_u32(p + 24, 1);                           // Streams
+    put_u32(p + 32, (uint32_t)avi->width);
+    put_u32(p + 36, (uint32_t)avi->height);
+    p += 56;
+
+    // Video stream
+    memcpy(p, "LIST", 4); put_u32(p + 4, 4 + 8 + 56 + 8 + 40); memcpy(p + 8, "strl", 4); p += 12;
+    memcpy(p, "strh", 4); put_u32(p + 4, 56); p += 8;
+    memcpy(p, "vids", 4); memcpy(p + 4, "MJPG", 4);
+    put_u32(p + 20, 1000);                        // Scale: rate / scale = fps
+    put_u32(p + 24, (uint32_t)(avi->fps * 1000 + 0.5));
+    put_u32(p + 40, 0xffffffffu);                 // Default quality
+    put_u16(p + 52, (uint16_t)avi->width);        // Frame rectangle
+    put_u16(p + 54, (uint16_t)avi->height);
+    p += 56;
+    memcpy(p, "strf", 4); put_u32(p + 4, 40); p += 8;
+    put_u32(p, 40);                               // BITMAPINFOHEADER
+    put_u32(p + 4, (uint32_t)avi->width);
+    put_u32(p + 8, (uint32_t)avi->height);
+    put_u16(p + 12, 1);                           // Planes
+    put_u16(p + 14, 24);                          // Bits per pixel
+    memcpy(p + 16, "MJPG", 4);
+    put_u32(p + 20, (uint32_t)avi->width * avi->height * 3);
+    p += 40;
+
+    memcpy(p, "LIST", 4); memcpy(p + 8, "movi", 4); p += 12;
+    avi->movi_pos = (long)(p - h) - 8;
+    write_bytes(avi, h, (size_t)(p - h));
+}
+
+AviWriter* avi_open(const char* filename, int width, int height, double fps) {
+    if (width <= 0 || height <= 0 || width > 65535 || height > 65535 || !(fps > 0)) return NULL;
+    AviWriter* avi = (AviWriter*)calloc(1, sizeof(AviWriter));
+    if (!avi) return NULL;
+    avi->f = fopen(filename, "wb");
+    if (!avi->f) {
+        free(avi);
+        return NULL;
+    }
+    setvbuf(avi->f, NULL, _IOFBF, 1 << 16);
+    avi->width = width;
+    avi->height = height;
+    avi->fps = fps;
+    avi->ok = true;
+    write_headers(avi);
+    return avi;
+}
+
+bool avi_add_frame(AviWriter* avi, const unsigned char* jpeg, size_t size) {
+    long pos = ftell(avi->f);
+    size_t padded = size + (size & 1);
+    // Room for this chunk and the index that follows it
+    size_t index_bytes = 8 + 16 * (size_t)(avi->num_frames + 1);
+    if (pos < 0 || (size_t)pos + 8 + padded + index_bytes > AVI_MAX_BYTES) {
+        fprintf(stderr, "Error: AVI file would exceed 1 GB\n");
+        return false;
+    }
+    if (avi->num_frames == avi->capacity) {
+        int capacity = avi->capacity ? avi->capacity * 2 : 256;
+        AviIndexEntry* grown = (AviIndexEntry*)realloc(avi->index, sizeof(AviIndexEntry) * capacity);
+        if (!grown) return false;
+        avi->index = grown;
+        avi->capacity = capacity;
+    }
+    avi->index[avi->num_frames].offset = (uint32_t)(pos - (avi->movi_pos + 4));
+    avi->index[avi->num_frames].size = (uint32_t)size;
+    avi->num_frames++;
+    if (size > avi->max_frame) avi->max_frame = (uint32_t)size;
+
+    write_bytes(avi, "00dc", 4);
+    write_u32(avi, (uint32_t)size);
+    write_bytes(avi, jpeg, size);
+    if (size & 1) write_bytes(avi, "", 1);
+    return avi->ok;
+}
+
+bool avi_close(AviWriter* avi) {
+    if (!avi) return false;
+    long movi_end = ftell(avi->f);
+
+    write_bytes(avi, "idx1", 4);
+    write_u32(avi, 16 * (uint32_t)avi->num_frames);
+    for (int i = 0; i < avi->num_frames; i++) {
+        write_bytes(avi, "00dc", 4);
+        write_u32(avi, AVIIF_KEYFRAME);
+        write_u32(avi, avi->index[i].offset);
+        write_u32(avi, avi->index[i].size);
+    }
+    long end = ftell(avi->f);
+
+    patch_u32(avi, AVI_POS_RIFF_SIZE, (uint32_t)(end - 8));
+    patch_u32(avi, AVI_POS_TOTAL_FRAMES, (uint32_t)avi->num_frames);
+    patch_u32(avi, AVI_POS_SUGGESTED_BUFFER, avi->max_frame + 8);
+    patch_u32(avi, AVI_POS_STREAM_LENGTH, (uint32_t)avi->num_frames);
+    patch_u32(avi, AVI_POS_STREAM_BUFFER, avi->max_frame + 8);
+    patch_u32(avi, avi->movi_pos, (uint32_t)(movi_end - avi->movi_pos - 4));
+
+    bool ok = avi->ok && movi_end >= 0 && end >= 0;
+    if (fclose(avi->f) != 0) ok = false;
+    free(avi->index);
+    free(avi);
+    return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef AVI_H
+#define AVI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Motion JPEG in an AVI 1.0 (RIFF) container: every frame is a complete JPEG,
+// so players and editors can seek to any frame. Frames are written as they
+// arrive; the index and frame counts are filled in by avi_close. The RIFF
+// format limits the file to 1 GB.
+typedef struct AviWriter AviWriter;
+
+// Returns NULL if the file cannot be created
+AviWriter* avi_open(const char* filename, int width, int height, double fps);
+bool avi_add_frame(AviWriter* avi, const unsigned char* jpeg, size_t size);
+// Writes the index, patches the headers and frees avi. Returns false if any
+// write failed.
+bool avi_close(AviWriter* avi);
+
+#endif
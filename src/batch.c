@@ -0,0 +1,257 @@
+#include "batch.h"
+#include "render.h"
+#include "output.h"
+#include "ephemerides.h"
+#include <pthread.h>
+
+#define BATCH_MAX_ARGS 128
+
+typedef struct {
+    Config cfg;
+    double jd;
+    int index;              // Position among the jobs in the file
+    int line;               // For messages
+    char filename[1024];
+} BatchJob;
+
+typedef struct {
+    KnightContext* ctx;
+    BatchJob* jobs;
+    int num_jobs;
+
+    // Consecutive runs of jobs handed out to workers as a unit
+    int* chunk_start;       // num_chunks + 1 entries
+    int num_chunks;
+
+    pthread_mutex_t lock;   // Guards next_chunk and finished
+    int next_chunk;
+    int finished;
+} Batch;
+
+static int compare_jobs(const void* a, const void* b) {
+    const BatchJob* x = (const BatchJob*)a;
+    const BatchJob* y = (const BatchJob*)b;
+    if (x->cfg.lat != y->cfg.lat) return x->cfg.lat < y->cfg.lat ? -1 : 1;
+    if (x->cfg.lon != y->cfg.lon) return x->cfg.lon < y->cfg.lon ? -1 : 1;
+    if (x->jd != y->jd) return x->jd < y->jd ? -1 : 1;
+    if (x->cfg.turbidity != y->cfg.turbidity) return x->cfg.turbidity < y->cfg.turbidity ? -1 : 1;
+    return x->index - y->index;
+}
+
+static bool same_str(const char* a, const char* b) {
+    if (!a || !b) return a == b;
+    return strcmp(a, b) == 0;
+}
+
+// Names the first option a job changed that only takes effect when loading, or
+// for the run as a whole
+static const char* scene_option_changed(const Config* base, const Config* job) {
+    if (job->use_tycho != base->use_tycho || !same_str(job->tycho_dir, base->tycho_dir)) return "--tycho/--tycho-dir";
+    if (job->star_mag_limit != base->star_mag_limit) return "--mag-limit";
+    if (job->merge_ybs != base->merge_ybs || job->match_tol_arcsec != base->match_tol_arcsec) return "--merge-ybs/--match-tol";
+    if (!same_str(job->catalog_out_dir, base->catalog_out_dir)) return "--save-catalog";
+    if (!same_str(job->mode, base->mode)) return "--mode";
+    if (!same_str(job->data_dir, base->data_dir)) return "--data-dir";
+    if (!same_str(job->seq_start, base->seq_start) || !same_str(job->seq_end, base->seq_end)) return "--start/--end";
+    if (!same_str(job->exposure_state_path, base->exposure_state_path)) return "--exposure-state";
+    if (!same_str(job->serve_socket, base->serve_socket)) return "--serve";
+    if (!same_str(job->batch_file, base->batch_file)) return "--batch";
+    if (job->workers != base->workers) return "--workers";
+    // Jobs sharing a checkpoint file would truncate it under each other
+    if (!same_str(job->checkpoint_path, base->checkpoint_path) || job->resume != base->resume) return "--checkpoint/--resume";
+    if (job->tile_rows != base->tile_rows) return "--tile-rows";
+    if (job->farm_processes != base->farm_processes || !same_str(job->farm_dir, base->farm_dir) ||
+        job->farm_worker != base->farm_worker || job->farm_frame != base->farm_frame) return "--farm";
+    if (!same_str(job->cache_dir, base->cache_dir) || job->cache_size_mb != base->cache_size_mb ||
+        job->cache_time_minutes != base->cache_time_minutes || job->cache_site_deg != base->cache_site_deg) return "--cache-dir";
+    return NULL;
+}
+
+// Reads the jobs file. Config strings point into *text_out, which the caller frees.
+static int load_jobs(const Config* base, BatchJob** jobs_out, char** text_out) {
+    FILE* f = fopen(base->batch_file, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: Could not open batch file %s\n", base->batch_file);
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char* text = (char*)malloc(size + 1);
+    if (!text || fread(text, 1, size, f) != (size_t)size) {
+        fprintf(stderr, "Error: Could not read batch file %s\n", base->batch_file);
+        free(text);
+        fclose(f);
+        return -1;
+    }
+    text[size] = '\0';
+    fclose(f);
+
+    int capacity = 64, n = 0, line_no = 0;
+    BatchJob* jobs = (BatchJob*)malloc(sizeof(BatchJob) * capacity);
+    char* line = text;
+    while (jobs && line && *line) {
+        char* nl = strchr(line, '\n');
+        if (nl) *nl = '\0';
+        char* next = nl ? nl + 1 : NULL;
+        line_no++;
+
+        char* p = line;
+        while (*p == ' ' || *p == '\t' || *p == '\r') p++;
+        if (*p != '\0' && *p != '#') {
+            if (n == capacity) {
+                capacity *= 2;
+                BatchJob* grown = (BatchJob*)realloc(jobs, sizeof(BatchJob) * capacity);
+                if (!grown) {
+                    free(jobs);
+                    jobs = NULL;
+                    break;
+                }
+                jobs = grown;
+            }
+            char* argv[BATCH_MAX_ARGS];
+            int argc = split_args(p, "knight", argv, BATCH_MAX_ARGS);
+            BatchJob* job = &jobs[n];
+            job->cfg = *base;
+            if (!parse_args(argc, argv, &job->cfg)) {
+                fprintf(stderr, "Error: %s:%d: unknown option, missing value or --help\n", base->batch_file, line_no);
+                free(jobs);
+                free(text);
+                return -1;
+            }
+
+            const char* changed = scene_option_changed(base, &job->cfg);
+            if (changed) {
+                fprintf(stderr, "Error: %s:%d: %s applies to the whole batch and cannot be set per job\n", base->batch_file, line_no, changed);
+                free(jobs);
+                free(text);
+                return -1;
+            }
+            if (job->cfg.width <= 0 || job->cfg.height <= 0 || !config_crop_valid(&job->cfg)) {
+                fprintf(stderr, "Error: %s:%d: invalid image size %dx%d or --crop outside it\n", base->batch_file, line_no, job->cfg.width, job->cfg.height);
+                free(jobs);
+                free(text);
+                return -1;
+            }
+            job->jd = get_julian_day(job->cfg.year, job->cfg.month, job->cfg.day, job->cfg.hour);
+            job->index = n;
+            job->line = line_no;
+            if (job->cfg.output_filename == base->output_filename) {
+                format_frame_filename(job->filename, sizeof(job->filename), base->output_filename, n);
+            } else {
+                snprintf(job->filename, sizeof(job->filename), "%s", job->cfg.output_filename);
+            }
+            n++;
+        }
+        line = next;
+    }
+    if (!jobs) {
+        fprintf(stderr, "Error: Out of memory reading %s\n", base->batch_file);
+        free(text);
+        return -1;
+    }
+    *jobs_out = jobs;
+    *text_out = text;
+    return n;
+}
+
+// Splits the sorted jobs into runs of one site, at most max_len long, so every
+// worker sees consecutive times of a site while the load stays balanced
+static int make_chunks(const BatchJob* jobs, int n, int max_len, int* start) {
+    int count = 0;
+    for (int i = 0; i < n; i++) {
+        bool new_site = i == 0 || jobs[i].cfg.lat != jobs[i - 1].cfg.lat || jobs[i].cfg.lon != jobs[i - 1].cfg.lon;
+        if (new_site || i - start[count - 1] >= max_len) start[count++] = i;
+    }
+    start[count] = n;
+    return count;
+}
+
+static void* batch_worker(void* arg) {
+    Batch* b = (Batch*)arg;
+    ImageRGB* outputs[CONFIG_MAX_EXPOSURES] = {NULL};
+    ImageHDR* hdr = NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&b->lock);
+        int chunk = b->next_chunk < b->num_chunks ? b->next_chunk++ : -1;
+        pthread_mutex_unlock(&b->lock);
+        if (chunk < 0) break;
+
+        for (int i = b->chunk_start[chunk]; i < b->chunk_start[chunk + 1]; i++) {
+            BatchJob* job = &b->jobs[i];
+            int num_exposures = config_num_exposures(&job->cfg);
+            int w, h;
+            config_image_size(&job->cfg, &w, &h);
+            for (int e = 0; e < num_exposures; e++) {
+                if (!outputs[e] || outputs[e]->width != w || outputs[e]->height != h) {
+                    image_rgb_free(outputs[e]);
+                    outputs[e] = image_rgb_create(w, h);
+                }
+            }
+            bool need_hdr = output_needs_hdr(job->filename, &job->cfg);
+            if (need_hdr && (!hdr || hdr->width != w || hdr->height != h)) {
+                image_hdr_free(hdr);
+                hdr = image_hdr_create(w, h);
+            }
+            if (knight_render_exposures(b->ctx, &job->cfg, job->jd, outputs, need_hdr ? hdr : NULL) != 0) {
+                fprintf(stderr, "Error: Out of memory, skipping %s\n", job->filename);
+                continue;
+            }
+
+            if (!output_save_exposures(job->filename, outputs, need_hdr ? hdr : NULL, &job->cfg)) continue;
+
+            pthread_mutex_lock(&b->lock);
+            int finished = ++b->finished;
+            pthread_mutex_unlock(&b->lock);
+            printf("Job %d/%d (line %d) saved to %s\n", finished, b->num_jobs, job->line, job->filename);
+        }
+    }
+
+    for (int e = 0; e < CONFIG_MAX_EXPOSURES; e++) image_rgb_free(outputs[e]);
+    image_hdr_free(hdr);
+    return NULL;
+}
+
+int batch_run(KnightContext* ctx, const Config* base) {
+    Batch b;
+    memset(&b, 0, sizeof(b));
+    char* text = NULL;
+    b.num_jobs = load_jobs(base, &b.jobs, &text);
+    if (b.num_jobs < 0) return 1;
+    b.ctx = ctx;
+
+    qsort(b.jobs, b.num_jobs, sizeof(BatchJob), compare_jobs);
+
+    int num_workers = base->workers > 0 ? base->workers : 1;
+    if (num_workers > b.num_jobs) num_workers = b.num_jobs > 0 ? b.num_jobs : 1;
+    int max_len = b.num_jobs / (num_workers * 4);
+    if (max_len < 1) max_len = 1;
+    b.chunk_start = (int*)malloc(sizeof(int) * (b.num_jobs + 1));
+    if (!b.chunk_start) {
+        free(b.jobs);
+        free(text);
+        return 1;
+    }
+    b.num_chunks = make_chunks(b.jobs, b.num_jobs, max_len, b.chunk_start);
+    printf("Batch: %d jobs in %d groups on %d workers\n", b.num_jobs, b.num_chunks, num_workers);
+
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * num_workers);
+    int started = 0;
+    for (int i = 0; threads && i < num_workers; i++) {
+        if (pthread_create(&threads[i], NULL, batch_worker, &b) != 0) break;
+        started++;
+    }
+    // Without any extra thread the jobs still run here
+    if (started == 0) batch_worker(&b);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+    free(threads);
+    pthread_mutex_destroy(&b.lock);
+
+    int status = b.finished == b.num_jobs ? 0 : 1;
+    free(b.chunk_start);
+    free(b.jobs);
+    free(text);
+    return status;
+}
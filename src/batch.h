@@ -0,0 +1,18 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "config.h"
+#include "knight.h"
+
+// Batch mode. Every non-empty line of base->batch_file that is not a # comment
+// is a set of command line options applied on top of base, describing one
+// image. Jobs are ordered by site and time and rendered by base->workers
+// threads sharing the catalogs and textures of ctx, so frames of the same time
+// and site reuse ephemerides and star transforms. A job without -o is
+// named from base's output file and its line number among the jobs.
+//
+// Options that change what is loaded (--tycho, --mag-limit, --mode, ...) must be
+// given on the command line, not per job. Returns the process exit status.
+int batch_run(KnightContext* ctx, const Config* base);
+
+#endif
@@ -0,0 +1,206 @@
+#include "catalog_merge.h"
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Coincident stars whose magnitudes differ by more than this are kept as distinct
+// entries (a faint companion or field star next to a bright YBS star).
+#define MERGE_MAX_DMAG 2.0f
+
+// Spatial hash over unit vectors. The sphere is cut into cubic cells whose edge equals
+// the match radius (as a chord), so every candidate lies in one of the 27 cells around
+// the query point. Cells are hashed into a power-of-two table stored in CSR form.
+typedef struct {
+    double cell;
+    uint32_t mask;
+    int* bucket_start; // mask + 2 offsets into entries
+    int* entries;      // star indices grouped by bucket
+    double* xyz;       // unit vectors, 3 per hashed star
+} StarHash;
+
+static void radec_to_unit(float ra, float dec, double* v) {
+    double cd = cos(dec);
+    v[0] = cd * cos(ra);
+    v[1] = cd * sin(ra);
+    v[2] = sin(dec);
+}
+
+static inline int64_t cell_coord(double x, double cell) {
+    return (int64_t)floor(x / cell);
+}
+
+static inline uint32_t cell_hash(int64_t ix, int64_t iy, int64_t iz, uint32_t mask) {
+    uint64_t h = (uint64_t)ix * 0x9E3779B97F4A7C15ULL;
+    h ^= (uint64_t)iy * 0xC2B2AE3D27D4EB4FULL;
+    h ^= (uint64_t)iz * 0x165667B19E3779F9ULL;
+    h ^= h >> 29;
+    return (uint32_t)h & mask;
+}
+
+static bool star_hash_build(StarHash* hash, const Star* stars, int n, double cell) {
+    uint32_t size = 1024;
+    while (size < (uint32_t)n * 2) size <<= 1;
+
+    hash->cell = cell;
+    hash->mask = size - 1;
+    hash->bucket_start = (int*)calloc(size + 1, sizeof(int));
+    hash->entries = (int*)malloc(sizeof(int) * (n > 0 ? n : 1));
+    hash->xyz = (double*)malloc(sizeof(double) * 3 * (n > 0 ? n : 1));
+    uint32_t* bucket = (uint32_t*)malloc(sizeof(uint32_t) * (n > 0 ? n : 1));
+    if (!hash->bucket_start || !hash->entries || !hash->xyz || !bucket) {
+        free(bucket);
+        return false;
+    }
+
+    // Counting sort of stars by bucket
+    for (int i = 0; i < n; i++) {
+        double* v = &hash->xyz[3 * i];
+        radec_to_unit(stars[i].ra, stars[i].dec, v);
+        bucket[i] = cell_hash(cell_coord(v[0], cell), cell_coord(v[1], cell), cell_coord(v[2], cell), hash->mask);
+        hash->bucket_start[bucket[i] + 1]++;
+    }
+    for (uint32_t b = 0; b < size; b++) hash->bucket_start[b + 1] += hash->bucket_start[b];
+
+    int* fill = (int*)malloc(sizeof(int) * size);
+    if (!fill) {
+        free(bucket);
+        return false;
+    }
+    memcpy(fill, hash->bucket_start, sizeof(int) * size);
+    for (int i = 0; i < n; i++) hash->entries[fill[bucket[i]]++] = i;
+
+    free(fill);
+    free(bucket);
+    return true;
+}
+
+static void star_hash_free(StarHash* hash) {
+    free(hash->bucket_start);
+    free(hash->entries);
+    free(hash->xyz);
+}
+
+// Returns index of the closest hashed star within sqrt(max_d2) whose magnitude is
+// compatible with vmag, or -1 if there is none.
+static int star_hash_match(const StarHash* hash, const Star* hashed, const double* p, float vmag, double max_d2) {
+    int64_t cx = cell_coord(p[0], hash->cell);
+    int64_t cy = cell_coord(p[1], hash->cell);
+    int64_t cz = cell_coord(p[2], hash->cell);
+
+    int best = -1;
+    double best_d2 = max_d2;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                uint32_t b = cell_hash(cx + dx, cy + dy, cz + dz, hash->mask);
+                for (int k = hash->bucket_start[b]; k < hash->bucket_start[b + 1]; k++) {
+                    int j = hash->entries[k];
+                    const double* q = &hash->xyz[3 * j];
+                    double ex = p[0] - q[0], ey = p[1] - q[1], ez = p[2] - q[2];
+                    double d2 = ex * ex + ey * ey + ez * ez;
+                    if (d2 > best_d2) continue;
+                    if (fabsf(hashed[j].vmag - vmag) > MERGE_MAX_DMAG) continue;
+                    best = j;
+                    best_d2 = d2;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+int merge_star_catalogs(const Star* bright, int n_bright, const Star* faint, int n_faint, float tol_arcsec, Star** merged) {
+    *merged = (Star*)malloc(sizeof(Star) * ((size_t)n_bright + n_faint + 1));
+    if (!*merged) return -1;
+
+    // Chord length corresponding to the angular tolerance
+    double tol_rad = (double)tol_arcsec / 3600.0 * (PI / 180.0);
+    double chord = 2.0 * sin(0.5 * tol_rad);
+    if (chord <= 0.0) chord = 1e-9;
+
+    StarHash hash;
+    memset(&hash, 0, sizeof(hash));
+    if (!star_hash_build(&hash, bright, n_bright, chord)) {
+        star_hash_free(&hash);
+        free(*merged);
+        *merged = NULL;
+        return -1;
+    }
+
+    int count = 0;
+    for (int i = 0; i < n_bright; i++) (*merged)[count++] = bright[i];
+
+    int duplicates = 0;
+    double max_d2 = chord * chord;
+    for (int i = 0; i < n_faint; i++) {
+        double p[3];
+        radec_to_unit(faint[i].ra, faint[i].dec, p);
+        if (n_bright > 0 && star_hash_match(&hash, bright, p, faint[i].vmag, max_d2) >= 0) {
+            duplicates++;
+            continue;
+        }
+        (*merged)[count++] = faint[i];
+    }
+    star_hash_free(&hash);
+
+    for (int i = 0; i < count; i++) (*merged)[i].id = i;
+
+    Star* shrunk = (Star*)realloc(*merged, sizeof(Star) * (count > 0 ? count : 1));
+    if (shrunk) *merged = shrunk;
+
+    printf("Catalog merge: %d bright + %d faint stars, %d duplicates removed (tolerance %.1f arcsec)\n",
+           n_bright, n_faint, duplicates, tol_arcsec);
+    return count;
+}
+
+int write_stars_tycho(const char* dirpath, const Star* stars, int num_stars) {
+    if (mkdir(dirpath, 0777) != 0 && errno != EEXIST) {
+        perror("Error creating catalog directory");
+        return -1;
+    }
+
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s/tyc2.dat.00", dirpath);
+    FILE* f = fopen(filepath, "w");
+    if (!f) {
+        perror("Error writing catalog");
+        return -1;
+    }
+
+    char line[208];
+    char field[32];
+    for (int i = 0; i < num_stars; i++) {
+        const Star* s = &stars[i];
+
+        // Invert the Tycho -> Johnson transform used by load_stars_tycho:
+        //   V = VT - 0.090 (BT - VT),  B-V = 0.850 (BT - VT)
+        float bt_vt = s->bv / 0.850f;
+        float vt = s->vmag + 0.090f * bt_vt;
+        float bt = vt + bt_vt;
+
+        double ra_deg = s->ra * RAD2DEG;
+        if (ra_deg < 0) ra_deg += 360.0;
+
+        memset(line, ' ', 206);
+        line[206] = '\n';
+        line[207] = '\0';
+
+        snprintf(field, sizeof(field), "%04d %05d 1", (i / 100000) % 10000, i % 100000);
+        memcpy(line + 0, field, 12);
+        snprintf(field, sizeof(field), "%12.8f", ra_deg);
+        memcpy(line + 15, field, 12);
+        snprintf(field, sizeof(field), "%12.8f", (double)(s->dec * RAD2DEG));
+        memcpy(line + 28, field, 12);
+        snprintf(field, sizeof(field), "%6.3f", bt);
+        memcpy(line + 110, field, 6);
+        snprintf(field, sizeof(field), "%6.3f", vt);
+        memcpy(line + 123, field, 6);
+
+        fputs(line, f);
+    }
+    fclose(f);
+
+    printf("Wrote %d stars to %s\n", num_stars, filepath);
+    return 0;
+}
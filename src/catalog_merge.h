@@ -0,0 +1,22 @@
+#ifndef CATALOG_MERGE_H
+#define CATALOG_MERGE_H
+
+#include "stars.h"
+
+// Default cross-match radius. Tycho-2 mean positions are at epoch ~J1991 while
+// YBS is J2000, so high proper motion stars drift by tens of arcseconds.
+#define CATALOG_MATCH_TOL_ARCSEC 30.0f
+
+// Merges a bright catalog (YBS) with a faint one (Tycho-2).
+// Every bright star is kept with its own photometry; faint stars that lie within
+// tol_arcsec of a bright star of similar magnitude are treated as duplicates and dropped.
+// Matching uses a spatial hash over unit vectors, so the cost is O(n_bright + n_faint).
+// Returns number of stars in *merged, or -1 on error. Caller frees *merged.
+int merge_star_catalogs(const Star* bright, int n_bright, const Star* faint, int n_faint, float tol_arcsec, Star** merged);
+
+// Writes stars in the Tycho-2 fixed-width layout as <dirpath>/tyc2.dat.00 so that
+// load_stars_tycho() can read the catalog back.
+// Returns 0 on success, -1 on error.
+int write_stars_tycho(const char* dirpath, const Star* stars, int num_stars);
+
+#endif
@@ -0,0 +1,140 @@
+#include "checkpoint.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC "KNIGHTCP"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_HEADER_SIZE 64
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    int32_t width, height;
+    uint32_t reserved;
+    uint64_t key;
+} CheckpointHeader;
+
+struct Checkpoint {
+    unsigned char* map;
+    size_t size;
+    int width, height;
+    unsigned char* done;    // One byte per row
+    XYZV* pixels;
+};
+
+// FNV-1a, fed field by field so struct padding and pointers stay out
+static void hash_bytes(uint64_t* h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) {
+        *h ^= p[i];
+        *h *= 1099511628211ULL;
+    }
+}
+
+static void hash_string(uint64_t* h, const char* s) {
+    hash_bytes(h, s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+#define HASH_FIELD(h, field) hash_bytes(h, &(field), sizeof(field))
+
+uint64_t checkpoint_key(const Config* cfg, double jd) {
+    uint64_t h = 14695981039346656037ULL;
+    HASH_FIELD(&h, jd);
+    HASH_FIELD(&h, cfg->width);
+    HASH_FIELD(&h, cfg->height);
+    HASH_FIELD(&h, cfg->env_map);
+    HASH_FIELD(&h, cfg->lat);
+    HASH_FIELD(&h, cfg->lon);
+    HASH_FIELD(&h, cfg->cam_alt);
+    HASH_FIELD(&h, cfg->cam_az);
+    HASH_FIELD(&h, cfg->fov);
+    HASH_FIELD(&h, cfg->custom_cam);
+    hash_string(&h, cfg->track_body);
+    HASH_FIELD(&h, cfg->turbidity);
+    HASH_FIELD(&h, cfg->sky_keyframe_error);
+    HASH_FIELD(&h, cfg->render_moon);
+    hash_string(&h, cfg->data_dir); // Moon texture
+    return h;
+}
+
+static size_t data_offset(int height) {
+    return CHECKPOINT_HEADER_SIZE + (((size_t)height + 63) & ~(size_t)63);
+}
+
+// True if fd holds a checkpoint of this frame
+static bool header_matches(int fd, size_t size, uint64_t key, int width, int height) {
+    struct stat st;
+    CheckpointHeader header;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != size) return false;
+    if (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) return false;
+    return memcmp(header.magic, CHECKPOINT_MAGIC, 8) == 0 && header.version == CHECKPOINT_VERSION &&
+           header.width == width && header.height == height && header.key == key;
+}
+
+Checkpoint* checkpoint_open(const char* path, uint64_t key, int width, int height, bool resume) {
+    size_t size = data_offset(height) + sizeof(XYZV) * (size_t)width * height;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not open checkpoint %s\n", path);
+        return NULL;
+    }
+    bool keep = resume && header_matches(fd, size, key, width, height);
+    struct stat st;
+    if (resume && !keep && fstat(fd, &st) == 0 && st.st_size > 0) {
+        printf("Checkpoint %s is of another render; starting over\n", path);
+    }
+    if (!keep) {
+        // Truncating first drops old rows; the rest of the file is sparse
+        CheckpointHeader header = {{0}, CHECKPOINT_VERSION, width, height, 0, key};
+        memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+        if (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0 ||
+            pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+            fprintf(stderr, "Error: Could not write checkpoint %s\n", path);
+            close(fd);
+            return NULL;
+        }
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "Error: Could not map checkpoint %s\n", path);
+        return NULL;
+    }
+    Checkpoint* cp = (Checkpoint*)calloc(1, sizeof(Checkpoint));
+    if (!cp) {
+        munmap(map, size);
+        return NULL;
+    }
+    cp->map = (unsigned char*)map;
+    cp->size = size;
+    cp->width = width;
+    cp->height = height;
+    cp->done = cp->map + CHECKPOINT_HEADER_SIZE;
+    cp->pixels = (XYZV*)(cp->map + data_offset(height));
+    return cp;
+}
+
+void checkpoint_close(Checkpoint* cp) {
+    if (!cp) return;
+    munmap(cp->map, cp->size);
+    free(cp);
+}
+
+int checkpoint_rows_done(const Checkpoint* cp) {
+    int n = 0;
+    for (int y = 0; y < cp->height; y++) n += cp->done[y] != 0;
+    return n;
+}
+
+const XYZV* checkpoint_row(const Checkpoint* cp, int y) {
+    return cp->done[y] ? cp->pixels + (size_t)y * cp->width : NULL;
+}
+
+void checkpoint_store_row(Checkpoint* cp, int y, const XYZV* pixels) {
+    memcpy(cp->pixels + (size_t)y * cp->width, pixels, sizeof(XYZV) * cp->width);
+    // The row reaches the mapping before its mark, so a killed process never
+    // leaves a row marked done without its pixels
+    __atomic_store_n(&cp->done[y], 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,40 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include "config.h"
+
+// Checkpoint of a long render (--checkpoint <file>, --resume).
+//
+// The CPU sky pass, which is most of the time of a large frame, copies every
+// row it finishes into a file mapped into memory and then marks the row done.
+// Rows are written once each at fixed offsets, so storing one costs a memcpy
+// into the page cache; the kernel writes it back in the background. A killed
+// render resumed from the file skips the rows marked done. Stars, planets,
+// optics and tone mapping are redone on top, as they take a small part of the
+// time.
+//
+// The file is a 64 byte header (magic, version, size and a key hashing the
+// options that change the sky pass), one byte per row, then the rows of XYZV
+// pixels. A file whose header does not match the render is started over.
+typedef struct Checkpoint Checkpoint;
+
+// Hash of the options and time that change the sky pass of a frame. Options
+// of the output, stars and optics are left out, so a resumed render may change
+// them.
+uint64_t checkpoint_key(const Config* cfg, double jd);
+
+// Opens path for a width x height frame. With resume, rows of a matching file
+// are kept; otherwise the file is created empty. Returns NULL on error.
+Checkpoint* checkpoint_open(const char* path, uint64_t key, int width, int height, bool resume);
+// Unmaps the file; it stays on disk
+void checkpoint_close(Checkpoint* cp);
+
+int checkpoint_rows_done(const Checkpoint* cp);
+// The saved pixels of row y, or NULL if it has not been finished
+const XYZV* checkpoint_row(const Checkpoint* cp, int y);
+// Saves row y (width pixels) and marks it done. Rows may be stored from
+// several threads at once.
+void checkpoint_store_row(Checkpoint* cp, int y, const XYZV* pixels);
+
+#endif
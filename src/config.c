@@ -3,6 +3,11 @@
 #include <stdlib.h>
 #include <getopt.h>
 #include <string.h>
+#include <time.h>
+#include "tonemap.h"
+#include "catalog_merge.h"
+#include "png.h"
+#include "jpeg.h"
 
 void print_help(const char* progname) {
     printf("Usage: %s [options]\n", progname);
@@ -16,10 +21,30 @@ void print_help(const char* progname) {
     printf("  -f, --fov <deg>      Field of view (default: 60.0)\n");
     printf("  -w, --width <px>     Image width (default: 640)\n");
     printf("  -h, --height <px>    Image height (default: 480)\n");
-    printf("  -o, --output <file>  Output filename (default: output.pfm)\n");
-    printf("  -c, --convert        Convert PFM to PNG using ImageMagick\n");
+    printf("  -o, --output <file>  Output filename (default: output.pfm; - for stdout)\n");
+    printf("      --format <fmt>   Output format instead of the -o extension: pfm, png, jpg, avi, y4m,\n");
+    printf("                       ppm, hdr or xyzv. With -o - frames stream to stdout, e.g. into ffmpeg\n");
+    printf("      --tile-rows <n>  Render in full-width strips of n rows, writing each as it finishes, so\n");
+    printf("                       memory stays bounded for huge images (.png, .ppm or .pfm only)\n");
+    printf("      --crop <x,y,w,h> Render only this window of the -w x -h frame, exposed as the whole\n");
+    printf("                       frame would be; the image is w x h\n");
+    printf("      --checkpoint <file> Save finished rows of the sky pass to <file> as it renders\n");
+    printf("      --resume         Keep the rows of a matching --checkpoint and render only the rest\n");
+    printf("      --cache-dir <dir> Keep finished single frames in <dir> and save repeats from there\n");
+    printf("                       without rendering\n");
+    printf("      --cache-size <MB> Most the cache may hold; least recently used frames go first (default: 1024)\n");
+    printf("      --cache-time <dur> Round the time to this for the cache, e.g. 30s, 1m (default: exact)\n");
+    printf("      --cache-site <deg> Round latitude and longitude to this for the cache (default: exact)\n");
+    printf("  -c, --convert        Also write a PNG next to the PFM (an -o ending in .png writes only the PNG)\n");
+    printf("      --png-depth <8|16> Bits per channel of PNG output (default: 8)\n");
+    printf("      --png-level <0-9> PNG compression; 0 is the fastest (default: 6)\n");
+    printf("      --jpeg-quality <1-100> Quality of .jpg and .avi output (default: 90)\n");
+    printf("      --fps <rate>     Frame rate of .avi and .y4m output (default: 24)\n");
     printf("  -T, --track <body|planet> Track celestial body (sun, moon, mercury, venus, mars, jupiter, saturn)\n");
-    printf("  -e, --exposure <val> Exposure boost in f-stops (default: 0.0)\n");
+    printf("  -e, --exposure <val[,val...]> Exposure boost in f-stops (default: 0.0); several values\n");
+    printf("                       write one image per exposure from a single render, named _ev<val>\n");
+    printf("      --exposure-state <file> Adapt exposure over a sequence, keeping state in <file>\n");
+    printf("      --adapt-tau <up,down> Adaptation time constants in simulated seconds (default: 60,300)\n");
     printf("  -E, --env            Generate cylindrical environment map\n");
     printf("  -n, --no-moon        Disable moon rendering\n");
     printf("  -O, --outline        Render constellation outlines\n");
@@ -27,16 +52,42 @@ void print_help(const char* progname) {
     printf("  -j, --label-bodies   Label planets, sun, and moon\n");
     printf("      --label-color <hex> Color for labels (default: FF0000)\n");
     printf("  -u, --turbidity <val> Atmospheric turbidity (Mie scattering multiplier, default: 1.0)\n");
+    printf("      --sky-keyframes <percent> Interpolate the sky between tables built at keyframes of the\n");
+    printf("                       Sun and Moon height, with at most this error (CPU; for sequences)\n");
     printf("  -A, --aperture <mm>  Observer aperture diameter in mm (default: 6.0)\n");
     printf("  -B, --bloom          Enable bloom/glare effect\n");
     printf("  -s, --bloom-size <deg> Bloom/glare size in degrees (default: 0.02)\n");
+    printf("      --glare          Diffraction glare from the pupil, eyelashes and lens (uses --aperture)\n");
     printf("      --tycho          Use Tycho-2 star catalog instead of YBSC5\n");
     printf("      --tycho-dir <path> Path to Tycho-2 data directory (default: ./tycho)\n");
+    printf("      --merge-ybs      Use Tycho-2 for faint stars and YBSC5 for bright ones (implies --tycho)\n");
+    printf("      --match-tol <arcsec> Cross-match radius for --merge-ybs (default: 30)\n");
+    printf("      --save-catalog <dir> Write the loaded star catalog as <dir>/tyc2.dat.00\n");
+    printf("      --start <date[Thh:mm[:ss]]> Render a sequence of frames starting at this UTC time\n");
+    printf("      --end <date[Thh:mm[:ss]]> Time of the last frame of the sequence\n");
+    printf("      --step <dur>     Time between frames, e.g. 5, 30s, 5m, 1h (default: 5 minutes)\n");
+    printf("                       Sequence frames are named from -o: a %%04d in it is replaced by\n");
+    printf("                       the frame number, otherwise _NNNN is added before the extension\n");
+    printf("      --serve <socket> Keep the scene loaded and render requests from a Unix socket\n");
+    printf("      --batch <file>   Render one image per line of <file>, each line holding options\n");
+    printf("      --workers <n>    Server requests or batch jobs rendered concurrently (default: 2)\n");
+    printf("      --farm <n>       Split a --start sequence by frame, or one image into bands of rows\n");
+    printf("                       (--tile-rows, default: 2 per process), across n knight processes\n");
+    printf("      --farm-dir <dir> Directory for the processes' tiles and logs (default: a new temp dir)\n");
+    printf("      --data-dir <path> Directory with ybsc5.dat, bound_in_20.txt and moon_albedo.jpg (default: data)\n");
     printf("  -m, --mag-limit <mag> Visual magnitude limit for stars (default: 6.0)\n");
     printf("      --mode <cpu|gpu> Rendering mode (default: cpu)\n");
     printf("      --help           Show this help\n");
 }
 
+// Long options without a short letter, past the range of characters
+#define OPT_RESUME 256
+#define OPT_CACHE_DIR 257
+#define OPT_CACHE_SIZE 258
+#define OPT_CACHE_TIME 259
+#define OPT_CACHE_SITE 260
+#define OPT_SKY_KEYFRAMES 261
+
 static struct option long_options[] = {
     {"lat",     required_argument, 0, 'l'},
     {"lon",     required_argument, 0, 'L'},
@@ -48,9 +99,24 @@ static struct option long_options[] = {
     {"width",   required_argument, 0, 'w'},
     {"height",  required_argument, 0, 'h'},
     {"output",  required_argument, 0, 'o'},
+    {"format",  required_argument, 0, 'V'},
+    {"tile-rows", required_argument, 0, 'X'},
+    {"crop",    required_argument, 0, 'Z'},
     {"convert", no_argument,       0, 'c'},
+    {"png-depth", required_argument, 0, 'p'},
+    {"png-level", required_argument, 0, 'q'},
+    {"jpeg-quality", required_argument, 0, 'J'},
+    {"fps",     required_argument, 0, 'U'},
     {"track",   required_argument, 0, 'T'},
     {"exposure",required_argument, 0, 'e'},
+    {"exposure-state", required_argument, 0, 'x'},
+    {"adapt-tau", required_argument, 0, 'Q'},
+    {"checkpoint", required_argument, 0, 'v'},
+    {"resume",  no_argument,       0, OPT_RESUME},
+    {"cache-dir", required_argument, 0, OPT_CACHE_DIR},
+    {"cache-size", required_argument, 0, OPT_CACHE_SIZE},
+    {"cache-time", required_argument, 0, OPT_CACHE_TIME},
+    {"cache-site", required_argument, 0, OPT_CACHE_SITE},
     {"env",     no_argument,       0, 'E'},
     {"no-moon", no_argument,       0, 'n'},
     {"outline", no_argument,       0, 'O'},
@@ -58,21 +124,133 @@ static struct option long_options[] = {
     {"label-bodies", no_argument,       0, 'j'},
     {"label-color", required_argument, 0, 'K'},
     {"turbidity", required_argument, 0, 'u'},
+    {"sky-keyframes", required_argument, 0, OPT_SKY_KEYFRAMES},
     {"aperture", required_argument, 0, 'A'},
     {"bloom",   no_argument,       0, 'B'},
     {"bloom-size", required_argument, 0, 's'},
+    {"glare",   no_argument,       0, 'P'},
     {"mode",    required_argument, 0, 'M'},
     {"tycho",   no_argument,       0, 'Y'},
     {"tycho-dir", required_argument, 0, 'D'},
     {"mag-limit", required_argument, 0, 'm'},
+    {"merge-ybs", no_argument,     0, 'G'},
+    {"match-tol", required_argument, 0, 'g'},
+    {"save-catalog", required_argument, 0, 'S'},
+    {"start",   required_argument, 0, 'b'},
+    {"end",     required_argument, 0, 'N'},
+    {"step",    required_argument, 0, 'k'},
+    {"serve",   required_argument, 0, 'R'},
+    {"workers", required_argument, 0, 'W'},
+    {"batch",   required_argument, 0, 'I'},
+    {"farm",    required_argument, 0, 'H'},
+    {"farm-dir", required_argument, 0, 'y'},
+    {"farm-worker", no_argument,   0, 'i'},
+    {"farm-frame", required_argument, 0, 'r'},
+    {"data-dir", required_argument, 0, 'F'},
     {"help",    no_argument,       0, '?'},
     {0, 0, 0, 0}
 };
 
-void parse_args(int argc, char** argv, Config* cfg) {
+void config_set_current_time(Config* cfg) {
+    time_t now = time(NULL);
+    struct tm t;
+    gmtime_r(&now, &t);
+    cfg->year = t.tm_year + 1900;
+    cfg->month = t.tm_mon + 1;
+    cfg->day = t.tm_mday;
+    cfg->hour = t.tm_hour + t.tm_min / 60.0 + t.tm_sec / 3600.0;
+}
+
+void config_set_defaults(Config* cfg) {
+    cfg->render_moon = true;
+    cfg->render_outlines = false;
+    cfg->convert_to_png = false;
+    cfg->png_bits = 8;
+    cfg->png_level = PNG_DEFAULT_LEVEL;
+    cfg->jpeg_quality = JPEG_DEFAULT_QUALITY;
+    cfg->fps = 24.0;
+    cfg->track_body = NULL;
+    cfg->aperture = 6.0f;
+    cfg->use_tycho = false;
+    cfg->tycho_dir = "tycho";
+    cfg->star_mag_limit = 6.0f;
+    cfg->merge_ybs = false;
+    cfg->match_tol_arcsec = CATALOG_MATCH_TOL_ARCSEC;
+    cfg->catalog_out_dir = NULL;
+    cfg->seq_start = NULL;
+    cfg->seq_end = NULL;
+    cfg->seq_step_minutes = 5.0;
+    cfg->serve_socket = NULL;
+    cfg->workers = 2;
+    cfg->batch_file = NULL;
+    cfg->farm_processes = 0;
+    cfg->farm_dir = NULL;
+    cfg->farm_worker = false;
+    cfg->farm_frame = -1;
+    cfg->data_dir = "data";
+
+    // Default to current UTC time
+    config_set_current_time(cfg);
+
+    cfg->lat = 45.0;
+    cfg->lon = 0.0;
+    cfg->cam_alt = 10.0f;
+    cfg->cam_az = 270.0f;
+    cfg->fov = 60.0f;
+    cfg->width = 640;
+    cfg->height = 480;
+    cfg->exposure_boost = 0.0f;
+    cfg->num_bracket = 0;
+    cfg->exposure_state_path = NULL;
+    cfg->adapt_tau_brighten = EXPOSURE_TAU_BRIGHTEN;
+    cfg->adapt_tau_darken = EXPOSURE_TAU_DARKEN;
+    cfg->output_filename = "output.pfm";
+    cfg->output_format = NULL;
+    cfg->tile_rows = 0;
+    cfg->crop_x = cfg->crop_y = 0;
+    cfg->crop_width = cfg->crop_height = 0;
+    cfg->checkpoint_path = NULL;
+    cfg->resume = false;
+    cfg->cache_dir = NULL;
+    cfg->cache_size_mb = 1024.0;
+    cfg->cache_time_minutes = 0.0;
+    cfg->cache_site_deg = 0.0;
+    cfg->custom_cam = false;
+    cfg->env_map = false;
+    cfg->turbidity = 1.0f;
+    cfg->sky_keyframe_error = 0.0f;
+    cfg->mode = "cpu";
+    cfg->bloom = false;
+    cfg->bloom_size = 0.02f;
+    cfg->glare = false;
+    cfg->outline_color = (RGB){0.0f, 1.0f, 0.0f};
+    cfg->label_bodies = false;
+    cfg->label_color = (RGB){1.0f, 0.0f, 0.0f};
+}
+
+int config_num_exposures(const Config* cfg) {
+    return 1 + cfg->num_bracket;
+}
+
+float config_exposure(const Config* cfg, int i) {
+    return i == 0 ? cfg->exposure_boost : cfg->exposure_bracket[i - 1];
+}
+
+void config_image_size(const Config* cfg, int* width, int* height) {
+    *width = cfg->crop_width > 0 ? cfg->crop_width : cfg->width;
+    *height = cfg->crop_width > 0 ? cfg->crop_height : cfg->height;
+}
+
+bool config_crop_valid(const Config* cfg) {
+    if (cfg->crop_width <= 0) return true;
+    return cfg->crop_x >= 0 && cfg->crop_y >= 0 && cfg->crop_height > 0 &&
+           cfg->crop_x + cfg->crop_width <= cfg->width && cfg->crop_y + cfg->crop_height <= cfg->height;
+}
+
+bool parse_args(int argc, char** argv, Config* cfg) {
     int opt;
     optind = 1;
-    while ((opt = getopt_long(argc, argv, "l:L:d:t:a:z:f:w:h:o:cT:e:EnOu:A:Bs:C:jK:M:YD:m:", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "l:L:d:t:a:z:f:w:h:o:cT:e:EnOu:A:Bs:C:jK:M:YD:m:Gg:S:Px:Q:b:N:k:R:W:I:F:p:q:J:U:V:X:Z:H:y:ir:v:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'l': cfg->lat = atof(optarg); break;
             case 'L': cfg->lon = atof(optarg); break;
@@ -93,9 +271,91 @@ void parse_args(int argc, char** argv, Config* cfg) {
             case 'w': cfg->width = atoi(optarg); break;
             case 'h': cfg->height = atoi(optarg); break;
             case 'o': cfg->output_filename = optarg; break;
+            case 'V': cfg->output_format = optarg; break;
+            case 'X': {
+                int rows = atoi(optarg);
+                if (rows >= 0) cfg->tile_rows = rows;
+                else fprintf(stderr, "Warning: Ignoring --tile-rows '%s'\n", optarg);
+                break;
+            }
+            case 'Z': {
+                int x, y, w, h;
+                if (sscanf(optarg, "%d,%d,%d,%d", &x, &y, &w, &h) == 4 && x >= 0 && y >= 0 && w > 0 && h > 0) {
+                    cfg->crop_x = x;
+                    cfg->crop_y = y;
+                    cfg->crop_width = w;
+                    cfg->crop_height = h;
+                } else {
+                    fprintf(stderr, "Warning: Ignoring --crop '%s' (use x,y,w,h)\n", optarg);
+                }
+                break;
+            }
             case 'c': cfg->convert_to_png = true; break;
+            case 'p': {
+                int bits = atoi(optarg);
+                if (bits == 8 || bits == 16) cfg->png_bits = bits;
+                else fprintf(stderr, "Warning: Ignoring --png-depth '%s' (use 8 or 16)\n", optarg);
+                break;
+            }
+            case 'q': {
+                int level = atoi(optarg);
+                if (level >= 0 && level <= 9) cfg->png_level = level;
+                else fprintf(stderr, "Warning: Ignoring --png-level '%s' (use 0-9)\n", optarg);
+                break;
+            }
+            case 'J': {
+                int quality = atoi(optarg);
+                if (quality >= 1 && quality <= 100) cfg->jpeg_quality = quality;
+                else fprintf(stderr, "Warning: Ignoring --jpeg-quality '%s' (use 1-100)\n", optarg);
+                break;
+            }
+            case 'U': {
+                double fps = atof(optarg);
+                if (fps > 0) cfg->fps = fps;
+                else fprintf(stderr, "Warning: Ignoring invalid --fps '%s'\n", optarg);
+                break;
+            }
             case 'T': cfg->track_body = optarg; cfg->custom_cam = true; break;
-            case 'e': cfg->exposure_boost = atof(optarg); break;
+            case 'e': {
+                // A comma separated list brackets several exposures from one render
+                char* end;
+                cfg->exposure_boost = strtof(optarg, &end);
+                cfg->num_bracket = 0;
+                while (*end == ',' && cfg->num_bracket < CONFIG_MAX_EXPOSURES - 1) {
+                    cfg->exposure_bracket[cfg->num_bracket++] = strtof(end + 1, &end);
+                }
+                if (*end != '\0') fprintf(stderr, "Warning: --exposure takes at most %d values; ignoring '%s'\n", CONFIG_MAX_EXPOSURES, end);
+                break;
+            }
+            case 'x': cfg->exposure_state_path = optarg; break;
+            case 'Q': sscanf(optarg, "%f,%f", &cfg->adapt_tau_brighten, &cfg->adapt_tau_darken); break;
+            case 'v': cfg->checkpoint_path = optarg; break;
+            case OPT_RESUME: cfg->resume = true; break;
+            case OPT_CACHE_DIR: cfg->cache_dir = optarg; break;
+            case OPT_CACHE_SIZE: {
+                double mb = atof(optarg);
+                if (mb > 0) cfg->cache_size_mb = mb;
+                else fprintf(stderr, "Warning: Ignoring invalid --cache-size '%s'\n", optarg);
+                break;
+            }
+            case OPT_CACHE_TIME: {
+                double minutes = parse_duration_minutes(optarg);
+                if (minutes >= 0) cfg->cache_time_minutes = minutes;
+                else fprintf(stderr, "Warning: Ignoring invalid --cache-time '%s'\n", optarg);
+                break;
+            }
+            case OPT_CACHE_SITE: {
+                double deg = atof(optarg);
+                if (deg >= 0) cfg->cache_site_deg = deg;
+                else fprintf(stderr, "Warning: Ignoring invalid --cache-site '%s'\n", optarg);
+                break;
+            }
+            case OPT_SKY_KEYFRAMES: {
+                float percent = atof(optarg);
+                if (percent >= 0) cfg->sky_keyframe_error = percent;
+                else fprintf(stderr, "Warning: Ignoring invalid --sky-keyframes '%s'\n", optarg);
+                break;
+            }
             case 'E': cfg->env_map = true; break;
             case 'n': cfg->render_moon = false; break;
             case 'O': cfg->render_outlines = true; break;
@@ -122,12 +382,267 @@ void parse_args(int argc, char** argv, Config* cfg) {
             case 'A': cfg->aperture = atof(optarg); break;
             case 'B': cfg->bloom = true; break;
             case 's': cfg->bloom_size = atof(optarg); break;
+            case 'P': cfg->glare = true; break;
             case 'M': cfg->mode = optarg; break;
             case 'Y': cfg->use_tycho = true; break;
             case 'D': cfg->tycho_dir = optarg; break;
             case 'm': cfg->star_mag_limit = atof(optarg); break;
-            case '?': print_help(argv[0]); exit(0);
+            case 'G': cfg->merge_ybs = true; cfg->use_tycho = true; break;
+            case 'g': cfg->match_tol_arcsec = atof(optarg); break;
+            case 'S': cfg->catalog_out_dir = optarg; break;
+            case 'b': cfg->seq_start = optarg; break;
+            case 'N': cfg->seq_end = optarg; break;
+            case 'k': {
+                double minutes = parse_duration_minutes(optarg);
+                if (minutes > 0) cfg->seq_step_minutes = minutes;
+                else fprintf(stderr, "Warning: Ignoring invalid --step '%s'\n", optarg);
+                break;
+            }
+            case 'R': cfg->serve_socket = optarg; break;
+            case 'W': cfg->workers = atoi(optarg); break;
+            case 'I': cfg->batch_file = optarg; break;
+            case 'H': cfg->farm_processes = atoi(optarg); break;
+            case 'y': cfg->farm_dir = optarg; break;
+            case 'i': cfg->farm_worker = true; break;
+            case 'r': cfg->farm_frame = atoi(optarg); break;
+            case 'F': cfg->data_dir = optarg; break;
+            case '?': return false;
             default: break;
         }
     }
+    return true;
+}
+
+int split_args(char* line, char* progname, char** argv, int max_args) {
+    int argc = 0;
+    argv[argc++] = progname;
+    char* save = NULL;
+    char* token = strtok_r(line, " \t\r\n", &save);
+    while (token && argc < max_args) {
+        argv[argc++] = token;
+        token = strtok_r(NULL, " \t\r\n", &save);
+    }
+    return argc;
+}
+
+bool parse_datetime(const char* s, int* year, int* month, int* day, double* hour) {
+    int y, mo, d, n = 0;
+    if (sscanf(s, "%d-%d-%d%n", &y, &mo, &d, &n) != 3) return false;
+    if (mo < 1 || mo > 12 || d < 1 || d > 31) return false;
+    double h = 0;
+    const char* rest = s + n;
+    if (*rest == 'T' || *rest == ' ') {
+        int hh = 0, mm = 0;
+        float ss = 0;
+        int k = sscanf(rest + 1, "%d:%d:%f", &hh, &mm, &ss);
+        if (k < 2) return false;
+        h = hh + mm / 60.0 + ss / 3600.0;
+    } else if (*rest != '\0') {
+        return false;
+    }
+    *year = y;
+    *month = mo;
+    *day = d;
+    *hour = h;
+    return true;
+}
+
+double parse_duration_minutes(const char* s) {
+    char* end;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    if (*end == '\0' || strcmp(end, "m") == 0) return v;
+    if (strcmp(end, "s") == 0) return v / 60.0;
+    if (strcmp(end, "h") == 0) return v * 60.0;
+    if (strcmp(end, "d") == 0) return v * 1440.0;
+    return -1;
+}
+
+#define REQUEST_MAX_KEYS 64
+
+// Options that pick the data the server loads at startup, or only make sense for
+// a one-shot run
+static const char* const startup_only_options[] = {
+    "output", "tile-rows", "convert", "jpeg-quality", "fps", "exposure-state", "adapt-tau", "checkpoint", "resume", "mode",
+    "cache-dir", "cache-size", "cache-time", "cache-site",
+    "tycho", "tycho-dir", "mag-limit", "merge-ybs", "match-tol", "save-catalog",
+    "start", "end", "step", "serve", "workers", "batch", "farm", "farm-dir", "farm-worker", "farm-frame", "data-dir", "help", NULL
+};
+
+static const struct option* find_long_option(const char* name) {
+    for (const struct option* o = long_options; o->name; o++) {
+        if (strcmp(o->name, name) == 0) return o;
+    }
+    return NULL;
+}
+
+static char* skip_space(char* s) {
+    while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+    return s;
+}
+
+static void trim_end(char* s) {
+    size_t n = strlen(s);
+    while (n > 0 && (s[n - 1] == ' ' || s[n - 1] == '\t' || s[n - 1] == '\r')) s[--n] = '\0';
+}
+
+// Reads a JSON string starting after the opening quote, unescaping in place.
+// Returns the position after the closing quote, or NULL if malformed.
+static char* json_string(char* s, char** out) {
+    char* w = s;
+    *out = s;
+    while (*s && *s != '"') {
+        if (*s == '\\') {
+            s++;
+            switch (*s) {
+                case '"': case '\\': case '/': *w++ = *s; break;
+                case 'n': *w++ = '\n'; break;
+                case 't': *w++ = '\t'; break;
+                default: return NULL;
+            }
+            s++;
+        } else {
+            *w++ = *s++;
+        }
+    }
+    if (*s != '"') return NULL;
+    *w = '\0';
+    return s + 1;
+}
+
+// Splits a flat JSON object into key/value pairs in place. A NULL value stands
+// for JSON null.
+static bool parse_json_pairs(char* s, char** keys, char** vals, int* n, char* err, size_t err_size) {
+    s = skip_space(s + 1); // past '{'
+    *n = 0;
+    if (*s == '}') return true;
+    for (;;) {
+        if (*s != '"' || *n >= REQUEST_MAX_KEYS) break;
+        char* key;
+        if (!(s = json_string(s + 1, &key))) break;
+        s = skip_space(s);
+        if (*s != ':') break;
+        s = skip_space(s + 1);
+        char* val;
+        if (*s == '"') {
+            if (!(s = json_string(s + 1, &val))) break;
+        } else {
+            val = s;
+            while (*s && *s != ',' && *s != '}' && *s != ' ' && *s != '\t' && *s != '\r' && *s != '\n') s++;
+            if (s == val) break;
+        }
+        // Terminating the value may overwrite the delimiter, so look at it first
+        char* next = skip_space(s);
+        char delim = *next;
+        *s = '\0';
+        if (strcmp(val, "null") == 0) val = NULL;
+        keys[*n] = key;
+        vals[*n] = val;
+        (*n)++;
+        if (delim == '}') return true;
+        if (delim != ',') break;
+        s = skip_space(next + 1);
+    }
+    snprintf(err, err_size, "malformed JSON request (expected a flat object of at most %d keys)", REQUEST_MAX_KEYS);
+    return false;
+}
+
+// "key=value" or bare "key" lines; blank lines and # comments are skipped
+static bool parse_line_pairs(char* s, char** keys, char** vals, int* n, char* err, size_t err_size) {
+    *n = 0;
+    while (*s) {
+        char* line = s;
+        char* nl = strchr(s, '\n');
+        if (nl) {
+            *nl = '\0';
+            s = nl + 1;
+        } else {
+            s += strlen(s);
+        }
+        line = skip_space(line);
+        trim_end(line);
+        if (*line == '\0' || *line == '#') continue;
+        if (*n >= REQUEST_MAX_KEYS) {
+            snprintf(err, err_size, "too many keys (at most %d)", REQUEST_MAX_KEYS);
+            return false;
+        }
+        if (line[0] == '-' && line[1] == '-') line += 2;
+        char* eq = strchr(line, '=');
+        char* val = NULL;
+        if (eq) {
+            *eq = '\0';
+            val = skip_space(eq + 1);
+            trim_end(line);
+        }
+        keys[*n] = line;
+        vals[*n] = val;
+        (*n)++;
+    }
+    return true;
+}
+
+bool config_apply_request(const char* request, Config* cfg, char** storage, char* err, size_t err_size) {
+    size_t len = strlen(request);
+    // The request copy followed by the "--key" strings handed to getopt
+    char* block = (char*)malloc(2 * len + 1 + 3 * REQUEST_MAX_KEYS);
+    if (!block) {
+        snprintf(err, err_size, "out of memory");
+        return false;
+    }
+    char* text = block;
+    memcpy(text, request, len + 1);
+    char* names = text + len + 1;
+    *storage = block;
+
+    char* keys[REQUEST_MAX_KEYS];
+    char* vals[REQUEST_MAX_KEYS];
+    int n = 0;
+    char* s = skip_space(text);
+    bool ok = *s == '{' ? parse_json_pairs(s, keys, vals, &n, err, err_size)
+                        : parse_line_pairs(s, keys, vals, &n, err, err_size);
+    if (!ok) goto fail;
+
+    char* argv[2 * REQUEST_MAX_KEYS + 2];
+    int argc = 0;
+    argv[argc++] = "knight";
+    for (int i = 0; i < n; i++) {
+        const struct option* o = find_long_option(keys[i]);
+        if (!o) {
+            snprintf(err, err_size, "unknown option '%s'", keys[i]);
+            goto fail;
+        }
+        for (int k = 0; startup_only_options[k]; k++) {
+            if (strcmp(keys[i], startup_only_options[k]) == 0) {
+                snprintf(err, err_size, "'%s' is fixed when the server starts", keys[i]);
+                goto fail;
+            }
+        }
+        const char* v = vals[i];
+        if (o->has_arg == no_argument) {
+            // Flags can only be switched on; false leaves the server's setting
+            if (v && (strcmp(v, "false") == 0 || strcmp(v, "0") == 0)) continue;
+            if (v && *v && strcmp(v, "true") != 0 && strcmp(v, "1") != 0) {
+                snprintf(err, err_size, "'%s' is a flag and takes true or false", keys[i]);
+                goto fail;
+            }
+        } else if (!v || !*v) {
+            snprintf(err, err_size, "'%s' needs a value", keys[i]);
+            goto fail;
+        }
+        int written = sprintf(names, "--%s", keys[i]);
+        argv[argc++] = names;
+        names += written + 1;
+        if (o->has_arg != no_argument) argv[argc++] = vals[i];
+    }
+    argv[argc] = NULL;
+    if (!parse_args(argc, argv, cfg)) {
+        snprintf(err, err_size, "invalid options");
+        goto fail;
+    }
+    return true;
+
+fail:
+    free(block);
+    *storage = NULL;
+    return false;
 }
@@ -4,34 +4,108 @@
 #include <stdbool.h>
 #include "core.h"
 
+// Exposures one render can be tone mapped to (-e a,b,c)
+#define CONFIG_MAX_EXPOSURES 8
+
 typedef struct {
     bool render_moon;
     bool render_outlines;
-    bool convert_to_png;
+    bool convert_to_png;       // Also write a PNG next to a PFM output
+    int png_bits;              // 8 or 16 bits per channel
+    int png_level;             // Deflate level; 0 = fast built-in encoder
+    int jpeg_quality;          // 1-100, for .jpg and .avi output
+    double fps;                // Frame rate of .avi and .y4m output
     char* track_body;
     int year, month, day;
     double hour;
     double lat, lon;
     float cam_alt, cam_az, fov;
     int width, height;
-    float exposure_boost;
-    char* output_filename;
+    float exposure_boost;      // First (or only) exposure, in stops
+    float exposure_bracket[CONFIG_MAX_EXPOSURES - 1]; // Further exposures of -e a,b,c
+    int num_bracket;
+    char* exposure_state_path; // Carries adapted exposure between runs
+    float adapt_tau_brighten;  // Adaptation time constants, simulated seconds
+    float adapt_tau_darken;
+    char* output_filename;     // "-" writes to stdout
+    char* output_format;       // Overrides the -o extension (pfm, png, y4m, ...)
+    int tile_rows;             // >0: render in strips of this many rows (bounded memory)
+    int crop_x, crop_y;        // --crop: window of the frame to render, top left corner
+    int crop_width, crop_height; // 0 = the whole frame
+    char* checkpoint_path;   // Finished rows of the sky pass are kept here (--checkpoint)
+    bool resume;             // Keep the rows of a matching checkpoint
+    char* cache_dir;         // Finished frames are kept here and reused (--cache-dir)
+    double cache_size_mb;    // Most the cache may hold before the least recently used go
+    double cache_time_minutes; // Times are rounded to this for the cache (0 = exact)
+    double cache_site_deg;   // Latitude and longitude likewise
     bool custom_cam;
     bool env_map;
     float turbidity;
+    float sky_keyframe_error; // --sky-keyframes: percent a sequence's sky may be interpolated off by (0 = off)
     char* mode;
     float aperture; // in mm
     bool bloom;
     float bloom_size; // in degrees
+    bool glare;       // Pupil diffraction glare (uses aperture)
     RGB outline_color;
     bool label_bodies;
     RGB label_color;
     bool use_tycho;
     char* tycho_dir;
     float star_mag_limit;
+    bool merge_ybs;          // Cross-match YBS into the Tycho-2 catalog
+    float match_tol_arcsec;  // Cross-match radius for merge_ybs
+    char* catalog_out_dir;   // If set, write the loaded catalog in Tycho-2 format here
+    char* seq_start;         // Sequence mode: first frame time (see parse_datetime)
+    char* seq_end;           // Last frame time
+    double seq_step_minutes; // Time between frames
+    char* serve_socket;      // Server mode: Unix domain socket path
+    int workers;             // Server requests or batch jobs rendered concurrently
+    char* batch_file;        // Batch mode: one option set per line
+    int farm_processes;      // >0: split the render across this many knight processes
+    char* farm_dir;          // Where farm workers leave tiles and logs (default: a temp dir)
+    bool farm_worker;        // Worker writing a band or frame for the farm coordinator
+    int farm_frame;          // Worker: the one sequence frame to render (-1 = all)
+    char* data_dir;          // Star catalog, outlines and Moon texture (default: data)
 } Config;
 
+// Fills every field with the command line defaults, dated now
+void config_set_defaults(Config* cfg);
+// Sets the date and time fields to the current UTC time
+void config_set_current_time(Config* cfg);
+
+// Number of exposures per frame, and the boost in stops of exposure i
+int config_num_exposures(const Config* cfg);
+float config_exposure(const Config* cfg, int i);
+
+// Size of the rendered image: the --crop window, or else the whole frame
+void config_image_size(const Config* cfg, int* width, int* height);
+// True unless a --crop window reaches outside the frame
+bool config_crop_valid(const Config* cfg);
+
 void print_help(const char* progname);
-void parse_args(int argc, char** argv, Config* cfg);
+// Applies argv's options to cfg. Returns false at an unknown option, one
+// missing its value, or --help; the options before it are applied.
+bool parse_args(int argc, char** argv, Config* cfg);
+
+// Splits line in place at spaces and tabs into argv[1..], with argv[0] set to
+// progname, for parse_args. Fills at most max_args entries; returns argc.
+int split_args(char* line, char* progname, char** argv, int max_args);
+
+// Applies a server render request on top of cfg. The request is either
+// "key=value" lines or a flat JSON object; keys are long option names and flags
+// take true/false, e.g. {"lat": 51.5, "date": "2026-03-01", "bloom": true}.
+// Options that select the data loaded at startup are rejected. On success
+// *storage holds the strings cfg now points into; free it once cfg is no longer
+// used. Not thread safe (uses getopt).
+bool config_apply_request(const char* request, Config* cfg, char** storage, char* err, size_t err_size);
+
+// Parses "YYYY-MM-DD", "YYYY-MM-DDTHH:MM[:SS]" or the same with a space instead
+// of 'T' (UTC). Returns false if malformed.
+bool parse_datetime(const char* s, int* year, int* month, int* day, double* hour);
+
+// Parses a duration in minutes. Plain numbers are minutes; an s, m, h or d
+// suffix selects the unit. Returns -1 if malformed.
+double parse_duration_minutes(const char* s);
 
 #endif
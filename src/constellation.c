@@ -6,18 +6,31 @@
 #include <string.h>
 #include <math.h>
 
-static void draw_line_rgb(ImageRGB* img, int x0, int y0, int x1, int y1, float r, float g, float b) {
+DrawTarget draw_target_image(ImageRGB* img) {
+    return (DrawTarget){img, 0, 0, img->width, img->height};
+}
+
+// Sets frame pixel (x, y) if it falls inside the target's window
+static void plot(const DrawTarget* t, int x, int y, float r, float g, float b) {
+    x -= t->x0;
+    y -= t->y0;
+    if (x >= 0 && x < t->img->width && y >= 0 && y < t->img->height) {
+        RGB* p = &t->img->pixels[y * t->img->width + x];
+        p->r = r;
+        p->g = g;
+        p->b = b;
+    }
+}
+
+static void label_centered(const DrawTarget* t, int x, int y, const char* label, float r, float g, float b);
+
+static void draw_line_rgb(const DrawTarget* t, int x0, int y0, int x1, int y1, float r, float g, float b) {
     int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
     int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
     int err = dx + dy, e2;
 
     while (1) {
-        if (x0 >= 0 && x0 < img->width && y0 >= 0 && y0 < img->height) {
-            int idx = y0 * img->width + x0;
-            img->pixels[idx].r = r;
-            img->pixels[idx].g = g;
-            img->pixels[idx].b = b;
-        }
+        plot(t, x0, y0, r, g, b);
         if (x0 == x1 && y0 == y1) break;
         e2 = 2 * err;
         if (e2 >= dy) { err += dy; x0 += sx; }
@@ -32,6 +45,7 @@ int load_constellation_boundaries(const char* filepath, ConstellationBoundary* b
     int capacity = 1024;
     boundary->vertices = (ConstellationVertex*)malloc(sizeof(ConstellationVertex) * capacity);
     boundary->count = 0;
+    boundary->directions = NULL;
     boundary->label_count = 0;
 
     char line[128];
@@ -113,11 +127,14 @@ void constellation_equ_to_horizon(double jd, double lat, double lon, Constellati
         double az = acos(cos_az);
         if (sin(ha) > 0) az = 2.0 * PI - az;
         
-        v->az = (float)az;
-        v->alt = (float)alt;
-        v->direction.x = (float)(cos(alt) * sin(az));
-        v->direction.y = (float)sin(alt);
-        v->direction.z = (float)(cos(alt) * cos(az));
+        Vec3* d = boundary->directions ? &boundary->directions[i] : &v->direction;
+        if (!boundary->directions) {
+            v->az = (float)az;
+            v->alt = (float)alt;
+        }
+        d->x = (float)(cos(alt) * sin(az));
+        d->y = (float)sin(alt);
+        d->z = (float)(cos(alt) * cos(az));
     }
 
     // Transform label centroids
@@ -143,6 +160,34 @@ void constellation_equ_to_horizon(double jd, double lat, double lon, Constellati
     }
 }
 
+static void direction_to_alt_az(Vec3 d, float* alt, float* az) {
+    // atan2 stays well conditioned near the zenith, where asin(y) does not
+    *alt = atan2f(d.y, sqrtf(d.x * d.x + d.z * d.z));
+    *az = atan2f(d.x, d.z);
+    if (*az < 0) *az += TWO_PI;
+}
+
+void constellation_horizon_advance(SkyRotation* rot, double jd, double lat, double lon, ConstellationBoundary* boundary) {
+    double R[9];
+    if (sky_rotation_current(rot, jd, lat, lon, boundary->vertices, boundary->count)) return;
+    if (!sky_rotation_step(rot, jd, lat, lon, boundary->vertices, boundary->count, R)) {
+        constellation_equ_to_horizon(jd, lat, lon, boundary);
+        return;
+    }
+    if (boundary->count > 0 && boundary->directions) {
+        rotate_directions(boundary->directions, sizeof(Vec3), boundary->count, R);
+    } else if (boundary->count > 0) {
+        rotate_directions(&boundary->vertices[0].direction, sizeof(ConstellationVertex), boundary->count, R);
+    }
+    if (boundary->label_count > 0) rotate_directions(&boundary->labels[0].direction, sizeof(ConstellationLabel), boundary->label_count, R);
+
+    // Labels are culled by altitude; keep alt/az in step with the directions
+    for (int i = 0; i < boundary->label_count; i++) {
+        ConstellationLabel* l = &boundary->labels[i];
+        direction_to_alt_az(l->direction, &l->alt, &l->az);
+    }
+}
+
 bool project_vertex(Vec3 v_dir, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, int width, int height, float* px, float* py) {
     float dz = vec3_dot(v_dir, cam_fwd);
     if (dz <= 0) return false;
@@ -162,28 +207,28 @@ void project_vertex_env(Vec3 v_dir, int width, int height, float* px, float* py)
     *py = (90.0f - alt) / 180.0f * height;
 }
 
-static void draw_line_env_wrapped(ImageRGB* img, float x0, float y0, float x1, float y1, RGB color) {
-    int w = img->width;
+static void draw_line_env_wrapped(const DrawTarget* target, float x0, float y0, float x1, float y1, RGB color) {
+    int w = target->frame_width;
     if (fabsf(x1 - x0) > w * 0.5f) {
         if (x1 > x0) {
             float x1_virtual = x1 - w;
             float t = (0.0f - x0) / (x1_virtual - x0);
             float y_edge = y0 + t * (y1 - y0);
-            draw_line_rgb(img, (int)roundf(x0), (int)roundf(y0), 0, (int)roundf(y_edge), color.r, color.g, color.b);
-            draw_line_rgb(img, w - 1, (int)roundf(y_edge), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
+            draw_line_rgb(target, (int)roundf(x0), (int)roundf(y0), 0, (int)roundf(y_edge), color.r, color.g, color.b);
+            draw_line_rgb(target, w - 1, (int)roundf(y_edge), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
         } else {
             float x1_virtual = x1 + w;
             float t = ((float)w - x0) / (x1_virtual - x0);
             float y_edge = y0 + t * (y1 - y0);
-            draw_line_rgb(img, (int)roundf(x0), (int)roundf(y0), w - 1, (int)roundf(y_edge), color.r, color.g, color.b);
-            draw_line_rgb(img, 0, (int)roundf(y_edge), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
+            draw_line_rgb(target, (int)roundf(x0), (int)roundf(y0), w - 1, (int)roundf(y_edge), color.r, color.g, color.b);
+            draw_line_rgb(target, 0, (int)roundf(y_edge), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
         }
     } else {
-        draw_line_rgb(img, (int)roundf(x0), (int)roundf(y0), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
+        draw_line_rgb(target, (int)roundf(x0), (int)roundf(y0), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
     }
 }
 
-static void subdivide_and_draw_env(ImageRGB* img, Vec3 p0, Vec3 p1, float max_cos, RGB color) {
+static void subdivide_and_draw_env(const DrawTarget* t, Vec3 p0, Vec3 p1, float max_cos, RGB color) {
     float cos_theta = vec3_dot(p0, p1);
     if (cos_theta < max_cos) {
         Vec3 mid = vec3_add(p0, p1);
@@ -194,43 +239,49 @@ static void subdivide_and_draw_env(ImageRGB* img, Vec3 p0, Vec3 p1, float max_co
             mid = vec3_cross(p0, perp);
         }
         mid = vec3_normalize(mid);
-        subdivide_and_draw_env(img, p0, mid, max_cos, color);
-        subdivide_and_draw_env(img, mid, p1, max_cos, color);
+        subdivide_and_draw_env(t, p0, mid, max_cos, color);
+        subdivide_and_draw_env(t, mid, p1, max_cos, color);
     } else {
         float x0, y0, x1, y1;
-        project_vertex_env(p0, img->width, img->height, &x0, &y0);
-        project_vertex_env(p1, img->width, img->height, &x1, &y1);
-        draw_line_env_wrapped(img, x0, y0, x1, y1, color);
+        project_vertex_env(p0, t->frame_width, t->frame_height, &x0, &y0);
+        project_vertex_env(p1, t->frame_width, t->frame_height, &x1, &y1);
+        draw_line_env_wrapped(t, x0, y0, x1, y1, color);
     }
 }
 
-void draw_line_subdivided(ImageRGB* img, Vec3 p0, Vec3 p1, bool env_map, 
-                          Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, 
-                          float tan_half_fov, float aspect, RGB color) {
+static void line_subdivided(const DrawTarget* t, Vec3 p0, Vec3 p1, bool env_map, Vec3 cam_fwd, Vec3 cam_up,
+                            Vec3 cam_right, float tan_half_fov, float aspect, RGB color) {
     if (env_map) {
         // cos(2 degrees) = 0.99939
-        subdivide_and_draw_env(img, p0, p1, 0.99939f, color);
+        subdivide_and_draw_env(t, p0, p1, 0.99939f, color);
     } else {
         float x0, y0, x1, y1;
-        if (project_vertex(p0, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, img->width, img->height, &x0, &y0) &&
-            project_vertex(p1, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, img->width, img->height, &x1, &y1)) {
-            draw_line_rgb(img, (int)roundf(x0), (int)roundf(y0), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
+        if (project_vertex(p0, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, t->frame_width, t->frame_height, &x0, &y0) &&
+            project_vertex(p1, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, t->frame_width, t->frame_height, &x1, &y1)) {
+            draw_line_rgb(t, (int)roundf(x0), (int)roundf(y0), (int)roundf(x1), (int)roundf(y1), color.r, color.g, color.b);
         }
     }
 }
 
-void draw_constellation_outlines(ImageRGB* img, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color) {
+void draw_line_subdivided(ImageRGB* img, Vec3 p0, Vec3 p1, bool env_map, 
+                          Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, 
+                          float tan_half_fov, float aspect, RGB color) {
+    DrawTarget t = draw_target_image(img);
+    line_subdivided(&t, p0, p1, env_map, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, color);
+}
+
+void draw_constellation_outlines(const DrawTarget* target, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color) {
     for (int i = 0; i < boundary->count - 1; i++) {
         ConstellationVertex* v0 = &boundary->vertices[i];
         ConstellationVertex* v1 = &boundary->vertices[i + 1];
 
         if (strcmp(v0->abbr, v1->abbr) != 0) continue;
         
-        // Skip if both are below horizon
-        if (v0->direction.y < 0 && v1->direction.y < 0) continue;
+        Vec3 p0 = boundary->directions ? boundary->directions[i] : v0->direction;
+        Vec3 p1 = boundary->directions ? boundary->directions[i + 1] : v1->direction;
 
-        Vec3 p0 = v0->direction;
-        Vec3 p1 = v1->direction;
+        // Skip if both are below horizon
+        if (p0.y < 0 && p1.y < 0) continue;
 
         // Clip to horizon (y=0)
         if (p0.y < 0 || p1.y < 0) {
@@ -241,11 +292,11 @@ void draw_constellation_outlines(ImageRGB* img, ConstellationBoundary* boundary,
             else p1 = intersect;
         }
 
-        draw_line_subdivided(img, p0, p1, env_map, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, color);
+        line_subdivided(target, p0, p1, env_map, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, color);
     }
 }
 
-void draw_constellation_labels(ImageRGB* img, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color) {
+void draw_constellation_labels(const DrawTarget* t, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color) {
     for (int i = 0; i < boundary->label_count; i++) {
         ConstellationLabel* l = &boundary->labels[i];
         if (l->alt < 0) continue;
@@ -253,21 +304,21 @@ void draw_constellation_labels(ImageRGB* img, ConstellationBoundary* boundary, V
         float px, py;
         bool visible = false;
         if (env_map) {
-            project_vertex_env(l->direction, img->width, img->height, &px, &py);
+            project_vertex_env(l->direction, t->frame_width, t->frame_height, &px, &py);
             visible = true;
         } else {
-            visible = project_vertex(l->direction, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, img->width, img->height, &px, &py);
+            visible = project_vertex(l->direction, cam_fwd, cam_up, cam_right, tan_half_fov, aspect, t->frame_width, t->frame_height, &px, &py);
         }
 
         if (visible) {
-            if (py >= 0 && py < img->height) {
-                draw_label_centered(img, (int)roundf(px), (int)roundf(py), l->abbr, color.r, color.g, color.b);
+            if (py >= 0 && py < t->frame_height) {
+                label_centered(t, (int)roundf(px), (int)roundf(py), l->abbr, color.r, color.g, color.b);
             }
         }
     }
 }
 
-void draw_char(ImageRGB* img, int x, int y, char c, float r, float g, float b) {
+static void plot_char(const DrawTarget* t, int x, int y, char c, float r, float g, float b) {
     if (c < 32 || c >= 127) return;
     const uint8_t* glyph = font8x8_basic[(int)c];
     if (!glyph) return;
@@ -279,37 +330,42 @@ void draw_char(ImageRGB* img, int x, int y, char c, float r, float g, float b) {
                 int py = y + row;
                 
                 // Horizontal wrap
-                px = (px % img->width + img->width) % img->width;
+                px = (px % t->frame_width + t->frame_width) % t->frame_width;
                 
-                if (py >= 0 && py < img->height) {
-                    int idx = py * img->width + px;
-                    img->pixels[idx].r = r;
-                    img->pixels[idx].g = g;
-                    img->pixels[idx].b = b;
-                }
+                if (py >= 0 && py < t->frame_height) plot(t, px, py, r, g, b);
             }
         }
     }
 }
 
-void draw_label_centered(ImageRGB* img, int x, int y, const char* label, float r, float g, float b) {
+void draw_char(ImageRGB* img, int x, int y, char c, float r, float g, float b) {
+    DrawTarget t = draw_target_image(img);
+    plot_char(&t, x, y, c, r, g, b);
+}
+
+static void label_centered(const DrawTarget* t, int x, int y, const char* label, float r, float g, float b) {
     int len = (int)strlen(label);
     int total_width = len * 8;
     int start_x = x - total_width / 2;
     int start_y = y - 4;
 
     for (int i = 0; i < len; i++) {
-        draw_char(img, start_x + i * 8, start_y, label[i], r, g, b);
+        plot_char(t, start_x + i * 8, start_y, label[i], r, g, b);
     }
 }
 
-void draw_label_offset(ImageRGB* img, int x, int y, int offset_x, const char* label, RGB color) {
+void draw_label_centered(ImageRGB* img, int x, int y, const char* label, float r, float g, float b) {
+    DrawTarget t = draw_target_image(img);
+    label_centered(&t, x, y, label, r, g, b);
+}
+
+void draw_label_offset(const DrawTarget* t, int x, int y, int offset_x, const char* label, RGB color) {
     int len = (int)strlen(label);
     int start_x = x + offset_x;
     int start_y = y - 4; // Vertically center 8x8 font
 
     for (int i = 0; i < len; i++) {
-        draw_char(img, start_x + i * 8, start_y, label[i], color.r, color.g, color.b);
+        plot_char(t, start_x + i * 8, start_y, label[i], color.r, color.g, color.b);
     }
 }
 
@@ -318,5 +374,7 @@ void free_constellation_boundaries(ConstellationBoundary* boundary) {
         free(boundary->vertices);
         boundary->vertices = NULL;
     }
+    free(boundary->directions);
+    boundary->directions = NULL;
     boundary->count = 0;
 }
\ No newline at end of file
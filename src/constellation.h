@@ -6,6 +6,7 @@
 #include "core.h"
 #include "image.h"
 #include "tonemap.h"
+#include "ephemerides.h"
 
 // Vertex on a constellation boundary polygon
 typedef struct {
@@ -35,6 +36,9 @@ typedef struct {
 typedef struct {
     ConstellationVertex* vertices;
     int count;
+    // If not NULL, the horizon direction of each vertex, kept here instead of
+    // in the vertices so renders can share one read-only vertex array
+    Vec3* directions;
 
     ConstellationLabel labels[88];
     int label_count;
@@ -45,8 +49,27 @@ typedef struct {
 int load_constellation_boundaries(const char* filepath, ConstellationBoundary* boundary);
 
 // Transforms constellation vertex coordinates from Equatorial (RA/Dec) to Horizon (Alt/Az) and Cartesian direction.
+// With boundary->directions set, only the directions are written for the vertices.
 void constellation_equ_to_horizon(double jd, double lat, double lon, ConstellationBoundary* boundary);
 
+// constellation_equ_to_horizon for sequences: rotates the previous frame's
+// directions about the celestial pole when possible (see SkyRotation). The
+// incremental path keeps the labels' alt and az in step, but only the
+// vertices' direction; their alt and az are refreshed when re-anchored.
+void constellation_horizon_advance(SkyRotation* rot, double jd, double lat, double lon, ConstellationBoundary* boundary);
+
+// Where overlays are drawn: img holds a window of a frame_width x
+// frame_height frame, with its top left pixel at frame pixel (x0, y0).
+// Positions are projected into the frame; only pixels inside img are written.
+typedef struct {
+    ImageRGB* img;
+    int x0, y0;
+    int frame_width, frame_height;
+} DrawTarget;
+
+// All of img as the frame
+DrawTarget draw_target_image(ImageRGB* img);
+
 // Project a single vertex to screen coordinates. Returns true if in front of camera.
 bool project_vertex(Vec3 v_dir, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, int width, int height, float* px, float* py);
 
@@ -59,10 +82,10 @@ void draw_line_subdivided(ImageRGB* img, Vec3 p0, Vec3 p1, bool env_map,
                           float tan_half_fov, float aspect, RGB color);
 
 // Draw constellation outlines to the final image buffer (post-tonemapping)
-void draw_constellation_outlines(ImageRGB* img, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color);
+void draw_constellation_outlines(const DrawTarget* target, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color);
 
 // Draw constellation labels at their centroids
-void draw_constellation_labels(ImageRGB* img, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color);
+void draw_constellation_labels(const DrawTarget* t, ConstellationBoundary* boundary, Vec3 cam_fwd, Vec3 cam_up, Vec3 cam_right, float tan_half_fov, float aspect, bool env_map, RGB color);
 
 // Draw a single 8x8 character
 void draw_char(ImageRGB* img, int x, int y, char c, float r, float g, float b);
@@ -71,9 +94,9 @@ void draw_char(ImageRGB* img, int x, int y, char c, float r, float g, float b);
 void draw_label_centered(ImageRGB* img, int x, int y, const char* label, float r, float g, float b);
 
 // Draw a label with an X offset, vertically centered
-void draw_label_offset(ImageRGB* img, int x, int y, int offset_x, const char* label, RGB color);
+void draw_label_offset(const DrawTarget* t, int x, int y, int offset_x, const char* label, RGB color);
 
-// Free constellation boundaries
+// Free constellation boundaries, with their directions if any
 void free_constellation_boundaries(ConstellationBoundary* boundary);
 
 #endif
\ No newline at end of file
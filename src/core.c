@@ -116,7 +116,11 @@ float integrate_gaussian_2d(float x0, float y0, float x1, float y1, float sigma)
 void write_pfm(const char* filename, int width, int height, const RGB* data) {
     FILE* f = fopen(filename, "wb");
     if (!f) return;
-    
+    write_pfm_stream(f, width, height, data);
+    fclose(f);
+}
+
+bool write_pfm_stream(FILE* f, int width, int height, const RGB* data) {
     // PFM Header
     // PF = RGB color, pf = grayscale
     // width height
@@ -128,13 +132,9 @@ void write_pfm(const char* filename, int width, int height, const RGB* data) {
     // the scanlines being written from bottom to top."
     // Let's write bottom-to-top.
     
+    // RGB is three packed floats, so each scanline goes out in one write
     for (int y = height - 1; y >= 0; y--) {
-        for (int x = 0; x < width; x++) {
-            RGB p = data[y * width + x];
-            float scanline[3] = {p.r, p.g, p.b};
-            fwrite(scanline, sizeof(float), 3, f);
-        }
+        if (fwrite(data + (size_t)y * width, sizeof(RGB), width, f) != (size_t)width) return false;
     }
-    
-    fclose(f);
+    return true;
 }
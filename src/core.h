@@ -92,6 +92,8 @@ void blackbody_spectrum(float tempK, Spectrum* out);
 // Writes a portable float map. Width, height, and RGB data (3 floats per pixel).
 // Note: PFM is usually RGB. We might want to write our tone-mapped RGB to it.
 void write_pfm(const char* filename, int width, int height, const RGB* data);
+// Same, to an open stream. Returns false on a write error.
+bool write_pfm_stream(FILE* f, int width, int height, const RGB* data);
 
 // Color conversion
 XYZV spectrum_to_xyzv(const Spectrum* s);
@@ -29,7 +29,8 @@ bool cuda_render_frame(
     XYZV* out_pixels // buffer on host to copy results to
 );
 
-bool cuda_upload_stars(const Star* stars, int num_stars);
+// dirs, if not NULL, replaces the stars' own directions (see render_stars_window)
+bool cuda_upload_stars(const Star* stars, const Vec3* dirs, int num_stars);
 
 bool cuda_render_stars(
     int width, int height,
@@ -11,6 +11,23 @@ double get_julian_day(int year, int month, int day, double hour) {
     return (int)(365.25 * (year + 4716)) + (int)(30.6001 * (month + 1)) + day + B - 1524.5 + hour / 24.0;
 }
 
+void julian_day_to_calendar(double jd, int* year, int* month, int* day, double* hour) {
+    // Meeus, Astronomical Algorithms, ch. 7
+    jd += 0.5;
+    double Z = floor(jd);
+    double F = jd - Z;
+    double alpha = floor((Z - 1867216.25) / 36524.25);
+    double A = Z + 1 + alpha - floor(alpha / 4);
+    double B = A + 1524;
+    double C = floor((B - 122.1) / 365.25);
+    double D = floor(365.25 * C);
+    double E = floor((B - D) / 30.6001);
+    *day = (int)(B - D - floor(30.6001 * E));
+    *month = (int)(E < 14 ? E - 1 : E - 13);
+    *year = (int)(*month > 2 ? C - 4716 : C - 4715);
+    *hour = F * 24.0;
+}
+
 double greenwich_mean_sidereal_time(double jd) {
     double T = (jd - 2451545.0) / 36525.0;
     double gmst = 280.46061837 + 360.98564736629 * (jd - 2451545.0) + T*T * (0.000387933 - T / 38710000.0);
@@ -167,6 +184,85 @@ void star_equ_to_horizon(double jd, double lat, double lon, Star* catalog, int n
     }
 }
 
+bool sky_rotation_step(SkyRotation* rot, double jd, double lat, double lon, const void* data, int count, double R[9]) {
+    double lmst = local_mean_sidereal_time(greenwich_mean_sidereal_time(jd), lon);
+    if (!rot->valid || rot->lat != lat || rot->lon != lon || rot->data != data || rot->count != count ||
+        rot->frames_since_anchor >= SKY_REANCHOR_FRAMES) {
+        rot->valid = true;
+        rot->lat = lat;
+        rot->lon = lon;
+        rot->data = data;
+        rot->count = count;
+        rot->lmst = lmst;
+        rot->frames_since_anchor = 0;
+        return false;
+    }
+
+    // Hour angles grow with sidereal time: a right-handed rotation by the LMST
+    // change about the pole axis (0, sin lat, cos lat) in the X=East, Y=Up,
+    // Z=North horizon frame.
+    double theta = lmst - rot->lmst;
+    double phi = lat * DEG2RAD;
+    double px = 0.0, py = sin(phi), pz = cos(phi);
+    double c = cos(theta), s = sin(theta), t = 1.0 - c;
+    R[0] = c + t * px * px;      R[1] = t * px * py - s * pz; R[2] = t * px * pz + s * py;
+    R[3] = t * py * px + s * pz; R[4] = c + t * py * py;      R[5] = t * py * pz - s * px;
+    R[6] = t * pz * px - s * py; R[7] = t * pz * py + s * px; R[8] = c + t * pz * pz;
+
+    rot->lmst = lmst;
+    rot->frames_since_anchor++;
+    return true;
+}
+
+bool sky_rotation_current(const SkyRotation* rot, double jd, double lat, double lon, const void* data, int count) {
+    if (!rot->valid || rot->lat != lat || rot->lon != lon || rot->data != data || rot->count != count) return false;
+    return local_mean_sidereal_time(greenwich_mean_sidereal_time(jd), lon) == rot->lmst;
+}
+
+void rotate_directions(Vec3* first, size_t stride, int n, const double R[9]) {
+    // Computed in double so each frame adds only the final rounding to float
+    char* base = (char*)first;
+    for (int i = 0; i < n; i++) {
+        Vec3* v = (Vec3*)(base + (size_t)i * stride);
+        double x = v->x, y = v->y, z = v->z;
+        v->x = (float)(R[0] * x + R[1] * y + R[2] * z);
+        v->y = (float)(R[3] * x + R[4] * y + R[5] * z);
+        v->z = (float)(R[6] * x + R[7] * y + R[8] * z);
+    }
+}
+
+void star_horizon_advance(SkyRotation* rot, double jd, double lat, double lon, Star* catalog, int n) {
+    double R[9];
+    if (n <= 0 || sky_rotation_current(rot, jd, lat, lon, catalog, n)) return;
+    if (sky_rotation_step(rot, jd, lat, lon, catalog, n, R)) {
+        rotate_directions(&catalog[0].direction, sizeof(Star), n, R);
+    } else {
+        star_equ_to_horizon(jd, lat, lon, catalog, n);
+    }
+}
+
+static void star_equ_to_directions(double jd, double lat, double lon, const Star* catalog, Vec3* dirs, int n) {
+    double lmst = local_mean_sidereal_time(greenwich_mean_sidereal_time(jd), lon);
+    for (int i = 0; i < n; i++) {
+        float alt, az;
+        equatorial_to_horizon(catalog[i].ra, catalog[i].dec, lmst, lat, &alt, &az);
+        dirs[i].x = cosf(alt) * sinf(az);
+        dirs[i].y = sinf(alt);
+        dirs[i].z = cosf(alt) * cosf(az);
+    }
+}
+
+void star_directions_advance(SkyRotation* rot, double jd, double lat, double lon, const Star* catalog, Vec3* dirs,
+                             int n) {
+    double R[9];
+    if (n <= 0 || sky_rotation_current(rot, jd, lat, lon, catalog, n)) return;
+    if (sky_rotation_step(rot, jd, lat, lon, catalog, n, R)) {
+        rotate_directions(dirs, sizeof(Vec3), n, R);
+    } else {
+        star_equ_to_directions(jd, lat, lon, catalog, dirs, n);
+    }
+}
+
 // Simplified Orbital Elements (J2000)
 // a: semi-major axis (AU), e: eccentricity, i: inclination (deg), 
 // L: mean longitude (deg), w: longitude of perihelion (deg), N: longitude of ascending node (deg)
@@ -7,6 +7,9 @@
 // Computes Julian Day from date
 double get_julian_day(int year, int month, int day, double hour);
 
+// Inverse of get_julian_day (Gregorian calendar, UTC hour of day)
+void julian_day_to_calendar(double jd, int* year, int* month, int* day, double* hour);
+
 // Computes Sun and Moon direction (normalized) in local horizon coordinates (North=Z?, usually Y=Up, Z=North, X=East in standard LH, or similar)
 // We will assume a coordinate system: Y is Up, Z is North, X is East (Right Handed).
 // lat, lon in degrees.
@@ -16,6 +19,44 @@ void sun_moon_position(double jd, double lat, double lon, Vec3* sun_dir, Vec3* m
 // Updates the az, alt, and direction fields of the stars.
 void star_equ_to_horizon(double jd, double lat, double lon, Star* catalog, int n);
 
+// At a fixed site the whole celestial sphere just turns about the celestial pole
+// by the change in local sidereal time. SkyRotation tracks that angle so catalog
+// directions can be advanced between frames with one rotation instead of a full
+// RA/Dec transform per object. Every SKY_REANCHOR_FRAMES frames the catalog is
+// transformed from scratch, which bounds the accumulated float round-off.
+// Zero-initialize; use one tracker per catalog.
+#define SKY_REANCHOR_FRAMES 64
+
+typedef struct {
+    bool valid;
+    double lat, lon;
+    double lmst;            // Sidereal time of the stored directions
+    const void* data;       // Catalog the directions belong to
+    int count;
+    int frames_since_anchor;
+} SkyRotation;
+
+// Returns true and the row-major rotation taking the stored directions to jd.
+// Returns false when the caller must run the full transform instead (first use,
+// new site or catalog, or time to re-anchor); the tracker is then anchored at jd.
+bool sky_rotation_step(SkyRotation* rot, double jd, double lat, double lon, const void* data, int count, double R[9]);
+
+// True when the stored directions already belong to this time, site and catalog
+bool sky_rotation_current(const SkyRotation* rot, double jd, double lat, double lon, const void* data, int count);
+
+// Applies R to n directions spaced stride bytes apart, in place
+void rotate_directions(Vec3* first, size_t stride, int n, const double R[9]);
+
+// star_equ_to_horizon for sequences: rotates the directions from the previous
+// call when possible. The incremental path maintains direction only; alt and az
+// are refreshed whenever the catalog is re-anchored.
+void star_horizon_advance(SkyRotation* rot, double jd, double lat, double lon, Star* catalog, int n);
+
+// The same for a catalog shared read-only between renders: dirs[i] receives the
+// direction of catalog[i], and the catalog is not written
+void star_directions_advance(SkyRotation* rot, double jd, double lat, double lon, const Star* catalog, Vec3* dirs,
+                             int n);
+
 typedef struct {
     const char* name;
     float ra, dec;
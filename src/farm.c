@@ -0,0 +1,318 @@
+#include "farm.h"
+#include "output.h"
+#include "render.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FARM_BANDS_PER_PROCESS 2
+#define FARM_MAX_EXTRA_ARGS 12
+
+typedef struct {
+    int frame;              // Sequence frame, or -1 for a band
+    int row0, rows;         // Band of a single image
+    char output[1024];      // -o of the worker
+    char log[1024];
+    int attempts;
+    pid_t pid;              // Running worker, or 0
+    bool done;              // Worker succeeded; not merged yet
+    bool merged;
+} FarmJob;
+
+typedef struct {
+    const Config* cfg;
+    FarmJob* jobs;
+    int num_jobs;
+    int next_merge;         // Jobs before it are merged
+    int width, height;
+    int num_exposures;
+    bool video;             // Sequence encoded by the coordinator
+    OutputVideo* videos[CONFIG_MAX_EXPOSURES];
+    OutputRows* sinks[CONFIG_MAX_EXPOSURES];    // Bands streamed to the image
+    ImageRGB* images[CONFIG_MAX_EXPOSURES];     // Bands gathered for other formats
+    bool write_failed;      // An output could not be written
+    char dir[512];
+} Farm;
+
+// Reads a tone mapped PFM as written by write_pfm_stream
+static ImageRGB* read_pfm(const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return NULL;
+    int w, h;
+    float scale;
+    ImageRGB* img = NULL;
+    if (fscanf(f, "PF %d %d %f", &w, &h, &scale) == 3 && fgetc(f) == '\n' && w > 0 && h > 0 && scale < 0) {
+        img = image_rgb_create(w, h);
+        for (int y = h - 1; img && y >= 0; y--) {
+            if (fread(img->pixels + (size_t)y * w, sizeof(RGB), w, f) != (size_t)w) {
+                image_rgb_free(img);
+                img = NULL;
+            }
+        }
+    }
+    fclose(f);
+    return img;
+}
+
+// The file a worker wrote for exposure e of job
+static void job_file(const Farm* farm, const FarmJob* job, int e, char* out, size_t size) {
+    char name[1024];
+    if (job->frame >= 0) format_frame_filename(name, sizeof(name), job->output, job->frame);
+    else snprintf(name, sizeof(name), "%s", job->output);
+    if (farm->num_exposures > 1) output_exposure_filename(out, size, name, config_exposure(farm->cfg, e));
+    else snprintf(out, size, "%s", name);
+}
+
+// Adds the files of a finished job to the outputs. Returns false if one
+// could not be read, leaving the outputs untouched, or could not be written
+// (farm->write_failed).
+static bool merge_job(Farm* farm, FarmJob* job) {
+    if (job->frame >= 0 && !farm->video) return true; // Written in place
+    ImageRGB* parts[CONFIG_MAX_EXPOSURES] = {NULL};
+    char path[1024];
+    bool ok = true;
+    for (int e = 0; e < farm->num_exposures && ok; e++) {
+        job_file(farm, job, e, path, sizeof(path));
+        parts[e] = read_pfm(path);
+        int rows = job->frame >= 0 ? farm->height : job->rows;
+        ok = parts[e] && parts[e]->width == farm->width && parts[e]->height == rows;
+    }
+    for (int e = 0; e < farm->num_exposures && ok; e++) {
+        bool written = true;
+        if (farm->video) {
+            written = output_video_add(farm->videos[e], parts[e]);
+        } else if (farm->sinks[e]) {
+            written = output_rows_add(farm->sinks[e], parts[e]);
+        } else {
+            memcpy(farm->images[e]->pixels + (size_t)job->row0 * farm->width, parts[e]->pixels,
+                   sizeof(RGB) * farm->width * job->rows);
+        }
+        if (!written) ok = false, farm->write_failed = true;
+    }
+    for (int e = 0; e < farm->num_exposures; e++) {
+        image_rgb_free(parts[e]);
+        if (ok) {
+            job_file(farm, job, e, path, sizeof(path));
+            remove(path);
+        }
+    }
+    return ok;
+}
+
+// Queues a failed job again. Returns false once it has used its attempts.
+static bool retry_job(const Farm* farm, const FarmJob* job) {
+    int index = (int)(job - farm->jobs);
+    if (job->attempts < FARM_MAX_ATTEMPTS) {
+        fprintf(stderr, "Warning: Farm job %d failed (attempt %d), retrying; see %s\n", index, job->attempts, job->log);
+        return true;
+    }
+    fprintf(stderr, "Error: Farm job %d failed %d times; see %s\n", index, job->attempts, job->log);
+    return false;
+}
+
+static pid_t spawn_worker(const char* exe, int argc, char** argv, char** extra, const char* log) {
+    char* args[argc + FARM_MAX_EXTRA_ARGS + 1];
+    int n = 0;
+    for (int i = 0; i < argc; i++) args[n++] = argv[i];
+    for (int i = 0; extra[i]; i++) args[n++] = extra[i];
+    args[n] = NULL;
+    fflush(NULL); // Or the child inherits unwritten output
+    pid_t pid = fork();
+    if (pid == 0) {
+        int fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(exe, args);
+        perror("execv");
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t start_job(Farm* farm, FarmJob* job, const char* exe, int argc, char** argv) {
+    const Config* cfg = farm->cfg;
+    char frame[16], crop[64];
+    char* extra[FARM_MAX_EXTRA_ARGS + 1];
+    int n = 0;
+    if (job->frame < 0 || farm->video) extra[n++] = "--farm-worker";
+    if (job->frame >= 0) {
+        snprintf(frame, sizeof(frame), "%d", job->frame);
+        extra[n++] = "--farm-frame";
+        extra[n++] = frame;
+    } else {
+        snprintf(crop, sizeof(crop), "0,%d,%d,%d", job->row0, cfg->width, job->rows);
+        extra[n++] = "--crop";
+        extra[n++] = crop;
+    }
+    if (job->frame < 0 || farm->video) {
+        extra[n++] = "--format";
+        extra[n++] = "pfm";
+        extra[n++] = "-o";
+        extra[n++] = job->output;
+    }
+    extra[n] = NULL;
+    job->attempts++;
+    job->pid = spawn_worker(exe, argc, argv, extra, job->log);
+    return job->pid;
+}
+
+// Opens what the coordinator writes: nothing for frames the workers save
+// themselves
+static bool open_outputs(Farm* farm, bool frames) {
+    const Config* cfg = farm->cfg;
+    if (frames && !farm->video) return true;
+    bool stream = farm->video || (output_supports_rows(cfg->output_filename, cfg) && !cfg->convert_to_png);
+    for (int e = 0; e < farm->num_exposures; e++) {
+        char name[1024];
+        if (farm->num_exposures > 1) output_exposure_filename(name, sizeof(name), cfg->output_filename, config_exposure(cfg, e));
+        else snprintf(name, sizeof(name), "%s", cfg->output_filename);
+        if (farm->video) farm->videos[e] = output_video_open(name, farm->width, farm->height, cfg);
+        else if (stream) farm->sinks[e] = output_rows_open(name, farm->width, farm->height, cfg);
+        else farm->images[e] = image_rgb_create(farm->width, farm->height);
+        if (!farm->videos[e] && !farm->sinks[e] && !farm->images[e]) return false;
+    }
+    return true;
+}
+
+// Finishes the outputs; writes the gathered images when all jobs merged
+static bool close_outputs(Farm* farm) {
+    const Config* cfg = farm->cfg;
+    bool ok = farm->next_merge == farm->num_jobs;
+    for (int e = 0; e < farm->num_exposures; e++) {
+        if (farm->videos[e] && !output_video_close(farm->videos[e])) ok = false;
+        if (farm->sinks[e] && !output_rows_close(farm->sinks[e])) ok = false;
+    }
+    if (ok && farm->images[0]) ok = output_save_exposures(cfg->output_filename, farm->images, NULL, cfg);
+    for (int e = 0; e < farm->num_exposures; e++) image_rgb_free(farm->images[e]);
+    return ok;
+}
+
+static bool make_dir(const Config* cfg, char* dir, size_t size, bool* made) {
+    *made = false;
+    if (cfg->farm_dir) {
+        snprintf(dir, size, "%s", cfg->farm_dir);
+        if (mkdir(dir, 0777) == 0) *made = true;
+        else if (errno != EEXIST) return false;
+        return true;
+    }
+    const char* tmp = getenv("TMPDIR");
+    snprintf(dir, size, "%s/knight-farm-XXXXXX", tmp && *tmp ? tmp : "/tmp");
+    *made = mkdtemp(dir) != NULL;
+    return *made;
+}
+
+static bool check_farm(const Config* cfg, int num_frames) {
+    const char* problem = NULL;
+    if (strcmp(cfg->output_filename, "-") == 0) problem = "-o -";
+    else if (cfg->exposure_state_path) problem = "--exposure-state";
+    else if (num_frames == 0 && cfg->crop_width > 0) problem = "--crop without --start";
+    else if (num_frames == 0 && output_needs_hdr(cfg->output_filename, cfg)) problem = "HDR output without --start";
+    else if (num_frames == 0 && output_is_video(cfg->output_filename, cfg)) problem = "video output without --start";
+    if (problem) fprintf(stderr, "Error: --farm cannot be used with %s\n", problem);
+    return problem == NULL;
+}
+
+int farm_run(const Config* cfg, const char* worker_exe, int argc, char** argv, int num_frames) {
+    if (!check_farm(cfg, num_frames)) return 1;
+    Farm farm;
+    memset(&farm, 0, sizeof(farm));
+    farm.cfg = cfg;
+    farm.num_exposures = config_num_exposures(cfg);
+    farm.video = num_frames > 0 && output_is_video(cfg->output_filename, cfg);
+    config_image_size(cfg, &farm.width, &farm.height);
+    bool made_dir;
+    if (!make_dir(cfg, farm.dir, sizeof(farm.dir), &made_dir)) {
+        fprintf(stderr, "Error: Could not create farm directory %s\n", farm.dir);
+        return 1;
+    }
+
+    // One job per frame, or per band of rows
+    int band = cfg->tile_rows;
+    if (band <= 0) {
+        int bands = cfg->farm_processes * FARM_BANDS_PER_PROCESS;
+        band = (cfg->height + bands - 1) / bands;
+    }
+    farm.num_jobs = num_frames > 0 ? num_frames : (cfg->height + band - 1) / band;
+    farm.jobs = (FarmJob*)calloc(farm.num_jobs, sizeof(FarmJob));
+    if (!farm.jobs) return 1;
+    for (int i = 0; i < farm.num_jobs; i++) {
+        FarmJob* job = &farm.jobs[i];
+        if (num_frames > 0) {
+            job->frame = i;
+            if (farm.video) snprintf(job->output, sizeof(job->output), "%s/frame_%%06d.pfm", farm.dir);
+            else snprintf(job->output, sizeof(job->output), "%s", cfg->output_filename);
+        } else {
+            job->frame = -1;
+            job->row0 = i * band;
+            job->rows = cfg->height - job->row0 < band ? cfg->height - job->row0 : band;
+            snprintf(job->output, sizeof(job->output), "%s/band_%04d.pfm", farm.dir, i);
+        }
+        snprintf(job->log, sizeof(job->log), "%s/job_%04d.log", farm.dir, i);
+    }
+    printf("Farm: %d %s on %d processes, working in %s\n", farm.num_jobs, num_frames > 0 ? "frames" : "bands",
+           cfg->farm_processes, farm.dir);
+
+    bool ok = open_outputs(&farm, num_frames > 0);
+    int running = 0;
+    while (ok && farm.next_merge < farm.num_jobs) {
+        // Hand out pending jobs in order to idle processes
+        for (int i = farm.next_merge; i < farm.num_jobs && running < cfg->farm_processes; i++) {
+            FarmJob* job = &farm.jobs[i];
+            if (job->pid || job->done || job->merged) continue;
+            if (start_job(&farm, job, worker_exe, argc, argv) < 0) {
+                perror("Error: fork");
+                ok = false;
+                break;
+            }
+            running++;
+        }
+        if (!ok || running == 0) break;
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            perror("Error: waitpid");
+            break;
+        }
+        FarmJob* job = NULL;
+        for (int i = 0; i < farm.num_jobs && !job; i++) {
+            if (farm.jobs[i].pid == pid) job = &farm.jobs[i];
+        }
+        if (!job) continue;
+        job->pid = 0;
+        running--;
+        job->done = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (!job->done) ok = retry_job(&farm, job);
+
+        // Merge finished jobs in order; a job whose files are bad runs again
+        while (ok && farm.next_merge < farm.num_jobs && farm.jobs[farm.next_merge].done) {
+            FarmJob* next = &farm.jobs[farm.next_merge];
+            if (!merge_job(&farm, next)) {
+                next->done = false;
+                ok = !farm.write_failed && retry_job(&farm, next);
+                break;
+            }
+            next->merged = true;
+            remove(next->log);
+            farm.next_merge++;
+            printf("Farm: %d/%d merged\n", farm.next_merge, farm.num_jobs);
+        }
+    }
+    // Let the remaining workers finish so none outlives the coordinator
+    while (running > 0) {
+        if (waitpid(-1, NULL, 0) > 0 || errno != EINTR) running--;
+    }
+
+    ok = close_outputs(&farm) && ok;
+    free(farm.jobs);
+    if (ok && made_dir) rmdir(farm.dir);
+    if (ok && num_frames > 0) printf("Done. Saved %d frames to %s\n", num_frames, cfg->output_filename);
+    else if (ok) printf("Done. Saved to %s\n", cfg->output_filename);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#ifndef FARM_H
+#define FARM_H
+
+#include "config.h"
+
+// Farm mode (--farm n). The coordinator process renders nothing itself: it
+// runs n knight worker processes on the same host, hands each one job at a
+// time on its command line and merges what they write, in job order, so the
+// result does not depend on which worker finished first.
+//
+// A --start sequence is split by frame; a worker renders one frame with
+// --farm-frame. Image files are written under their final names by the
+// workers. A video or frame stream is encoded by the coordinator from the
+// tone mapped PFM frames the workers leave in the farm directory. Each frame
+// is metered on its own, as in separate runs.
+//
+// A single image is split into full width bands of cfg->tile_rows rows (by
+// default two bands per process). Workers render them as --crop windows into
+// PFM files in the farm directory. Every crop is exposed from the same
+// whole-frame pre-pass, so the bands share one exposure and join without
+// seams.
+//
+// A job whose worker exits with an error, or whose file cannot be read, is
+// handed out again, up to FARM_MAX_ATTEMPTS times. Worker output goes to a
+// log per job in the farm directory, kept if the job fails for good.
+#define FARM_MAX_ATTEMPTS 3
+
+// Runs the farm for cfg. worker_exe is started with argv[0..argc) followed
+// by the options of its job. num_frames is the length of the --start
+// sequence, or 0 for a single image. Returns the process exit status.
+int farm_run(const Config* cfg, const char* worker_exe, int argc, char** argv, int num_frames);
+
+#endif
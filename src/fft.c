@@ -0,0 +1,155 @@
+#include "fft.h"
+#include "parallel.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FFT_MAX_RADIX 64
+
+int fft_good_size(int n) {
+    if (n < 1) n = 1;
+    for (;; n++) {
+        int m = n;
+        while (m % 2 == 0) m /= 2;
+        while (m % 3 == 0) m /= 3;
+        while (m % 5 == 0) m /= 5;
+        if (m == 1) return n;
+    }
+}
+
+bool fft_plan_init(FFTPlan* plan, int n) {
+    plan->n = n;
+    plan->num_factors = 0;
+    plan->twiddles = (Complex*)malloc(sizeof(Complex) * n);
+    if (!plan->twiddles) return false;
+
+    for (int k = 0; k < n; k++) {
+        double a = -2.0 * 3.14159265358979323846 * k / n;
+        plan->twiddles[k].re = cos(a);
+        plan->twiddles[k].im = sin(a);
+    }
+
+    // Factor n, largest radices first so the recursion is shallow at the top
+    int m = n;
+    const int radices[] = {5, 3, 2};
+    for (int r = 0; r < 3; r++) {
+        while (m % radices[r] == 0 && plan->num_factors < FFT_MAX_FACTORS) {
+            plan->factors[plan->num_factors++] = radices[r];
+            m /= radices[r];
+        }
+    }
+    for (int p = 7; m > 1 && plan->num_factors < FFT_MAX_FACTORS; p += 2) {
+        while (m % p == 0 && plan->num_factors < FFT_MAX_FACTORS) {
+            if (p > FFT_MAX_RADIX) {
+                free(plan->twiddles);
+                plan->twiddles = NULL;
+                return false;
+            }
+            plan->factors[plan->num_factors++] = p;
+            m /= p;
+        }
+    }
+    if (plan->num_factors == 0) plan->factors[plan->num_factors++] = 1;
+    return true;
+}
+
+void fft_plan_free(FFTPlan* plan) {
+    free(plan->twiddles);
+    plan->twiddles = NULL;
+}
+
+static inline Complex twiddle(const FFTPlan* plan, long long idx, bool inverse) {
+    Complex w = plan->twiddles[idx % plan->n];
+    if (inverse) w.im = -w.im;
+    return w;
+}
+
+static inline Complex cmul(Complex a, Complex b) {
+    return (Complex){a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re};
+}
+
+// Transforms n values read from in[0], in[stride], ... into out[0..n-1]
+static void fft_rec(const FFTPlan* plan, Complex* out, const Complex* in, int n, int stride, int stage, bool inverse) {
+    int p = plan->factors[stage];
+    int m = n / p;
+    int tw_step = plan->n / n;
+
+    if (m == 1) {
+        for (int q = 0; q < p; q++) out[q] = in[q * stride];
+    } else {
+        for (int q = 0; q < p; q++) {
+            fft_rec(plan, out + q * m, in + q * stride, m, stride * p, stage + 1, inverse);
+        }
+    }
+    if (p == 1) return;
+
+    if (p == 2) {
+        for (int k = 0; k < m; k++) {
+            Complex t0 = out[k];
+            Complex t1 = cmul(out[k + m], twiddle(plan, (long long)k * tw_step, inverse));
+            out[k] = (Complex){t0.re + t1.re, t0.im + t1.im};
+            out[k + m] = (Complex){t0.re - t1.re, t0.im - t1.im};
+        }
+        return;
+    }
+
+    Complex tmp[FFT_MAX_RADIX];
+    for (int k = 0; k < m; k++) {
+        for (int q = 0; q < p; q++) {
+            tmp[q] = cmul(out[k + q * m], twiddle(plan, (long long)q * k * tw_step, inverse));
+        }
+        for (int r = 0; r < p; r++) {
+            Complex sum = tmp[0];
+            for (int q = 1; q < p; q++) {
+                // W_p^(q r) = W_n^(q r m)
+                Complex t = cmul(tmp[q], twiddle(plan, (long long)q * r * m * tw_step, inverse));
+                sum.re += t.re;
+                sum.im += t.im;
+            }
+            out[k + r * m] = sum;
+        }
+    }
+}
+
+void fft_execute(const FFTPlan* plan, Complex* data, Complex* scratch, bool inverse) {
+    memcpy(scratch, data, sizeof(Complex) * plan->n);
+    fft_rec(plan, data, scratch, plan->n, 1, 0, inverse);
+}
+
+typedef struct {
+    const FFTPlan* row_plan;
+    const FFTPlan* col_plan;
+    Complex* data;
+    bool inverse;
+} FFT2DJob;
+
+static void fft_rows(int begin, int end, void* ctx) {
+    FFT2DJob* job = (FFT2DJob*)ctx;
+    int w = job->row_plan->n;
+    Complex* scratch = (Complex*)malloc(sizeof(Complex) * w);
+    for (int y = begin; y < end; y++) {
+        fft_execute(job->row_plan, job->data + (size_t)y * w, scratch, job->inverse);
+    }
+    free(scratch);
+}
+
+static void fft_cols(int begin, int end, void* ctx) {
+    FFT2DJob* job = (FFT2DJob*)ctx;
+    int w = job->row_plan->n;
+    int h = job->col_plan->n;
+    Complex* col = (Complex*)malloc(sizeof(Complex) * h);
+    Complex* scratch = (Complex*)malloc(sizeof(Complex) * h);
+    for (int x = begin; x < end; x++) {
+        for (int y = 0; y < h; y++) col[y] = job->data[(size_t)y * w + x];
+        fft_execute(job->col_plan, col, scratch, job->inverse);
+        for (int y = 0; y < h; y++) job->data[(size_t)y * w + x] = col[y];
+    }
+    free(col);
+    free(scratch);
+}
+
+void fft_2d(const FFTPlan* row_plan, const FFTPlan* col_plan, Complex* data, bool inverse) {
+    FFT2DJob job = { row_plan, col_plan, data, inverse };
+    parallel_for(col_plan->n, 8, fft_rows, &job);
+    parallel_for(row_plan->n, 8, fft_cols, &job);
+}
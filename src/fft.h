@@ -0,0 +1,38 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <stdbool.h>
+
+// Self-contained mixed-radix FFT (recursive decimation in time).
+// Sizes whose prime factors are 2, 3 and 5 are fast; other primes fall back to an
+// O(p^2) butterfly, so use fft_good_size() to pick padded sizes.
+
+#define FFT_MAX_FACTORS 32
+
+typedef struct {
+    double re, im;
+} Complex;
+
+typedef struct {
+    int n;
+    int factors[FFT_MAX_FACTORS];
+    int num_factors;
+    Complex* twiddles; // exp(-2 pi i k / n), k < n
+} FFTPlan;
+
+// Smallest size >= n whose only prime factors are 2, 3 and 5
+int fft_good_size(int n);
+
+// Returns false on allocation failure
+bool fft_plan_init(FFTPlan* plan, int n);
+void fft_plan_free(FFTPlan* plan);
+
+// In-place transform of plan->n contiguous values. scratch must hold plan->n values.
+// The inverse transform is unnormalized (scale by 1/n yourself).
+void fft_execute(const FFTPlan* plan, Complex* data, Complex* scratch, bool inverse);
+
+// In-place 2D transform of a row-major width x height array, rows then columns,
+// spread over worker threads. Plans must match width and height respectively.
+void fft_2d(const FFTPlan* row_plan, const FFTPlan* col_plan, Complex* data, bool inverse);
+
+#endif
@@ -0,0 +1,379 @@
+#include "glare.h"
+#include "fft.h"
+#include "parallel.h"
+
+// Pupil obstructions. Eyelashes are thin opaque bars across the upper pupil and
+// produce the characteristic streaks; lens particles produce the ciliary corona.
+// Positions come from a fixed-seed generator so every frame gets the same PSF.
+#define GLARE_EYELASHES 5
+#define GLARE_EYELASH_WIDTH 0.012f   // in pupil diameters
+#define GLARE_PARTICLES 48
+#define GLARE_SEED 0x6a09e667u
+
+static float glare_uniform(unsigned int* state) {
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+// Pupil transmission on an n x n grid spanning two pupil diameters, so the power
+// spectrum (the pupil autocorrelation) does not alias.
+static void build_pupil(float* pupil, int n) {
+    float dx = 2.0f / n;
+    for (int j = 0; j < n; j++) {
+        float y = (j + 0.5f) * dx - 1.0f;
+        for (int i = 0; i < n; i++) {
+            float x = (i + 0.5f) * dx - 1.0f;
+            pupil[j * n + i] = (x * x + y * y <= 0.25f) ? 1.0f : 0.0f;
+        }
+    }
+
+    unsigned int seed = GLARE_SEED;
+    for (int e = 0; e < GLARE_EYELASHES; e++) {
+        float y0 = 0.22f + 0.2f * glare_uniform(&seed);
+        float slope = (glare_uniform(&seed) - 0.5f) * 0.6f;
+        float inv_len = 1.0f / sqrtf(1.0f + slope * slope);
+        for (int j = 0; j < n; j++) {
+            float y = (j + 0.5f) * dx - 1.0f;
+            for (int i = 0; i < n; i++) {
+                float x = (i + 0.5f) * dx - 1.0f;
+                if (fabsf(y - (y0 + slope * x)) * inv_len < 0.5f * GLARE_EYELASH_WIDTH) pupil[j * n + i] = 0.0f;
+            }
+        }
+    }
+
+    for (int p = 0; p < GLARE_PARTICLES; p++) {
+        float r = 0.45f * sqrtf(glare_uniform(&seed));
+        float phi = TWO_PI * glare_uniform(&seed);
+        float cx = r * cosf(phi), cy = r * sinf(phi);
+        float rad = 0.004f + 0.004f * glare_uniform(&seed);
+        int i0 = (int)((cx - rad + 1.0f) / dx), i1 = (int)((cx + rad + 1.0f) / dx) + 1;
+        int j0 = (int)((cy - rad + 1.0f) / dx), j1 = (int)((cy + rad + 1.0f) / dx) + 1;
+        for (int j = j0; j <= j1 && j < n; j++) {
+            float y = (j + 0.5f) * dx - 1.0f;
+            for (int i = i0; i <= i1 && i < n; i++) {
+                float x = (i + 0.5f) * dx - 1.0f;
+                if ((x - cx) * (x - cx) + (y - cy) * (y - cy) <= rad * rad) pupil[j * n + i] = 0.0f;
+            }
+        }
+    }
+}
+
+// Summed-area table of the normalized, centered PSF power spectrum.
+// sat[(j)*(n+1) + i] is the energy in cells [0,i) x [0,j).
+static double* build_psf_sat(int n) {
+    float* pupil = (float*)malloc(sizeof(float) * n * n);
+    Complex* field = (Complex*)malloc(sizeof(Complex) * n * n);
+    double* sat = (double*)calloc((size_t)(n + 1) * (n + 1), sizeof(double));
+    FFTPlan plan;
+    if (!pupil || !field || !sat || !fft_plan_init(&plan, n)) {
+        free(pupil); free(field); free(sat);
+        return NULL;
+    }
+
+    build_pupil(pupil, n);
+    for (int i = 0; i < n * n; i++) field[i] = (Complex){pupil[i], 0.0f};
+    fft_2d(&plan, &plan, field, false);
+    fft_plan_free(&plan);
+
+    double total = 0;
+    for (int i = 0; i < n * n; i++) total += field[i].re * field[i].re + field[i].im * field[i].im;
+
+    // Shift zero frequency to cell n/2 while accumulating
+    for (int j = 0; j < n; j++) {
+        int sj = (j + n / 2) % n;
+        double row = 0;
+        for (int i = 0; i < n; i++) {
+            int si = (i + n / 2) % n;
+            Complex c = field[sj * n + si];
+            row += (c.re * c.re + c.im * c.im) / total;
+            sat[(size_t)(j + 1) * (n + 1) + i + 1] = sat[(size_t)j * (n + 1) + i + 1] + row;
+        }
+    }
+
+    free(pupil);
+    free(field);
+    return sat;
+}
+
+static double sat_at(const double* sat, int n, double u, double v) {
+    if (u < 0) u = 0;
+    if (v < 0) v = 0;
+    if (u > n) u = n;
+    if (v > n) v = n;
+    int i = (int)u, j = (int)v;
+    if (i > n - 1) i = n - 1;
+    if (j > n - 1) j = n - 1;
+    double fu = u - i, fv = v - j;
+    const double* r0 = sat + (size_t)j * (n + 1);
+    const double* r1 = r0 + (n + 1);
+    return (r0[i] * (1 - fu) + r0[i + 1] * fu) * (1 - fv) + (r1[i] * (1 - fu) + r1[i + 1] * fu) * fv;
+}
+
+typedef struct {
+    const double* sat;
+    int n;
+    int radius;
+    float pixel_angle;      // radians per pixel
+    float aperture_m;
+    float band_weight[SPECTRUM_BANDS][4];
+    float weight_sum[4];
+    float* kernel[4];       // (2r+1)^2 per channel
+} GlareKernelJob;
+
+// Integrates each band's PSF over the pixel footprints of kernel rows [begin, end)
+static void glare_kernel_rows(int begin, int end, void* ctx) {
+    GlareKernelJob* job = (GlareKernelJob*)ctx;
+    int r = job->radius, size = 2 * r + 1;
+    double center = job->n / 2 + 0.5;
+
+    for (int row = begin; row < end; row++) {
+        int dy = row - r;
+        for (int b = 0; b < SPECTRUM_BANDS; b++) {
+            double lambda = (LAMBDA_START + b * LAMBDA_STEP) * 1e-9;
+            // Grid cells per radian: the grid spans two apertures, so cell = lambda / (2 D)
+            double scale = 2.0 * job->aperture_m / lambda * job->pixel_angle;
+            double v0 = (dy - 0.5) * scale + center, v1 = (dy + 0.5) * scale + center;
+            for (int dx = -r; dx <= r; dx++) {
+                double u0 = (dx - 0.5) * scale + center, u1 = (dx + 0.5) * scale + center;
+                double e = sat_at(job->sat, job->n, u1, v1) - sat_at(job->sat, job->n, u0, v1)
+                         - sat_at(job->sat, job->n, u1, v0) + sat_at(job->sat, job->n, u0, v0);
+                int idx = row * size + (dx + r);
+                for (int c = 0; c < 4; c++) job->kernel[c][idx] += (float)e * job->band_weight[b][c];
+            }
+        }
+        for (int c = 0; c < 4; c++) {
+            for (int i = row * size; i < (row + 1) * size; i++) job->kernel[c][i] /= job->weight_sum[c];
+        }
+    }
+}
+
+void glare_cache_free(GlareCache* cache) {
+    for (int p = 0; p < 2; p++) {
+        free(cache->spec_a[p]);
+        free(cache->spec_b[p]);
+        cache->spec_a[p] = cache->spec_b[p] = NULL;
+    }
+    cache->valid = false;
+}
+
+int glare_psf_radius(float aperture_mm, float fov_deg, int w, int h) {
+    float pixel_angle = fov_deg * DEG2RAD / w;
+    float aperture_m = aperture_mm * 1e-3f;
+    // Reach of the PSF grid at the longest wavelength
+    float reach = (GLARE_PUPIL_N / 2) * (LAMBDA_END * 1e-9f) / (2.0f * aperture_m);
+    int r = (int)ceilf(reach / pixel_angle);
+    int max_r = (w > h ? w : h) / 2;
+    return r > max_r ? max_r : r;
+}
+
+static bool glare_cache_build(GlareCache* cache, float aperture_mm, float fov_deg, int w, int h) {
+    glare_cache_free(cache);
+    cache->aperture_mm = aperture_mm;
+    cache->fov_deg = fov_deg;
+    cache->width = w;
+    cache->height = h;
+    cache->radius = 0;
+    for (int c = 0; c < 4; c++) cache->center[c] = 1.0f;
+
+    int n = GLARE_PUPIL_N;
+    float pixel_angle = fov_deg * DEG2RAD / w;
+    float aperture_m = aperture_mm * 1e-3f;
+    int r = glare_psf_radius(aperture_mm, fov_deg, w, h);
+    if (r < 1) {
+        // Whole PSF falls inside one pixel: glare is the identity
+        cache->valid = true;
+        return true;
+    }
+
+    double* sat = build_psf_sat(n);
+    if (!sat) return false;
+
+    GlareKernelJob job;
+    memset(&job, 0, sizeof(job));
+    job.sat = sat;
+    job.n = n;
+    job.radius = r;
+    job.pixel_angle = pixel_angle;
+    job.aperture_m = aperture_m;
+    Spectrum unit;
+    for (int b = 0; b < SPECTRUM_BANDS; b++) {
+        spectrum_zero(&unit);
+        unit.s[b] = 1.0f;
+        XYZV xyzv = spectrum_to_xyzv(&unit);
+        float wts[4] = {xyzv.X, xyzv.Y, xyzv.Z, xyzv.V};
+        for (int c = 0; c < 4; c++) {
+            job.band_weight[b][c] = wts[c];
+            job.weight_sum[c] += wts[c];
+        }
+    }
+    int size = 2 * r + 1;
+    for (int c = 0; c < 4; c++) job.kernel[c] = (float*)calloc(size * size, sizeof(float));
+    parallel_for(size, 4, glare_kernel_rows, &job);
+    free(sat);
+
+    int fw = fft_good_size(w + r);
+    int fh = fft_good_size(h + r);
+    FFTPlan row_plan = {0}, col_plan = {0};
+    Complex* buf = (Complex*)malloc(sizeof(Complex) * fw * fh);
+    bool ok = buf && fft_plan_init(&row_plan, fw);
+    ok = ok && fft_plan_init(&col_plan, fh);
+
+    double* spec[4] = {NULL, NULL, NULL, NULL};
+    for (int c = 0; ok && c < 4; c++) {
+        // The central pixel is applied directly and only the halo goes through the FFT
+        cache->center[c] = job.kernel[c][r * size + r];
+        memset(buf, 0, sizeof(Complex) * fw * fh);
+        for (int dy = -r; dy <= r; dy++) {
+            for (int dx = -r; dx <= r; dx++) {
+                if (dx == 0 && dy == 0) continue;
+                buf[((dy + fh) % fh) * fw + (dx + fw) % fw].re = job.kernel[c][(dy + r) * size + (dx + r)];
+            }
+        }
+        fft_2d(&row_plan, &col_plan, buf, false);
+        // The kernel is centro-symmetric, so its spectrum is real
+        spec[c] = (double*)malloc(sizeof(double) * fw * fh);
+        if (!spec[c]) { ok = false; break; }
+        for (int i = 0; i < fw * fh; i++) spec[c][i] = buf[i].re;
+    }
+
+    if (ok) {
+        // Two real channels share one complex transform; fold the pair separation and the
+        // inverse-transform normalization into a/b so the apply step is a single pass.
+        double inv_n = 1.0 / ((double)fw * fh);
+        for (int p = 0; p < 2; p++) {
+            cache->spec_a[p] = (double*)malloc(sizeof(double) * fw * fh);
+            cache->spec_b[p] = (double*)malloc(sizeof(double) * fw * fh);
+            if (!cache->spec_a[p] || !cache->spec_b[p]) { ok = false; break; }
+            for (int i = 0; i < fw * fh; i++) {
+                cache->spec_a[p][i] = 0.5 * (spec[2 * p][i] + spec[2 * p + 1][i]) * inv_n;
+                cache->spec_b[p][i] = 0.5 * (spec[2 * p][i] - spec[2 * p + 1][i]) * inv_n;
+            }
+        }
+    }
+
+    for (int c = 0; c < 4; c++) {
+        free(spec[c]);
+        free(job.kernel[c]);
+    }
+    free(buf);
+    fft_plan_free(&row_plan);
+    fft_plan_free(&col_plan);
+
+    if (!ok) {
+        glare_cache_free(cache);
+        return false;
+    }
+    cache->radius = r;
+    cache->fft_w = fw;
+    cache->fft_h = fh;
+    cache->valid = true;
+    printf("Glare PSF: radius %d px, FFT %dx%d\n", r, fw, fh);
+    return true;
+}
+
+typedef struct {
+    Complex* buf;
+    const double* a;
+    const double* b;
+    int fw, fh;
+} GlareSpectrumJob;
+
+// Multiplies the packed spectrum by the per-channel kernels. Z[k] and Z[-k] are
+// needed together, so each job row is paired with its mirror row.
+static void glare_spectrum_rows(int begin, int end, void* ctx) {
+    GlareSpectrumJob* job = (GlareSpectrumJob*)ctx;
+    int fw = job->fw, fh = job->fh;
+    for (int ky = begin; ky < end; ky++) {
+        int ky2 = (fh - ky) % fh;
+        for (int kx = 0; kx < fw; kx++) {
+            int kx2 = (fw - kx) % fw;
+            if (ky == ky2 && kx > kx2) continue;
+            size_t i1 = (size_t)ky * fw + kx;
+            size_t i2 = (size_t)ky2 * fw + kx2;
+            Complex z1 = job->buf[i1], z2 = job->buf[i2];
+            job->buf[i1].re = job->a[i1] * z1.re + job->b[i1] * z2.re;
+            job->buf[i1].im = job->a[i1] * z1.im - job->b[i1] * z2.im;
+            if (i2 != i1) {
+                job->buf[i2].re = job->a[i2] * z2.re + job->b[i2] * z1.re;
+                job->buf[i2].im = job->a[i2] * z2.im - job->b[i2] * z1.im;
+            }
+        }
+    }
+}
+
+typedef struct {
+    const GlareCache* cache;
+    const Complex* buf;
+    float* pixels;
+    int w;
+    int c0, c1;
+} GlareWriteJob;
+
+// Adds the convolved halo back onto the central tap for image rows [begin, end)
+static void glare_write_rows(int begin, int end, LumHistogram* hist, void* ctx) {
+    GlareWriteJob* job = (GlareWriteJob*)ctx;
+    int w = job->w, fw = job->cache->fft_w;
+    float k0 = job->cache->center[job->c0], k1 = job->cache->center[job->c1];
+    for (int y = begin; y < end; y++) {
+        for (int x = 0; x < w; x++) {
+            float* v = job->pixels + ((size_t)y * w + x) * 4;
+            Complex s = job->buf[(size_t)y * fw + x];
+            float a = (float)(v[job->c0] * k0 + s.re);
+            float b = (float)(v[job->c1] * k1 + s.im);
+            v[job->c0] = a > 0.0f ? a : 0.0f;
+            v[job->c1] = b > 0.0f ? b : 0.0f;
+            // Only the (X,Y) pass carries luminance; the histogram is rebuilt from it
+            if (hist) lum_hist_add(hist, v[1]);
+        }
+    }
+}
+
+void glare_apply(GlareCache* cache, ImageHDR* img, float aperture_mm, float fov_deg) {
+    int w = img->width, h = img->height;
+    if (!cache->valid || cache->aperture_mm != aperture_mm || cache->fov_deg != fov_deg ||
+        cache->width != w || cache->height != h) {
+        if (!glare_cache_build(cache, aperture_mm, fov_deg, w, h)) {
+            fprintf(stderr, "Warning: could not build glare PSF, skipping glare.\n");
+            return;
+        }
+    }
+    if (cache->radius < 1) return;
+
+    int fw = cache->fft_w, fh = cache->fft_h;
+    FFTPlan row_plan, col_plan;
+    Complex* buf = (Complex*)malloc(sizeof(Complex) * fw * fh);
+    if (!buf || !fft_plan_init(&row_plan, fw)) {
+        free(buf);
+        return;
+    }
+    if (!fft_plan_init(&col_plan, fh)) {
+        fft_plan_free(&row_plan);
+        free(buf);
+        return;
+    }
+
+    float* px = (float*)img->pixels;
+    for (int p = 0; p < 2; p++) {
+        int c0 = 2 * p, c1 = 2 * p + 1;
+        memset(buf, 0, sizeof(Complex) * fw * fh);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                const float* v = px + ((size_t)y * w + x) * 4;
+                buf[(size_t)y * fw + x] = (Complex){v[c0], v[c1]};
+            }
+        }
+        fft_2d(&row_plan, &col_plan, buf, false);
+        GlareSpectrumJob job = { buf, cache->spec_a[p], cache->spec_b[p], fw, fh };
+        parallel_for(fh / 2 + 1, 16, glare_spectrum_rows, &job);
+        fft_2d(&row_plan, &col_plan, buf, true);
+
+        GlareWriteJob wjob = { cache, buf, px, w, c0, c1 };
+        LumHistogram* hist = (p == 0) ? img->hist : NULL;
+        if (hist) lum_hist_clear(hist);
+        parallel_for_hist(h, 16, hist, glare_write_rows, &wjob);
+    }
+
+    fft_plan_free(&row_plan);
+    fft_plan_free(&col_plan);
+    free(buf);
+}
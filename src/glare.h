@@ -0,0 +1,42 @@
+#ifndef GLARE_H
+#define GLARE_H
+
+#include "core.h"
+#include "tonemap.h"
+
+// Physically-based glare: the point spread function of the eye's pupil (with
+// eyelashes and lens particles) is computed by Fraunhofer diffraction for every
+// spectral band, folded into per-channel XYZV kernels and applied to the image by
+// FFT convolution.
+
+// Pupil plane grid resolution. Together with the aperture this sets the angular
+// reach of the PSF (about +/- N/4 * lambda / aperture).
+#define GLARE_PUPIL_N 1024
+
+// Kernel spectra for one (aperture, pixel scale, image size) combination.
+// Keep one around between frames: glare_apply() only rebuilds it when the
+// parameters change. Zero-initialize before first use.
+typedef struct {
+    bool valid;
+    float aperture_mm;
+    float fov_deg;
+    int width, height;
+
+    int radius;              // Kernel half-width in pixels
+    int fft_w, fft_h;        // Padded transform size
+    float center[4];         // Energy of the central pixel per XYZV channel
+    double* spec_a[2];       // Combined kernel spectra for the (X,Y) and (Z,V) pairs
+    double* spec_b[2];
+} GlareCache;
+
+// Convolves img with the pupil diffraction PSF for the given aperture.
+// fov_deg is the angle spanned by the image width.
+void glare_apply(GlareCache* cache, ImageHDR* img, float aperture_mm, float fov_deg);
+
+// Half-width in pixels of the PSF glare_apply uses for a w x h image: how far
+// light spreads, e.g. the overlap strips of a tiled render need
+int glare_psf_radius(float aperture_mm, float fov_deg, int w, int h);
+
+void glare_cache_free(GlareCache* cache);
+
+#endif
@@ -0,0 +1,184 @@
+#include "hdrio.h"
+#include <stdint.h>
+
+#define RGBE_MIN_RLE_WIDTH 8
+#define RGBE_MAX_RLE_WIDTH 32767
+
+static void float_to_rgbe(unsigned char* rgbe, float r, float g, float b) {
+    if (!(r > 0.0f)) r = 0.0f; // Also catches NaN
+    if (!(g > 0.0f)) g = 0.0f;
+    if (!(b > 0.0f)) b = 0.0f;
+    float v = r > g ? r : g;
+    if (b > v) v = b;
+    if (v < 1e-32f) {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+        return;
+    }
+    int e;
+    float scale = frexpf(v, &e) * 256.0f / v;
+    rgbe[0] = (unsigned char)(r * scale);
+    rgbe[1] = (unsigned char)(g * scale);
+    rgbe[2] = (unsigned char)(b * scale);
+    rgbe[3] = (unsigned char)(e + 128);
+}
+
+// Run-length encodes one channel of a scanline (Radiance's adaptive RLE): runs
+// of 4 or more equal bytes become (128 + count, byte), the rest (count, bytes...)
+static unsigned char* rle_channel(unsigned char* out, const unsigned char* data, int n) {
+    int cur = 0;
+    while (cur < n) {
+        // Find the next run of at least 4
+        int run_start = cur, run_len = 0;
+        while (run_start < n) {
+            run_len = 1;
+            while (run_start + run_len < n && run_len < 127 && data[run_start + run_len] == data[run_start]) run_len++;
+            if (run_len >= 4) break;
+            run_start += run_len;
+        }
+        if (run_start >= n) run_len = 0;
+        // A short run just before the long one is cheaper as a run too
+        if (run_start - cur > 1 && run_start - cur < 4) {
+            int len = run_start - cur;
+            bool same = true;
+            for (int i = 1; i < len; i++) same = same && data[cur + i] == data[cur];
+            if (same) {
+                *out++ = (unsigned char)(128 + len);
+                *out++ = data[cur];
+                cur = run_start;
+            }
+        }
+        // Literals up to the run
+        while (cur < run_start) {
+            int len = run_start - cur;
+            if (len > 128) len = 128;
+            *out++ = (unsigned char)len;
+            memcpy(out, data + cur, len);
+            out += len;
+            cur += len;
+        }
+        if (run_len >= 4) {
+            *out++ = (unsigned char)(128 + run_len);
+            *out++ = data[run_start];
+            cur += run_len;
+        }
+    }
+    return out;
+}
+
+bool write_rgbe_stream(FILE* f, const ImageHDR* img) {
+    int w = img->width, h = img->height;
+    if (fprintf(f, "#?RADIANCE\n# Written by knight\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", h, w) < 0) return false;
+
+    bool rle = w >= RGBE_MIN_RLE_WIDTH && w <= RGBE_MAX_RLE_WIDTH;
+    // Channel-separated scanline, and worst case RLE output: 4 header bytes and
+    // one count byte per 128 literals in each channel
+    unsigned char* planar = (unsigned char*)malloc((size_t)w * 4);
+    unsigned char* encoded = (unsigned char*)malloc(4 + (size_t)w * 4 + 4 * (w / 128 + 1));
+    bool ok = planar && encoded;
+    for (int y = 0; ok && y < h; y++) {
+        const XYZV* row = img->pixels + (size_t)y * w;
+        if (!rle) {
+            for (int x = 0; x < w; x++) {
+                RGB c = xyz_to_srgb(row[x].X, row[x].Y, row[x].Z);
+                float_to_rgbe(encoded + 4 * x, c.r, c.g, c.b);
+            }
+            ok = fwrite(encoded, 4, w, f) == (size_t)w;
+            continue;
+        }
+        for (int x = 0; x < w; x++) {
+            RGB c = xyz_to_srgb(row[x].X, row[x].Y, row[x].Z);
+            unsigned char rgbe[4];
+            float_to_rgbe(rgbe, c.r, c.g, c.b);
+            for (int k = 0; k < 4; k++) planar[k * w + x] = rgbe[k];
+        }
+        unsigned char* p = encoded;
+        *p++ = 2;
+        *p++ = 2;
+        *p++ = (unsigned char)(w >> 8);
+        *p++ = (unsigned char)(w & 0xff);
+        for (int k = 0; k < 4; k++) p = rle_channel(p, planar + k * w, w);
+        size_t len = (size_t)(p - encoded);
+        ok = fwrite(encoded, 1, len, f) == len;
+    }
+    free(planar);
+    free(encoded);
+    return ok;
+}
+
+bool write_rgbe(const char* filename, const ImageHDR* img) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) return false;
+    setvbuf(f, NULL, _IOFBF, 1 << 16);
+    bool ok = write_rgbe_stream(f, img);
+    return fclose(f) == 0 && ok;
+}
+
+static bool little_endian(void) {
+    const uint16_t probe = 1;
+    return *(const unsigned char*)&probe == 1;
+}
+
+static void swap_floats(XYZV* pixels, size_t count) {
+    unsigned char* b = (unsigned char*)pixels;
+    for (size_t i = 0; i < count * 4; i++, b += 4) {
+        unsigned char t = b[0]; b[0] = b[3]; b[3] = t;
+        t = b[1]; b[1] = b[2]; b[2] = t;
+    }
+}
+
+bool write_xyzv_stream(FILE* f, const ImageHDR* img, const XyzvInfo* info) {
+    size_t count = (size_t)img->width * img->height;
+    if (fprintf(f, "XYZV\nFOV=%.9g\nPROJECTION=%s\n%d %d\n", info->fov_deg,
+                info->env_map ? "env" : "perspective", img->width, img->height) < 0) return false;
+    if (little_endian()) {
+        // One write of the whole buffer
+        return fwrite(img->pixels, sizeof(XYZV), count, f) == count;
+    }
+    XYZV row[256];
+    for (size_t i = 0; i < count; i += 256) {
+        size_t n = count - i < 256 ? count - i : 256;
+        memcpy(row, img->pixels + i, sizeof(XYZV) * n);
+        swap_floats(row, n);
+        if (fwrite(row, sizeof(XYZV), n, f) != n) return false;
+    }
+    return true;
+}
+
+bool write_xyzv(const char* filename, const ImageHDR* img, const XyzvInfo* info) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) return false;
+    // The pixels go out in one write, so stdio's buffer would only add a copy
+    setvbuf(f, NULL, _IONBF, 0);
+    bool ok = write_xyzv_stream(f, img, info);
+    return fclose(f) == 0 && ok;
+}
+
+ImageHDR* read_xyzv(const char* filename, XyzvInfo* info) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) return NULL;
+    XyzvInfo local = {60.0f, false};
+    char line[256];
+    int w = 0, h = 0;
+    bool ok = fgets(line, sizeof(line), f) && strcmp(line, "XYZV\n") == 0;
+    while (ok) {
+        ok = fgets(line, sizeof(line), f) != NULL;
+        if (!ok) break;
+        if (strncmp(line, "FOV=", 4) == 0) local.fov_deg = strtof(line + 4, NULL);
+        else if (strcmp(line, "PROJECTION=env\n") == 0) local.env_map = true;
+        else if (!strchr(line, '=')) {
+            ok = sscanf(line, "%d %d", &w, &h) == 2 && w > 0 && h > 0;
+            break;
+        }
+    }
+    ImageHDR* img = ok ? image_hdr_create(w, h) : NULL;
+    size_t count = (size_t)w * h;
+    if (img && (!img->pixels || fread(img->pixels, sizeof(XYZV), count, f) != count)) {
+        image_hdr_free(img);
+        img = NULL;
+    }
+    fclose(f);
+    if (!img) return NULL;
+    if (!little_endian()) swap_floats(img->pixels, count);
+    if (info) *info = local;
+    return img;
+}
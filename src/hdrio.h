@@ -0,0 +1,32 @@
+#ifndef HDRIO_H
+#define HDRIO_H
+
+#include "tonemap.h"
+
+// HDR output of the radiance buffer, before tone mapping.
+//
+// Radiance RGBE (.hdr): linear sRGB primaries with a shared 8 bit exponent,
+// run-length encoded per scanline; about 4 bytes per pixel or less, readable by
+// most HDR tools. Negative components (outside the sRGB gamut) are clipped.
+bool write_rgbe_stream(FILE* f, const ImageHDR* img);
+bool write_rgbe(const char* filename, const ImageHDR* img);
+
+// Raw dump (.xyzv): a text header, then the pixels as little-endian float X,
+// Y, Z, V, top row first. Lossless, so an image can be tone mapped again later
+// (knight-tonemap) without re-rendering. The header is
+//     XYZV
+//     FOV=<deg>
+//     PROJECTION=perspective|env
+//     <width> <height>
+// Readers skip KEY=VALUE lines they do not know.
+typedef struct {
+    float fov_deg;  // --fov of the render (the width of a perspective view)
+    bool env_map;   // Cylindrical environment map instead of a perspective view
+} XyzvInfo;
+
+bool write_xyzv_stream(FILE* f, const ImageHDR* img, const XyzvInfo* info);
+bool write_xyzv(const char* filename, const ImageHDR* img, const XyzvInfo* info);
+// Returns NULL if the file cannot be read. info may be NULL.
+ImageHDR* read_xyzv(const char* filename, XyzvInfo* info);
+
+#endif
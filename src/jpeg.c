@@ -0,0 +1,89 @@
+#include "jpeg.h"
+#include <jpeglib.h>
+#include <setjmp.h>
+
+// libjpeg's default error handler exits the process; a failed write should only
+// fail this image
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf escape;
+} JpegError;
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+    JpegError* err = (JpegError*)cinfo->err;
+    (*cinfo->err->output_message)(cinfo);
+    longjmp(err->escape, 1);
+}
+
+static inline unsigned char to_byte(float v) {
+    if (!(v > 0.0f)) return 0; // Also catches NaN
+    return v < 1.0f ? (unsigned char)(v * 255.0f + 0.5f) : 255;
+}
+
+// Compresses img through a destination the caller has set up on cinfo
+static bool compress_image(struct jpeg_compress_struct* cinfo, JpegError* err, const ImageRGB* img, int quality) {
+    unsigned char* volatile row = (unsigned char*)malloc((size_t)img->width * 3);
+    if (!row) return false;
+    if (setjmp(err->escape)) {
+        free(row);
+        return false;
+    }
+    cinfo->image_width = img->width;
+    cinfo->image_height = img->height;
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality < 1 ? 1 : (quality > 100 ? 100 : quality), TRUE);
+    jpeg_start_compress(cinfo, TRUE);
+
+    while (cinfo->next_scanline < cinfo->image_height) {
+        const RGB* src = img->pixels + (size_t)cinfo->next_scanline * img->width;
+        for (int x = 0; x < img->width; x++) {
+            row[3 * x] = to_byte(src[x].r);
+            row[3 * x + 1] = to_byte(src[x].g);
+            row[3 * x + 2] = to_byte(src[x].b);
+        }
+        JSAMPROW rows[1] = {row};
+        jpeg_write_scanlines(cinfo, rows, 1);
+    }
+    jpeg_finish_compress(cinfo);
+    free(row);
+    return true;
+}
+
+bool write_jpeg_stream(FILE* f, const ImageRGB* img, int quality) {
+    struct jpeg_compress_struct cinfo;
+    JpegError err;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = jpeg_error_exit;
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, f);
+    bool ok = compress_image(&cinfo, &err, img, quality);
+    jpeg_destroy_compress(&cinfo);
+    return ok;
+}
+
+bool write_jpeg(const char* filename, const ImageRGB* img, int quality) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) return false;
+    bool ok = write_jpeg_stream(f, img, quality);
+    return fclose(f) == 0 && ok;
+}
+
+bool encode_jpeg(const ImageRGB* img, int quality, unsigned char** data, unsigned long* size) {
+    struct jpeg_compress_struct cinfo;
+    JpegError err;
+    cinfo.err = jpeg_std_error(&err.pub);
+    err.pub.error_exit = jpeg_error_exit;
+    jpeg_create_compress(&cinfo);
+    *data = NULL;
+    *size = 0;
+    jpeg_mem_dest(&cinfo, data, size);
+    bool ok = compress_image(&cinfo, &err, img, quality);
+    jpeg_destroy_compress(&cinfo);
+    if (!ok) {
+        free(*data);
+        *data = NULL;
+    }
+    return ok;
+}
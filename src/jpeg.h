@@ -0,0 +1,17 @@
+#ifndef JPEG_H
+#define JPEG_H
+
+#include "tonemap.h"
+
+// Baseline JPEG encoding of tone-mapped images with libjpeg, fed one row at a
+// time. Pixels are clamped to [0, 1]. quality is libjpeg's 1-100 scale.
+#define JPEG_DEFAULT_QUALITY 90
+
+bool write_jpeg_stream(FILE* f, const ImageRGB* img, int quality);
+bool write_jpeg(const char* filename, const ImageRGB* img, int quality);
+
+// Encodes into a malloc'd buffer (*data, *size) for containers such as AVI.
+// The caller frees *data.
+bool encode_jpeg(const ImageRGB* img, int quality, unsigned char** data, unsigned long* size);
+
+#endif
@@ -0,0 +1,168 @@
+#include "knight.h"
+#include "render.h"
+#include "pipeline.h"
+#include "ephemerides.h"
+#include <pthread.h>
+
+struct KnightContext {
+    Scene scene;              // As loaded; only read once created
+
+    // Scene views for concurrent renders, reused most recently released first
+    // so a single caller keeps getting the same one
+    pthread_mutex_t lock;
+    Scene** idle;
+    int num_idle;
+    int num_views;
+    int capacity;
+
+    pthread_mutex_t gpu_lock; // The CUDA path keeps global device state
+};
+
+KnightContext* knight_context_create(const Config* cfg) {
+    KnightContext* ctx = (KnightContext*)calloc(1, sizeof(KnightContext));
+    if (!ctx) return NULL;
+    if (scene_load(&ctx->scene, cfg) != 0) {
+        free(ctx);
+        return NULL;
+    }
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_mutex_init(&ctx->gpu_lock, NULL);
+    return ctx;
+}
+
+static Scene* acquire_view(KnightContext* ctx) {
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->num_idle > 0) {
+        Scene* view = ctx->idle[--ctx->num_idle];
+        pthread_mutex_unlock(&ctx->lock);
+        return view;
+    }
+    // Reserve a pool slot now so releasing never has to allocate
+    if (ctx->num_views == ctx->capacity) {
+        int capacity = ctx->capacity ? ctx->capacity * 2 : 4;
+        Scene** grown = (Scene**)realloc(ctx->idle, sizeof(Scene*) * capacity);
+        if (!grown) {
+            pthread_mutex_unlock(&ctx->lock);
+            return NULL;
+        }
+        ctx->idle = grown;
+        ctx->capacity = capacity;
+    }
+    bool primary = ctx->num_views == 0;
+    ctx->num_views++;
+    pthread_mutex_unlock(&ctx->lock);
+
+    Scene* view = (Scene*)malloc(sizeof(Scene));
+    if (!view || !scene_view_init(view, &ctx->scene)) {
+        if (view) scene_view_free(view);
+        free(view);
+        pthread_mutex_lock(&ctx->lock);
+        ctx->num_views--;
+        pthread_mutex_unlock(&ctx->lock);
+        return NULL;
+    }
+    // Exposure adaptation follows the first view, which a single caller always gets back
+    if (primary) {
+        view->adapt_exposure = ctx->scene.adapt_exposure;
+        view->exposure = ctx->scene.exposure;
+    }
+    return view;
+}
+
+static void release_view(KnightContext* ctx, Scene* view) {
+    pthread_mutex_lock(&ctx->lock);
+    ctx->idle[ctx->num_idle++] = view;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static int render(KnightContext* ctx, const Config* cfg, double jd, ImageRGB* const* outs, int num_outs, ImageHDR* hdr) {
+    int w, h;
+    config_image_size(cfg, &w, &h);
+    if (!config_crop_valid(cfg)) return -1;
+    for (int i = 0; i < num_outs; i++) {
+        if (!outs[i] || outs[i]->width != w || outs[i]->height != h) return -1;
+    }
+    if (hdr && (hdr->width != w || hdr->height != h)) return -1;
+    Scene* view = acquire_view(ctx);
+    if (!view) return -1;
+
+    if (view->use_gpu) pthread_mutex_lock(&ctx->gpu_lock);
+    bool ok = render_frame(view, cfg, jd, outs, num_outs, hdr);
+    if (view->use_gpu) pthread_mutex_unlock(&ctx->gpu_lock);
+
+    release_view(ctx, view);
+    return ok ? 0 : -1;
+}
+
+int knight_render_hdr(KnightContext* ctx, const Config* cfg, double jd, ImageRGB* out, ImageHDR* hdr) {
+    return render(ctx, cfg, jd, &out, 1, hdr);
+}
+
+int knight_render_exposures(KnightContext* ctx, const Config* cfg, double jd, ImageRGB* const* outs, ImageHDR* hdr) {
+    return render(ctx, cfg, jd, outs, config_num_exposures(cfg), hdr);
+}
+
+int knight_render_tiled(KnightContext* ctx, const Config* cfg, double jd, int strip_rows, KnightStripFn emit, void* user) {
+    if (cfg->crop_width > 0) return -1;
+    Scene* view = acquire_view(ctx);
+    if (!view) return -1;
+    // Only the exposure pre-pass can use the GPU
+    if (view->use_gpu) pthread_mutex_lock(&ctx->gpu_lock);
+    bool ok = render_frame_tiled(view, cfg, jd, strip_rows, emit, user);
+    if (view->use_gpu) pthread_mutex_unlock(&ctx->gpu_lock);
+    release_view(ctx, view);
+    return ok ? 0 : -1;
+}
+
+// A --crop window has no pipeline stages; its frames render one at a time
+static bool render_sequence_crop(Scene* view, const Config* cfg, double start_jd, double step_days, int first, int end,
+                                 bool keep_hdr, KnightFrameFn emit, void* user) {
+    int w, h;
+    config_image_size(cfg, &w, &h);
+    int n = config_num_exposures(cfg);
+    ImageRGB* outs[CONFIG_MAX_EXPOSURES] = {NULL};
+    ImageHDR* hdr = keep_hdr ? image_hdr_create(w, h) : NULL;
+    bool ok = !keep_hdr || hdr;
+    for (int e = 0; e < n && ok; e++) ok = (outs[e] = image_rgb_create(w, h)) != NULL;
+    for (int frame = first; ok && frame < end; frame++) {
+        ok = render_frame(view, cfg, start_jd + frame * step_days, outs, n, hdr) && emit(frame, outs, hdr, user);
+    }
+    for (int e = 0; e < n; e++) image_rgb_free(outs[e]);
+    image_hdr_free(hdr);
+    return ok;
+}
+
+int knight_render_sequence(KnightContext* ctx, const Config* cfg, double start_jd, double step_days, int first, int end,
+                           bool keep_hdr, KnightFrameFn emit, void* user) {
+    if (!config_crop_valid(cfg)) return -1;
+    Scene* view = acquire_view(ctx);
+    if (!view) return -1;
+    if (view->use_gpu) pthread_mutex_lock(&ctx->gpu_lock);
+    bool ok = cfg->crop_width > 0
+        ? render_sequence_crop(view, cfg, start_jd, step_days, first, end, keep_hdr, emit, user)
+        : render_pipeline(view, cfg, start_jd, step_days, first, end, keep_hdr, emit, user);
+    if (view->use_gpu) pthread_mutex_unlock(&ctx->gpu_lock);
+    release_view(ctx, view);
+    return ok ? 0 : -1;
+}
+
+int knight_render_at(KnightContext* ctx, const Config* cfg, double jd, ImageRGB* out) {
+    return knight_render_hdr(ctx, cfg, jd, out, NULL);
+}
+
+int knight_render(KnightContext* ctx, const Config* cfg, ImageRGB* out) {
+    return knight_render_at(ctx, cfg, get_julian_day(cfg->year, cfg->month, cfg->day, cfg->hour), out);
+}
+
+void knight_context_destroy(KnightContext* ctx) {
+    if (!ctx) return;
+    for (int i = 0; i < ctx->num_idle; i++) {
+        scene_view_free(ctx->idle[i]);
+        free(ctx->idle[i]);
+    }
+    free(ctx->idle);
+    scene_free(&ctx->scene);
+    pthread_mutex_destroy(&ctx->lock);
+    pthread_mutex_destroy(&ctx->gpu_lock);
+    free(ctx);
+}
@@ -0,0 +1,71 @@
+#ifndef KNIGHT_H
+#define KNIGHT_H
+
+#include "config.h"
+#include "tonemap.h"
+
+// Public interface of libknight: load the catalogs, textures and atmosphere once,
+// then render any number of images from one or more threads.
+//
+//     Config cfg;
+//     config_set_defaults(&cfg);
+//     cfg.data_dir = "/usr/share/knight";
+//     KnightContext* ctx = knight_context_create(&cfg);
+//     ImageRGB* img = image_rgb_create(cfg.width, cfg.height);
+//     cfg.lat = 51.5;
+//     knight_render(ctx, &cfg, img);
+//     ...
+//     image_rgb_free(img);
+//     knight_context_destroy(ctx);
+
+typedef struct KnightContext KnightContext;
+
+// Loads what cfg selects: star catalog (--tycho, --mag-limit, ...), Moon
+// texture, constellation outlines (if render_outlines) and the render mode.
+// Later renders may change any other field. Returns NULL on failure.
+KnightContext* knight_context_create(const Config* cfg);
+
+// Renders and tone maps the sky at cfg's date and time into out, which must be
+// cfg->width x cfg->height, or the --crop window's size when cfg has one (see
+// config_image_size). Safe to call from several threads at once; each
+// concurrent call works on its own copy of the per-frame state, and GPU renders
+// are serialized. Returns 0 on success, -1 if out does not match cfg or memory
+// runs out.
+int knight_render(KnightContext* ctx, const Config* cfg, ImageRGB* out);
+
+// Same at an explicit Julian day. Exposure adaptation (sequences,
+// --exposure-state) follows the renders of one caller at a time.
+int knight_render_at(KnightContext* ctx, const Config* cfg, double jd, ImageRGB* out);
+
+// Same, also keeping the scene radiance (XYZV, before bloom and glare) for HDR
+// output or later tone mapping. hdr must be the size of out.
+int knight_render_hdr(KnightContext* ctx, const Config* cfg, double jd, ImageRGB* out, ImageHDR* hdr);
+
+// Renders once and tone maps into outs[i] at each of the
+// config_num_exposures(cfg) exposures (-e a,b,c). hdr may be NULL.
+int knight_render_exposures(KnightContext* ctx, const Config* cfg, double jd, ImageRGB* const* outs, ImageHDR* hdr);
+
+// Renders a frame too large to hold in memory in full width strips of
+// strip_rows rows, tone mapped at each of the config_num_exposures(cfg)
+// exposures. emit gets every strip top to bottom, with the frame row of its
+// first row, and returns false to stop. Memory grows with the strip size, not
+// the frame. cfg must not have a --crop window. Returns 0 on success, -1 if
+// out of memory or emit failed.
+typedef bool (*KnightStripFn)(const ImageRGB* rows, int row0, int exposure, void* user);
+int knight_render_tiled(KnightContext* ctx, const Config* cfg, double jd, int strip_rows, KnightStripFn emit, void* user);
+
+// Renders frames first..end-1 of a sequence, frame i at start_jd + i *
+// step_days, as a pipeline: while frame N is handed to emit, the following
+// frames are tone mapped and rendered on other threads (see pipeline.h). emit
+// gets each frame's config_num_exposures(cfg) images in order, on one thread,
+// with the radiance if keep_hdr (else NULL), and returns false to stop. A
+// --crop sequence renders frame by frame. Returns 0 on success, -1 if memory
+// ran out or emit stopped the sequence.
+typedef bool (*KnightFrameFn)(int frame, ImageRGB* const* outs, const ImageHDR* hdr, void* user);
+int knight_render_sequence(KnightContext* ctx, const Config* cfg, double start_jd, double step_days, int first, int end,
+                           bool keep_hdr, KnightFrameFn emit, void* user);
+
+// No renders may be in progress
+void knight_context_destroy(KnightContext* ctx);
+
+#endif
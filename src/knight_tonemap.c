@@ -0,0 +1,88 @@
+#include "core.h"
+#include "config.h"
+#include "hdrio.h"
+#include "output.h"
+#include "render.h"
+#include <getopt.h>
+
+// knight-tonemap: tone maps radiance saved with -o <name>.xyzv again, so
+// exposure (-e, also as a list), bloom (-B, -s) and glare (--glare, -A)
+// variations do not need a new render. Takes knight's options; ones that only
+// affect rendering are ignored. Each input is written to -o, or next to it as
+// <input>.png.
+int main(int argc, char** argv) {
+    Config cfg;
+    config_set_defaults(&cfg);
+    cfg.output_filename = NULL;
+    if (!parse_args(argc, argv, &cfg)) {
+        print_help(argv[0]);
+        return 0;
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [knight options] <file.xyzv>...\n", argv[0]);
+        return 1;
+    }
+    if (cfg.output_filename && argc - optind > 1) {
+        fprintf(stderr, "Error: -o names a single output; leave it out to write <input>.png for each input\n");
+        return 1;
+    }
+    if (!output_prepare(&cfg)) return 1;
+
+    int status = 0;
+    GlareCache glare;
+    memset(&glare, 0, sizeof(glare));
+    for (int i = optind; i < argc; i++) {
+        const char* input = argv[i];
+        XyzvInfo info;
+        ImageHDR* hdr = read_xyzv(input, &info);
+        if (!hdr) {
+            fprintf(stderr, "Error: Could not read %s\n", input);
+            status = 1;
+            continue;
+        }
+        // Geometry comes from the render, so bloom and glare keep their angular size
+        Config c = cfg;
+        c.width = hdr->width;
+        c.height = hdr->height;
+        c.fov = info.fov_deg;
+        c.env_map = info.env_map;
+
+        char output[1024];
+        if (cfg.output_filename) {
+            snprintf(output, sizeof(output), "%s", cfg.output_filename);
+        } else {
+            const char* dot = strrchr(input, '.');
+            const char* slash = strrchr(input, '/');
+            int stem = (dot && (!slash || dot > slash)) ? (int)(dot - input) : (int)strlen(input);
+            snprintf(output, sizeof(output), "%.*s.png", stem, input);
+        }
+        if (output_needs_hdr(output, &c)) {
+            fprintf(stderr, "Error: %s: knight-tonemap writes tone mapped images only\n", output);
+            image_hdr_free(hdr);
+            status = 1;
+            continue;
+        }
+
+        image_hdr_track_histogram(hdr);
+        if (hdr->hist) lum_hist_from_image(hdr->hist, hdr);
+        render_apply_optics(&glare, &c, hdr);
+        float max_Y = 0;
+        float L_avg = tonemap_meter(hdr, &max_Y);
+
+        int num_exposures = config_num_exposures(&c);
+        ImageRGB* outputs[CONFIG_MAX_EXPOSURES];
+        for (int e = 0; e < num_exposures; e++) {
+            outputs[e] = image_rgb_create(c.width, c.height);
+            ToneParams tone;
+            tonemap_params_from_luminance(L_avg, max_Y, config_exposure(&c, e), &tone);
+            tonemap_apply(hdr, outputs[e], &tone);
+        }
+        if (output_save_exposures(output, outputs, NULL, &c)) printf("Saved %s\n", output);
+        else status = 1;
+
+        for (int e = 0; e < num_exposures; e++) image_rgb_free(outputs[e]);
+        image_hdr_free(hdr);
+    }
+    glare_cache_free(&glare);
+    return status;
+}
@@ -0,0 +1,439 @@
+#include "output.h"
+#include "png.h"
+#include "jpeg.h"
+#include "avi.h"
+#include "hdrio.h"
+#include "y4m.h"
+#include <pthread.h>
+#include <strings.h>
+#include <unistd.h>
+
+typedef enum {
+    FORMAT_PFM,
+    FORMAT_PNG,
+    FORMAT_JPEG,
+    FORMAT_AVI,
+    FORMAT_RGBE,
+    FORMAT_XYZV,
+    FORMAT_Y4M,
+    FORMAT_PPM
+} OutputFormat;
+
+// --format names, which are also the file extensions
+static const struct {
+    const char* name;
+    OutputFormat format;
+} format_names[] = {
+    {"pfm", FORMAT_PFM}, {"png", FORMAT_PNG}, {"jpg", FORMAT_JPEG}, {"jpeg", FORMAT_JPEG},
+    {"avi", FORMAT_AVI}, {"hdr", FORMAT_RGBE}, {"xyzv", FORMAT_XYZV}, {"y4m", FORMAT_Y4M},
+    {"ppm", FORMAT_PPM}, {NULL, FORMAT_PFM}
+};
+
+// A sequence encoded into one video or stream. A writer thread encodes each
+// frame while the caller renders the next one.
+struct OutputVideo {
+    OutputFormat format;
+    AviWriter* avi;            // FORMAT_AVI
+    FILE* stream;              // FORMAT_Y4M and FORMAT_PPM
+    bool close_stream;         // False for stdout
+    int width, height;
+    int jpeg_quality;
+    unsigned char* scratch;    // Converted frame for the streams
+    ImageRGB* pending;         // Copy of the frame being written
+    bool has_pending;
+    bool finished;
+    bool ok;                   // False once a write failed
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+// The process's original stdout once output_prepare has taken it for -o -
+static FILE* stdout_stream = NULL;
+
+static bool is_stdout(const char* filename) {
+    return strcmp(filename, "-") == 0;
+}
+
+static bool format_from_name(const char* name, OutputFormat* format) {
+    for (int i = 0; format_names[i].name; i++) {
+        if (strcasecmp(name, format_names[i].name) == 0) {
+            *format = format_names[i].format;
+            return true;
+        }
+    }
+    return false;
+}
+
+static OutputFormat output_format(const char* filename, const Config* cfg) {
+    OutputFormat format = FORMAT_PFM;
+    if (cfg->output_format && format_from_name(cfg->output_format, &format)) return format;
+    const char* dot = strrchr(filename, '.');
+    if (dot) format_from_name(dot + 1, &format);
+    return format;
+}
+
+bool output_prepare(const Config* cfg) {
+    OutputFormat format;
+    if (cfg->output_format && !format_from_name(cfg->output_format, &format)) {
+        fprintf(stderr, "Error: Unknown --format '%s'\n", cfg->output_format);
+        return false;
+    }
+    if (!cfg->output_filename || !is_stdout(cfg->output_filename)) return true;
+    if (cfg->batch_file || cfg->serve_socket) {
+        fprintf(stderr, "Error: -o - cannot be used with --batch or --serve\n");
+        return false;
+    }
+    if (output_format(cfg->output_filename, cfg) == FORMAT_AVI || config_num_exposures(cfg) > 1) {
+        fprintf(stderr, "Error: -o - needs a single exposure and a streamable --format (not avi)\n");
+        return false;
+    }
+    // Keep the real stdout for the images and send everything printed to stderr
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 || !(stdout_stream = fdopen(fd, "wb"))) {
+        perror("Error: Could not redirect stdout");
+        return false;
+    }
+    return true;
+}
+
+bool output_needs_hdr(const char* filename, const Config* cfg) {
+    OutputFormat format = output_format(filename, cfg);
+    return format == FORMAT_RGBE || format == FORMAT_XYZV;
+}
+
+bool output_is_video(const char* filename, const Config* cfg) {
+    OutputFormat format = output_format(filename, cfg);
+    return format == FORMAT_AVI || format == FORMAT_Y4M || format == FORMAT_PPM;
+}
+
+static bool write_video_frame(OutputVideo* video, const ImageRGB* img) {
+    switch (video->format) {
+        case FORMAT_Y4M:
+            return write_y4m_frame(video->stream, img, video->scratch);
+        case FORMAT_PPM:
+            return write_ppm_frame(video->stream, img, video->scratch);
+        default: {
+            unsigned char* jpeg;
+            unsigned long size;
+            if (!encode_jpeg(img, video->jpeg_quality, &jpeg, &size)) return false;
+            bool ok = avi_add_frame(video->avi, jpeg, size);
+            free(jpeg);
+            return ok;
+        }
+    }
+}
+
+static void* video_writer(void* arg) {
+    OutputVideo* video = (OutputVideo*)arg;
+    pthread_mutex_lock(&video->lock);
+    for (;;) {
+        while (!video->has_pending && !video->finished) pthread_cond_wait(&video->cond, &video->lock);
+        if (!video->has_pending) break;
+        pthread_mutex_unlock(&video->lock);
+        bool ok = write_video_frame(video, video->pending);
+        pthread_mutex_lock(&video->lock);
+        if (!ok) video->ok = false;
+        video->has_pending = false;
+        pthread_cond_broadcast(&video->cond);
+    }
+    pthread_mutex_unlock(&video->lock);
+    return NULL;
+}
+
+static void video_free(OutputVideo* video) {
+    if (video->stream && video->close_stream) fclose(video->stream);
+    image_rgb_free(video->pending);
+    free(video->scratch);
+    free(video);
+}
+
+OutputVideo* output_video_open(const char* filename, int width, int height, const Config* cfg) {
+    OutputVideo* video = (OutputVideo*)calloc(1, sizeof(OutputVideo));
+    if (!video) return NULL;
+    video->format = output_format(filename, cfg);
+    video->width = width;
+    video->height = height;
+    video->jpeg_quality = cfg->jpeg_quality;
+    video->ok = true;
+    bool opened;
+    if (video->format == FORMAT_AVI) {
+        opened = (video->avi = avi_open(filename, width, height, cfg->fps)) != NULL;
+    } else {
+        video->close_stream = !is_stdout(filename);
+        video->stream = video->close_stream ? fopen(filename, "wb") : stdout_stream;
+        size_t scratch = video->format == FORMAT_Y4M ? y4m_frame_size(width, height) : (size_t)width * height * 3;
+        video->scratch = (unsigned char*)malloc(scratch);
+        opened = video->stream && video->scratch &&
+                 (video->format != FORMAT_Y4M || write_y4m_header(video->stream, width, height, cfg->fps));
+    }
+    video->pending = opened ? image_rgb_create(width, height) : NULL;
+    if (!video->pending) {
+        fprintf(stderr, "Error: Could not create %s\n", filename);
+        if (video->avi) avi_close(video->avi);
+        video_free(video);
+        return NULL;
+    }
+    pthread_mutex_init(&video->lock, NULL);
+    pthread_cond_init(&video->cond, NULL);
+    pthread_create(&video->thread, NULL, video_writer, video);
+    return video;
+}
+
+bool output_video_add(OutputVideo* video, const ImageRGB* img) {
+    if (img->width != video->width || img->height != video->height) return false;
+    pthread_mutex_lock(&video->lock);
+    while (video->has_pending) pthread_cond_wait(&video->cond, &video->lock);
+    bool ok = video->ok;
+    if (ok) {
+        memcpy(video->pending->pixels, img->pixels, sizeof(RGB) * (size_t)img->width * img->height);
+        video->has_pending = true;
+        pthread_cond_broadcast(&video->cond);
+    }
+    pthread_mutex_unlock(&video->lock);
+    return ok;
+}
+
+bool output_video_close(OutputVideo* video) {
+    if (!video) return false;
+    pthread_mutex_lock(&video->lock);
+    video->finished = true;
+    pthread_cond_broadcast(&video->cond);
+    pthread_mutex_unlock(&video->lock);
+    pthread_join(video->thread, NULL);
+    pthread_mutex_destroy(&video->lock);
+    pthread_cond_destroy(&video->cond);
+
+    bool ok = video->ok;
+    if (video->avi) {
+        ok = avi_close(video->avi) && ok;
+    } else {
+        if (fflush(video->stream) != 0) ok = false;
+        if (video->close_stream && fclose(video->stream) != 0) ok = false;
+        video->stream = NULL;
+    }
+    video_free(video);
+    return ok;
+}
+
+// A single image to -o -, the stdout kept by output_prepare
+static bool write_image_stdout(OutputFormat format, const ImageRGB* img, const ImageHDR* hdr, const Config* cfg) {
+    FILE* f = stdout_stream;
+    if (!f) return false;
+    bool ok = false;
+    switch (format) {
+        case FORMAT_RGBE:
+            ok = hdr && write_rgbe_stream(f, hdr);
+            break;
+        case FORMAT_XYZV:
+            if (hdr) {
+                XyzvInfo info = {cfg->fov, cfg->env_map};
+                ok = write_xyzv_stream(f, hdr, &info);
+            }
+            break;
+        case FORMAT_PNG:
+            ok = write_png_stream(f, img, cfg->png_bits, cfg->png_level);
+            break;
+        case FORMAT_JPEG:
+            ok = write_jpeg_stream(f, img, cfg->jpeg_quality);
+            break;
+        case FORMAT_PFM:
+            ok = write_pfm_stream(f, img->width, img->height, img->pixels);
+            break;
+        default:
+            break;
+    }
+    return fflush(f) == 0 && ok;
+}
+
+static bool write_image(const char* filename, OutputFormat format, const ImageRGB* img, const ImageHDR* hdr,
+                        const Config* cfg) {
+    bool ok = false;
+    if (format == FORMAT_AVI || format == FORMAT_Y4M || format == FORMAT_PPM) {
+        // A one-frame video
+        OutputVideo* video = output_video_open(filename, img->width, img->height, cfg);
+        if (!video) return false;
+        ok = output_video_add(video, img);
+        ok = output_video_close(video) && ok;
+    } else if (is_stdout(filename)) {
+        ok = write_image_stdout(format, img, hdr, cfg);
+    } else {
+        switch (format) {
+            case FORMAT_RGBE:
+                ok = hdr && write_rgbe(filename, hdr);
+                break;
+            case FORMAT_XYZV:
+                if (hdr) {
+                    XyzvInfo info = {cfg->fov, cfg->env_map};
+                    ok = write_xyzv(filename, hdr, &info);
+                }
+                break;
+            case FORMAT_PNG:
+                ok = write_png(filename, img, cfg->png_bits, cfg->png_level);
+                break;
+            case FORMAT_JPEG:
+                ok = write_jpeg(filename, img, cfg->jpeg_quality);
+                break;
+            default: {
+                FILE* f = fopen(filename, "wb");
+                ok = f && write_pfm_stream(f, img->width, img->height, img->pixels);
+                if (f && fclose(f) != 0) ok = false;
+                break;
+            }
+        }
+    }
+    if (!ok) fprintf(stderr, "Error: Could not write %s\n", filename);
+    return ok;
+}
+
+void output_exposure_filename(char* out, size_t size, const char* filename, float stops) {
+    const char* dot = strrchr(filename, '.');
+    const char* slash = strrchr(filename, '/');
+    if (!dot || (slash && dot < slash)) dot = filename + strlen(filename);
+    snprintf(out, size, "%.*s_ev%+g%s", (int)(dot - filename), filename, stops, dot);
+}
+
+bool output_save_exposures(const char* filename, ImageRGB* const* imgs, const ImageHDR* hdr, const Config* cfg) {
+    int n = config_num_exposures(cfg);
+    if (n == 1 || output_needs_hdr(filename, cfg)) return output_save(filename, imgs[0], hdr, cfg);
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        char name[1024];
+        output_exposure_filename(name, sizeof(name), filename, config_exposure(cfg, i));
+        ok = output_save(name, imgs[i], NULL, cfg) && ok;
+    }
+    return ok;
+}
+
+bool output_save(const char* filename, const ImageRGB* img, const ImageHDR* hdr, const Config* cfg) {
+    OutputFormat format = output_format(filename, cfg);
+    bool ok = write_image(filename, format, img, hdr, cfg);
+    if (cfg->convert_to_png && format == FORMAT_PFM && !is_stdout(filename)) {
+        char png_filename[1024];
+        snprintf(png_filename, sizeof(png_filename), "%s", filename);
+        char* dot = strrchr(png_filename, '.');
+        char* slash = strrchr(png_filename, '/');
+        if (dot && (!slash || dot > slash)) *dot = '\0';
+        size_t len = strlen(png_filename);
+        snprintf(png_filename + len, sizeof(png_filename) - len, ".png");
+        printf("Writing PNG: %s\n", png_filename);
+        ok = write_image(png_filename, FORMAT_PNG, img, NULL, cfg) && ok;
+    }
+    return ok;
+}
+
+struct OutputRows {
+    OutputFormat format;
+    FILE* f;
+    bool close_stream;         // False for stdout
+    char filename[1024];
+    int width, height;
+    int next_row;
+    long header_len;           // FORMAT_PFM
+    PngWriter* png;            // FORMAT_PNG
+    unsigned char* scratch;    // FORMAT_PPM, grown to the largest strip
+    size_t scratch_size;
+    bool ok;
+};
+
+bool output_supports_rows(const char* filename, const Config* cfg) {
+    OutputFormat format = output_format(filename, cfg);
+    if (format == FORMAT_PFM) return !is_stdout(filename);
+    return format == FORMAT_PNG || format == FORMAT_PPM;
+}
+
+OutputRows* output_rows_open(const char* filename, int width, int height, const Config* cfg) {
+    if (!output_supports_rows(filename, cfg)) {
+        fprintf(stderr, "Error: %s cannot be written in strips (use .png, .ppm or .pfm)\n", filename);
+        return NULL;
+    }
+    OutputRows* out = (OutputRows*)calloc(1, sizeof(OutputRows));
+    out->format = output_format(filename, cfg);
+    snprintf(out->filename, sizeof(out->filename), "%s", filename);
+    out->width = width;
+    out->height = height;
+    out->ok = true;
+    if (is_stdout(filename)) {
+        out->f = stdout_stream;
+    } else {
+        out->f = fopen(filename, "wb");
+        out->close_stream = true;
+    }
+    if (out->f) {
+        switch (out->format) {
+            case FORMAT_PNG:
+                out->png = png_writer_open(out->f, width, height, cfg->png_bits, cfg->png_level);
+                out->ok = out->png != NULL;
+                break;
+            case FORMAT_PPM:
+                out->ok = write_ppm_header(out->f, width, height);
+                break;
+            default:
+                // Sized up front so strips can be written in any order
+                out->ok = fprintf(out->f, "PF\n%d %d\n-1.0\n", width, height) > 0;
+                out->header_len = ftell(out->f);
+                if (out->ok && height > 0) {
+                    out->ok = fseek(out->f, out->header_len + (long)height * width * (long)sizeof(RGB) - 1, SEEK_SET) == 0 &&
+                              fputc(0, out->f) != EOF;
+                }
+                break;
+        }
+    }
+    if (!out->f || !out->ok) {
+        fprintf(stderr, "Error: Could not write %s\n", filename);
+        if (out->png) png_writer_close(out->png);
+        if (out->f && out->close_stream) fclose(out->f);
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+bool output_rows_add(OutputRows* out, const ImageRGB* rows) {
+    if (!out->ok) return false;
+    if (rows->width != out->width || out->next_row + rows->height > out->height) {
+        out->ok = false;
+        return false;
+    }
+    int w = rows->width;
+    switch (out->format) {
+        case FORMAT_PNG:
+            for (int y = 0; y < rows->height && out->ok; y++) out->ok = png_writer_row(out->png, rows->pixels + (size_t)y * w);
+            break;
+        case FORMAT_PPM: {
+            size_t size = (size_t)w * rows->height * 3;
+            if (size > out->scratch_size) {
+                free(out->scratch);
+                out->scratch = (unsigned char*)malloc(size);
+                out->scratch_size = out->scratch ? size : 0;
+            }
+            out->ok = out->scratch && write_ppm_rows(out->f, rows, out->scratch);
+            break;
+        }
+        default:
+            // Bottom to top: image row y is file row height - 1 - y
+            for (int y = 0; y < rows->height && out->ok; y++) {
+                long row = out->height - 1 - (out->next_row + y);
+                out->ok = fseek(out->f, out->header_len + row * w * (long)sizeof(RGB), SEEK_SET) == 0 &&
+                          fwrite(rows->pixels + (size_t)y * w, sizeof(RGB), w, out->f) == (size_t)w;
+            }
+            break;
+    }
+    out->next_row += rows->height;
+    return out->ok;
+}
+
+bool output_rows_close(OutputRows* out) {
+    bool ok = out->ok && out->next_row == out->height;
+    if (out->png) ok = png_writer_close(out->png) && ok;
+    if (out->close_stream) {
+        if (fclose(out->f) != 0) ok = false;
+    } else if (fflush(out->f) != 0) {
+        ok = false;
+    }
+    if (!ok) fprintf(stderr, "Error: Could not write %s\n", out->filename);
+    free(out->scratch);
+    free(out);
+    return ok;
+}
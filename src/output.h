@@ -0,0 +1,65 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "config.h"
+#include "tonemap.h"
+
+// Writes a finished frame in the format named by cfg->output_format, or else
+// by the file extension: PNG for .png, JPEG for .jpg/.jpeg, a one-frame Motion
+// JPEG video for .avi, YUV4MPEG2 for .y4m, binary PPM for .ppm, Radiance RGBE
+// for .hdr and a raw XYZV dump for .xyzv, PFM otherwise. The last two store
+// hdr, the radiance before tone mapping; the others img. With
+// cfg->convert_to_png a PFM also gets a PNG of the same name next to it. The
+// file name "-" writes to stdout (see output_prepare). Returns false if a file
+// could not be written.
+bool output_save(const char* filename, const ImageRGB* img, const ImageHDR* hdr, const Config* cfg);
+
+// Checks --format and -o before rendering starts. For -o - it keeps the
+// process's stdout for the images and points stdout at stderr, so messages
+// printed anywhere cannot corrupt the image stream; call it before printing
+// anything. Returns false after printing an error.
+bool output_prepare(const Config* cfg);
+
+// True if output_save needs the radiance buffer for filename
+bool output_needs_hdr(const char* filename, const Config* cfg);
+
+// Saves the images of one frame tone mapped at each of the
+// config_num_exposures(cfg) exposures. With several, each name gets the
+// exposure before its extension (output_exposure_filename); an HDR format
+// stores hdr once under filename. Returns false if a file could not be written.
+bool output_save_exposures(const char* filename, ImageRGB* const* imgs, const ImageHDR* hdr, const Config* cfg);
+
+// filename with _ev<stops> before the extension, e.g. sky_ev+2.png
+void output_exposure_filename(char* out, size_t size, const char* filename, float stops);
+
+// True if filename names a video (.avi) or frame stream (.y4m, .ppm), which
+// holds a whole sequence in one file
+bool output_is_video(const char* filename, const Config* cfg);
+
+// A sequence encoded into one video file as its frames are rendered. Frames
+// are encoded on a writer thread, overlapping the render of the next frame.
+typedef struct OutputVideo OutputVideo;
+
+// Opens a width x height video at cfg->fps. Returns NULL if it cannot be created.
+OutputVideo* output_video_open(const char* filename, int width, int height, const Config* cfg);
+// Queues a copy of img, waiting for the previous frame to be written. Returns
+// false if img has the wrong size or an earlier frame failed to write.
+bool output_video_add(OutputVideo* video, const ImageRGB* img);
+// Finishes and closes the file; returns false if any write failed
+bool output_video_close(OutputVideo* video);
+
+// An image written a strip of rows at a time, for --tile-rows. PNG and PPM
+// rows are written as they come (also to -o -); PFM, which stores its rows
+// bottom to top, is filled in by seeking and so needs a real file.
+typedef struct OutputRows OutputRows;
+
+// True if filename can be written by output_rows_open
+bool output_supports_rows(const char* filename, const Config* cfg);
+// Opens a width x height image. Returns NULL after printing an error.
+OutputRows* output_rows_open(const char* filename, int width, int height, const Config* cfg);
+// Appends the next rows->height rows, which must follow the previous ones
+bool output_rows_add(OutputRows* out, const ImageRGB* rows);
+// Closes the file; returns false if a write failed or rows are missing
+bool output_rows_close(OutputRows* out);
+
+#endif
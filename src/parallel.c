@@ -0,0 +1,59 @@
+#include "parallel.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define PARALLEL_MAX_THREADS 256
+
+typedef struct {
+    ParallelRangeFn fn;
+    void* ctx;
+    int begin, end;
+} ParallelRange;
+
+static void* parallel_worker(void* arg) {
+    ParallelRange* r = (ParallelRange*)arg;
+    r->fn(r->begin, r->end, r->ctx);
+    return NULL;
+}
+
+int parallel_num_threads(void) {
+    const char* env = getenv("KNIGHT_THREADS");
+    int n = env ? atoi(env) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (n < 1) n = 1;
+    if (n > PARALLEL_MAX_THREADS) n = PARALLEL_MAX_THREADS;
+    return n;
+}
+
+void parallel_for(int n, int min_chunk, ParallelRangeFn fn, void* ctx) {
+    if (n <= 0) return;
+    if (min_chunk < 1) min_chunk = 1;
+
+    int threads = parallel_num_threads();
+    if (threads > n / min_chunk) threads = n / min_chunk;
+    if (threads <= 1) {
+        fn(0, n, ctx);
+        return;
+    }
+
+    ParallelRange ranges[PARALLEL_MAX_THREADS];
+    pthread_t tids[PARALLEL_MAX_THREADS];
+    bool spawned[PARALLEL_MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        ranges[t].fn = fn;
+        ranges[t].ctx = ctx;
+        ranges[t].begin = (int)((long long)n * t / threads);
+        ranges[t].end = (int)((long long)n * (t + 1) / threads);
+    }
+
+    // The calling thread takes the first range; if a thread cannot be created its range runs inline.
+    for (int t = 1; t < threads; t++) {
+        spawned[t] = pthread_create(&tids[t], NULL, parallel_worker, &ranges[t]) == 0;
+        if (!spawned[t]) parallel_worker(&ranges[t]);
+    }
+    parallel_worker(&ranges[0]);
+    for (int t = 1; t < threads; t++) {
+        if (spawned[t]) pthread_join(tids[t], NULL);
+    }
+}
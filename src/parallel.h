@@ -0,0 +1,16 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Work function for parallel_for: processes items [begin, end).
+typedef void (*ParallelRangeFn)(int begin, int end, void* ctx);
+
+// Number of worker threads used by parallel_for.
+// Defaults to the number of online CPUs; override with KNIGHT_THREADS.
+int parallel_num_threads(void);
+
+// Splits [0, n) into one contiguous range per thread and runs fn on each.
+// Ranges are never smaller than min_chunk items, so small jobs stay on the calling thread.
+// Returns once every range has been processed.
+void parallel_for(int n, int min_chunk, ParallelRangeFn fn, void* ctx);
+
+#endif
@@ -0,0 +1,280 @@
+#include "pipeline.h"
+#include <pthread.h>
+#include <time.h>
+
+#define PIPELINE_MAX_STAGES 5
+
+typedef struct {
+    int frame;
+    double jd;
+    RenderWork* work;
+    ImageRGB* outputs[CONFIG_MAX_EXPOSURES];
+    ImageHDR* hdr;              // Radiance kept for emit, or NULL
+} PipelineFrame;
+
+// Bounded FIFO between two stages; NULL marks the end of the sequence
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    PipelineFrame* items[PIPELINE_QUEUE_DEPTH];
+    int head, count;
+    double occupancy;           // Frames waiting, integrated over seconds
+    double last_change;
+} FrameQueue;
+
+struct Pipeline;
+typedef bool (*StageFn)(struct Pipeline* p, PipelineFrame* f);
+
+typedef struct {
+    const char* name;
+    StageFn run;
+    FrameQueue* in;             // NULL for the first stage, which makes the frames
+    FrameQueue* out;            // NULL for the last
+    struct Pipeline* pipeline;
+    pthread_t thread;
+    double busy;                // Seconds spent in run
+    int frames;
+} Stage;
+
+typedef struct Pipeline {
+    Scene* scene;
+    const Config* cfg;
+    double start_jd, step_days;
+    int first, end;
+    bool keep_hdr;
+    int num_outputs;
+    PipelineEmitFn emit;
+    void* ctx;
+
+    pthread_mutex_t lock;
+    bool failed;                // Stops the sequence; frames in flight are dropped
+
+    Stage stages[PIPELINE_MAX_STAGES];
+    FrameQueue queues[PIPELINE_MAX_STAGES - 1];
+    int num_stages;
+} Pipeline;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void queue_init(FrameQueue* q, double t) {
+    memset(q, 0, sizeof(FrameQueue));
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->ready, NULL);
+    pthread_cond_init(&q->space, NULL);
+    q->last_change = t;
+}
+
+static void queue_destroy(FrameQueue* q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->ready);
+    pthread_cond_destroy(&q->space);
+}
+
+// Call with the lock held, before count changes
+static void queue_account(FrameQueue* q) {
+    double t = now_seconds();
+    q->occupancy += q->count * (t - q->last_change);
+    q->last_change = t;
+}
+
+static void queue_push(FrameQueue* q, PipelineFrame* f) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == PIPELINE_QUEUE_DEPTH) pthread_cond_wait(&q->space, &q->lock);
+    queue_account(q);
+    q->items[(q->head + q->count) % PIPELINE_QUEUE_DEPTH] = f;
+    q->count++;
+    pthread_cond_signal(&q->ready);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static PipelineFrame* queue_pop(FrameQueue* q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0) pthread_cond_wait(&q->ready, &q->lock);
+    queue_account(q);
+    PipelineFrame* f = q->items[q->head];
+    q->head = (q->head + 1) % PIPELINE_QUEUE_DEPTH;
+    q->count--;
+    pthread_cond_signal(&q->space);
+    pthread_mutex_unlock(&q->lock);
+    return f;
+}
+
+static bool pipeline_failed(Pipeline* p) {
+    pthread_mutex_lock(&p->lock);
+    bool failed = p->failed;
+    pthread_mutex_unlock(&p->lock);
+    return failed;
+}
+
+static void pipeline_fail(Pipeline* p) {
+    pthread_mutex_lock(&p->lock);
+    p->failed = true;
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void frame_free(PipelineFrame* f) {
+    render_work_free(f->work);
+    for (int e = 0; e < CONFIG_MAX_EXPOSURES; e++) image_rgb_free(f->outputs[e]);
+    image_hdr_free(f->hdr);
+    free(f);
+}
+
+static PipelineFrame* frame_create(Pipeline* p, int frame) {
+    const Config* cfg = p->cfg;
+    PipelineFrame* f = (PipelineFrame*)calloc(1, sizeof(PipelineFrame));
+    if (!f) return NULL;
+    f->frame = frame;
+    f->jd = p->start_jd + frame * p->step_days;
+    bool ok = true;
+    for (int e = 0; e < p->num_outputs && ok; e++) {
+        f->outputs[e] = image_rgb_create(cfg->width, cfg->height);
+        ok = f->outputs[e] != NULL;
+    }
+    if (ok && p->keep_hdr) {
+        f->hdr = image_hdr_create(cfg->width, cfg->height);
+        ok = f->hdr != NULL;
+    }
+    if (!ok) {
+        frame_free(f);
+        return NULL;
+    }
+    return f;
+}
+
+static bool run_sky(Pipeline* p, PipelineFrame* f) {
+    f->work = render_stage_sky(p->scene, p->cfg, f->jd, f->hdr);
+    return f->work != NULL;
+}
+
+static bool run_sky_and_stars(Pipeline* p, PipelineFrame* f) {
+    if (!run_sky(p, f)) return false;
+    render_stage_stars(p->scene, p->cfg, f->work);
+    return true;
+}
+
+static bool run_stars(Pipeline* p, PipelineFrame* f) {
+    render_stage_stars(p->scene, p->cfg, f->work);
+    return true;
+}
+
+static bool run_tonemap(Pipeline* p, PipelineFrame* f) {
+    render_stage_tonemap(p->scene, p->cfg, f->work, f->outputs, p->num_outputs);
+    return true;
+}
+
+static bool run_overlays(Pipeline* p, PipelineFrame* f) {
+    render_stage_overlays(p->scene, p->cfg, f->work, f->outputs, p->num_outputs);
+    render_work_free(f->work);
+    f->work = NULL;
+    return true;
+}
+
+static bool run_write(Pipeline* p, PipelineFrame* f) {
+    return p->emit(f->frame, f->outputs, f->hdr, p->ctx);
+}
+
+static void* stage_thread(void* arg) {
+    Stage* st = (Stage*)arg;
+    Pipeline* p = st->pipeline;
+    for (int frame = p->first;; frame++) {
+        PipelineFrame* f = NULL;
+        if (st->in) {
+            f = queue_pop(st->in);
+        } else if (frame < p->end && !pipeline_failed(p)) {
+            f = frame_create(p, frame);
+            if (!f) pipeline_fail(p);
+        }
+        if (!f) break;
+        if (!pipeline_failed(p)) {
+            double t0 = now_seconds();
+            if (!st->run(p, f)) pipeline_fail(p);
+            st->busy += now_seconds() - t0;
+            st->frames++;
+        }
+        if (st->out) queue_push(st->out, f);
+        else frame_free(f);
+    }
+    if (st->out) queue_push(st->out, NULL);
+    return NULL;
+}
+
+static void add_stage(Pipeline* p, const char* name, StageFn run) {
+    Stage* st = &p->stages[p->num_stages];
+    st->name = name;
+    st->run = run;
+    st->pipeline = p;
+    if (p->num_stages > 0) {
+        st->in = &p->queues[p->num_stages - 1];
+        p->stages[p->num_stages - 1].out = st->in;
+    }
+    p->num_stages++;
+}
+
+static void pipeline_report(const Pipeline* p, double elapsed) {
+    int frames = p->stages[p->num_stages - 1].frames;
+    printf("Pipeline: %d frames in %.2f s (%.2f frames/s)\n", frames, elapsed,
+           elapsed > 0 ? frames / elapsed : 0.0);
+    for (int i = 0; i < p->num_stages; i++) {
+        const Stage* st = &p->stages[i];
+        printf("  %-10s busy %7.2f s (%3.0f%%), %.3f s/frame", st->name, st->busy,
+               elapsed > 0 ? 100.0 * st->busy / elapsed : 0.0, st->frames > 0 ? st->busy / st->frames : 0.0);
+        if (st->in) printf(", queue in %.2f of %d frames", elapsed > 0 ? st->in->occupancy / elapsed : 0.0,
+                           PIPELINE_QUEUE_DEPTH);
+        printf("\n");
+    }
+}
+
+bool render_pipeline(Scene* scene, const Config* cfg, double start_jd, double step_days, int first, int end,
+                     bool keep_hdr, PipelineEmitFn emit, void* ctx) {
+    Pipeline p;
+    memset(&p, 0, sizeof(p));
+    p.scene = scene;
+    p.cfg = cfg;
+    p.start_jd = start_jd;
+    p.step_days = step_days;
+    p.first = first;
+    p.end = end;
+    p.keep_hdr = keep_hdr;
+    p.num_outputs = config_num_exposures(cfg);
+    p.emit = emit;
+    p.ctx = ctx;
+    pthread_mutex_init(&p.lock, NULL);
+
+    // The device state is global, so GPU sky and stars stay on one thread
+    if (scene->use_gpu) {
+        add_stage(&p, "sky+stars", run_sky_and_stars);
+    } else {
+        add_stage(&p, "sky", run_sky);
+        add_stage(&p, "stars", run_stars);
+    }
+    add_stage(&p, "tone map", run_tonemap);
+    add_stage(&p, "overlays", run_overlays);
+    add_stage(&p, "write", run_write);
+
+    double start = now_seconds();
+    for (int i = 0; i < p.num_stages - 1; i++) queue_init(&p.queues[i], start);
+    // Consumers first, so a thread that cannot be started leaves only
+    // consumers running, which the end marker then stops
+    int first_started = p.num_stages;
+    while (first_started > 0) {
+        Stage* st = &p.stages[first_started - 1];
+        if (pthread_create(&st->thread, NULL, stage_thread, st) != 0) break;
+        first_started--;
+    }
+    if (first_started > 0) {
+        fprintf(stderr, "Error: Could not start the pipeline threads\n");
+        p.failed = true;
+        if (first_started < p.num_stages) queue_push(&p.queues[first_started - 1], NULL);
+    }
+    for (int i = first_started; i < p.num_stages; i++) pthread_join(p.stages[i].thread, NULL);
+    pipeline_report(&p, now_seconds() - start);
+
+    for (int i = 0; i < p.num_stages - 1; i++) queue_destroy(&p.queues[i]);
+    pthread_mutex_destroy(&p.lock);
+    return !p.failed;
+}
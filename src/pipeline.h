@@ -0,0 +1,34 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "render.h"
+
+// Pipelined sequences. The frames of a sequence pass through stages that each
+// run on their own thread, connected by queues of PIPELINE_QUEUE_DEPTH frames:
+//
+//     sky -> stars -> tone map -> overlays -> write
+//
+// so while frame N is being written, N+1 can be tone mapped and N+2 rendered.
+// The sky stage does the ephemerides and camera and spreads its rows over all
+// cores as usual; the other stages fill the time the cores would otherwise
+// wait for one thread. Every stage sees the frames in order, so exposure
+// adaptation and the output are the same as from a plain loop. With the GPU,
+// the sky and stars share one stage.
+//
+// At the end the busy time of each stage and the mean occupancy of the queue
+// in front of it are printed; the stage busy for most of the run is the
+// bottleneck.
+#define PIPELINE_QUEUE_DEPTH 1
+
+// Receives the tone mapped images of a frame, one per config_exposure, and
+// the radiance if asked for (else NULL). Called on the write stage's thread,
+// in frame order. Returns false to stop the sequence.
+typedef bool (*PipelineEmitFn)(int frame, ImageRGB* const* outputs, const ImageHDR* hdr, void* ctx);
+
+// Renders frames first..end-1 at start_jd + frame * step_days for cfg, which
+// must be a whole frame (no --crop). keep_hdr passes the radiance to emit.
+// Returns false if memory ran out or emit stopped the sequence.
+bool render_pipeline(Scene* scene, const Config* cfg, double start_jd, double step_days, int first, int end,
+                     bool keep_hdr, PipelineEmitFn emit, void* ctx);
+
+#endif
@@ -0,0 +1,312 @@
+#include "png.h"
+#include <stdint.h>
+#include <pthread.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define PNG_IDAT_SIZE 65536
+
+struct PngWriter {
+    FILE* f;
+    int width, height;
+    int bytes_per_pixel;
+    int rows;
+    size_t row_bytes;       // Including the filter type byte
+    unsigned char* row;     // Filtered row being compressed
+    unsigned char idat[PNG_IDAT_SIZE];
+    size_t idat_len;
+    bool ok;
+#ifdef HAVE_ZLIB
+    bool use_zlib;
+    z_stream z;
+#endif
+    // Built-in encoder state
+    uint64_t bits;
+    int num_bits;
+    uint32_t adler_a, adler_b;
+};
+
+// CRC-32 for chunks and the fixed Huffman codes, bit reversed for LSB-first output
+static uint32_t crc_table[256];
+static uint16_t lit_code[288];
+static uint8_t lit_len[288];
+static uint8_t len_symbol[259];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static const uint16_t len_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+static uint16_t reverse_bits(uint16_t code, int len) {
+    uint16_t r = 0;
+    for (int i = 0; i < len; i++) r |= ((code >> i) & 1) << (len - 1 - i);
+    return r;
+}
+
+static void tables_init(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+    // RFC 1951 section 3.2.6
+    for (int s = 0; s < 288; s++) {
+        uint16_t code;
+        int len;
+        if (s < 144) { code = 0x30 + s; len = 8; }
+        else if (s < 256) { code = 0x190 + (s - 144); len = 9; }
+        else if (s < 280) { code = s - 256; len = 7; }
+        else { code = 0xc0 + (s - 280); len = 8; }
+        lit_code[s] = reverse_bits(code, len);
+        lit_len[s] = (uint8_t)len;
+    }
+    // Later symbols win, so 258 gets its own code rather than 227 + 31
+    for (int s = 0; s < 29; s++) {
+        for (int l = len_base[s]; l < len_base[s] + (1 << len_extra[s]) && l <= 258; l++) len_symbol[l] = (uint8_t)s;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const unsigned char* buf, size_t len) {
+    for (size_t i = 0; i < len; i++) crc = crc_table[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static void put_be32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static void write_chunk(PngWriter* w, const char* type, const unsigned char* data, size_t len) {
+    unsigned char head[8], tail[4];
+    put_be32(head, (uint32_t)len);
+    memcpy(head + 4, type, 4);
+    uint32_t crc = crc_update(0xffffffffu, head + 4, 4);
+    crc = crc_update(crc, data, len);
+    put_be32(tail, crc ^ 0xffffffffu);
+    if (fwrite(head, 1, 8, w->f) != 8) w->ok = false;
+    if (len > 0 && fwrite(data, 1, len, w->f) != len) w->ok = false;
+    if (fwrite(tail, 1, 4, w->f) != 4) w->ok = false;
+}
+
+static void flush_idat(PngWriter* w) {
+    if (w->idat_len == 0) return;
+    write_chunk(w, "IDAT", w->idat, w->idat_len);
+    w->idat_len = 0;
+}
+
+// Built-in deflate: one fixed Huffman block, with runs of a repeated byte coded
+// as matches at distance 1 (the Sub filter turns flat areas into runs of zeros)
+static inline void put_byte(PngWriter* w, unsigned char b) {
+    w->idat[w->idat_len++] = b;
+    if (w->idat_len == PNG_IDAT_SIZE) flush_idat(w);
+}
+
+static inline void put_bits(PngWriter* w, uint32_t value, int n) {
+    w->bits |= (uint64_t)value << w->num_bits;
+    w->num_bits += n;
+    while (w->num_bits >= 8) {
+        put_byte(w, (unsigned char)w->bits);
+        w->bits >>= 8;
+        w->num_bits -= 8;
+    }
+}
+
+static inline void put_symbol(PngWriter* w, int s) {
+    put_bits(w, lit_code[s], lit_len[s]);
+}
+
+static void put_match(PngWriter* w, int len) {
+    int s = len_symbol[len];
+    put_symbol(w, 257 + s);
+    if (len_extra[s]) put_bits(w, (uint32_t)(len - len_base[s]), len_extra[s]);
+    put_bits(w, 0, 5); // Distance code 0: distance 1
+}
+
+static void adler_update(PngWriter* w, const unsigned char* buf, size_t len) {
+    while (len > 0) {
+        size_t n = len < 5552 ? len : 5552; // Largest run without overflowing 32 bits
+        for (size_t i = 0; i < n; i++) {
+            w->adler_a += buf[i];
+            w->adler_b += w->adler_a;
+        }
+        w->adler_a %= 65521;
+        w->adler_b %= 65521;
+        buf += n;
+        len -= n;
+    }
+}
+
+static void deflate_rle(PngWriter* w, const unsigned char* buf, size_t n) {
+    adler_update(w, buf, n);
+    size_t i = 0;
+    while (i < n) {
+        unsigned char b = buf[i++];
+        put_symbol(w, b);
+        size_t run = 0;
+        while (i + run < n && buf[i + run] == b && run < 258) run++;
+        if (run >= 3) {
+            put_match(w, (int)run);
+            i += run;
+        }
+    }
+}
+
+PngWriter* png_writer_open(FILE* f, int width, int height, int bit_depth, int level) {
+    if (width <= 0 || height <= 0 || (bit_depth != 8 && bit_depth != 16)) return NULL;
+    pthread_once(&tables_once, tables_init);
+
+    PngWriter* w = (PngWriter*)calloc(1, sizeof(PngWriter));
+    if (!w) return NULL;
+    w->f = f;
+    w->width = width;
+    w->height = height;
+    w->bytes_per_pixel = bit_depth / 8 * 3;
+    w->row_bytes = 1 + (size_t)width * w->bytes_per_pixel;
+    w->row = (unsigned char*)malloc(w->row_bytes);
+    w->ok = w->row != NULL;
+    w->adler_a = 1;
+
+#ifdef HAVE_ZLIB
+    if (w->ok && level > 0) {
+        w->use_zlib = deflateInit(&w->z, level > 9 ? 9 : level) == Z_OK;
+        w->ok = w->use_zlib;
+    }
+#else
+    (void)level;
+#endif
+    if (!w->ok) {
+        free(w->row);
+        free(w);
+        return NULL;
+    }
+
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (fwrite(signature, 1, 8, f) != 8) w->ok = false;
+    unsigned char ihdr[13];
+    put_be32(ihdr, (uint32_t)width);
+    put_be32(ihdr + 4, (uint32_t)height);
+    ihdr[8] = (unsigned char)bit_depth;
+    ihdr[9] = 2;  // Truecolour
+    ihdr[10] = 0; // Deflate
+    ihdr[11] = 0; // Adaptive filtering
+    ihdr[12] = 0; // Not interlaced
+    write_chunk(w, "IHDR", ihdr, sizeof(ihdr));
+    unsigned char gama[4];
+    put_be32(gama, 45455); // 1 / 2.2, as encoded by the tone mapper
+    write_chunk(w, "gAMA", gama, sizeof(gama));
+
+#ifdef HAVE_ZLIB
+    if (w->use_zlib) return w;
+#endif
+    put_byte(w, 0x78); // zlib header: deflate, 32K window, fastest
+    put_byte(w, 0x01);
+    put_bits(w, 0, 1); // Not the final block
+    put_bits(w, 1, 2); // Fixed Huffman codes
+    return w;
+}
+
+static inline float clamp01(float v) {
+    if (!(v > 0.0f)) return 0.0f; // Also catches NaN
+    return v < 1.0f ? v : 1.0f;
+}
+
+bool png_writer_row(PngWriter* w, const RGB* row) {
+    if (w->rows >= w->height) return false;
+    w->rows++;
+
+    unsigned char* p = w->row + 1;
+    if (w->bytes_per_pixel == 3) {
+        for (int x = 0; x < w->width; x++) {
+            *p++ = (unsigned char)(clamp01(row[x].r) * 255.0f + 0.5f);
+            *p++ = (unsigned char)(clamp01(row[x].g) * 255.0f + 0.5f);
+            *p++ = (unsigned char)(clamp01(row[x].b) * 255.0f + 0.5f);
+        }
+    } else {
+        for (int x = 0; x < w->width; x++) {
+            float c[3] = {row[x].r, row[x].g, row[x].b};
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = (unsigned int)(clamp01(c[k]) * 65535.0f + 0.5f);
+                *p++ = (unsigned char)(v >> 8);
+                *p++ = (unsigned char)v;
+            }
+        }
+    }
+    // Sub filter, from the right so every byte still sees its unfiltered neighbour
+    w->row[0] = 1;
+    unsigned char* data = w->row + 1;
+    for (size_t i = w->row_bytes - 2; i + 1 > (size_t)w->bytes_per_pixel; i--) data[i] -= data[i - w->bytes_per_pixel];
+
+#ifdef HAVE_ZLIB
+    if (w->use_zlib) {
+        w->z.next_in = w->row;
+        w->z.avail_in = (uInt)w->row_bytes;
+        while (w->z.avail_in > 0) {
+            w->z.next_out = w->idat + w->idat_len;
+            w->z.avail_out = (uInt)(PNG_IDAT_SIZE - w->idat_len);
+            if (deflate(&w->z, Z_NO_FLUSH) == Z_STREAM_ERROR) {
+                w->ok = false;
+                break;
+            }
+            w->idat_len = PNG_IDAT_SIZE - w->z.avail_out;
+            if (w->idat_len == PNG_IDAT_SIZE) flush_idat(w);
+        }
+        return w->ok;
+    }
+#endif
+    deflate_rle(w, w->row, w->row_bytes);
+    return w->ok;
+}
+
+bool png_writer_close(PngWriter* w) {
+    if (!w) return false;
+    bool complete = w->rows == w->height;
+#ifdef HAVE_ZLIB
+    if (w->use_zlib) {
+        int status;
+        do {
+            w->z.next_out = w->idat + w->idat_len;
+            w->z.avail_out = (uInt)(PNG_IDAT_SIZE - w->idat_len);
+            status = deflate(&w->z, Z_FINISH);
+            w->idat_len = PNG_IDAT_SIZE - w->z.avail_out;
+            if (w->idat_len == PNG_IDAT_SIZE) flush_idat(w);
+        } while (status == Z_OK);
+        if (status != Z_STREAM_END) w->ok = false;
+        deflateEnd(&w->z);
+    } else
+#endif
+    {
+        put_symbol(w, 256); // End of block
+        put_bits(w, 1, 1);  // Empty final block
+        put_bits(w, 1, 2);
+        put_symbol(w, 256);
+        if (w->num_bits > 0) put_bits(w, 0, 8 - w->num_bits);
+        uint32_t adler = (w->adler_b << 16) | w->adler_a;
+        for (int shift = 24; shift >= 0; shift -= 8) put_byte(w, (unsigned char)(adler >> shift));
+    }
+    flush_idat(w);
+    write_chunk(w, "IEND", NULL, 0);
+
+    bool ok = w->ok && complete;
+    free(w->row);
+    free(w);
+    return ok;
+}
+
+bool write_png_stream(FILE* f, const ImageRGB* img, int bit_depth, int level) {
+    PngWriter* w = png_writer_open(f, img->width, img->height, bit_depth, level);
+    if (!w) return false;
+    for (int y = 0; y < img->height; y++) png_writer_row(w, img->pixels + (size_t)y * img->width);
+    return png_writer_close(w);
+}
+
+bool write_png(const char* filename, const ImageRGB* img, int bit_depth, int level) {
+    FILE* f = fopen(filename, "wb");
+    if (!f) return false;
+    setvbuf(f, NULL, _IOFBF, 1 << 16);
+    bool ok = write_png_stream(f, img, bit_depth, level);
+    return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,28 @@
+#ifndef PNG_H
+#define PNG_H
+
+#include "tonemap.h"
+
+// PNG encoder fed one tone-mapped row at a time, so frames go straight from
+// the ImageRGB to disk without a float copy. Pixels are clamped to [0, 1] and
+// stored as 8 or 16 bit RGB with the renderer's 2.2 gamma recorded in gAMA.
+//
+// level 1-9 deflates with zlib at that level when built with HAVE_ZLIB. level
+// 0, or any level without zlib, uses the built-in encoder: fixed Huffman codes
+// with run-length matches, which is fast and still shrinks the dark sky well.
+#define PNG_DEFAULT_LEVEL 6
+
+typedef struct PngWriter PngWriter;
+
+// Writes the header to f. Returns NULL on a write error or bad arguments.
+PngWriter* png_writer_open(FILE* f, int width, int height, int bit_depth, int level);
+// Appends the next row (width pixels, top row first)
+bool png_writer_row(PngWriter* w, const RGB* row);
+// Finishes the image data after the last row and frees w. Does not close f.
+// Returns false if any write failed or fewer than height rows were given.
+bool png_writer_close(PngWriter* w);
+
+bool write_png_stream(FILE* f, const ImageRGB* img, int bit_depth, int level);
+bool write_png(const char* filename, const ImageRGB* img, int bit_depth, int level);
+
+#endif
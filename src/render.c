@@ -0,0 +1,1124 @@
+#include "render.h"
+#include "ephemerides.h"
+#include "atmosphere.h"
+#include "zodiacal.h"
+#include "catalog_merge.h"
+#include "cuda_host.h"
+#include "checkpoint.h"
+#include <strings.h>
+#include <pthread.h>
+
+typedef struct {
+    const Config* cfg;
+    const Atmosphere* atm;
+    const AtmosphereLUT* lut;
+    const Image* moon_tex;
+    Vec3 cam_pos, cam_forward, cam_right, cam_up;
+    float aspect, tan_half_fov;
+    Vec3 sun_dir, moon_dir;
+    Spectrum sun_intensity, moon_intensity;
+    float sun_ecl_lon;
+    double lmst;
+    ImageHDR* hdr;
+    int first_row;  // Frame row of job item 0
+    int col_begin, col_end; // Frame columns to render
+    int col0, row0; // Frame pixel of hdr's first pixel
+    Checkpoint* checkpoint; // Rows of hdr already rendered, and where to save new ones
+    const SkyKeyframes* keys; // Scattered light from these tables instead of marching, if not NULL
+    SkyKeyBody sun_key, moon_key;
+} SkyJob;
+
+// CPU render of sky, ground, moon and sun disk for frame rows
+// [first_row + begin, first_row + end)
+static void render_sky_rows(int begin, int end, LumHistogram* hist, void* ctx) {
+    const SkyJob* job = (const SkyJob*)ctx;
+    const Config cfg = *job->cfg;
+    const Atmosphere atm = *job->atm;
+    const AtmosphereLUT* lut = job->lut;
+    const Image* moon_tex = job->moon_tex;
+    Vec3 cam_pos = job->cam_pos, cam_forward = job->cam_forward;
+    Vec3 cam_right = job->cam_right, cam_up = job->cam_up;
+    float aspect = job->aspect, tan_half_fov = job->tan_half_fov;
+    Vec3 sun_dir = job->sun_dir, moon_dir = job->moon_dir;
+    Spectrum sun_intensity = job->sun_intensity, moon_intensity = job->moon_intensity;
+    float sun_ecl_lon = job->sun_ecl_lon;
+    double lmst = job->lmst;
+    ImageHDR* hdr = job->hdr;
+    int col0 = job->col0, row0 = job->row0;
+    Checkpoint* checkpoint = job->checkpoint;
+    const SkyKeyframes* keys = job->keys;
+
+    for (int y = job->first_row + begin; y < job->first_row + end; y++) {
+        XYZV* row = hdr->pixels + (size_t)(y - row0) * hdr->width;
+        const XYZV* saved = checkpoint ? checkpoint_row(checkpoint, y - row0) : NULL;
+        if (saved) {
+            memcpy(row, saved, sizeof(XYZV) * hdr->width);
+            for (int x = 0; hist && x < hdr->width; x++) lum_hist_add(hist, row[x].Y);
+            continue;
+        }
+        for (int x = job->col_begin; x < job->col_end; x++) {
+            Vec3 dir;
+            if (cfg.env_map) {
+                float az_rad = (float)x / cfg.width * TWO_PI;
+                float alt_rad = (0.5f - (float)y / cfg.height) * PI;
+                dir.x = cosf(alt_rad) * sinf(az_rad);
+                dir.y = sinf(alt_rad);
+                dir.z = cosf(alt_rad) * cosf(az_rad);
+            } else {
+                float u = (2.0f * (x + 0.5f) / cfg.width - 1.0f) * aspect * tan_half_fov;
+                float v = (1.0f - 2.0f * (y + 0.5f) / cfg.height) * tan_half_fov;
+                dir = vec3_add(cam_forward, vec3_add(vec3_mul(cam_right, u), vec3_mul(cam_up, v)));
+                dir = vec3_normalize(dir);
+            }
+            
+            float alpha_atm = 1.0f;
+            Spectrum L;
+            XYZV sky_px = {0, 0, 0, 0};
+            if (keys) {
+                spectrum_zero(&L);
+                sky_px = sky_keyframes_eval(keys, &job->sun_key, &job->moon_key, dir, &alpha_atm);
+            } else {
+                L = atmosphere_render(&atm, lut, cam_pos, dir, sun_dir, &sun_intensity, moon_dir, &moon_intensity, &alpha_atm);
+            }
+            
+            float t_e0, t_e1;
+            if (ray_sphere_intersect(cam_pos, dir, EARTH_RADIUS, &t_e0, &t_e1)) {
+                // Ground Intersection
+                Vec3 p_hit = vec3_add(cam_pos, vec3_mul(dir, t_e0));
+                Vec3 N = vec3_normalize(p_hit); // Normal on sphere
+                
+                Spectrum ground_irradiance;
+                spectrum_zero(&ground_irradiance);
+                
+                // Direct Sun
+                float ndotl_sun = vec3_dot(N, sun_dir);
+                if (ndotl_sun > 0) {
+                    Spectrum t_sun = atmosphere_transmittance(&atm, lut, p_hit, sun_dir);
+                    Spectrum direct_sun = sun_intensity;
+                    spectrum_mul_spec(&direct_sun, &t_sun);
+                    spectrum_mul(&direct_sun, ndotl_sun);
+                    spectrum_add(&ground_irradiance, &direct_sun);
+                }
+                
+                // Direct Moon
+                float ndotl_moon = vec3_dot(N, moon_dir);
+                if (ndotl_moon > 0) {
+                    Spectrum t_moon = atmosphere_transmittance(&atm, lut, p_hit, moon_dir);
+                    Spectrum direct_moon = moon_intensity;
+                    spectrum_mul_spec(&direct_moon, &t_moon);
+                    spectrum_mul(&direct_moon, ndotl_moon);
+                    spectrum_add(&ground_irradiance, &direct_moon);
+                }
+                
+                // Simple Ambient approximation (Hemispherical skylight)
+                Spectrum ambient = sun_intensity; 
+                spectrum_mul(&ambient, 0.0005f * (sun_dir.y > 0 ? sun_dir.y : 0)); // Day ambient
+                
+                Spectrum moon_amb = moon_intensity;
+                spectrum_mul(&moon_amb, 0.0005f * (moon_dir.y > 0 ? moon_dir.y : 0)); // Night ambient
+                
+                spectrum_add(&ambient, &moon_amb);
+                // Add a base low-light ambient (starlight/airglow approx)
+                // Reduced from 1e-4 (Full Moon level) to 2e-7 (Starlight level)
+                Spectrum base_amb; spectrum_set(&base_amb, 2.0e-7f);
+                spectrum_add(&ambient, &base_amb);
+                
+                spectrum_add(&ground_irradiance, &ambient);
+
+                // Lambertian BRDF: Radiance = (Albedo / PI) * Irradiance
+                // Albedo = 0.1 (Asphalt/Dirt)
+                Spectrum ground_rad = ground_irradiance;
+                spectrum_mul(&ground_rad, 0.1f / PI);
+                
+                // Attenuate ground radiance by path to camera
+                spectrum_mul(&ground_rad, alpha_atm);
+                
+                spectrum_add(&L, &ground_rad);
+                alpha_atm = 0.0f; 
+            } else {
+                // Sky / Space View
+                // Add Zodiacal Light (attenuated by atmosphere)
+                if (alpha_atm > 0.0f) {
+                    Spectrum zod = compute_zodiacal_light(dir, sun_dir, sun_ecl_lon, cfg.lat, (float)lmst);
+                    spectrum_mul(&zod, alpha_atm);
+                    spectrum_add(&L, &zod);
+                }
+            }
+
+            if (cfg.render_moon) {
+                float cos_theta_moon = vec3_dot(dir, moon_dir);
+                if (cos_theta_moon > 0.99999f && moon_dir.y > 0) {
+                    Vec3 m_up_vec = {0, 1, 0};
+                    if (fabsf(moon_dir.y) > 0.99f) m_up_vec = (Vec3){0, 0, 1};
+                    Vec3 m_right = vec3_normalize(vec3_cross(m_up_vec, moon_dir));
+                    Vec3 m_actual_up = vec3_cross(moon_dir, m_right);
+                    float dx = vec3_dot(dir, m_right);
+                    float dy = vec3_dot(dir, m_actual_up);
+                    float dist = sqrtf(dx*dx + dy*dy) / 0.0045f;
+                    if (dist <= 1.0f) {
+                        float dz = sqrtf(1.0f - dist*dist);
+                        Vec3 N = vec3_add(vec3_add(vec3_mul(m_right, dx/0.0045f), vec3_mul(m_actual_up, dy/0.0045f)), vec3_mul(moon_dir, -dz));
+                        N = vec3_normalize(N);
+                        float albedo = 0.12f;
+                        
+                        // Fix texture mapping to be local to the moon face
+                        float nx_local = dx / 0.0045f;
+                        float ny_local = dy / 0.0045f;
+                        // Use local coordinates for UV (Center face is 0,0,1 local)
+                        if (moon_tex) albedo = image_sample_bilinear(moon_tex, (atan2f(nx_local, dz) + PI) / TWO_PI, acosf(ny_local) / PI) * 0.2f;
+                        
+                        float ndotl = vec3_dot(N, sun_dir);
+                        if (ndotl < 0) ndotl = 0;
+                        Spectrum moon_disk = sun_intensity;
+                        // Add a small amount of earthshine (0.005) to the shadow side
+                        spectrum_mul(&moon_disk, albedo * (ndotl + 0.005f) * alpha_atm);
+                        spectrum_add(&L, &moon_disk);
+                    }
+                }
+            }
+
+            // Render Sun Disk
+            float cos_theta_sun = vec3_dot(dir, sun_dir);
+            if (cos_theta_sun > 0.99999f && sun_dir.y > -0.02f) {
+                Spectrum sun_disk = sun_intensity;
+                spectrum_mul(&sun_disk, alpha_atm);
+                spectrum_add(&L, &sun_disk);
+            }
+            XYZV px_out = spectrum_to_xyzv(&L);
+            if (keys) {
+                px_out.X += sky_px.X;
+                px_out.Y += sky_px.Y;
+                px_out.Z += sky_px.Z;
+                px_out.V += sky_px.V;
+            }
+            hdr->pixels[(y - row0) * hdr->width + (x - col0)] = px_out;
+            if (hist) lum_hist_add(hist, px_out.Y);
+        }
+        if (checkpoint) checkpoint_store_row(checkpoint, y - row0, row);
+    }
+}
+
+// Files of a scene read on a background thread (scene_load). The parts become
+// ready in ScenePart order and are read-only from then on.
+struct SceneLoader {
+    pthread_t thread;
+    bool threaded;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool ready[SCENE_NUM_PARTS];
+
+    // What to load, copied so cfg need not outlive the load
+    char data_dir[1024];
+    char tycho_dir[1024];
+    char catalog_out_dir[1024];
+    bool render_moon, use_tycho, merge_ybs, outlines;
+    float star_mag_limit, match_tol_arcsec;
+
+    Image* moon_tex;
+    Star* stars;
+    int num_stars;
+    ConstellationBoundary constellations;
+};
+
+static void loader_mark_ready(SceneLoader* l, ScenePart part) {
+    pthread_mutex_lock(&l->lock);
+    l->ready[part] = true;
+    pthread_cond_broadcast(&l->changed);
+    pthread_mutex_unlock(&l->lock);
+}
+
+static Star* load_catalog(const SceneLoader* l, int* count) {
+    char ybs_path[1100];
+    snprintf(ybs_path, sizeof(ybs_path), "%s/ybsc5.dat", l->data_dir);
+    Star* stars = NULL;
+    int num_stars = 0;
+    if (l->use_tycho) {
+        printf("Loading Tycho-2 stars from %s (limit %.1f)...\n", l->tycho_dir, l->star_mag_limit);
+        num_stars = load_stars_tycho(l->tycho_dir, l->star_mag_limit, &stars);
+        if (l->merge_ybs) {
+            Star* ybs = NULL;
+            printf("Loading YBS stars from %s for bright-star photometry...\n", ybs_path);
+            int num_ybs = load_stars(ybs_path, l->star_mag_limit, &ybs);
+            Star* merged = NULL;
+            int num_merged = merge_star_catalogs(ybs, num_ybs, stars, num_stars > 0 ? num_stars : 0, l->match_tol_arcsec, &merged);
+            if (num_merged >= 0) {
+                free(stars);
+                stars = merged;
+                num_stars = num_merged;
+            }
+            free(ybs);
+        }
+    } else {
+        printf("Loading YBS stars from %s (limit %.1f)...\n", ybs_path, l->star_mag_limit);
+        num_stars = load_stars(ybs_path, l->star_mag_limit, &stars);
+    }
+    if (num_stars < 0) num_stars = 0;
+    printf("Loaded %d stars.\n", num_stars);
+    if (l->catalog_out_dir[0] && num_stars > 0) write_stars_tycho(l->catalog_out_dir, stars, num_stars);
+    *count = num_stars;
+    return stars;
+}
+
+static void* loader_thread(void* arg) {
+    SceneLoader* l = (SceneLoader*)arg;
+    char path[1100];
+    if (l->render_moon) {
+        snprintf(path, sizeof(path), "%s/moon_albedo.jpg", l->data_dir);
+        l->moon_tex = image_load_jpeg(path);
+    }
+    loader_mark_ready(l, SCENE_MOON);
+
+    l->stars = load_catalog(l, &l->num_stars);
+    loader_mark_ready(l, SCENE_STARS);
+
+    if (l->outlines) {
+        snprintf(path, sizeof(path), "%s/bound_in_20.txt", l->data_dir);
+        if (load_constellation_boundaries(path, &l->constellations) == 0) {
+            printf("Loaded %d constellation boundary vertices.\n", l->constellations.count);
+        } else {
+            printf("Warning: Could not load constellation boundaries.\n");
+        }
+    }
+    loader_mark_ready(l, SCENE_OUTLINES);
+    return NULL;
+}
+
+// Takes part of the background load into scene, waiting for it if needed.
+// The catalog and outline vertices stay with the loader, shared read-only by
+// every view; the scene gets its own arrays of their directions, which frames
+// turn in place.
+static void scene_wait(Scene* scene, ScenePart part) {
+    SceneLoader* l = scene->loader;
+    if (!l || scene->loaded[part]) return;
+    pthread_mutex_lock(&l->lock);
+    while (!l->ready[part]) pthread_cond_wait(&l->changed, &l->lock);
+    pthread_mutex_unlock(&l->lock);
+    scene->loaded[part] = true;
+
+    if (part == SCENE_MOON) {
+        scene->moon_tex = l->moon_tex;
+    } else if (part == SCENE_STARS && l->num_stars > 0) {
+        scene->star_dirs = (Vec3*)malloc(sizeof(Vec3) * l->num_stars);
+        if (scene->star_dirs) {
+            scene->stars = l->stars;
+            scene->num_stars = l->num_stars;
+        } else {
+            printf("Warning: Out of memory for the star catalog.\n");
+        }
+    } else if (part == SCENE_OUTLINES && l->constellations.count > 0) {
+        scene->constellations = l->constellations;
+        scene->constellations.directions = (Vec3*)malloc(sizeof(Vec3) * l->constellations.count);
+        if (!scene->constellations.directions) {
+            scene->constellations.count = 0;
+            printf("Warning: Out of memory for the constellation outlines.\n");
+        }
+    }
+}
+
+int scene_load(Scene* scene, const Config* cfg) {
+    memset(scene, 0, sizeof(Scene));
+    atmosphere_init_default(&scene->atm, cfg->turbidity);
+    scene->turbidity = cfg->turbidity;
+
+    SceneLoader* l = (SceneLoader*)calloc(1, sizeof(SceneLoader));
+    if (!l) return -1;
+    snprintf(l->data_dir, sizeof(l->data_dir), "%s", cfg->data_dir ? cfg->data_dir : "data");
+    snprintf(l->tycho_dir, sizeof(l->tycho_dir), "%s", cfg->tycho_dir ? cfg->tycho_dir : "");
+    snprintf(l->catalog_out_dir, sizeof(l->catalog_out_dir), "%s", cfg->catalog_out_dir ? cfg->catalog_out_dir : "");
+    l->render_moon = cfg->render_moon;
+    l->use_tycho = cfg->use_tycho;
+    l->merge_ybs = cfg->merge_ybs;
+    // Servers and batches load the outlines up front so any job can switch them on
+    l->outlines = cfg->render_outlines || cfg->serve_socket || cfg->batch_file;
+    l->star_mag_limit = cfg->star_mag_limit;
+    l->match_tol_arcsec = cfg->match_tol_arcsec;
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->changed, NULL);
+    // Without a thread the files are read here, as before
+    l->threaded = pthread_create(&l->thread, NULL, loader_thread, l) == 0;
+    if (!l->threaded) loader_thread(l);
+    scene->loader = l;
+
+    if (strcasecmp(cfg->mode, "gpu") == 0) {
+#ifdef CUDA_ENABLED
+        scene->use_gpu = true;
+        cuda_init();
+#else
+        printf("Warning: CUDA not enabled. Falling back to CPU.\n");
+#endif
+    }
+
+    // Sequences always adapt; single frames only when a state file links the runs
+    scene->adapt_exposure = cfg->seq_start != NULL || cfg->exposure_state_path != NULL;
+    exposure_state_init(&scene->exposure, cfg->adapt_tau_brighten, cfg->adapt_tau_darken);
+    if (cfg->exposure_state_path) exposure_state_load(&scene->exposure, cfg->exposure_state_path);
+    return 0;
+}
+
+void scene_free(Scene* scene) {
+    SceneLoader* l = scene->loader;
+    if (l) {
+        if (l->threaded) pthread_join(l->thread, NULL);
+        image_free(l->moon_tex);
+        free(l->stars);
+        free_constellation_boundaries(&l->constellations);
+        pthread_mutex_destroy(&l->lock);
+        pthread_cond_destroy(&l->changed);
+        free(l);
+    }
+    free(scene->star_dirs);
+    free(scene->constellations.directions);
+    sky_keyframes_free(scene->sky_keys);
+    atmosphere_lut_close(&scene->atm_lut);
+    glare_cache_free(&scene->glare);
+#ifdef CUDA_ENABLED
+    if (scene->use_gpu) cuda_cleanup();
+#endif
+    memset(scene, 0, sizeof(Scene));
+}
+
+bool scene_view_init(Scene* view, const Scene* shared) {
+    *view = *shared;
+    memset(&view->glare, 0, sizeof(view->glare));
+    memset(&view->star_rot, 0, sizeof(view->star_rot));
+    memset(&view->constellation_rot, 0, sizeof(view->constellation_rot));
+    memset(&view->ephemeris, 0, sizeof(view->ephemeris));
+    memset(&view->atm_lut, 0, sizeof(view->atm_lut));
+    view->sky_keys = NULL;
+    view->adapt_exposure = false;
+    // The loaded parts are taken from the shared loader as needed
+    view->moon_tex = NULL;
+    view->stars = NULL;
+    view->star_dirs = NULL;
+    view->num_stars = 0;
+    memset(&view->constellations, 0, sizeof(view->constellations));
+    memset(view->loaded, 0, sizeof(view->loaded));
+    return true;
+}
+
+void scene_view_free(Scene* view) {
+    free(view->star_dirs);
+    free(view->constellations.directions);
+    sky_keyframes_free(view->sky_keys);
+    atmosphere_lut_close(&view->atm_lut);
+    glare_cache_free(&view->glare);
+    memset(view, 0, sizeof(Scene));
+}
+
+static const FrameEphemeris* frame_ephemeris(Scene* scene, double jd, double lat, double lon) {
+    FrameEphemeris* e = &scene->ephemeris;
+    if (e->valid && e->jd == jd && e->lat == lat && e->lon == lon) return e;
+    e->valid = true;
+    e->jd = jd;
+    e->lat = lat;
+    e->lon = lon;
+    sun_rise_set(jd, lat, lon, &e->sunrise, &e->sunset, &e->astro_dawn, &e->astro_dusk);
+    sun_moon_position(jd, lat, lon, &e->sun_dir, &e->moon_dir);
+    e->lmst = local_mean_sidereal_time(greenwich_mean_sidereal_time(jd), lon);
+    e->sun_ecl_lon = (float)get_sun_ecliptic_longitude(jd);
+    planets_position(jd, lat, lon, e->planets);
+    return e;
+}
+
+double jd_to_seconds(double jd) {
+    return (jd - 2451545.0) * 86400.0;
+}
+
+void format_frame_filename(char* out, size_t size, const char* pattern, int index) {
+    // Accept exactly one %d conversion with optional zero padding and width
+    const char* pct = strchr(pattern, '%');
+    if (pct) {
+        const char* p = pct + 1;
+        if (*p == '0') p++;
+        while (*p >= '0' && *p <= '9') p++;
+        if (*p == 'd' && !strchr(p, '%')) {
+            snprintf(out, size, pattern, index);
+            return;
+        }
+    }
+    const char* dot = strrchr(pattern, '.');
+    const char* slash = strrchr(pattern, '/');
+    if (!dot || (slash && dot < slash)) dot = pattern + strlen(pattern);
+    snprintf(out, size, "%.*s_%04d%s", (int)(dot - pattern), pattern, index, dot);
+}
+
+void render_apply_optics(GlareCache* glare, const Config* cfg, ImageHDR* hdr) {
+    // A window of the frame spans that part of the field of view
+    float scale = (float)hdr->width / cfg->width;
+    if (cfg->glare) glare_apply(glare, hdr, cfg->aperture, (cfg->env_map ? 360.0f : cfg->fov) * scale);
+    if (cfg->bloom) apply_glare(hdr, cfg->bloom_size, cfg->fov * scale);
+}
+
+// Camera and lighting of one frame, shared by the full frame and tiled renderers
+typedef struct {
+    const FrameEphemeris* eph;
+    Vec3 sun_dir, moon_dir;
+    float s_alt, s_az, m_alt, m_az;
+    Spectrum sun_intensity, moon_intensity;
+    Vec3 cam_pos, cam_forward, cam_right, cam_up;
+    float aspect, tan_half_fov;
+} FrameView;
+
+// Positions the bodies and the camera for jd. The star catalog and the
+// constellation outlines are turned to jd where they are drawn.
+static void frame_view_setup(Scene* scene, const Config* cfg, double jd, FrameView* v) {
+    if (cfg->turbidity != scene->turbidity) {
+        atmosphere_init_default(&scene->atm, cfg->turbidity);
+        scene->turbidity = cfg->turbidity;
+        sky_keyframes_free(scene->sky_keys);
+        scene->sky_keys = NULL;
+        atmosphere_lut_close(&scene->atm_lut);
+    }
+    const FrameEphemeris* eph = frame_ephemeris(scene, jd, cfg->lat, cfg->lon);
+    v->eph = eph;
+
+    int year, month, day;
+    double hour;
+    julian_day_to_calendar(jd, &year, &month, &day, &hour);
+    printf("Observer Location: Lat %.2f, Lon %.2f\n", cfg->lat, cfg->lon);
+    printf("Simulation Time: %04d-%02d-%02d %02.2f UTC (JD %.2f)\n", year, month, day, hour, jd);
+    
+    double sunrise = eph->sunrise, sunset = eph->sunset;
+    double astro_dawn = eph->astro_dawn, astro_dusk = eph->astro_dusk;
+    if (astro_dawn >= 0) printf("Astro Dawn     : %02d:%02d UTC\n", (int)astro_dawn, (int)((astro_dawn - (int)astro_dawn) * 60));
+    if (sunrise >= 0)    printf("Sunrise        : %02d:%02d UTC\n", (int)sunrise, (int)((sunrise - (int)sunrise) * 60));
+    if (sunset >= 0)     printf("Sunset         : %02d:%02d UTC\n", (int)sunset, (int)((sunset - (int)sunset) * 60));
+    if (astro_dusk >= 0) printf("Astro Dusk     : %02d:%02d UTC\n", (int)astro_dusk, (int)((astro_dusk - (int)astro_dusk) * 60));
+    
+    Vec3 sun_dir = eph->sun_dir, moon_dir = eph->moon_dir;
+    v->sun_dir = sun_dir;
+    v->moon_dir = moon_dir;
+    
+    float s_alt = asinf(sun_dir.y) * RAD2DEG;
+    float s_az = atan2f(sun_dir.x, sun_dir.z) * RAD2DEG;
+    if (s_az < 0) s_az += 360.0f;
+    printf("Sun Position : Alt %6.2f, Az %6.2f\n", s_alt, s_az);
+
+    float m_alt = asinf(moon_dir.y) * RAD2DEG;
+    float m_az = atan2f(moon_dir.x, moon_dir.z) * RAD2DEG;
+    if (m_az < 0) m_az += 360.0f;
+    printf("Moon Position: Alt %6.2f, Az %6.2f\n", m_alt, m_az);
+    v->s_alt = s_alt;
+    v->s_az = s_az;
+    v->m_alt = m_alt;
+    v->m_az = m_az;
+
+    // Zodiacal parameters
+    printf("Sun Ecliptic Lon: %.2f deg\n", eph->sun_ecl_lon);
+
+    const Planet* planets = eph->planets;
+    for (int i=0; i<5; i++) {
+        if (planets[i].alt > 0) {
+            float p_az = planets[i].az * RAD2DEG;
+            if (p_az < 0) p_az += 360.0f;
+            printf("Planet %-8s: Alt %6.2f, Az %6.2f, Mag %5.1f\n", planets[i].name, planets[i].alt*RAD2DEG, p_az, planets[i].vmag);
+        }
+    }
+
+    Spectrum sun_intensity;
+    spectrum_set(&sun_intensity, 100.0f); 
+    
+    Spectrum moon_intensity;
+    float moon_phase_factor = 1.0f;
+    if (cfg->render_moon) {
+        float cos_elong = vec3_dot(sun_dir, moon_dir);
+        float alpha = acosf(-cos_elong);
+        float a2 = alpha * 0.5f;
+        float a4 = alpha * 0.25f;
+        if (alpha < 0.01f) moon_phase_factor = 1.0f;
+        else if (alpha > PI - 0.01f) moon_phase_factor = 0.0f;
+        else moon_phase_factor = (1.0f - sinf(a2) * tanf(a2) * logf(1.0f/tanf(a4)));
+        if (moon_phase_factor < 0) moon_phase_factor = 0;
+        moon_intensity = sun_intensity;
+        spectrum_mul(&moon_intensity, 1.0e-6f * moon_phase_factor); 
+        printf("Moon Phase       : %s (Factor %.3f, Alpha %.1f deg)\n", get_moon_phase_name(jd), moon_phase_factor, alpha * RAD2DEG);
+    } else spectrum_zero(&moon_intensity);
+    v->sun_intensity = sun_intensity;
+    v->moon_intensity = moon_intensity;
+    
+    v->aspect = (float)cfg->width / (float)cfg->height;
+    v->tan_half_fov = tanf(cfg->fov * 0.5f * DEG2RAD);
+    
+    Vec3 cam_pos = {0, EARTH_RADIUS + 10.0f, 0}; 
+    Vec3 cam_forward;
+    float final_cam_alt, final_cam_az;
+
+    if (cfg->track_body) {
+        bool found = false;
+        if (strcasecmp(cfg->track_body, "sun") == 0) {
+            final_cam_alt = s_alt;
+            final_cam_az = s_az;
+            cam_forward = sun_dir;
+            found = true;
+        } else if (strcasecmp(cfg->track_body, "moon") == 0) {
+            if (!cfg->render_moon) printf("Warning: Tracking Moon but moon rendering is disabled.\n");
+            final_cam_alt = m_alt;
+            final_cam_az = m_az;
+            cam_forward = moon_dir;
+            found = true;
+        } else {
+            for (int i=0; i<5; i++) {
+                if (strcasecmp(cfg->track_body, planets[i].name) == 0) {
+                    final_cam_alt = planets[i].alt * RAD2DEG;
+                    final_cam_az = planets[i].az * RAD2DEG;
+                    if (final_cam_az < 0) final_cam_az += 360.0f;
+                    cam_forward = planets[i].direction;
+                    found = true;
+                    break;
+                }
+            }
+        }
+        
+        if (found) {
+            printf("Tracking body: %s at Alt %.2f, Az %.2f\n", cfg->track_body, final_cam_alt, final_cam_az);
+        } else {
+            printf("Warning: Celestial body '%s' not found. Using defaults.\n", cfg->track_body);
+            final_cam_alt = cfg->cam_alt;
+            final_cam_az = cfg->cam_az;
+            float rad_az = final_cam_az * DEG2RAD;
+            float rad_alt = final_cam_alt * DEG2RAD;
+            cam_forward.x = cosf(rad_alt) * sinf(rad_az);
+            cam_forward.y = sinf(rad_alt);
+            cam_forward.z = cosf(rad_alt) * cosf(rad_az);
+        }
+    } else if (!cfg->custom_cam && moon_dir.y > 0) {
+        cam_forward = moon_dir; 
+        final_cam_alt = m_alt;
+        final_cam_az = m_az;
+        printf("Tracking Moon position (default).\n");
+    } else {
+        final_cam_alt = cfg->cam_alt;
+        final_cam_az = cfg->cam_az;
+        float rad_az = final_cam_az * DEG2RAD;
+        float rad_alt = final_cam_alt * DEG2RAD;
+        cam_forward.x = cosf(rad_alt) * sinf(rad_az);
+        cam_forward.y = sinf(rad_alt);
+        cam_forward.z = cosf(rad_alt) * cosf(rad_az);
+    }
+    printf("Viewer Position: Alt %6.2f, Az %6.2f\n", final_cam_alt, final_cam_az);
+    cam_forward = vec3_normalize(cam_forward);
+    
+    Vec3 world_up = {0, 1, 0};
+    if (fabsf(cam_forward.y) > 0.99f) world_up = (Vec3){0, 0, 1};
+    v->cam_pos = cam_pos;
+    v->cam_forward = cam_forward;
+    v->cam_right = vec3_normalize(vec3_cross(world_up, cam_forward));
+    v->cam_up = vec3_cross(cam_forward, v->cam_right);
+}
+
+// The GPU is only used for whole frames
+static bool gpu_window(const Scene* scene, const Config* cfg, const ImageHDR* hdr, int col0, int row0) {
+    return scene->use_gpu && col0 == 0 && row0 == 0 && hdr->width == cfg->width && hdr->height == cfg->height;
+}
+
+// The --sky-keyframes tables for the frame view v, with the keyframes of its
+// Sun and Moon in sun and moon, or NULL to march every pixel
+static const SkyKeyframes* frame_sky_keys(Scene* scene, const Config* cfg, const FrameView* v, SkyKeyBody* sun,
+                                          SkyKeyBody* moon) {
+    if (cfg->sky_keyframe_error <= 0 || !scene->atm_lut.table) return NULL;
+    float tolerance = cfg->sky_keyframe_error / 100.0f;
+    float cam_radius = v->cam_pos.y;
+    if (scene->sky_keys && !sky_keyframes_match(scene->sky_keys, cam_radius, &v->sun_intensity, tolerance)) {
+        sky_keyframes_free(scene->sky_keys);
+        scene->sky_keys = NULL;
+    }
+    if (!scene->sky_keys) {
+        scene->sky_keys = sky_keyframes_create(&scene->atm, &scene->atm_lut, cam_radius, &v->sun_intensity, tolerance);
+    }
+    SkyKeyframes* keys = scene->sky_keys;
+    // Moonlight is sunlight scaled by the phase
+    float moon_scale = v->sun_intensity.s[0] > 0 ? v->moon_intensity.s[0] / v->sun_intensity.s[0] : 0.0f;
+    int before = keys ? sky_keyframes_count(keys) : 0;
+    if (!keys || !sky_keyframes_prepare(keys, v->sun_dir, 1.0f, sun) ||
+        !sky_keyframes_prepare(keys, v->moon_dir, moon_scale, moon)) {
+        printf("Warning: Out of memory for the sky keyframes.\n");
+        return NULL;
+    }
+    printf("Sky keyframes: %d (%d new)\n", sky_keyframes_count(keys), sky_keyframes_count(keys) - before);
+    return keys;
+}
+
+// Sky, ground, Moon and Sun of the frame window with its top left pixel at
+// (col0, row0), into hdr, which must be black. Pixels outside the frame stay
+// black. checkpoint, if given, covers the rows of hdr; it is used on the CPU
+// only.
+static void render_sky(Scene* scene, const Config* cfg, const FrameView* v, ImageHDR* hdr, int col0, int row0,
+                       Checkpoint* checkpoint) {
+    scene_wait(scene, SCENE_MOON);
+    const Atmosphere* atm = &scene->atm;
+    const Image* moon_tex = scene->moon_tex;
+    bool use_gpu = gpu_window(scene, cfg, hdr, col0, row0);
+    Vec3 cam_pos = v->cam_pos, cam_forward = v->cam_forward;
+    Vec3 cam_right = v->cam_right, cam_up = v->cam_up;
+    float aspect = v->aspect, tan_half_fov = v->tan_half_fov;
+    int row_begin = row0 > 0 ? row0 : 0;
+    int row_end = row0 + hdr->height < cfg->height ? row0 + hdr->height : cfg->height;
+    int col_begin = col0 > 0 ? col0 : 0;
+    int col_end = col0 + hdr->width < cfg->width ? col0 + hdr->width : cfg->width;
+
+    printf("Rendering Atmosphere...\n");
+
+    if (use_gpu) {
+#ifdef CUDA_ENABLED
+        printf("Using GPU for rendering.\n");
+        unsigned char* moon_data = moon_tex ? moon_tex->data : NULL;
+        int moon_w = moon_tex ? moon_tex->width : 0;
+        int moon_h = moon_tex ? moon_tex->height : 0;
+        
+        bool ok = cuda_render_frame(
+            cfg->width, cfg->height, atm,
+            cam_pos, cam_forward, cam_right, cam_up,
+            cfg->fov, aspect,
+            v->sun_dir, &v->sun_intensity,
+            v->moon_dir, &v->moon_intensity,
+            v->eph->sun_ecl_lon, cfg->lat, (float)v->eph->lmst,
+            cfg->env_map,
+            moon_data, moon_w, moon_h,
+            hdr->pixels
+        );
+        if (!ok) {
+            printf("GPU Rendering failed.\n");
+        }
+        // The device does not track luminance; count the frame once on the host
+        if (hdr->hist) lum_hist_from_image(hdr->hist, hdr);
+#endif
+    } else if (row_end > row_begin && col_end > col_begin) {
+        if (!scene->atm_lut.table) {
+            char dir[1024];
+            if (!atmosphere_lut_open(&scene->atm_lut, atm, atmosphere_cache_dir(dir, sizeof(dir)))) {
+                printf("Warning: Out of memory for the atmosphere table.\n");
+            }
+        }
+        SkyKeyBody sun_key, moon_key;
+        const SkyKeyframes* keys = frame_sky_keys(scene, cfg, v, &sun_key, &moon_key);
+        // CPU Rendering Loop, split by rows over worker threads
+        SkyJob sky = {
+            cfg, atm, scene->atm_lut.table ? &scene->atm_lut : NULL, moon_tex,
+            cam_pos, cam_forward, cam_right, cam_up,
+            aspect, tan_half_fov,
+            v->sun_dir, v->moon_dir,
+            v->sun_intensity, v->moon_intensity,
+            v->eph->sun_ecl_lon, v->eph->lmst,
+            hdr, row_begin, col_begin, col_end, col0, row0, checkpoint,
+            keys, sun_key, moon_key
+        };
+        parallel_for_hist(row_end - row_begin, 4, hdr->hist, render_sky_rows, &sky);
+    }
+}
+
+// Stars and planets of the window, added to the sky in hdr. The catalog is
+// turned to the frame's time first.
+static void render_points(Scene* scene, const Config* cfg, const FrameView* v, ImageHDR* hdr, int col0, int row0) {
+    scene_wait(scene, SCENE_STARS);
+    const Star* stars = scene->stars;
+    Vec3* dirs = scene->star_dirs;
+    int num_stars = scene->num_stars;
+    bool use_gpu = gpu_window(scene, cfg, hdr, col0, row0);
+    const Planet* planets = v->eph->planets;
+    Vec3 cam_pos = v->cam_pos, cam_forward = v->cam_forward;
+    Vec3 cam_right = v->cam_right, cam_up = v->cam_up;
+    float aspect = v->aspect, tan_half_fov = v->tan_half_fov;
+    int row_begin = row0 > 0 ? row0 : 0;
+    int row_end = row0 + hdr->height < cfg->height ? row0 + hdr->height : cfg->height;
+    int col_begin = col0 > 0 ? col0 : 0;
+    int col_end = col0 + hdr->width < cfg->width ? col0 + hdr->width : cfg->width;
+
+    if (num_stars > 0) {
+        star_directions_advance(&scene->star_rot, v->eph->jd, cfg->lat, cfg->lon, stars, dirs, num_stars);
+        printf("Rendering Stars...\n");
+        
+        RenderCamera rcam;
+        rcam.width = cfg->width;
+        rcam.height = cfg->height;
+        rcam.aspect = aspect;
+        rcam.tan_half_fov = tan_half_fov;
+        rcam.pos = cam_pos;
+        rcam.forward = cam_forward;
+        rcam.up = cam_up;
+        rcam.right = cam_right;
+        rcam.env_map = cfg->env_map;
+
+        if (use_gpu) {
+#ifdef CUDA_ENABLED
+            if (cuda_upload_stars(stars, dirs, num_stars)) {
+                cuda_render_stars(cfg->width, cfg->height, &rcam, cfg->aperture, hdr->pixels);
+                if (hdr->hist) lum_hist_from_image(hdr->hist, hdr);
+            } else {
+                printf("Warning: GPU star upload failed. Falling back to CPU for stars.\n");
+                render_stars_window(stars, dirs, num_stars, &rcam, cfg->aperture, hdr, 0, 0);
+            }
+#endif
+        } else {
+            render_stars_window(stars, dirs, num_stars, &rcam, cfg->aperture, hdr, col0, row0);
+        }
+    }
+
+    printf("Rendering Planets...\n");
+    for (int i = 0; i < 5; i++) {
+        Planet p = planets[i];
+        if (p.alt <= 0) continue;
+        float px, py;
+        if (cfg->env_map) {
+            float p_az_deg = atan2f(p.direction.x, p.direction.z) * RAD2DEG;
+            if (p_az_deg < 0) p_az_deg += 360.0f;
+            px = (p_az_deg / 360.0f) * cfg->width;
+            py = (90.0f - p.alt*RAD2DEG) / 180.0f * cfg->height;
+        } else {
+            float dz = vec3_dot(p.direction, cam_forward);
+            if (dz <= 0) continue; 
+            px = (vec3_dot(p.direction, cam_right) / dz / (aspect * tan_half_fov) + 1.0f) * 0.5f * cfg->width;
+            py = (1.0f - vec3_dot(p.direction, cam_up) / dz / tan_half_fov) * 0.5f * cfg->height;
+        }
+        if (px >= col_begin && px < col_end && py >= row_begin && py < row_end) {
+            float t0, t1;
+            if (ray_sphere_intersect(cam_pos, p.direction, EARTH_RADIUS, &t0, &t1)) continue;
+            float solid_angle = cfg->env_map ? (TWO_PI/cfg->width)*(PI/cfg->height)*cosf(p.alt) : (4.0f*tan_half_fov*tan_half_fov*aspect)/(cfg->width*cfg->height);
+            float radiance = powf(10.0f, -0.4f * p.vmag) * 2.0e-5f / (solid_angle + 1e-12f);
+            float T = expf(-0.1f / (p.direction.y + 0.01f)); 
+            int idx = ((int)py - row0) * hdr->width + ((int)px - col0);
+            float old_Y = hdr->pixels[idx].Y;
+            hdr->pixels[idx].Y += radiance * T; hdr->pixels[idx].X += radiance * T; 
+            hdr->pixels[idx].Z += radiance * T; hdr->pixels[idx].V += radiance * T; 
+            if (hdr->hist) lum_hist_update(hdr->hist, old_Y, hdr->pixels[idx].Y);
+        }
+    }
+}
+
+// Renders the radiance of the frame window with its top left pixel at (col0,
+// row0) into hdr, which must be black
+static void render_radiance(Scene* scene, const Config* cfg, const FrameView* v, ImageHDR* hdr, int col0, int row0) {
+    render_sky(scene, cfg, v, hdr, col0, row0, NULL);
+    render_points(scene, cfg, v, hdr, col0, row0);
+}
+
+// The metered luminance of lit, adapted over time when the scene adapts
+static float frame_exposure(Scene* scene, const Config* cfg, double jd, const ImageHDR* lit, float* max_Y) {
+    float L_avg = tonemap_meter(lit, max_Y);
+    if (scene->adapt_exposure) {
+        float metered = L_avg;
+        L_avg = exposure_adapt(&scene->exposure, jd_to_seconds(jd), metered);
+        printf("Adapted L_avg: %e (metered %e)\n", L_avg, metered);
+        if (cfg->exposure_state_path && !exposure_state_save(&scene->exposure, cfg->exposure_state_path)) {
+            printf("Warning: Could not write exposure state to %s\n", cfg->exposure_state_path);
+        }
+    }
+    return L_avg;
+}
+
+// Labels and constellation outlines on a tone mapped frame, or on the window
+// of it with its top left pixel at (x0, y0)
+static void annotate(Scene* scene, const Config* cfg, const FrameView* v, ImageRGB* output, int x0, int y0) {
+    scene_wait(scene, SCENE_OUTLINES);
+    ConstellationBoundary* constellations = &scene->constellations;
+    if (constellations->count > 0) {
+        constellation_horizon_advance(&scene->constellation_rot, v->eph->jd, cfg->lat, cfg->lon, constellations);
+    }
+    const Planet* planets = v->eph->planets;
+    Vec3 sun_dir = v->sun_dir, moon_dir = v->moon_dir;
+    Vec3 cam_forward = v->cam_forward, cam_right = v->cam_right, cam_up = v->cam_up;
+    float aspect = v->aspect, tan_half_fov = v->tan_half_fov;
+    float s_alt = v->s_alt, s_az = v->s_az, m_alt = v->m_alt, m_az = v->m_az;
+    DrawTarget target = {output, x0, y0, cfg->width, cfg->height};
+
+    if (cfg->label_bodies) {
+        printf("Labeling Celestial Bodies...\n");
+        // Label Planets
+        for (int i = 0; i < 5; i++) {
+            Planet p = planets[i];
+            if (p.alt <= 0) continue;
+            float px, py;
+            if (cfg->env_map) {
+                float p_az_deg = atan2f(p.direction.x, p.direction.z) * RAD2DEG;
+                if (p_az_deg < 0) p_az_deg += 360.0f;
+                px = (p_az_deg / 360.0f) * cfg->width;
+                py = (90.0f - p.alt*RAD2DEG) / 180.0f * cfg->height;
+            } else {
+                float dz = vec3_dot(p.direction, cam_forward);
+                if (dz <= 0) continue; 
+                px = (vec3_dot(p.direction, cam_right) / dz / (aspect * tan_half_fov) + 1.0f) * 0.5f * cfg->width;
+                py = (1.0f - vec3_dot(p.direction, cam_up) / dz / tan_half_fov) * 0.5f * cfg->height;
+            }
+            if (px >= 0 && px < cfg->width && py >= 0 && py < cfg->height) {
+                draw_label_offset(&target, (int)px, (int)py, 8, p.name, cfg->label_color);
+            }
+        }
+        // Label Sun
+        if (s_alt > 0) {
+            float px, py;
+            if (cfg->env_map) {
+                px = (s_az / 360.0f) * cfg->width;
+                py = (90.0f - s_alt) / 180.0f * cfg->height;
+            } else {
+                float dz = vec3_dot(sun_dir, cam_forward);
+                if (dz > 0) {
+                    px = (vec3_dot(sun_dir, cam_right) / dz / (aspect * tan_half_fov) + 1.0f) * 0.5f * cfg->width;
+                    py = (1.0f - vec3_dot(sun_dir, cam_up) / dz / tan_half_fov) * 0.5f * cfg->height;
+                    if (px >= 0 && px < cfg->width && py >= 0 && py < cfg->height) {
+                        draw_label_offset(&target, (int)px, (int)py, 8, "Sun", cfg->label_color);
+                    }
+                }
+            }
+        }
+        // Label Moon
+        if (cfg->render_moon && m_alt > 0) {
+            float px, py;
+            if (cfg->env_map) {
+                px = (m_az / 360.0f) * cfg->width;
+                py = (90.0f - m_alt) / 180.0f * cfg->height;
+            } else {
+                float dz = vec3_dot(moon_dir, cam_forward);
+                if (dz > 0) {
+                    px = (vec3_dot(moon_dir, cam_right) / dz / (aspect * tan_half_fov) + 1.0f) * 0.5f * cfg->width;
+                    py = (1.0f - vec3_dot(moon_dir, cam_up) / dz / tan_half_fov) * 0.5f * cfg->height;
+                    if (px >= 0 && px < cfg->width && py >= 0 && py < cfg->height) {
+                        draw_label_offset(&target, (int)px, (int)py, 8, "Moon", cfg->label_color);
+                    }
+                }
+            }
+        }
+    }
+
+    if (cfg->render_outlines && constellations->count > 0) {
+        printf("Drawing Constellation Outlines and Labels...\n");
+        draw_constellation_outlines(&target, constellations, cam_forward, cam_up, cam_right, tan_half_fov, aspect, cfg->env_map, cfg->outline_color);
+        draw_constellation_labels(&target, constellations, cam_forward, cam_up, cam_right, tan_half_fov, aspect, cfg->env_map, cfg->outline_color);
+    }
+}
+
+// The exposure pre-pass of cfg's frame: the frame at most RENDER_PREPASS_WIDTH
+// wide. The meter ignores the brightest pixels, so point sources whose
+// per-pixel radiance depends on the resolution barely move it. Diffraction
+// glare is left out of a reduced pre-pass, since its kernels would be built
+// for a throwaway size.
+static Config prepass_config(const Config* cfg) {
+    Config pre = *cfg;
+    if (cfg->width > RENDER_PREPASS_WIDTH) {
+        pre.width = RENDER_PREPASS_WIDTH;
+        pre.height = (int)((double)cfg->height * RENDER_PREPASS_WIDTH / cfg->width + 0.5);
+        if (pre.height < 1) pre.height = 1;
+        pre.glare = false;
+    }
+    return pre;
+}
+
+// Tone mapping of the whole frame for renders that never hold all of it,
+// metered on the pre-pass like a whole frame
+static bool prepass_exposure(Scene* scene, const Config* cfg, double jd, const FrameView* view, int num_outputs,
+                             ToneParams* tone) {
+    Config pre = prepass_config(cfg);
+    printf("Exposure pre-pass at %dx%d...\n", pre.width, pre.height);
+    ImageHDR* small = image_hdr_create(pre.width, pre.height);
+    if (!small) return false;
+    image_hdr_track_histogram(small);
+    render_radiance(scene, &pre, view, small, 0, 0);
+    render_apply_optics(&scene->glare, &pre, small);
+    float max_Y = 0;
+    float L_avg = frame_exposure(scene, cfg, jd, small, &max_Y);
+    image_hdr_free(small);
+    for (int e = 0; e < num_outputs; e++) tonemap_params_from_luminance(L_avg, max_Y, config_exposure(cfg, e), &tone[e]);
+    return true;
+}
+
+// Copies the window of src that starts offset pixels in from its top left
+// corner and has dst's size
+static void copy_window(const ImageHDR* src, int offset, ImageHDR* dst) {
+    for (int y = 0; y < dst->height; y++) {
+        memcpy(dst->pixels + (size_t)y * dst->width, src->pixels + (size_t)(y + offset) * src->width + offset,
+               sizeof(XYZV) * dst->width);
+    }
+}
+
+// --crop: the window is rendered with a margin of the pixels the optics
+// spread light from, then exposed like the whole frame. Returns false if out
+// of memory.
+static bool render_frame_crop(Scene* scene, const Config* cfg, double jd, ImageRGB* const* outputs, int num_outputs,
+                              ImageHDR* hdr_out) {
+    int w, h;
+    config_image_size(cfg, &w, &h);
+    FrameView view;
+    frame_view_setup(scene, cfg, jd, &view);
+    ToneParams tone[CONFIG_MAX_EXPOSURES];
+    if (!prepass_exposure(scene, cfg, jd, &view, num_outputs, tone)) return false;
+
+    int margin = render_optics_reach(cfg, cfg->width, cfg->height);
+    printf("Rendering crop %dx%d at %d,%d (margin %d)...\n", w, h, cfg->crop_x, cfg->crop_y, margin);
+    ImageHDR* window = image_hdr_create(w + 2 * margin, h + 2 * margin);
+    ImageHDR* crop = margin > 0 ? image_hdr_create(w, h) : window;
+    bool ok = window && crop;
+    if (ok) {
+        render_radiance(scene, cfg, &view, window, cfg->crop_x - margin, cfg->crop_y - margin);
+        if (hdr_out) copy_window(window, margin, hdr_out);
+        render_apply_optics(&scene->glare, cfg, window);
+        if (crop != window) copy_window(window, margin, crop);
+        printf("Tone Mapping...\n");
+        for (int e = 0; e < num_outputs; e++) {
+            tonemap_apply(crop, outputs[e], &tone[e]);
+            annotate(scene, cfg, &view, outputs[e], cfg->crop_x, cfg->crop_y);
+        }
+    }
+    if (crop != window) image_hdr_free(crop);
+    image_hdr_free(window);
+    return ok;
+}
+
+struct RenderWork {
+    double jd;
+    FrameEphemeris eph;     // The scene's copy moves on to later frames
+    FrameView view;
+    ImageHDR* hdr;
+    bool keep_radiance;     // hdr is the caller's, left as rendered
+    ImageHDR* meter;        // Pre-pass of a frame wider than RENDER_PREPASS_WIDTH
+};
+
+RenderWork* render_stage_sky(Scene* scene, const Config* cfg, double jd, ImageHDR* hdr_out) {
+    RenderWork* work = (RenderWork*)calloc(1, sizeof(RenderWork));
+    if (!work) return NULL;
+    work->jd = jd;
+    frame_view_setup(scene, cfg, jd, &work->view);
+    work->eph = *work->view.eph;
+    work->view.eph = &work->eph;
+
+    work->keep_radiance = hdr_out != NULL;
+    work->hdr = hdr_out;
+    if (work->hdr) memset(work->hdr->pixels, 0, sizeof(XYZV) * cfg->width * cfg->height);
+    else work->hdr = image_hdr_create(cfg->width, cfg->height);
+    if (cfg->width > RENDER_PREPASS_WIDTH) {
+        work->meter = image_hdr_create(RENDER_PREPASS_WIDTH, prepass_config(cfg).height);
+        if (work->meter) image_hdr_track_histogram(work->meter);
+    }
+    if (!work->hdr || (cfg->width > RENDER_PREPASS_WIDTH && !work->meter)) {
+        render_work_free(work);
+        return NULL;
+    }
+    image_hdr_track_histogram(work->hdr);
+    Checkpoint* checkpoint = NULL;
+    if (cfg->checkpoint_path && scene->use_gpu) printf("Note: --checkpoint is not used by the GPU renderer\n");
+    if (cfg->checkpoint_path && !scene->use_gpu) {
+        checkpoint = checkpoint_open(cfg->checkpoint_path, checkpoint_key(cfg, jd), cfg->width, cfg->height,
+                                     cfg->resume);
+        if (checkpoint && cfg->resume) {
+            printf("Resuming: %d of %d rows from %s\n", checkpoint_rows_done(checkpoint), cfg->height,
+                   cfg->checkpoint_path);
+        }
+    }
+    render_sky(scene, cfg, &work->view, work->hdr, 0, 0, checkpoint);
+    checkpoint_close(checkpoint);
+    if (work->meter) {
+        Config pre = prepass_config(cfg);
+        printf("Exposure pre-pass at %dx%d...\n", pre.width, pre.height);
+        render_sky(scene, &pre, &work->view, work->meter, 0, 0, NULL);
+    }
+    return work;
+}
+
+void render_stage_stars(Scene* scene, const Config* cfg, RenderWork* work) {
+    render_points(scene, cfg, &work->view, work->hdr, 0, 0);
+    if (work->meter) {
+        Config pre = prepass_config(cfg);
+        render_points(scene, &pre, &work->view, work->meter, 0, 0);
+    }
+}
+
+void render_stage_tonemap(Scene* scene, const Config* cfg, RenderWork* work, ImageRGB* const* outputs,
+                          int num_outputs) {
+    printf("Tone Mapping...\n");
+    // A kept radiance buffer stays as rendered, so the optics work on a copy
+    ImageHDR* lit = work->hdr;
+    if (work->keep_radiance && (cfg->glare || cfg->bloom)) {
+        lit = image_hdr_copy(work->hdr);
+        if (!lit) lit = work->hdr;
+    }
+    render_apply_optics(&scene->glare, cfg, lit);
+    // Frames wider than the pre-pass are metered on it, as crops and strips
+    // of them are, so all of them get the same exposure
+    const ImageHDR* metered = lit;
+    if (work->meter) {
+        Config pre = prepass_config(cfg);
+        render_apply_optics(&scene->glare, &pre, work->meter);
+        metered = work->meter;
+    }
+    float max_Y = 0;
+    float L_avg = frame_exposure(scene, cfg, work->jd, metered, &max_Y);
+
+    // Every exposure comes from the same metering, so they differ by exactly their boost
+    for (int e = 0; e < num_outputs; e++) {
+        ToneParams tone;
+        tonemap_params_from_luminance(L_avg, max_Y, config_exposure(cfg, e), &tone);
+        tonemap_apply(lit, outputs[e], &tone);
+    }
+    if (lit != work->hdr) image_hdr_free(lit);
+    if (!work->keep_radiance) {
+        image_hdr_free(work->hdr);
+        work->hdr = NULL;
+    }
+    image_hdr_free(work->meter);
+    work->meter = NULL;
+}
+
+void render_stage_overlays(Scene* scene, const Config* cfg, RenderWork* work, ImageRGB* const* outputs,
+                           int num_outputs) {
+    for (int e = 0; e < num_outputs; e++) annotate(scene, cfg, &work->view, outputs[e], 0, 0);
+}
+
+void render_work_free(RenderWork* work) {
+    if (!work) return;
+    if (!work->keep_radiance) image_hdr_free(work->hdr);
+    image_hdr_free(work->meter);
+    free(work);
+}
+
+bool render_frame(Scene* scene, const Config* cfg, double jd, ImageRGB* const* outputs, int num_outputs, ImageHDR* hdr_out) {
+    if (cfg->crop_width > 0) return render_frame_crop(scene, cfg, jd, outputs, num_outputs, hdr_out);
+    RenderWork* work = render_stage_sky(scene, cfg, jd, hdr_out);
+    if (!work) return false;
+    render_stage_stars(scene, cfg, work);
+    render_stage_tonemap(scene, cfg, work, outputs, num_outputs);
+    render_stage_overlays(scene, cfg, work, outputs, num_outputs);
+    render_work_free(work);
+    return true;
+}
+
+int render_optics_reach(const Config* cfg, int width, int height) {
+    int reach = 0;
+    if (cfg->glare) reach += glare_psf_radius(cfg->aperture, cfg->env_map ? 360.0f : cfg->fov, width, height);
+    if (cfg->bloom) reach += apply_glare_reach(width, cfg->bloom_size, cfg->fov);
+    return reach;
+}
+
+bool render_frame_tiled(Scene* scene, const Config* cfg, double jd, int strip_rows, RenderStripFn emit, void* ctx) {
+    int w = cfg->width, h = cfg->height;
+    int num_outputs = config_num_exposures(cfg);
+    if (strip_rows < 1) strip_rows = 1;
+    if (strip_rows > h) strip_rows = h;
+    FrameView view;
+    frame_view_setup(scene, cfg, jd, &view);
+    ToneParams tone[CONFIG_MAX_EXPOSURES];
+    if (!prepass_exposure(scene, cfg, jd, &view, num_outputs, tone)) return false;
+
+    // Each strip is rendered with the rows the optics spread light from
+    // (halo) above and below it. Past the frame edge they stay black, as
+    // they are for a whole frame, and every strip buffer keeps the same size
+    // so the glare kernels are built once.
+    int halo = render_optics_reach(cfg, w, h);
+    int buf_rows = strip_rows + 2 * halo;
+    printf("Tiled render: strips of %d rows with %d rows of overlap\n", strip_rows, halo);
+    ImageHDR* strip = image_hdr_create(w, buf_rows);
+    ImageRGB* out = image_rgb_create(w, strip_rows);
+    bool ok = strip && out;
+    for (int row = 0; ok && row < h; row += strip_rows) {
+        int n = h - row < strip_rows ? h - row : strip_rows;
+        memset(strip->pixels, 0, sizeof(XYZV) * w * buf_rows);
+        render_radiance(scene, cfg, &view, strip, 0, row - halo);
+        render_apply_optics(&scene->glare, cfg, strip);
+        ImageHDR center = {w, n, strip->pixels + (size_t)halo * w, NULL};
+        ImageRGB rows = {w, n, out->pixels};
+        for (int e = 0; ok && e < num_outputs; e++) {
+            tonemap_apply(&center, &rows, &tone[e]);
+            annotate(scene, cfg, &view, &rows, 0, row);
+            ok = emit(&rows, row, e, ctx);
+        }
+    }
+    image_hdr_free(strip);
+    image_rgb_free(out);
+    return ok;
+}
@@ -0,0 +1,142 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "core.h"
+#include "config.h"
+#include "atmosphere.h"
+#include "sky_keyframes.h"
+#include "stars.h"
+#include "constellation.h"
+#include "image.h"
+#include "tonemap.h"
+#include "glare.h"
+#include "ephemerides.h"
+
+// Everything that does not depend on the simulated time. Loaded once and reused
+// by every frame of a sequence; render_frame only recomputes ephemerides and
+// transforms.
+// Sun, Moon and planet positions for one time and site. render_frame keeps the
+// last set and reuses it while both match, e.g. for several cameras at once.
+typedef struct {
+    bool valid;
+    double jd, lat, lon;
+    double sunrise, sunset, astro_dawn, astro_dusk;
+    Vec3 sun_dir, moon_dir;
+    double lmst;
+    float sun_ecl_lon;
+    Planet planets[5];
+} FrameEphemeris;
+
+// Parts of a scene read from disk, in the order they are loaded
+typedef enum { SCENE_MOON, SCENE_STARS, SCENE_OUTLINES, SCENE_NUM_PARTS } ScenePart;
+typedef struct SceneLoader SceneLoader;
+
+typedef struct {
+    Atmosphere atm;
+    float turbidity;        // The atmosphere is rebuilt when a frame asks for another
+    AtmosphereLUT atm_lut;  // Transmittance table of atm, opened by the first CPU sky
+    SkyKeyframes* sky_keys; // Sky tables of --sky-keyframes, built as frames need them
+    Image* moon_tex;
+    const Star* stars;      // Read-only, shared by all views of the scene
+    Vec3* star_dirs;        // Direction of each star at the last frame
+    int num_stars;
+    ConstellationBoundary constellations; // Vertices shared; directions and labels per view
+    bool use_gpu;
+    // The moon texture, catalog and outlines arrive from a background load,
+    // each taken when a frame first needs it
+    SceneLoader* loader;
+    bool loaded[SCENE_NUM_PARTS];
+
+    // State carried from frame to frame
+    GlareCache glare;
+    SkyRotation star_rot;   // Incremental sidereal rotation of the catalogs
+    SkyRotation constellation_rot;
+    FrameEphemeris ephemeris;
+    bool adapt_exposure;    // Sequence mode or --exposure-state
+    ExposureState exposure;
+} Scene;
+
+// Sets up the atmosphere for cfg and starts loading the moon texture, star
+// catalog and constellation outlines on a background thread, so the files are
+// read while the first sky renders. The stars and overlays of a frame wait
+// for their part. Returns 0 on success.
+int scene_load(Scene* scene, const Config* cfg);
+void scene_free(Scene* scene);
+
+// Scene for one of several threads rendering at once. The atmosphere, moon
+// texture, star catalog and constellation outlines are shared read-only with
+// `shared`, while the data render_frame updates in place (catalog directions,
+// glare kernels, cached ephemerides) is private; a view allocates only the
+// direction arrays, when it first renders stars or outlines. Returns false if
+// out of memory. Release with scene_view_free, before `shared`.
+bool scene_view_init(Scene* view, const Scene* shared);
+void scene_view_free(Scene* view);
+
+// Renders the sky at Julian day jd and tone maps it into outputs[i] (each
+// cfg->width x cfg->height) at exposure config_exposure(cfg, i), for i up to
+// num_outputs. If hdr_out is not NULL (same size), the radiance is rendered
+// there and left as it was before bloom and glare, so it can be tone mapped
+// again with other settings. Returns false if out of memory.
+bool render_frame(Scene* scene, const Config* cfg, double jd, ImageRGB* const* outputs, int num_outputs, ImageHDR* hdr_out);
+
+// The parts of render_frame for a whole frame, so successive frames of a
+// sequence can be in different parts at once (pipeline.h). Each part updates
+// only its own share of the scene: the sky the atmosphere and ephemerides, the
+// stars the catalog, tone mapping the glare kernels and exposure state, and
+// the overlays the constellation outlines. Parts of different frames may
+// therefore run concurrently on one scene, as long as each part sees the
+// frames in order. With the GPU, the sky and the stars must not overlap.
+typedef struct RenderWork RenderWork;
+
+// Positions the camera and renders the sky of frame jd. The radiance goes
+// into hdr_out (cfg->width x cfg->height) and is left there as rendered, or
+// into a buffer of the work if hdr_out is NULL. Returns NULL if out of memory.
+RenderWork* render_stage_sky(Scene* scene, const Config* cfg, double jd, ImageHDR* hdr_out);
+// Adds the stars and planets
+void render_stage_stars(Scene* scene, const Config* cfg, RenderWork* work);
+// Applies bloom and glare, meters (adapting exposure) and tone maps into
+// outputs[i] at config_exposure(cfg, i)
+void render_stage_tonemap(Scene* scene, const Config* cfg, RenderWork* work, ImageRGB* const* outputs,
+                          int num_outputs);
+// Draws labels and constellation outlines on the tone mapped outputs
+void render_stage_overlays(Scene* scene, const Config* cfg, RenderWork* work, ImageRGB* const* outputs,
+                           int num_outputs);
+void render_work_free(RenderWork* work);
+
+// The eye and lens effects selected by cfg (--glare, --bloom), applied to the
+// radiance in place. hdr may be a window of the cfg->width wide frame.
+// glare keeps the diffraction kernels between calls.
+void render_apply_optics(GlareCache* glare, const Config* cfg, ImageHDR* hdr);
+
+// Frames wider than this are metered on a pre-pass this wide, whether they
+// are rendered whole, as a --crop window or in strips, so all three get the
+// same exposure.
+#define RENDER_PREPASS_WIDTH 512
+
+// Tiled rendering, for images too large to hold in memory (e.g. gigapixel
+// environment maps). The exposure comes from the pre-pass, then the frame is
+// rendered, given bloom and glare, and tone mapped in full width strips.
+// Memory grows with the strip size rather than the image.
+
+// Receives tone mapped frame rows [row0, row0 + rows->height) for exposure
+// config_exposure(cfg, exposure). Strips arrive top to bottom, every exposure
+// of a strip before the next strip. Returns false to stop the render.
+typedef bool (*RenderStripFn)(const ImageRGB* rows, int row0, int exposure, void* ctx);
+
+// Renders like render_frame in strips of strip_rows rows, passing each to
+// emit. The GPU is not used for the strips and cfg's --crop is ignored.
+// Returns false if out of memory or emit failed.
+bool render_frame_tiled(Scene* scene, const Config* cfg, double jd, int strip_rows, RenderStripFn emit, void* ctx);
+
+// Rows of overlap bloom and glare need around a strip of a width x height frame
+int render_optics_reach(const Config* cfg, int width, int height);
+
+// Seconds since J2000, the clock used for exposure adaptation
+double jd_to_seconds(double jd);
+
+// Builds the file name for frame `index` of a sequence. A pattern containing a
+// single printf-style integer conversion (e.g. frames/f_%04d.pfm) is expanded;
+// otherwise _NNNN is inserted before the extension.
+void format_frame_filename(char* out, size_t size, const char* pattern, int index);
+
+#endif
@@ -150,7 +150,7 @@ __global__ void render_kernel(
     }
     
     float alpha_atm = 1.0f;
-    Spectrum L = atmosphere_render_radiance(&atm, cam_pos, dir, sun_dir, &sun_intensity, moon_dir, &moon_intensity, &alpha_atm);
+    Spectrum L = atmosphere_render_radiance(&atm, NULL, cam_pos, dir, sun_dir, &sun_intensity, moon_dir, &moon_intensity, &alpha_atm);
     
     float t_e0, t_e1;
     if (ray_sphere_intersect_math(cam_pos, dir, EARTH_RADIUS, &t_e0, &t_e1)) {
@@ -255,7 +255,7 @@ __global__ void render_kernel(
     out_pixels[y * width + x] = dev_spectrum_to_xyzv(&L);
 }
 
-extern "C" bool cuda_upload_stars(const Star* stars, int num_stars) {
+extern "C" bool cuda_upload_stars(const Star* stars, const Vec3* dirs, int num_stars) {
     if (num_stars <= 0) return true;
     
     if (d_stars != NULL && d_num_stars < num_stars) {
@@ -277,6 +277,15 @@ extern "C" bool cuda_upload_stars(const Star* stars, int num_stars) {
         printf("CUDA Error: Failed to copy stars to GPU: %s\n", cudaGetErrorString(err));
         return false;
     }
+    if (dirs) {
+        // Scatter the directions into the uploaded stars' direction fields
+        err = cudaMemcpy2D(&d_stars[0].direction, sizeof(Star), dirs, sizeof(Vec3), sizeof(Vec3), num_stars,
+                           cudaMemcpyHostToDevice);
+        if (err != cudaSuccess) {
+            printf("CUDA Error: Failed to copy star directions to GPU: %s\n", cudaGetErrorString(err));
+            return false;
+        }
+    }
     
     return true;
 }
@@ -0,0 +1,229 @@
+#include "result_cache.h"
+#include "ephemerides.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RESULT_CACHE_MAGIC "KNIGHTRC"
+#define RESULT_CACHE_VERSION 1
+#define RESULT_CACHE_HEADER_SIZE 64
+#define RESULT_CACHE_SUFFIX ".kres"
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    int32_t width, height;
+    uint32_t num_exposures;
+    uint32_t has_hdr;
+    uint32_t reserved;
+    uint64_t key;
+} ResultHeader;
+
+// FNV-1a, fed field by field so struct padding and pointers stay out
+static void hash_bytes(uint64_t* h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) {
+        *h ^= p[i];
+        *h *= 1099511628211ULL;
+    }
+}
+
+static void hash_string(uint64_t* h, const char* s) {
+    hash_bytes(h, s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+#define HASH_FIELD(h, field) hash_bytes(h, &(field), sizeof(field))
+
+static double snap(double value, double step) {
+    return step > 0 ? round(value / step) * step : value;
+}
+
+double result_cache_snap(Config* cfg, double jd) {
+    cfg->lat = snap(cfg->lat, cfg->cache_site_deg);
+    cfg->lon = snap(cfg->lon, cfg->cache_site_deg);
+    if (cfg->cache_time_minutes > 0) {
+        jd = snap(jd * 1440.0, cfg->cache_time_minutes) / 1440.0;
+        julian_day_to_calendar(jd, &cfg->year, &cfg->month, &cfg->day, &cfg->hour);
+    }
+    return jd;
+}
+
+uint64_t result_cache_key(const Config* cfg, double jd) {
+    uint64_t h = 14695981039346656037ULL;
+    uint32_t version = RESULT_CACHE_VERSION;
+    HASH_FIELD(&h, version);
+    // A rebuilt knight may render differently
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+        int64_t exe[2] = {(int64_t)st.st_size, (int64_t)st.st_mtime};
+        HASH_FIELD(&h, exe);
+    }
+    HASH_FIELD(&h, jd);
+    HASH_FIELD(&h, cfg->lat);
+    HASH_FIELD(&h, cfg->lon);
+    HASH_FIELD(&h, cfg->width);
+    HASH_FIELD(&h, cfg->height);
+    HASH_FIELD(&h, cfg->crop_x);
+    HASH_FIELD(&h, cfg->crop_y);
+    HASH_FIELD(&h, cfg->crop_width);
+    HASH_FIELD(&h, cfg->crop_height);
+    HASH_FIELD(&h, cfg->env_map);
+    HASH_FIELD(&h, cfg->custom_cam);
+    HASH_FIELD(&h, cfg->cam_alt);
+    HASH_FIELD(&h, cfg->cam_az);
+    HASH_FIELD(&h, cfg->fov);
+    hash_string(&h, cfg->track_body);
+    int n = config_num_exposures(cfg);
+    HASH_FIELD(&h, n);
+    for (int e = 0; e < n; e++) {
+        float stops = config_exposure(cfg, e);
+        HASH_FIELD(&h, stops);
+    }
+    HASH_FIELD(&h, cfg->turbidity);
+    HASH_FIELD(&h, cfg->sky_keyframe_error);
+    HASH_FIELD(&h, cfg->render_moon);
+    HASH_FIELD(&h, cfg->aperture);
+    HASH_FIELD(&h, cfg->bloom);
+    HASH_FIELD(&h, cfg->bloom_size);
+    HASH_FIELD(&h, cfg->glare);
+    HASH_FIELD(&h, cfg->render_outlines);
+    HASH_FIELD(&h, cfg->outline_color);
+    HASH_FIELD(&h, cfg->label_bodies);
+    HASH_FIELD(&h, cfg->label_color);
+    HASH_FIELD(&h, cfg->use_tycho);
+    if (cfg->use_tycho) hash_string(&h, cfg->tycho_dir);
+    HASH_FIELD(&h, cfg->merge_ybs);
+    HASH_FIELD(&h, cfg->match_tol_arcsec);
+    HASH_FIELD(&h, cfg->star_mag_limit);
+    hash_string(&h, cfg->mode);
+    hash_string(&h, cfg->data_dir);
+    return h;
+}
+
+static void entry_path(char* path, size_t size, const char* dir, uint64_t key) {
+    snprintf(path, size, "%s/%016llx%s", dir, (unsigned long long)key, RESULT_CACHE_SUFFIX);
+}
+
+static size_t entry_size(int width, int height, int num_exposures, bool has_hdr) {
+    size_t pixels = (size_t)width * height;
+    return RESULT_CACHE_HEADER_SIZE + sizeof(RGB) * pixels * num_exposures + (has_hdr ? sizeof(XYZV) * pixels : 0);
+}
+
+bool result_cache_load(const char* dir, uint64_t key, ImageRGB* const* outs, int num_outs, ImageHDR* hdr) {
+    char path[1100];
+    entry_path(path, sizeof(path), dir, key);
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    ResultHeader header;
+    struct stat st;
+    int w = outs[0]->width, h = outs[0]->height;
+    size_t pixels = (size_t)w * h;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && fstat(fileno(f), &st) == 0;
+    bool valid = ok && memcmp(header.magic, RESULT_CACHE_MAGIC, 8) == 0 && header.version == RESULT_CACHE_VERSION &&
+                 header.key == key && header.width > 0 && header.height > 0 &&
+                 (size_t)st.st_size == entry_size(header.width, header.height, header.num_exposures, header.has_hdr);
+    // Another frame size or fewer exposures than asked for is a miss; a
+    // damaged entry is removed
+    ok = valid && header.width == w && header.height == h && (int)header.num_exposures == num_outs &&
+         (header.has_hdr || !hdr) && fseek(f, RESULT_CACHE_HEADER_SIZE, SEEK_SET) == 0;
+    for (int e = 0; e < num_outs && ok; e++) ok = fread(outs[e]->pixels, sizeof(RGB), pixels, f) == pixels;
+    if (ok && hdr) ok = fread(hdr->pixels, sizeof(XYZV), pixels, f) == pixels;
+    fclose(f);
+    if (!valid) {
+        remove(path);
+        return false;
+    }
+    // The file's time orders the entries for eviction
+    if (ok) utimensat(AT_FDCWD, path, NULL, 0);
+    return ok;
+}
+
+typedef struct {
+    char name[64];
+    off_t size;
+    struct timespec used;
+} CacheEntry;
+
+static int compare_used(const void* a, const void* b) {
+    const struct timespec* x = &((const CacheEntry*)a)->used;
+    const struct timespec* y = &((const CacheEntry*)b)->used;
+    if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+    if (x->tv_nsec != y->tv_nsec) return x->tv_nsec < y->tv_nsec ? -1 : 1;
+    return 0;
+}
+
+// Deletes the least recently used entries until the rest fit in budget bytes
+static void evict(const char* dir, uint64_t budget) {
+    DIR* d = opendir(dir);
+    if (!d) return;
+    CacheEntry* entries = NULL;
+    int count = 0, capacity = 0;
+    uint64_t total = 0;
+    char path[1200];
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        size_t suffix = strlen(RESULT_CACHE_SUFFIX);
+        if (len <= suffix || len >= sizeof(entries[0].name) || strcmp(de->d_name + len - suffix, RESULT_CACHE_SUFFIX) != 0) {
+            continue;
+        }
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (stat(path, &st) != 0) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            CacheEntry* grown = (CacheEntry*)realloc(entries, sizeof(CacheEntry) * capacity);
+            if (!grown) break;
+            entries = grown;
+        }
+        snprintf(entries[count].name, sizeof(entries[count].name), "%s", de->d_name);
+        entries[count].size = st.st_size;
+        entries[count].used = st.st_mtim;
+        total += (uint64_t)st.st_size;
+        count++;
+    }
+    closedir(d);
+    qsort(entries, count, sizeof(CacheEntry), compare_used);
+    for (int i = 0; i < count && total > budget; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+        if (remove(path) == 0) total -= (uint64_t)entries[i].size;
+    }
+    free(entries);
+}
+
+bool result_cache_store(const char* dir, uint64_t key, ImageRGB* const* outs, int num_outs, const ImageHDR* hdr,
+                        uint64_t budget) {
+    int w = outs[0]->width, h = outs[0]->height;
+    size_t pixels = (size_t)w * h;
+    if (entry_size(w, h, num_outs, hdr != NULL) > budget) return true; // Would be evicted at once
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Warning: Could not create cache directory %s\n", dir);
+        return false;
+    }
+    char path[1100], tmp[1200];
+    entry_path(path, sizeof(path), dir, key);
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        fprintf(stderr, "Warning: Could not write cache entry %s\n", tmp);
+        return false;
+    }
+    ResultHeader header = {{0}, RESULT_CACHE_VERSION, w, h, (uint32_t)num_outs, hdr != NULL, 0, key};
+    memcpy(header.magic, RESULT_CACHE_MAGIC, 8);
+    unsigned char block[RESULT_CACHE_HEADER_SIZE] = {0};
+    memcpy(block, &header, sizeof(header));
+    bool ok = fwrite(block, 1, sizeof(block), f) == sizeof(block);
+    for (int e = 0; e < num_outs && ok; e++) ok = fwrite(outs[e]->pixels, sizeof(RGB), pixels, f) == pixels;
+    if (ok && hdr) ok = fwrite(hdr->pixels, sizeof(XYZV), pixels, f) == pixels;
+    ok = fclose(f) == 0 && ok;
+    // Renamed into place whole, so a reader never sees a partial entry
+    if (!ok || rename(tmp, path) != 0) {
+        fprintf(stderr, "Warning: Could not write cache entry %s\n", path);
+        remove(tmp);
+        return false;
+    }
+    evict(dir, budget);
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stdint.h>
+#include "config.h"
+#include "tonemap.h"
+
+// Cache of finished single frames (--cache-dir <dir>), for servers that get
+// the same view asked for over and over.
+//
+// The tone mapped images of a frame, and its radiance when the output format
+// needed it, are saved in <dir> under a key hashing every option that changes
+// the pixels, the time and the knight binary. Output options (file name,
+// format, PNG depth, ...) are not part of the key, so a frame cached as a PNG
+// can be saved again as a JPEG. A later run with the same key writes its
+// output from the cache without loading catalogs or rendering.
+//
+// --cache-time and --cache-site round the time and the site to a grid before
+// rendering, so requests a few seconds or metres apart become the same frame.
+// Entries are used most recently first; past --cache-size MB the least
+// recently used are deleted.
+//
+// An entry is a 64 byte header (magic, version, size, exposures, whether it
+// holds the radiance, and the key), the RGB images one after another, then the
+// XYZV radiance if any. Files that do not match their name are deleted.
+
+// Rounds cfg's site to the --cache-site grid and jd to the --cache-time grid,
+// returning the rounded Julian day
+double result_cache_snap(Config* cfg, double jd);
+
+// Hash of the options of cfg that change the frame rendered at jd
+uint64_t result_cache_key(const Config* cfg, double jd);
+
+// Fills outs (num_outs images) and hdr, if not NULL, from the entry for key,
+// which must match in size and hold the radiance if hdr is asked for. Marks
+// the entry as just used. Returns false on a miss.
+bool result_cache_load(const char* dir, uint64_t key, ImageRGB* const* outs, int num_outs, ImageHDR* hdr);
+
+// Saves the frame under key, hdr may be NULL, then deletes the least recently
+// used entries until the directory holds at most budget bytes. Returns false
+// if the entry could not be written.
+bool result_cache_store(const char* dir, uint64_t key, ImageRGB* const* outs, int num_outs, const ImageHDR* hdr,
+                        uint64_t budget);
+
+#endif
@@ -0,0 +1,344 @@
+#include "serve.h"
+#include "png.h"
+#include <pthread.h>
+#include <signal.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#define SERVE_MAX_REQUEST 65536
+#define SERVE_QUEUE_SIZE 64
+#define SERVE_MAX_PIXELS (8192 * 8192)
+#define SERVE_READ_TIMEOUT_S 30
+
+typedef struct {
+    KnightContext* ctx;
+    const Config* base;
+
+    pthread_mutex_t parse_lock; // getopt is not reentrant
+
+    // Accepted connections waiting for a worker; -1 tells a worker to exit
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;
+    pthread_cond_t queue_space;
+    int queue[SERVE_QUEUE_SIZE];
+    int queue_head, queue_count;
+} Server;
+
+typedef struct {
+    Server* srv;
+    int id;
+    pthread_t thread;
+} ServeWorker;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void serve_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+static void queue_push(Server* srv, int fd) {
+    pthread_mutex_lock(&srv->queue_lock);
+    while (srv->queue_count == SERVE_QUEUE_SIZE) pthread_cond_wait(&srv->queue_space, &srv->queue_lock);
+    srv->queue[(srv->queue_head + srv->queue_count) % SERVE_QUEUE_SIZE] = fd;
+    srv->queue_count++;
+    pthread_cond_signal(&srv->queue_ready);
+    pthread_mutex_unlock(&srv->queue_lock);
+}
+
+static int queue_pop(Server* srv) {
+    pthread_mutex_lock(&srv->queue_lock);
+    while (srv->queue_count == 0) pthread_cond_wait(&srv->queue_ready, &srv->queue_lock);
+    int fd = srv->queue[srv->queue_head];
+    srv->queue_head = (srv->queue_head + 1) % SERVE_QUEUE_SIZE;
+    srv->queue_count--;
+    pthread_cond_signal(&srv->queue_space);
+    pthread_mutex_unlock(&srv->queue_lock);
+    return fd;
+}
+
+// A request ends at EOF, at a blank line, or when a JSON object closes
+static bool request_complete(const char* buf, size_t len) {
+    size_t i = 0;
+    while (i < len && (buf[i] == ' ' || buf[i] == '\t' || buf[i] == '\r' || buf[i] == '\n')) i++;
+    if (i < len && buf[i] == '{') {
+        int depth = 0;
+        bool in_string = false;
+        for (; i < len; i++) {
+            char c = buf[i];
+            if (in_string) {
+                if (c == '\\') i++;
+                else if (c == '"') in_string = false;
+            } else if (c == '"') {
+                in_string = true;
+            } else if (c == '{') {
+                depth++;
+            } else if (c == '}' && --depth == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    for (; i + 1 < len; i++) {
+        if (buf[i] == '\n' && (buf[i + 1] == '\n' || (buf[i + 1] == '\r' && i + 2 < len && buf[i + 2] == '\n'))) return true;
+    }
+    return false;
+}
+
+// Returns the request text (caller frees) or NULL with a message in err
+static char* read_request(int fd, char* err, size_t err_size) {
+    char* buf = (char*)malloc(SERVE_MAX_REQUEST + 1);
+    if (!buf) {
+        snprintf(err, err_size, "out of memory");
+        return NULL;
+    }
+    size_t len = 0;
+    for (;;) {
+        if (len == SERVE_MAX_REQUEST) {
+            snprintf(err, err_size, "request larger than %d bytes", SERVE_MAX_REQUEST);
+            free(buf);
+            return NULL;
+        }
+        ssize_t got = read(fd, buf + len, SERVE_MAX_REQUEST - len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) {
+            snprintf(err, err_size, "read failed: %s", strerror(errno));
+            free(buf);
+            return NULL;
+        }
+        if (got == 0) break;
+        len += (size_t)got;
+        if (request_complete(buf, len)) break;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+static void send_error(int fd, const char* msg) {
+    char line[512];
+    int n = snprintf(line, sizeof(line), "ERR %s\n", msg);
+    if (n > (int)sizeof(line) - 1) n = (int)sizeof(line) - 1;
+    if (write(fd, line, (size_t)n) < 0) {
+        // Client already gone
+    }
+}
+
+static bool send_pfm(int fd, const ImageRGB* img) {
+    char header[64];
+    int header_len = snprintf(header, sizeof(header), "PF\n%d %d\n-1.0\n", img->width, img->height);
+    size_t bytes = (size_t)header_len + (size_t)img->width * img->height * 3 * sizeof(float);
+
+    int out_fd = dup(fd);
+    if (out_fd < 0) return false;
+    FILE* f = fdopen(out_fd, "wb");
+    if (!f) {
+        close(out_fd);
+        return false;
+    }
+    setvbuf(f, NULL, _IOFBF, 1 << 16);
+    fprintf(f, "OK image/x-portable-floatmap %zu\n", bytes);
+    bool ok = write_pfm_stream(f, img->width, img->height, img->pixels);
+    return fclose(f) == 0 && ok;
+}
+
+// PNG sizes are only known once encoded, so the image is built in memory first
+static bool send_png(int fd, const ImageRGB* img, const Config* cfg) {
+    char* data = NULL;
+    size_t bytes = 0;
+    FILE* mem = open_memstream(&data, &bytes);
+    if (!mem) return false;
+    bool encoded = write_png_stream(mem, img, cfg->png_bits, cfg->png_level);
+    if (fclose(mem) != 0 || !encoded) {
+        free(data);
+        send_error(fd, "PNG encoding failed");
+        return true;
+    }
+
+    int out_fd = dup(fd);
+    FILE* f = out_fd < 0 ? NULL : fdopen(out_fd, "wb");
+    if (!f) {
+        if (out_fd >= 0) close(out_fd);
+        free(data);
+        return false;
+    }
+    fprintf(f, "OK image/png %zu\n", bytes);
+    bool ok = fwrite(data, 1, bytes, f) == bytes;
+    free(data);
+    return fclose(f) == 0 && ok;
+}
+
+static void serve_connection(ServeWorker* w, ImageRGB** output, int fd) {
+    Server* srv = w->srv;
+    char err[256];
+    char* request = read_request(fd, err, sizeof(err));
+    if (!request) {
+        send_error(fd, err);
+        return;
+    }
+
+    Config cfg = *srv->base;
+    config_set_current_time(&cfg);
+    char* storage = NULL;
+    pthread_mutex_lock(&srv->parse_lock);
+    bool ok = config_apply_request(request, &cfg, &storage, err, sizeof(err));
+    pthread_mutex_unlock(&srv->parse_lock);
+    free(request);
+    if (!ok) {
+        send_error(fd, err);
+        return;
+    }
+    if (cfg.width <= 0 || cfg.height <= 0 || (long long)cfg.width * cfg.height > SERVE_MAX_PIXELS) {
+        snprintf(err, sizeof(err), "image size %dx%d out of range", cfg.width, cfg.height);
+        send_error(fd, err);
+        free(storage);
+        return;
+    }
+
+    if (!config_crop_valid(&cfg)) {
+        send_error(fd, "crop window outside the image");
+        free(storage);
+        return;
+    }
+
+    bool png = cfg.output_format && strcmp(cfg.output_format, "png") == 0;
+    if (cfg.output_format && !png && strcmp(cfg.output_format, "pfm") != 0) {
+        snprintf(err, sizeof(err), "format '%s' is not served; use pfm or png", cfg.output_format);
+        send_error(fd, err);
+        free(storage);
+        return;
+    }
+
+    int width, height;
+    config_image_size(&cfg, &width, &height);
+    if (!*output || (*output)->width != width || (*output)->height != height) {
+        image_rgb_free(*output);
+        *output = image_rgb_create(width, height);
+    }
+
+    printf("[worker %d] Rendering %dx%d at Lat %.2f, Lon %.2f\n", w->id, width, height, cfg.lat, cfg.lon);
+    int status = knight_render(srv->ctx, &cfg, *output);
+    free(storage);
+    if (status != 0) {
+        send_error(fd, "render failed (out of memory)");
+        return;
+    }
+
+    bool sent = png ? send_png(fd, *output, &cfg) : send_pfm(fd, *output);
+    if (!sent) printf("[worker %d] Client disconnected before the image was sent\n", w->id);
+}
+
+static void* serve_worker(void* arg) {
+    ServeWorker* w = (ServeWorker*)arg;
+    ImageRGB* output = NULL;
+
+    for (;;) {
+        int fd = queue_pop(w->srv);
+        if (fd < 0) break;
+        serve_connection(w, &output, fd);
+        close(fd);
+    }
+
+    image_rgb_free(output);
+    return NULL;
+}
+
+static int open_listen_socket(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: Socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    // Replace a stale socket from an earlier run, but never any other file
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "Error: %s exists and is not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, SERVE_QUEUE_SIZE) != 0) {
+        fprintf(stderr, "Error: Could not listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_run(KnightContext* ctx, const Config* base) {
+    int listen_fd = open_listen_socket(base->serve_socket);
+    if (listen_fd < 0) return 1;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = serve_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    Server srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.ctx = ctx;
+    srv.base = base;
+    pthread_mutex_init(&srv.parse_lock, NULL);
+    pthread_mutex_init(&srv.queue_lock, NULL);
+    pthread_cond_init(&srv.queue_ready, NULL);
+    pthread_cond_init(&srv.queue_space, NULL);
+
+    int num_workers = base->workers > 0 ? base->workers : 1;
+    ServeWorker* workers = (ServeWorker*)calloc(num_workers, sizeof(ServeWorker));
+    int started = 0;
+    for (int i = 0; workers && i < num_workers; i++) {
+        workers[i].srv = &srv;
+        workers[i].id = i;
+        if (pthread_create(&workers[i].thread, NULL, serve_worker, &workers[i]) != 0) break;
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Could not start server workers\n");
+        serve_stop = 1;
+    } else {
+        printf("Serving on %s with %d workers\n", base->serve_socket, started);
+    }
+    fflush(stdout);
+
+    while (!serve_stop) {
+        struct pollfd pfd = { listen_fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, 500);
+        if (ready <= 0) continue;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+        struct timeval tv = { SERVE_READ_TIMEOUT_S, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        queue_push(&srv, fd);
+    }
+
+    printf("Shutting down server...\n");
+    close(listen_fd);
+    unlink(base->serve_socket);
+    for (int i = 0; i < started; i++) queue_push(&srv, -1);
+    for (int i = 0; i < started; i++) pthread_join(workers[i].thread, NULL);
+    free(workers);
+
+    pthread_mutex_destroy(&srv.parse_lock);
+    pthread_mutex_destroy(&srv.queue_lock);
+    pthread_cond_destroy(&srv.queue_ready);
+    pthread_cond_destroy(&srv.queue_space);
+    return started > 0 ? 0 : 1;
+}
@@ -0,0 +1,21 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "config.h"
+#include "knight.h"
+
+// Render server. Listens on the Unix domain socket base->serve_socket and renders
+// one request per connection with a pool of base->workers threads, keeping the
+// catalogs, textures and atmosphere of ctx resident between requests.
+//
+// Protocol: the client sends a request (see config_apply_request) and closes its
+// writing side, or ends the request with a blank line. The server answers
+//   OK <content-type> <bytes>\n<image>
+// or
+//   ERR <message>\n
+// and closes the connection. A request without date/time renders the current sky.
+//
+// Runs until SIGINT or SIGTERM; returns the process exit status.
+int serve_run(KnightContext* ctx, const Config* base);
+
+#endif
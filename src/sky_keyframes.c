@@ -0,0 +1,239 @@
+#include "sky_keyframes.h"
+#include "atmosphere_math.h"
+#include "parallel.h"
+
+// Keyframes lie on a grid of body zenith angles: SKY_KEY_SPANS intervals over
+// [0, pi], each halved up to SKY_KEY_DEPTH times
+#define SKY_KEY_SPANS 16
+#define SKY_KEY_DEPTH 7
+#define SKY_KEY_NODES (SKY_KEY_SPANS << SKY_KEY_DEPTH)
+// View zenith rows above the horizon; the rest are below
+#define SKY_KEY_SKY_ROWS 96
+// Rayleigh then Mie XYZV, as logarithms
+#define SKY_KEY_CELL 8
+#define SKY_KEY_MIN 1e-30f
+
+typedef struct {
+    float* table;
+    bool checked;   // Whether the interval this node is the middle of was tested
+    bool ok;        // and interpolates within the tolerance
+} KeyNode;
+
+struct SkyKeyframes {
+    Atmosphere atm;
+    const AtmosphereLUT* lut;
+    float cam_radius;
+    Spectrum light;
+    float tolerance;
+    float horizon;                  // View zenith angle of the horizon
+    float alpha[SKY_KEY_ZENITHS];   // Transmittance of each view zenith row
+    KeyNode nodes[SKY_KEY_NODES + 1];
+    int count;
+};
+
+// View zenith angle of row i, just off the horizon on its own side
+static float row_zenith(const SkyKeyframes* keys, int i) {
+    const float eps = 1e-5f;
+    if (i < SKY_KEY_SKY_ROWS) {
+        float g = 1.0f - (float)i / (SKY_KEY_SKY_ROWS - 1);
+        return fminf(keys->horizon * (1.0f - g * g), keys->horizon - eps);
+    }
+    float g = (float)(i - SKY_KEY_SKY_ROWS) / (SKY_KEY_ZENITHS - SKY_KEY_SKY_ROWS - 1);
+    return fmaxf(keys->horizon + (PI - keys->horizon) * g * g, keys->horizon + eps);
+}
+
+// Fractional row of view zenith angle theta, never across the horizon
+static float zenith_row(const SkyKeyframes* keys, float theta, int* row) {
+    float f;
+    int lo, hi;
+    if (theta < keys->horizon) {
+        f = (SKY_KEY_SKY_ROWS - 1) * (1.0f - sqrtf(fmaxf(0.0f, 1.0f - theta / keys->horizon)));
+        lo = 0;
+        hi = SKY_KEY_SKY_ROWS - 1;
+    } else {
+        f = SKY_KEY_SKY_ROWS + (SKY_KEY_ZENITHS - SKY_KEY_SKY_ROWS - 1) *
+                                   sqrtf(fminf(1.0f, (theta - keys->horizon) / (PI - keys->horizon)));
+        lo = SKY_KEY_SKY_ROWS;
+        hi = SKY_KEY_ZENITHS - 1;
+    }
+    int i = (int)f;
+    if (i < lo) i = lo;
+    if (i > hi - 1) i = hi - 1;
+    *row = i;
+    return fminf(1.0f, fmaxf(0.0f, f - i));
+}
+
+static Vec3 zenith_azimuth_dir(float zenith, float azimuth) {
+    return (Vec3){sinf(zenith) * sinf(azimuth), cosf(zenith), sinf(zenith) * cosf(azimuth)};
+}
+
+typedef struct {
+    const SkyKeyframes* keys;
+    Vec3 body;
+    float* table;
+} BuildJob;
+
+static void build_rows(int begin, int end, void* ctx) {
+    const BuildJob* job = (const BuildJob*)ctx;
+    const SkyKeyframes* keys = job->keys;
+    Vec3 origin = {0, keys->cam_radius, 0};
+    for (int i = begin; i < end; i++) {
+        float zenith = row_zenith(keys, i);
+        for (int j = 0; j < SKY_KEY_AZIMUTHS; j++) {
+            Vec3 dir = zenith_azimuth_dir(zenith, PI * j / (SKY_KEY_AZIMUTHS - 1));
+            Spectrum r, m;
+            float alpha;
+            atmosphere_scattering(&keys->atm, keys->lut, origin, dir, job->body, &r, &m, &alpha);
+            spectrum_mul_spec(&r, &keys->light);
+            spectrum_mul_spec(&m, &keys->light);
+            XYZV xr = spectrum_to_xyzv(&r), xm = spectrum_to_xyzv(&m);
+            float* cell = job->table + ((size_t)i * SKY_KEY_AZIMUTHS + j) * SKY_KEY_CELL;
+            float values[SKY_KEY_CELL] = {xr.X, xr.Y, xr.Z, xr.V, xm.X, xm.Y, xm.Z, xm.V};
+            for (int k = 0; k < SKY_KEY_CELL; k++) cell[k] = logf(fmaxf(values[k], SKY_KEY_MIN));
+        }
+    }
+}
+
+static float node_zenith(int node) {
+    return PI * node / SKY_KEY_NODES;
+}
+
+// The keyframe at grid node n, built if need be
+static const float* node_table(SkyKeyframes* keys, int n) {
+    KeyNode* node = &keys->nodes[n];
+    if (node->table) return node->table;
+    float* table = (float*)malloc(sizeof(float) * SKY_KEY_ZENITHS * SKY_KEY_AZIMUTHS * SKY_KEY_CELL);
+    if (!table) return NULL;
+    BuildJob job = {keys, zenith_azimuth_dir(node_zenith(n), 0.0f), table};
+    parallel_for(SKY_KEY_ZENITHS, 4, build_rows, &job);
+    node->table = table;
+    keys->count++;
+    return table;
+}
+
+// Largest difference in luminance between mid and the geometric mean of a
+// and b, relative to mid's where mid is not much darker than its brightest cell
+static float interval_error(const float* a, const float* b, const float* mid) {
+    const size_t cells = (size_t)SKY_KEY_ZENITHS * SKY_KEY_AZIMUTHS;
+    float peak = 0.0f;
+    for (size_t c = 0; c < cells; c++) {
+        peak = fmaxf(peak, expf(mid[c * SKY_KEY_CELL + 1]) + expf(mid[c * SKY_KEY_CELL + 5]));
+    }
+    float floor_Y = 1e-3f * peak, err = 0.0f;
+    for (size_t c = 0; c < cells; c++) {
+        const float* pa = a + c * SKY_KEY_CELL;
+        const float* pb = b + c * SKY_KEY_CELL;
+        const float* pm = mid + c * SKY_KEY_CELL;
+        float Y = expf(pm[1]) + expf(pm[5]);
+        float lerp = expf(0.5f * (pa[1] + pb[1])) + expf(0.5f * (pa[5] + pb[5]));
+        if (Y > 2.0f * SKY_KEY_MIN) err = fmaxf(err, fabsf(lerp - Y) / fmaxf(Y, floor_Y));
+    }
+    return err;
+}
+
+SkyKeyframes* sky_keyframes_create(const Atmosphere* atm, const AtmosphereLUT* lut, float cam_radius,
+                                   const Spectrum* light, float tolerance) {
+    SkyKeyframes* keys = (SkyKeyframes*)calloc(1, sizeof(SkyKeyframes));
+    if (!keys) return NULL;
+    keys->atm = *atm;
+    keys->lut = lut;
+    keys->cam_radius = cam_radius;
+    keys->light = *light;
+    keys->tolerance = tolerance;
+    keys->horizon = acosf(atmosphere_horizon_mu(atm, cam_radius));
+    Vec3 origin = {0, cam_radius, 0};
+    for (int i = 0; i < SKY_KEY_ZENITHS; i++) {
+        Spectrum r, m;
+        atmosphere_scattering(atm, lut, origin, zenith_azimuth_dir(row_zenith(keys, i), 0.0f), (Vec3){0, 1, 0}, &r,
+                              &m, &keys->alpha[i]);
+    }
+    return keys;
+}
+
+void sky_keyframes_free(SkyKeyframes* keys) {
+    if (!keys) return;
+    for (int n = 0; n <= SKY_KEY_NODES; n++) free(keys->nodes[n].table);
+    free(keys);
+}
+
+bool sky_keyframes_match(const SkyKeyframes* keys, float cam_radius, const Spectrum* light, float tolerance) {
+    return keys->cam_radius == cam_radius && keys->tolerance == tolerance &&
+           memcmp(&keys->light, light, sizeof(Spectrum)) == 0;
+}
+
+bool sky_keyframes_prepare(SkyKeyframes* keys, Vec3 dir, float scale, SkyKeyBody* body) {
+    memset(body, 0, sizeof(SkyKeyBody));
+    body->dir = dir;
+    body->scale = scale;
+    body->azimuth = atan2f(dir.x, dir.z);
+    if (scale <= 0.0f) return true;
+    float zenith = acosf(fmaxf(-1.0f, fminf(1.0f, dir.y)));
+
+    // Halve the interval around zenith until its middle is within tolerance
+    int span = 1 << SKY_KEY_DEPTH;
+    int a = (int)(zenith / PI * SKY_KEY_SPANS) * span;
+    if (a > SKY_KEY_NODES - span) a = SKY_KEY_NODES - span;
+    while (span > 1) {
+        int m = a + span / 2, b = a + span;
+        const float* ta = node_table(keys, a);
+        const float* tb = node_table(keys, b);
+        const float* tm = node_table(keys, m);
+        if (!ta || !tb || !tm) return false;
+        KeyNode* mid = &keys->nodes[m];
+        if (!mid->checked) {
+            mid->ok = interval_error(ta, tb, tm) <= keys->tolerance;
+            mid->checked = true;
+        }
+        if (zenith >= node_zenith(m)) a = m;
+        span /= 2;
+        if (mid->ok) break;
+    }
+    body->table[0] = node_table(keys, a);
+    body->table[1] = node_table(keys, a + span);
+    if (!body->table[0] || !body->table[1]) return false;
+    body->weight = fminf(1.0f, fmaxf(0.0f, (zenith - node_zenith(a)) / (node_zenith(a + span) - node_zenith(a))));
+    return true;
+}
+
+// Adds the light of body along view zenith row and azimuth to out
+static void eval_body(const SkyKeyframes* keys, const SkyKeyBody* body, Vec3 dir, int row, float wz, float azimuth,
+                      float* out) {
+    float phi = fabsf(azimuth - body->azimuth);
+    if (phi > PI) phi = TWO_PI - phi;
+    float fa = phi / PI * (SKY_KEY_AZIMUTHS - 1);
+    int col = (int)fa;
+    if (col > SKY_KEY_AZIMUTHS - 2) col = SKY_KEY_AZIMUTHS - 2;
+    float wa = fa - col;
+    float cell[SKY_KEY_CELL] = {0};
+    for (int t = 0; t < 2; t++) {
+        float wt = t ? body->weight : 1.0f - body->weight;
+        if (wt <= 0.0f) continue;
+        const float* c00 = body->table[t] + ((size_t)row * SKY_KEY_AZIMUTHS + col) * SKY_KEY_CELL;
+        const float* c01 = c00 + SKY_KEY_CELL;
+        const float* c10 = c00 + SKY_KEY_AZIMUTHS * SKY_KEY_CELL;
+        const float* c11 = c10 + SKY_KEY_CELL;
+        float w00 = wt * (1.0f - wz) * (1.0f - wa), w01 = wt * (1.0f - wz) * wa;
+        float w10 = wt * wz * (1.0f - wa), w11 = wt * wz * wa;
+        for (int k = 0; k < SKY_KEY_CELL; k++) cell[k] += w00 * c00[k] + w01 * c01[k] + w10 * c10[k] + w11 * c11[k];
+    }
+    float mu = vec3_dot(dir, body->dir);
+    float pr = phase_rayleigh_math(mu) * body->scale;
+    float pm = phase_mie_math(mu, keys->atm.mie_g) * body->scale;
+    for (int k = 0; k < 4; k++) out[k] += pr * expf(cell[k]) + pm * expf(cell[4 + k]);
+}
+
+XYZV sky_keyframes_eval(const SkyKeyframes* keys, const SkyKeyBody* sun, const SkyKeyBody* moon, Vec3 dir,
+                        float* out_alpha) {
+    int row;
+    float wz = zenith_row(keys, acosf(fmaxf(-1.0f, fminf(1.0f, dir.y))), &row);
+    *out_alpha = keys->alpha[row] + wz * (keys->alpha[row + 1] - keys->alpha[row]);
+    float azimuth = atan2f(dir.x, dir.z);
+    float out[4] = {0, 0, 0, 0};
+    if (sun->table[0]) eval_body(keys, sun, dir, row, wz, azimuth, out);
+    if (moon->table[0]) eval_body(keys, moon, dir, row, wz, azimuth, out);
+    return (XYZV){out[0], out[1], out[2], out[3]};
+}
+
+int sky_keyframes_count(const SkyKeyframes* keys) {
+    return keys->count;
+}
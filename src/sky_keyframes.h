@@ -0,0 +1,63 @@
+#ifndef SKY_KEYFRAMES_H
+#define SKY_KEYFRAMES_H
+
+#include "atmosphere.h"
+
+// Sky keyframes (--sky-keyframes <percent>), for sequences where the sky
+// changes little from one frame to the next.
+//
+// In a spherical atmosphere the light a body scatters toward the camera only
+// depends on the body's zenith angle, the view's zenith angle and the azimuth
+// between them. Without the phase functions, which are exact per pixel, it is
+// smooth in all three. A keyframe tabulates it at one body zenith angle over
+// SKY_KEY_ZENITHS view zenith angles (finest at the horizon) and
+// SKY_KEY_AZIMUTHS relative azimuths in [0, pi], as the logarithms of the
+// XYZV of the Rayleigh and Mie parts, so light that fades exponentially
+// interpolates well. Frames interpolate between the two keyframes around the
+// Sun, and separately around the Moon, whose light is sunlight scaled by its
+// phase, so both share one set of tables.
+//
+// Keyframes sit on a grid of body zenith angles that halves around a frame's
+// zenith as long as the table at the middle of an interval differs from the
+// blend of its ends by more than the tolerance (relative to its brightness),
+// down to pi / 2048 apart. They are dense in twilight, where the sky changes
+// fast, and sparse at noon and midnight. Tables are built the first time a
+// frame needs them, so the result does not depend on the order of the frames.
+#define SKY_KEY_ZENITHS 128
+#define SKY_KEY_AZIMUTHS 64
+
+typedef struct SkyKeyframes SkyKeyframes;
+
+// Interpolation weights of one body for a frame
+typedef struct {
+    const float* table[2];      // Keyframes around the body's zenith angle
+    float weight;               // Of table[1]
+    Vec3 dir;
+    float azimuth;              // Radians
+    float scale;                // Light relative to the tables'
+} SkyKeyBody;
+
+// Keyframes of atm seen from cam_radius metres from the Earth's centre, lit
+// by light. lut, which must outlive the set, speeds up building the tables.
+// tolerance is the largest relative error allowed, e.g. 0.01. Returns NULL if
+// out of memory.
+SkyKeyframes* sky_keyframes_create(const Atmosphere* atm, const AtmosphereLUT* lut, float cam_radius,
+                                   const Spectrum* light, float tolerance);
+void sky_keyframes_free(SkyKeyframes* keys);
+
+// Whether keys were made for these arguments of sky_keyframes_create
+bool sky_keyframes_match(const SkyKeyframes* keys, float cam_radius, const Spectrum* light, float tolerance);
+
+// Builds the keyframes a body in direction dir needs, with light scale times
+// the tables', and fills body. Returns false if out of memory.
+bool sky_keyframes_prepare(SkyKeyframes* keys, Vec3 dir, float scale, SkyKeyBody* body);
+
+// Scattered light of sun and moon along view direction dir, and the
+// transmittance along it like atmosphere_render
+XYZV sky_keyframes_eval(const SkyKeyframes* keys, const SkyKeyBody* sun, const SkyKeyBody* moon, Vec3 dir,
+                        float* out_alpha);
+
+// Keyframes built so far
+int sky_keyframes_count(const SkyKeyframes* keys);
+
+#endif
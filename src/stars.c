@@ -3,20 +3,6 @@
 #include <string.h>
 #include <math.h>
 
-static XYZV CIE_XYZV_weighted[SPECTRUM_BANDS];
-static bool cie_cached = false;
-
-static void init_cie_cache() {
-    if (cie_cached) return;
-    Spectrum s;
-    for (int i = 0; i < SPECTRUM_BANDS; i++) {
-        spectrum_zero(&s);
-        s.s[i] = 1.0f;
-        CIE_XYZV_weighted[i] = spectrum_to_xyzv(&s);
-    }
-    cie_cached = true;
-}
-
 float bv_to_temp(float bv) {
     float term1 = 1.0f / (0.92f * bv + 1.7f);
     float term2 = 1.0f / (0.92f * bv + 0.62f);
@@ -84,7 +70,15 @@ int load_stars(const char* filepath, float mag_limit, Star** stars) {
 }
 
 void render_stars(const Star* stars, int num_stars, const RenderCamera* cam, float aperture, ImageHDR* hdr) {
-    init_cie_cache();
+    render_stars_window(stars, NULL, num_stars, cam, aperture, hdr, 0, 0);
+}
+
+void render_stars_window(const Star* stars, const Vec3* dirs, int num_stars, const RenderCamera* cam, float aperture,
+                         ImageHDR* hdr, int col0, int row0) {
+    int col_begin = col0 > 0 ? col0 : 0;
+    int col_end = col0 + hdr->width < cam->width ? col0 + hdr->width : cam->width;
+    int row_begin = row0 > 0 ? row0 : 0;
+    int row_end = row0 + hdr->height < cam->height ? row0 + hdr->height : cam->height;
 
     // Constant sigma based on 550nm wavelength
     float lambda_550nm = 550.0f;
@@ -98,6 +92,7 @@ void render_stars(const Star* stars, int num_stars, const RenderCamera* cam, flo
 
     for (int i = 0; i < num_stars; i++) {
         Star s = stars[i];
+        if (dirs) s.direction = dirs[i];
         if (s.direction.y <= 0) continue; 
 
         float px, py;
@@ -113,7 +108,7 @@ void render_stars(const Star* stars, int num_stars, const RenderCamera* cam, flo
             py = (1.0f - vec3_dot(s.direction, cam->up) / dz / cam->tan_half_fov) * 0.5f * cam->height;
         }
 
-        if (px < -20 || px >= cam->width + 20 || py < -20 || py >= cam->height + 20) continue;
+        if (px < col_begin - 20 || px >= col_end + 20 || py < row_begin - 20 || py >= row_end + 20) continue;
 
         Spectrum spec;
         blackbody_spectrum(bv_to_temp(s.bv), &spec);
@@ -146,10 +141,10 @@ void render_stars(const Star* stars, int num_stars, const RenderCamera* cam, flo
         int y_start = (int)py - radius;
         int y_end = (int)py + radius;
 
-        if (x_start < 0) x_start = 0;
-        if (x_end >= cam->width) x_end = cam->width - 1;
-        if (y_start < 0) y_start = 0;
-        if (y_end >= cam->height) y_end = cam->height - 1;
+        if (x_start < col_begin) x_start = col_begin;
+        if (x_end >= col_end) x_end = col_end - 1;
+        if (y_start < row_begin) y_start = row_begin;
+        if (y_end >= row_end) y_end = row_end - 1;
 
         float rad_factor = 1.0f / (solid_angle + 1e-15f);
 
@@ -158,11 +153,13 @@ void render_stars(const Star* stars, int num_stars, const RenderCamera* cam, flo
                 float weight = integrate_gaussian_2d((float)ix - px, (float)iy - py, (float)ix + 1.0f - px, (float)iy + 1.0f - py, sigma_px);
                 float f = weight * rad_factor;
                 
-                int idx = iy * cam->width + ix;
+                int idx = (iy - row0) * hdr->width + (ix - col0);
+                float old_Y = hdr->pixels[idx].Y;
                 hdr->pixels[idx].X += star_xyzv.X * f;
                 hdr->pixels[idx].Y += star_xyzv.Y * f;
                 hdr->pixels[idx].Z += star_xyzv.Z * f;
                 hdr->pixels[idx].V += star_xyzv.V * f;
+                if (hdr->hist) lum_hist_update(hdr->hist, old_Y, hdr->pixels[idx].Y);
             }
         }
     }
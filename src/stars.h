@@ -36,5 +36,11 @@ typedef struct {
 
 // Render stars to an HDR image using PSF
 void render_stars(const Star* stars, int num_stars, const RenderCamera* cam, float aperture, ImageHDR* hdr);
+// The same for a window of the camera image: hdr holds columns [col0, col0 +
+// hdr->width) of rows [row0, row0 + hdr->height) and may reach past the
+// image, where nothing is drawn. dirs, if not NULL, holds the direction of
+// each star in place of its own, for a catalog shared between renders.
+void render_stars_window(const Star* stars, const Vec3* dirs, int num_stars, const RenderCamera* cam, float aperture,
+                         ImageHDR* hdr, int col0, int row0);
 
 #endif
@@ -1,25 +1,120 @@
 #include "tonemap.h"
+#include "parallel.h"
+#include <pthread.h>
+#include <stdint.h>
 
 ImageHDR* image_hdr_create(int w, int h) {
     ImageHDR* img = (ImageHDR*)malloc(sizeof(ImageHDR));
+    if (!img) return NULL;
     img->width = w;
     img->height = h;
-    img->pixels = (XYZV*)calloc(w * h, sizeof(XYZV));
+    img->pixels = (XYZV*)calloc((size_t)w * h, sizeof(XYZV));
+    img->hist = NULL;
+    if (!img->pixels) {
+        free(img);
+        return NULL;
+    }
+    return img;
+}
+
+ImageHDR* image_hdr_copy(const ImageHDR* src) {
+    ImageHDR* img = (ImageHDR*)malloc(sizeof(ImageHDR));
+    if (!img) return NULL;
+    size_t count = (size_t)src->width * src->height;
+    img->width = src->width;
+    img->height = src->height;
+    img->pixels = (XYZV*)malloc(sizeof(XYZV) * count);
+    img->hist = src->hist ? (LumHistogram*)malloc(sizeof(LumHistogram)) : NULL;
+    if (!img->pixels || (src->hist && !img->hist)) {
+        image_hdr_free(img);
+        return NULL;
+    }
+    memcpy(img->pixels, src->pixels, sizeof(XYZV) * count);
+    if (img->hist) *img->hist = *src->hist;
     return img;
 }
 
 void image_hdr_free(ImageHDR* img) {
     if (img) {
         free(img->pixels);
+        free(img->hist);
         free(img);
     }
 }
 
+void image_hdr_track_histogram(ImageHDR* img) {
+    free(img->hist);
+    img->hist = (LumHistogram*)malloc(sizeof(LumHistogram));
+    if (img->hist) lum_hist_clear(img->hist);
+}
+
+void lum_hist_clear(LumHistogram* h) {
+    memset(h, 0, sizeof(LumHistogram));
+}
+
+void lum_hist_merge(LumHistogram* dst, const LumHistogram* src) {
+    for (int b = 0; b < LUM_HIST_BINS; b++) dst->bins[b] += src->bins[b];
+    dst->count += src->count;
+    if (src->max_Y > dst->max_Y) dst->max_Y = src->max_Y;
+}
+
+typedef struct {
+    int n, parts;
+    LumHistogram* hists;
+    HistRangeFn fn;
+    void* ctx;
+} HistPartJob;
+
+static void hist_parts(int begin, int end, void* ctx) {
+    HistPartJob* job = (HistPartJob*)ctx;
+    for (int p = begin; p < end; p++) {
+        int b = (int)((long long)job->n * p / job->parts);
+        int e = (int)((long long)job->n * (p + 1) / job->parts);
+        job->fn(b, e, job->hists ? &job->hists[p] : NULL, job->ctx);
+    }
+}
+
+void parallel_for_hist(int n, int min_chunk, LumHistogram* hist, HistRangeFn fn, void* ctx) {
+    if (n <= 0) return;
+    if (min_chunk < 1) min_chunk = 1;
+    int parts = parallel_num_threads();
+    if (parts > n / min_chunk) parts = n / min_chunk;
+    if (parts < 1) parts = 1;
+
+    HistPartJob job = { n, parts, NULL, fn, ctx };
+    if (hist && parts > 1) job.hists = (LumHistogram*)calloc(parts, sizeof(LumHistogram));
+    if (hist && !job.hists) {
+        // Single range (or no memory for per-range histograms): record directly
+        fn(0, n, hist, ctx);
+        return;
+    }
+    parallel_for(parts, 1, hist_parts, &job);
+    if (job.hists) {
+        for (int p = 0; p < parts; p++) lum_hist_merge(hist, &job.hists[p]);
+        free(job.hists);
+    }
+}
+
+static void hist_from_pixels(int begin, int end, LumHistogram* hist, void* ctx) {
+    const XYZV* pixels = (const XYZV*)ctx;
+    for (int i = begin; i < end; i++) lum_hist_add(hist, pixels[i].Y);
+}
+
+void lum_hist_from_image(LumHistogram* h, const ImageHDR* img) {
+    lum_hist_clear(h);
+    parallel_for_hist(img->width * img->height, 65536, h, hist_from_pixels, img->pixels);
+}
+
 ImageRGB* image_rgb_create(int w, int h) {
     ImageRGB* img = (ImageRGB*)malloc(sizeof(ImageRGB));
+    if (!img) return NULL;
     img->width = w;
     img->height = h;
-    img->pixels = (RGB*)calloc(w * h, sizeof(RGB));
+    img->pixels = (RGB*)calloc((size_t)w * h, sizeof(RGB));
+    if (!img->pixels) {
+        free(img);
+        return NULL;
+    }
     return img;
 }
 
@@ -37,32 +132,79 @@ static float smoothstep(float edge0, float edge1, float x) {
     return x * x * (3.0f - 2.0f * x);
 }
 
-void apply_night_post_processing(ImageHDR* src, ImageRGB* dst, float exposure_boost_stops) {
-    int count = src->width * src->height;
-    
-    // 1. Calculate Log-Average Luminance for Auto-Exposure
-    float sum_log_Y = 0;
-    int valid_pixels = 0;
-    float max_Y = 0;
+// Rod saturation runs over log10(Y) in [-2, 0.6]; outside it s is exactly 0 or 1
+#define MESOPIC_LOW 0.01f
+#define MESOPIC_HIGH 3.98107171f
 
-    for (int i = 0; i < count; i++) {
-        float Y = src->pixels[i].Y;
-        // Ignore very dark pixels (like the artificial ground ~1e-8) to prevent skewing auto-exposure
-        if (Y > 1e-6f) {
-            sum_log_Y += logf(Y);
-            valid_pixels++;
-            if (Y > max_Y) max_Y = Y;
-        }
+// Gamma LUT indexed by the float exponent and top mantissa bits, so the relative
+// spacing is constant and linear interpolation is accurate down to deep shadows.
+#define GAMMA_LUT_OCTAVES 32
+#define GAMMA_LUT_BITS 6
+#define GAMMA_LUT_STEPS (1 << GAMMA_LUT_BITS)
+#define GAMMA_LUT_SIZE (GAMMA_LUT_OCTAVES * GAMMA_LUT_STEPS + 1)
+
+static float gamma_lut[GAMMA_LUT_SIZE];
+static pthread_once_t gamma_lut_once = PTHREAD_ONCE_INIT;
+
+static void gamma_lut_init(void) {
+    for (int i = 0; i < GAMMA_LUT_SIZE; i++) {
+        int e = i / GAMMA_LUT_STEPS - GAMMA_LUT_OCTAVES;
+        double x = ldexp(1.0 + (double)(i % GAMMA_LUT_STEPS) / GAMMA_LUT_STEPS, e);
+        gamma_lut[i] = (float)pow(x, 1.0 / 2.2);
     }
-    
-    float L_avg = (valid_pixels > 0) ? expf(sum_log_Y / valid_pixels) : 0.001f;
-    
+}
+
+static inline float gamma_encode(float x) {
+    if (x >= 1.0f) return 1.0f;
+    if (!(x > 2.3283064e-10f)) return 0.0f; // 2^-32; also catches NaN
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int e = (int)((bits >> 23) & 0xff) - 127;
+    int idx = (e + GAMMA_LUT_OCTAVES) * GAMMA_LUT_STEPS + (int)((bits >> (23 - GAMMA_LUT_BITS)) & (GAMMA_LUT_STEPS - 1));
+    float frac = (float)(bits & ((1u << (23 - GAMMA_LUT_BITS)) - 1)) * (1.0f / (1u << (23 - GAMMA_LUT_BITS)));
+    return gamma_lut[idx] + (gamma_lut[idx + 1] - gamma_lut[idx]) * frac;
+}
+
+// Log-average of the histogram, skipping the brightest `trim` fraction of pixels.
+// Each bin contributes at its center; with 64 bins per decade the error in
+// L_avg is well below 1%.
+static float hist_log_average(const LumHistogram* h, float trim, long long* used) {
+    long long keep = h->count - (long long)(h->count * (double)trim);
+    double sum = 0;
+    long long n = 0;
+    for (int b = 0; b < LUM_HIST_BINS && n < keep; b++) {
+        long long c = h->bins[b];
+        if (c > keep - n) c = keep - n;
+        if (c <= 0) continue;
+        double log10_center = LUM_HIST_LOG_MIN + (b + 0.5) / LUM_HIST_BINS_PER_DECADE;
+        sum += c * log10_center;
+        n += c;
+    }
+    *used = n;
+    return n > 0 ? (float)pow(10.0, sum / n) : 0.0f;
+}
+
+float tonemap_meter(const ImageHDR* src, float* max_Y) {
+    LumHistogram local;
+    const LumHistogram* hist = src->hist;
+    if (!hist) {
+        lum_hist_from_image(&local, src);
+        hist = &local;
+    }
+    long long used = 0;
+    float L_avg = hist_log_average(hist, TONEMAP_HIGHLIGHT_TRIM, &used);
+    if (used == 0) L_avg = 0.001f;
+    if (max_Y) *max_Y = hist->max_Y;
+
     // Clamp L_avg to a minimum floor to avoid over-exposing deep night
     if (L_avg < 1.0e-5f) L_avg = 1.0e-5f;
+    return L_avg;
+}
 
+void tonemap_params_from_luminance(float L_avg, float max_Y, float exposure_boost_stops, ToneParams* params) {
     printf("DEBUG: Scene L_avg: %e, MaxY: %e\n", L_avg, max_Y);
-    
-    // Key value: 0.18 is "middle grey". 
+
+    // Key value: 0.18 is "middle grey".
     // For night, we want it lower, but twilight needs something reasonable.
     // Let's use a key that scales slightly with brightness.
     float key = 0.18f;
@@ -70,129 +212,366 @@ void apply_night_post_processing(ImageHDR* src, ImageRGB* dst, float exposure_bo
 
     // Apply exposure boost (f-stops)
     key *= powf(2.0f, exposure_boost_stops);
-    
+
+    params->L_avg = L_avg;
+    params->key = key;
+    params->max_Y = max_Y;
+}
+
+void tonemap_compute_params(const ImageHDR* src, float exposure_boost_stops, ToneParams* params) {
+    float max_Y = 0;
+    float L_avg = tonemap_meter(src, &max_Y);
+    tonemap_params_from_luminance(L_avg, max_Y, exposure_boost_stops, params);
+}
+
+void exposure_state_init(ExposureState* st, float tau_brighten, float tau_darken) {
+    st->valid = false;
+    st->time = 0;
+    st->log_L = 0;
+    st->tau_brighten = tau_brighten;
+    st->tau_darken = tau_darken;
+}
+
+float exposure_adapt(ExposureState* st, double time_s, float L_avg) {
+    float target = log10f(L_avg);
+    double dt = time_s - st->time;
+    if (!st->valid || dt < 0 || dt > EXPOSURE_MAX_GAP) {
+        // First frame, or the sequence jumped: start adapted to this scene
+        st->log_L = target;
+    } else {
+        float tau = (target > st->log_L) ? st->tau_brighten : st->tau_darken;
+        float alpha = (tau > 0) ? 1.0f - expf(-(float)dt / tau) : 1.0f;
+        st->log_L += alpha * (target - st->log_L);
+    }
+    st->valid = true;
+    st->time = time_s;
+    return powf(10.0f, st->log_L);
+}
+
+bool exposure_state_load(ExposureState* st, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    int version = 0;
+    double time_s;
+    float log_L;
+    bool ok = fscanf(f, "knight-exposure %d time %lf log_L %f", &version, &time_s, &log_L) == 3 &&
+              version == EXPOSURE_STATE_VERSION;
+    fclose(f);
+    if (!ok) return false;
+    st->valid = true;
+    st->time = time_s;
+    st->log_L = log_L;
+    return true;
+}
+
+bool exposure_state_save(const ExposureState* st, const char* path) {
+    if (!st->valid) return false;
+    FILE* f = fopen(path, "w");
+    if (!f) return false;
+    fprintf(f, "knight-exposure %d\ntime %.3f\nlog_L %.9g\n", EXPOSURE_STATE_VERSION, st->time, st->log_L);
+    return fclose(f) == 0;
+}
+
+typedef struct {
+    const XYZV* src;
+    RGB* dst;
+    float scale; // key / L_avg
+} ToneMapJob;
+
+static void tonemap_range(int begin, int end, void* ctx) {
+    const ToneMapJob* job = (const ToneMapJob*)ctx;
+    const XYZV* restrict in = job->src;
+    RGB* restrict out = job->dst;
+    const float scale = job->scale;
+
     // 2. Blue Shift (Mesopic)
-    float xb = 0.25f;
-    float yb = 0.25f;
-    
-    for (int i = 0; i < count; i++) {
-        XYZV p = src->pixels[i];
-        
+    const float xb = 0.25f;
+    const float yb = 0.25f;
+    // We use a white point to allow some burning
+    const float inv_white2 = 1.0f / (1000.0f * 1000.0f);
+
+    for (int i = begin; i < end; i++) {
+        XYZV p = in[i];
         float Y = p.Y;
         if (Y <= 0) {
-            dst->pixels[i] = (RGB){0,0,0};
+            out[i] = (RGB){0, 0, 0};
             continue;
         }
-        
-        // Rod saturation s
-        float logY = log10f(Y + 1e-9f);
-        float s = smoothstep(-2.0f, 0.6f, logY);
-        
+
+        // Rod saturation s. log10 is only needed inside the mesopic range.
+        float s = 0.0f;
+        if (Y >= MESOPIC_HIGH) s = 1.0f;
+        else if (Y > MESOPIC_LOW) s = smoothstep(-2.0f, 0.6f, log10f(Y + 1e-9f));
+
         // Current chromaticity
         float xyz_sum = p.X + p.Y + p.Z;
         if (xyz_sum == 0) xyz_sum = 1.0f;
-        float x = p.X / xyz_sum;
-        float y = p.Y / xyz_sum;
-        
+        float inv_sum = 1.0f / xyz_sum;
+
         // Shift towards blue
-        float x_new = (1.0f - s) * xb + s * x;
-        float y_new = (1.0f - s) * yb + s * y;
-        
+        float x_new = (1.0f - s) * xb + s * p.X * inv_sum;
+        float y_new = (1.0f - s) * yb + s * p.Y * inv_sum;
+
         // Mix Luminance (Purkinje)
         float Y_mixed = 0.4468f * (1.0f - s) * p.V + s * Y;
-        
+
         // Reconstruct XYZ
         if (y_new < 1e-4f) y_new = 1e-4f;
         float new_sum = Y_mixed / y_new;
-        float X_final = x_new * new_sum;
-        float Z_final = (1.0f - x_new - y_new) * new_sum;
-        float Y_final = Y_mixed;
-        
-        // 3. Reinhard Tone Mapping
-        // Scale by key/L_avg
-        float L_scaled = (Y_final * key) / L_avg;
-        
-        // Simple Reinhard: L_d = L_s / (1 + L_s)
-        // We use a white point to allow some burning
-        float L_white = 1000.0f; 
-        float Y_tonemapped = (L_scaled * (1.0f + L_scaled / (L_white * L_white))) / (1.0f + L_scaled);
-        
-        float scale = Y_tonemapped / (Y_final + 1e-9f);
-        X_final *= scale;
-        Y_final *= scale;
-        Z_final *= scale;
-        
+
+        // 3. Reinhard Tone Mapping, scaled by key/L_avg
+        float L_scaled = Y_mixed * scale;
+        float Y_tonemapped = (L_scaled * (1.0f + L_scaled * inv_white2)) / (1.0f + L_scaled);
+        float k = Y_tonemapped / (Y_mixed + 1e-9f);
+
+        float X_final = x_new * new_sum * k;
+        float Y_final = Y_mixed * k;
+        float Z_final = (1.0f - x_new - y_new) * new_sum * k;
+
         // 4. Linear to sRGB and Gamma
         RGB rgb = xyz_to_srgb(X_final, Y_final, Z_final);
-        
-        if (rgb.r < 0) rgb.r = 0;
-        if (rgb.g < 0) rgb.g = 0;
-        if (rgb.b < 0) rgb.b = 0;
-        if (rgb.r > 1) rgb.r = 1;
-        if (rgb.g > 1) rgb.g = 1;
-        if (rgb.b > 1) rgb.b = 1;
-        
-        rgb.r = powf(rgb.r, 1.0f/2.2f);
-        rgb.g = powf(rgb.g, 1.0f/2.2f);
-        rgb.b = powf(rgb.b, 1.0f/2.2f);
-        
-        dst->pixels[i] = rgb;
+        out[i] = (RGB){gamma_encode(rgb.r), gamma_encode(rgb.g), gamma_encode(rgb.b)};
+    }
+}
+
+void tonemap_apply(const ImageHDR* src, ImageRGB* dst, const ToneParams* params) {
+    pthread_once(&gamma_lut_once, gamma_lut_init);
+    ToneMapJob job = { src->pixels, dst->pixels, params->key / params->L_avg };
+    parallel_for(src->width * src->height, 4096, tonemap_range, &job);
+}
+
+void apply_night_post_processing(ImageHDR* src, ImageRGB* dst, float exposure_boost_stops) {
+    // 1. Log-Average Luminance for Auto-Exposure
+    ToneParams params;
+    tonemap_compute_params(src, exposure_boost_stops, &params);
+    tonemap_apply(src, dst, &params);
+}
+
+// Large Gaussians are approximated by three successive box filters (Kovesi, "Fast
+// Almost-Gaussian Filtering"). Each box pass is a running sum, so the cost per
+// pixel does not depend on the blur radius. Sums are kept in double because
+// bright sources (sun, moon) and the night sky differ by ~10 orders of magnitude
+// and a float running sum would leave visible residue after subtracting them.
+// Below GLARE_BOX_MIN_SIGMA the box approximation is too coarse (the default
+// bloom is sub-pixel), so a short exact separable kernel is used instead.
+#define GLARE_BOX_PASSES 3
+#define GLARE_BOX_MIN_SIGMA 2.5f
+#define GLARE_MAX_TAPS 32
+
+static void gaussian_box_radii(float sigma, int* radii) {
+    float w_ideal = sqrtf(12.0f * sigma * sigma / GLARE_BOX_PASSES + 1.0f);
+    int wl = (int)floorf(w_ideal);
+    if (wl % 2 == 0) wl--;
+    int wu = wl + 2;
+    float m_ideal = (12.0f * sigma * sigma - GLARE_BOX_PASSES * wl * wl - 4.0f * GLARE_BOX_PASSES * wl - 3.0f * GLARE_BOX_PASSES) / (-4.0f * wl - 4.0f);
+    int m = (int)roundf(m_ideal);
+    for (int i = 0; i < GLARE_BOX_PASSES; i++) radii[i] = ((i < m ? wl : wu) - 1) / 2;
+}
+
+typedef struct {
+    float* data; // XYZV as 4 floats per pixel
+    int w, h;
+    int r;
+    const float* taps; // 2r+1 kernel weights for the exact passes
+} BoxBlurJob;
+
+// Horizontal box pass, in place, over rows [begin, end)
+static void box_blur_rows(int begin, int end, void* ctx) {
+    BoxBlurJob* job = (BoxBlurJob*)ctx;
+    int w = job->w, r = job->r;
+    float norm = 1.0f / (2 * r + 1);
+    float* orig = (float*)malloc(sizeof(float) * 4 * w);
+
+    for (int y = begin; y < end; y++) {
+        float* row = job->data + (size_t)y * w * 4;
+        memcpy(orig, row, sizeof(float) * 4 * w);
+
+        double acc[4] = {0, 0, 0, 0};
+        for (int x = 0; x < r && x < w; x++) {
+            for (int c = 0; c < 4; c++) acc[c] += orig[x * 4 + c];
+        }
+        for (int x = 0; x < w; x++) {
+            int xa = x + r, xs = x - r - 1;
+            if (xa < w) for (int c = 0; c < 4; c++) acc[c] += orig[xa * 4 + c];
+            if (xs >= 0) for (int c = 0; c < 4; c++) acc[c] -= orig[xs * 4 + c];
+            for (int c = 0; c < 4; c++) row[x * 4 + c] = (float)acc[c] * norm;
+        }
+    }
+    free(orig);
+}
+
+// Vertical box pass, in place, over pixel columns [begin, end).
+// Whole row segments are processed at once so the inner loops run over contiguous
+// floats and vectorize; a ring buffer keeps the original rows that leave the window.
+static void box_blur_cols(int begin, int end, void* ctx) {
+    BoxBlurJob* job = (BoxBlurJob*)ctx;
+    int w = job->w, h = job->h, r = job->r;
+    int n = (end - begin) * 4;
+    int ring_rows = r + 2;
+    float norm = 1.0f / (2 * r + 1);
+
+    double* acc = (double*)calloc(n, sizeof(double));
+    float* ring = (float*)malloc(sizeof(float) * n * ring_rows);
+
+    for (int y = 0; y < r && y < h; y++) {
+        const float* src = job->data + ((size_t)y * w + begin) * 4;
+        for (int i = 0; i < n; i++) acc[i] += src[i];
+    }
+    for (int y = 0; y < h; y++) {
+        float* row = job->data + ((size_t)y * w + begin) * 4;
+        int ya = y + r, ys = y - r - 1;
+        if (ya < h) {
+            const float* add = job->data + ((size_t)ya * w + begin) * 4;
+            for (int i = 0; i < n; i++) acc[i] += add[i];
+        }
+        if (ys >= 0) {
+            const float* sub = ring + (size_t)(ys % ring_rows) * n;
+            for (int i = 0; i < n; i++) acc[i] -= sub[i];
+        }
+        memcpy(ring + (size_t)(y % ring_rows) * n, row, sizeof(float) * n);
+        for (int i = 0; i < n; i++) row[i] = (float)acc[i] * norm;
+    }
+    free(acc);
+    free(ring);
+}
+
+// Exact separable Gaussian, horizontal, in place over rows [begin, end)
+static void gauss_blur_rows(int begin, int end, void* ctx) {
+    BoxBlurJob* job = (BoxBlurJob*)ctx;
+    int w = job->w, r = job->r;
+    float* orig = (float*)malloc(sizeof(float) * 4 * w);
+
+    for (int y = begin; y < end; y++) {
+        float* row = job->data + (size_t)y * w * 4;
+        memcpy(orig, row, sizeof(float) * 4 * w);
+        for (int x = 0; x < w; x++) {
+            float acc[4] = {0, 0, 0, 0};
+            for (int k = -r; k <= r; k++) {
+                int xs = x + k;
+                if (xs < 0 || xs >= w) continue;
+                for (int c = 0; c < 4; c++) acc[c] += orig[xs * 4 + c] * job->taps[k + r];
+            }
+            for (int c = 0; c < 4; c++) row[x * 4 + c] = acc[c];
+        }
     }
+    free(orig);
+}
+
+// Exact separable Gaussian, vertical, in place over pixel columns [begin, end).
+// The ring buffer holds the original values of the r rows above the current one.
+static void gauss_blur_cols(int begin, int end, void* ctx) {
+    BoxBlurJob* job = (BoxBlurJob*)ctx;
+    int w = job->w, h = job->h, r = job->r;
+    int n = (end - begin) * 4;
+    int ring_rows = r + 1;
+
+    float* acc = (float*)malloc(sizeof(float) * n);
+    float* ring = (float*)malloc(sizeof(float) * n * ring_rows);
+
+    for (int y = 0; y < h; y++) {
+        float* row = job->data + ((size_t)y * w + begin) * 4;
+        for (int i = 0; i < n; i++) acc[i] = 0.0f;
+        for (int k = -r; k <= r; k++) {
+            int ys = y + k;
+            if (ys < 0 || ys >= h) continue;
+            const float* src = (k < 0) ? ring + (size_t)(ys % ring_rows) * n : job->data + ((size_t)ys * w + begin) * 4;
+            float t = job->taps[k + r];
+            for (int i = 0; i < n; i++) acc[i] += src[i] * t;
+        }
+        memcpy(ring + (size_t)(y % ring_rows) * n, row, sizeof(float) * n);
+        memcpy(row, acc, sizeof(float) * n);
+    }
+    free(acc);
+    free(ring);
+}
+
+typedef struct {
+    XYZV* dst;
+    const XYZV* src;
+    float threshold;
+    float gain;
+} GlarePixelJob;
+
+static void glare_bright_pass(int begin, int end, void* ctx) {
+    GlarePixelJob* job = (GlarePixelJob*)ctx;
+    for (int i = begin; i < end; i++) {
+        XYZV p = job->src[i];
+        job->dst[i] = (p.Y < job->threshold) ? (XYZV){0, 0, 0, 0} : p;
+    }
+}
+
+static void glare_composite(int begin, int end, LumHistogram* hist, void* ctx) {
+    GlarePixelJob* job = (GlarePixelJob*)ctx;
+    float g = job->gain;
+    for (int i = begin; i < end; i++) {
+        float old_Y = job->dst[i].Y;
+        job->dst[i].X += job->src[i].X * g;
+        job->dst[i].Y += job->src[i].Y * g;
+        job->dst[i].Z += job->src[i].Z * g;
+        job->dst[i].V += job->src[i].V * g;
+        if (hist && job->src[i].Y != 0.0f) lum_hist_update(hist, old_Y, job->dst[i].Y);
+    }
+}
+
+// Sigma of the bloom Gaussian in pixels, the same angle at every resolution
+static float bloom_sigma(int width, float bloom_size_deg, float fov_deg) {
+    float sigma = (bloom_size_deg / fov_deg) * width;
+    return sigma < 0.8f ? 0.8f : sigma; // Minimum blur
+}
+
+int apply_glare_reach(int width, float bloom_size_deg, float fov_deg) {
+    float sigma = bloom_sigma(width, bloom_size_deg, fov_deg);
+    if (sigma < GLARE_BOX_MIN_SIGMA) return (int)ceilf(3.0f * sigma);
+    int radii[GLARE_BOX_PASSES];
+    gaussian_box_radii(sigma, radii);
+    int reach = 0;
+    for (int i = 0; i < GLARE_BOX_PASSES; i++) reach += radii[i];
+    return reach;
 }
 
 void apply_glare(ImageHDR* img, float bloom_size_deg, float fov_deg) {
     int w = img->width;
     int h = img->height;
-    XYZV* temp = (XYZV*)calloc(w * h, sizeof(XYZV));
-    
-    // Copy original
-    memcpy(temp, img->pixels, w * h * sizeof(XYZV));
-    
+    int count = w * h;
+    XYZV* bright = (XYZV*)malloc(sizeof(XYZV) * count);
+    if (!bright) return;
+
     // Threshold to prevent glowing sky. 0.01 is bright enough for stars but low enough for consistency.
-    float threshold = 0.01f; 
-    
-    // Sigma for Gaussian. Make it angularly consistent.
-    float sigma = (bloom_size_deg / fov_deg) * w;
-    if (sigma < 0.8f) sigma = 0.8f; // Minimum blur
-    
-    float inv_2sigma2 = 1.0f / (2.0f * sigma * sigma);
-    
+    float threshold = 0.01f;
+
+    float sigma = bloom_sigma(w, bloom_size_deg, fov_deg);
+
     // Spread factor (total energy redistributed)
     float spread_factor = 0.05f;
-            
-    int k_radius = (int)(sigma * 3.0f);
-    if (k_radius < 2) k_radius = 2;
-    if (k_radius > 10) k_radius = 10; // Cap for performance
-            
-    for (int y = 0; y < h; y++) {
-        for (int x = 0; x < w; x++) {
-            XYZV p = temp[y * w + x];
-            if (p.Y < threshold) continue; 
-            
-            for (int ky = -k_radius; ky <= k_radius; ky++) {
-                for (int kx = -k_radius; kx <= k_radius; kx++) {
-                    if (kx == 0 && ky == 0) continue; 
-                    
-                    int nx = x + kx;
-                    int ny = y + ky;
-                    
-                    if (nx >= 0 && nx < w && ny >= 0 && ny < h) {
-                        float dist2 = (float)(kx*kx + ky*ky);
-                        float wgt = expf(-dist2 * inv_2sigma2);
-                        
-                        // Normalized weight approx
-                        float s = wgt * spread_factor * (1.0f / (6.28f * sigma * sigma)); 
-                        
-                        XYZV* dest = &img->pixels[ny * w + nx];
-                        dest->X += p.X * s;
-                        dest->Y += p.Y * s;
-                        dest->Z += p.Z * s;
-                        dest->V += p.V * s;
-                    }
-                }
-            }
+
+    GlarePixelJob pix = { bright, img->pixels, threshold, spread_factor };
+    parallel_for(count, 65536, glare_bright_pass, &pix);
+
+    if (sigma < GLARE_BOX_MIN_SIGMA) {
+        float taps[GLARE_MAX_TAPS];
+        int r = (int)ceilf(3.0f * sigma);
+        float sum = 0.0f;
+        for (int k = -r; k <= r; k++) {
+            taps[k + r] = expf(-(float)(k * k) / (2.0f * sigma * sigma));
+            sum += taps[k + r];
+        }
+        for (int k = 0; k <= 2 * r; k++) taps[k] /= sum;
+        BoxBlurJob job = { (float*)bright, w, h, r, taps };
+        parallel_for(h, 16, gauss_blur_rows, &job);
+        parallel_for(w, 64, gauss_blur_cols, &job);
+    } else {
+        int radii[GLARE_BOX_PASSES];
+        gaussian_box_radii(sigma, radii);
+        for (int i = 0; i < GLARE_BOX_PASSES; i++) {
+            BoxBlurJob job = { (float*)bright, w, h, radii[i], NULL };
+            parallel_for(h, 16, box_blur_rows, &job);
+            parallel_for(w, 64, box_blur_cols, &job);
         }
     }
-    
-    free(temp);
+
+    pix.dst = img->pixels;
+    pix.src = bright;
+    parallel_for_hist(count, 65536, img->hist, glare_composite, &pix);
+
+    free(bright);
 }
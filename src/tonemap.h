@@ -3,10 +3,26 @@
 
 #include "core.h"
 
+// Log-luminance histogram used for auto-exposure. Render passes keep it up to
+// date as they write pixels, so the tone mapper does not need its own pass over
+// the image. Bins are signed so per-thread deltas (remove old value, add new)
+// can simply be summed.
+#define LUM_HIST_MIN_Y 1e-6f        // Darker pixels (the artificial ground) are not counted
+#define LUM_HIST_LOG_MIN -6.0f      // log10 of the first bin edge
+#define LUM_HIST_BINS_PER_DECADE 64
+#define LUM_HIST_BINS 1024          // 16 decades
+
+typedef struct {
+    long long bins[LUM_HIST_BINS];
+    long long count;
+    float max_Y;
+} LumHistogram;
+
 typedef struct {
     int width;
     int height;
     XYZV* pixels; // Raw spectral/XYZV data
+    LumHistogram* hist; // Luminance histogram of pixels, or NULL if not tracked
 } ImageHDR;
 
 typedef struct {
@@ -15,19 +31,117 @@ typedef struct {
     RGB* pixels;
 } ImageRGB;
 
+// All black images; NULL if out of memory
 ImageHDR* image_hdr_create(int w, int h);
 void image_hdr_free(ImageHDR* img);
+// Copies the pixels and histogram; NULL if out of memory
+ImageHDR* image_hdr_copy(const ImageHDR* src);
+
+// Starts tracking a histogram for a freshly created (all black) image.
+// Frees any previous one; image_hdr_free releases it.
+void image_hdr_track_histogram(ImageHDR* img);
 
 ImageRGB* image_rgb_create(int w, int h);
 void image_rgb_free(ImageRGB* img);
 
+static inline int lum_hist_bin(float Y) {
+    int b = (int)((log10f(Y) - LUM_HIST_LOG_MIN) * LUM_HIST_BINS_PER_DECADE);
+    if (b < 0) b = 0;
+    if (b >= LUM_HIST_BINS) b = LUM_HIST_BINS - 1;
+    return b;
+}
+
+static inline void lum_hist_add(LumHistogram* h, float Y) {
+    if (!(Y > LUM_HIST_MIN_Y)) return;
+    h->bins[lum_hist_bin(Y)]++;
+    h->count++;
+    if (Y > h->max_Y) h->max_Y = Y;
+}
+
+// Replaces a pixel's old luminance with its new one
+static inline void lum_hist_update(LumHistogram* h, float old_Y, float new_Y) {
+    if (old_Y > LUM_HIST_MIN_Y) {
+        h->bins[lum_hist_bin(old_Y)]--;
+        h->count--;
+    }
+    lum_hist_add(h, new_Y);
+}
+
+void lum_hist_clear(LumHistogram* h);
+void lum_hist_merge(LumHistogram* dst, const LumHistogram* src);
+
+// Builds the histogram of an image from scratch
+void lum_hist_from_image(LumHistogram* h, const ImageHDR* img);
+
+// Work function for parallel_for_hist: processes items [begin, end), recording
+// luminance changes in hist (NULL when the image has no histogram).
+typedef void (*HistRangeFn)(int begin, int end, LumHistogram* hist, void* ctx);
+
+// parallel_for that gives every range its own histogram and merges them into
+// hist afterwards. Counts are integers, so the result does not depend on the
+// number of threads. hist may be NULL.
+void parallel_for_hist(int n, int min_chunk, LumHistogram* hist, HistRangeFn fn, void* ctx);
+
+// Fraction of lit pixels ignored at the bright end when metering
+#define TONEMAP_HIGHLIGHT_TRIM 0.005f
+
+// Exposure for one frame
+typedef struct {
+    float L_avg;  // Log-average luminance of lit pixels
+    float key;    // Target middle grey, including the exposure boost
+    float max_Y;
+} ToneParams;
+
 // Main post-processing pipeline
 // 1. Blue Shift (XYZV -> XYZ modified)
 // 2. Tone map (XYZ -> RGB)
 // 3. Blur (optional)
 void apply_night_post_processing(ImageHDR* src, ImageRGB* dst, float exposure_boost_stops);
 
-// Applies a simple glare/bloom effect to bright pixels
+// The two halves of apply_night_post_processing. Exposure comes from the
+// image's histogram (built on the fly if it has none): the log-average of all lit
+// pixels except the brightest TONEMAP_HIGHLIGHT_TRIM fraction, so the sun disk,
+// moon and bright planets do not pull the exposure down.
+void tonemap_compute_params(const ImageHDR* src, float exposure_boost_stops, ToneParams* params);
+
+// tonemap_compute_params in two steps, for callers that adapt the metered value:
+// the trimmed log-average luminance (max_Y may be NULL), and the key for it.
+float tonemap_meter(const ImageHDR* src, float* max_Y);
+void tonemap_params_from_luminance(float L_avg, float max_Y, float exposure_boost_stops, ToneParams* params);
+
+// Exposure adaptation across the frames of a sequence. The adapted luminance
+// follows the metered one with an exponential lag, like the eye (slow to dark,
+// faster to bright), which removes frame-to-frame flicker in timelapses.
+// Times are simulated seconds, so the result does not depend on the frame step.
+#define EXPOSURE_STATE_VERSION 1
+#define EXPOSURE_TAU_BRIGHTEN 60.0f   // seconds
+#define EXPOSURE_TAU_DARKEN 300.0f
+#define EXPOSURE_MAX_GAP 21600.0      // Larger jumps (or going back in time) reset the state
+
+typedef struct {
+    bool valid;         // false until the first frame
+    double time;        // Simulated time of the last frame, seconds
+    float log_L;        // Adapted log10 luminance
+    float tau_brighten; // Time constants in seconds
+    float tau_darken;
+} ExposureState;
+
+void exposure_state_init(ExposureState* st, float tau_brighten, float tau_darken);
+
+// Advances the state to time_s with this frame's metered L_avg; returns the adapted L_avg
+float exposure_adapt(ExposureState* st, double time_s, float L_avg);
+
+// Small text file, so separate knight processes can share the state.
+// Load keeps the time constants already in st; both return false on failure.
+bool exposure_state_load(ExposureState* st, const char* path);
+bool exposure_state_save(const ExposureState* st, const char* path);
+void tonemap_apply(const ImageHDR* src, ImageRGB* dst, const ToneParams* params);
+
+// Applies a Gaussian glare/bloom effect to bright pixels.
+// The blur is separable and O(N) in the image size for any bloom_size_deg, so the
+// bloom covers the same angle at every resolution.
 void apply_glare(ImageHDR* img, float bloom_size_deg, float fov_deg);
+// How many pixels apply_glare spreads light vertically in an image width wide
+int apply_glare_reach(int width, float bloom_size_deg, float fov_deg);
 
 #endif
@@ -0,0 +1,111 @@
+#include "y4m.h"
+
+// BT.601 studio range: Y' = 16 + 219 * luma, Cb/Cr = 128 + 224 * chroma.
+// The +0.5 rounds, since every value is positive by then.
+#define LUMA_R 0.299f
+#define LUMA_G 0.587f
+#define LUMA_B 0.114f
+
+static inline float clamp01(float v) {
+    v = v > 0.0f ? v : 0.0f; // Also catches NaN
+    return v < 1.0f ? v : 1.0f;
+}
+
+// The loops below are branch free with restrict pointers so the compiler can
+// vectorize them (the Makefile adds -fno-trapping-math for this file).
+static void luma_row(const RGB* restrict in, unsigned char* restrict out, int n) {
+    for (int x = 0; x < n; x++) {
+        float y = LUMA_R * clamp01(in[x].r) + LUMA_G * clamp01(in[x].g) + LUMA_B * clamp01(in[x].b);
+        out[x] = (unsigned char)(int)(16.5f + 219.0f * y);
+    }
+}
+
+static inline void chroma(float r, float g, float b, unsigned char* u, unsigned char* v) {
+    float y = LUMA_R * r + LUMA_G * g + LUMA_B * b;
+    *u = (unsigned char)(int)(128.5f + 224.0f * 0.5f / (1.0f - LUMA_B) * (b - y));
+    *v = (unsigned char)(int)(128.5f + 224.0f * 0.5f / (1.0f - LUMA_R) * (r - y));
+}
+
+// Sums the clamped pixels of a row pair into planar r, g, b
+static void sum_rows(const RGB* restrict r0, const RGB* restrict r1, float* restrict r, float* restrict g,
+                     float* restrict b, int w) {
+    for (int x = 0; x < w; x++) {
+        r[x] = clamp01(r0[x].r) + clamp01(r1[x].r);
+        g[x] = clamp01(r0[x].g) + clamp01(r1[x].g);
+        b[x] = clamp01(r0[x].b) + clamp01(r1[x].b);
+    }
+}
+
+// Chroma of one row pair from the mean of each 2x2 block, given the row sums.
+// An odd last column averages just its own two pixels.
+static void chroma_row(const float* restrict r, const float* restrict g, const float* restrict b,
+                       unsigned char* restrict u, unsigned char* restrict v, int w) {
+    int pairs = w / 2;
+    for (int cx = 0; cx < pairs; cx++) {
+        int x = 2 * cx;
+        chroma(0.25f * (r[x] + r[x + 1]), 0.25f * (g[x] + g[x + 1]), 0.25f * (b[x] + b[x + 1]), u + cx, v + cx);
+    }
+    if (w & 1) chroma(0.5f * r[w - 1], 0.5f * g[w - 1], 0.5f * b[w - 1], u + pairs, v + pairs);
+}
+
+size_t y4m_frame_size(int width, int height) {
+    size_t chroma_size = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    return (size_t)width * height + 2 * chroma_size;
+}
+
+bool rgb_to_yuv420(const ImageRGB* img, unsigned char* yuv) {
+    int w = img->width, h = img->height;
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    unsigned char* y_plane = yuv;
+    unsigned char* u_plane = yuv + (size_t)w * h;
+    unsigned char* v_plane = u_plane + (size_t)cw * ch;
+    for (int y = 0; y < h; y++) luma_row(img->pixels + (size_t)y * w, y_plane + (size_t)y * w, w);
+    float* sums = (float*)malloc(sizeof(float) * 3 * (size_t)w);
+    if (!sums) return false;
+    for (int cy = 0; cy < ch; cy++) {
+        const RGB* r0 = img->pixels + (size_t)(2 * cy) * w;
+        const RGB* r1 = 2 * cy + 1 < h ? r0 + w : r0;
+        sum_rows(r0, r1, sums, sums + w, sums + 2 * w, w);
+        chroma_row(sums, sums + w, sums + 2 * w, u_plane + (size_t)cy * cw, v_plane + (size_t)cy * cw, w);
+    }
+    free(sums);
+    return true;
+}
+
+static long gcd(long a, long b) {
+    while (b) {
+        long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+bool write_y4m_header(FILE* f, int width, int height, double fps) {
+    // Same millisecond frame rate resolution as the AVI writer
+    long num = lround(fps * 1000.0), den = 1000;
+    if (num <= 0 || width <= 0 || height <= 0) return false;
+    long d = gcd(num, den);
+    return fprintf(f, "YUV4MPEG2 W%d H%d F%ld:%ld Ip A1:1 C420jpeg\n", width, height, num / d, den / d) > 0;
+}
+
+bool write_y4m_frame(FILE* f, const ImageRGB* img, unsigned char* yuv) {
+    size_t size = y4m_frame_size(img->width, img->height);
+    if (!rgb_to_yuv420(img, yuv)) return false;
+    return fputs("FRAME\n", f) >= 0 && fwrite(yuv, 1, size, f) == size;
+}
+
+bool write_ppm_header(FILE* f, int width, int height) {
+    return fprintf(f, "P6\n%d %d\n255\n", width, height) > 0;
+}
+
+bool write_ppm_rows(FILE* f, const ImageRGB* rows, unsigned char* rgb) {
+    size_t n = (size_t)rows->width * rows->height;
+    const float* in = (const float*)rows->pixels;
+    for (size_t i = 0; i < 3 * n; i++) rgb[i] = (unsigned char)(int)(clamp01(in[i]) * 255.0f + 0.5f);
+    return fwrite(rgb, 1, 3 * n, f) == 3 * n;
+}
+
+bool write_ppm_frame(FILE* f, const ImageRGB* img, unsigned char* rgb) {
+    return write_ppm_header(f, img->width, img->height) && write_ppm_rows(f, img, rgb);
+}
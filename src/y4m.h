@@ -0,0 +1,30 @@
+#ifndef Y4M_H
+#define Y4M_H
+
+#include "tonemap.h"
+
+// Uncompressed frame streams for piping into an encoder such as ffmpeg.
+//
+// YUV4MPEG2 (.y4m): one header, then per frame "FRAME\n" and 8 bit 4:2:0
+// Y'CbCr planes. Uses BT.601 studio range (Y' 16-235) with centred chroma
+// (C420jpeg), which is what encoders assume when the stream says nothing else.
+bool write_y4m_header(FILE* f, int width, int height, double fps);
+// Bytes of one converted frame: a full size Y' plane and two half size chroma
+// planes, rounded up for odd sizes
+size_t y4m_frame_size(int width, int height);
+// Converts img into the planes of one frame. Pixels are clamped to [0, 1].
+// Returns false if out of memory.
+bool rgb_to_yuv420(const ImageRGB* img, unsigned char* yuv);
+// Writes one frame; yuv is scratch space of y4m_frame_size bytes
+bool write_y4m_frame(FILE* f, const ImageRGB* img, unsigned char* yuv);
+
+// Binary PPM (.ppm), 8 bit RGB with its own small header. Frames can be
+// concatenated into one stream (ffmpeg -f image2pipe). rgb is scratch space of
+// width * height * 3 bytes.
+bool write_ppm_frame(FILE* f, const ImageRGB* img, unsigned char* rgb);
+// The same in parts: the header, then rows of the image top to bottom, with
+// rgb holding img->width * img->height * 3 bytes
+bool write_ppm_header(FILE* f, int width, int height);
+bool write_ppm_rows(FILE* f, const ImageRGB* rows, unsigned char* rgb);
+
+#endif
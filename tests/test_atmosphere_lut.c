@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "atmosphere.h"
+#include "atmosphere_math.h"
+
+#define DIR "test_atmosphere_cache"
+
+static void lut_path(char* path, size_t size, const Atmosphere* atm) {
+    snprintf(path, size, "%s/atm-%016llx.lut", DIR, (unsigned long long)atmosphere_lut_key(atm));
+}
+
+// The table must follow the ray marched transmittance above the horizon, to
+// a few percent just over it where the transmittance falls steeply
+static void test_accuracy(void) {
+    Atmosphere atm;
+    atmosphere_init_default(&atm, 1.0f);
+    AtmosphereLUT lut;
+    assert(atmosphere_lut_open(&lut, &atm, NULL));
+    assert(lut.table && !lut.map);
+    float heights[] = {0.0f, 800.0f, 5000.0f, 30000.0f};
+    float worst = 0.0f;
+    for (int i = 0; i < 4; i++) {
+        Vec3 p = {0.0f, EARTH_RADIUS + heights[i], 0.0f};
+        float mu_h = atmosphere_horizon_mu(&atm, p.y);
+        for (float mu = mu_h + 0.01f; mu <= 1.0f; mu += 0.0037f) {
+            Vec3 dir = {sqrtf(1.0f - mu * mu), mu, 0.0f};
+            Spectrum a = atmosphere_transmittance(&atm, NULL, p, dir);
+            Spectrum b = atmosphere_transmittance(&atm, &lut, p, dir);
+            for (int k = 0; k < SPECTRUM_BANDS; k++) {
+                float err = fabsf(a.s[k] - b.s[k]) / (a.s[k] + 1e-3f);
+                if (err > worst) worst = err;
+            }
+        }
+    }
+    printf("Worst relative error above the horizon: %.2e\n", worst);
+    assert(worst < 0.05f);
+    atmosphere_lut_close(&lut);
+    printf("test_accuracy passed\n");
+}
+
+static void test_cache(void) {
+    char path[256];
+    Atmosphere atm, hazy;
+    atmosphere_init_default(&atm, 1.0f);
+    atmosphere_init_default(&hazy, 3.0f);
+    assert(atmosphere_lut_key(&atm) != atmosphere_lut_key(&hazy));
+    lut_path(path, sizeof(path), &atm);
+    remove(path);
+    rmdir(DIR);
+
+    // Built and saved, then mapped from the file
+    AtmosphereLUT built, mapped;
+    assert(atmosphere_lut_open(&built, &atm, DIR));
+    assert(!built.map);
+    struct stat st;
+    assert(stat(path, &st) == 0);
+    assert(atmosphere_lut_open(&mapped, &atm, DIR));
+    assert(mapped.map);
+    size_t bytes = sizeof(float) * ATM_LUT_ALTITUDES * ATM_LUT_ZENITHS * SPECTRUM_BANDS;
+    assert(memcmp(built.table, mapped.table, bytes) == 0);
+    atmosphere_lut_close(&mapped);
+
+    // A damaged table is rebuilt and saved again
+    FILE* f = fopen(path, "r+b");
+    assert(f);
+    fseek(f, (long)(st.st_size / 2), SEEK_SET);
+    fputc(0x5a, f);
+    fclose(f);
+    assert(atmosphere_lut_open(&mapped, &atm, DIR));
+    assert(!mapped.map && memcmp(built.table, mapped.table, bytes) == 0);
+    atmosphere_lut_close(&mapped);
+    assert(atmosphere_lut_open(&mapped, &atm, DIR));
+    assert(mapped.map);
+    atmosphere_lut_close(&mapped);
+
+    // A truncated file too
+    assert(truncate(path, 100) == 0);
+    assert(atmosphere_lut_open(&mapped, &atm, DIR));
+    assert(!mapped.map);
+    atmosphere_lut_close(&mapped);
+    atmosphere_lut_close(&built);
+
+    remove(path);
+    rmdir(DIR);
+    printf("test_cache passed\n");
+}
+
+static void test_cache_dir(void) {
+    char buf[256];
+    setenv("KNIGHT_CACHE_DIR", "", 1);
+    assert(atmosphere_cache_dir(buf, sizeof(buf)) == NULL);
+    setenv("KNIGHT_CACHE_DIR", "/tmp/knight-cache", 1);
+    assert(strcmp(atmosphere_cache_dir(buf, sizeof(buf)), "/tmp/knight-cache") == 0);
+    unsetenv("KNIGHT_CACHE_DIR");
+    setenv("XDG_CACHE_HOME", "/tmp/xdg", 1);
+    assert(strcmp(atmosphere_cache_dir(buf, sizeof(buf)), "/tmp/xdg/knight") == 0);
+    unsetenv("XDG_CACHE_HOME");
+    setenv("HOME", "/home/someone", 1);
+    assert(strcmp(atmosphere_cache_dir(buf, sizeof(buf)), "/home/someone/.cache/knight") == 0);
+    printf("test_cache_dir passed\n");
+}
+
+int main() {
+    test_accuracy();
+    test_cache();
+    test_cache_dir();
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include "tonemap.h"
+
+// Renders a single bright pixel at the image center and blooms it.
+// bloom_size / fov is chosen so that sigma = sigma_frac * width.
+static ImageHDR* bloom_point(int size, float sigma_frac, float power) {
+    ImageHDR* img = image_hdr_create(size, size);
+    int c = size / 2;
+    img->pixels[c * size + c] = (XYZV){power, power, power, power};
+    apply_glare(img, sigma_frac * 60.0f, 60.0f);
+    return img;
+}
+
+static float halo_at(const ImageHDR* img, int dx, int dy) {
+    int c = img->width / 2;
+    return img->pixels[(c + dy) * img->width + (c + dx)].Y;
+}
+
+void test_bloom_profile() {
+    int size = 201;
+    float sigma = 10.0f;
+    float power = 1000.0f;
+    ImageHDR* img = bloom_point(size, sigma / size, power);
+
+    double total = 0;
+    for (int i = 0; i < size * size; i++) total += img->pixels[i].Y;
+    double halo = total - power;
+    printf("Halo energy: %f (expected %f)\n", halo, 0.05 * power);
+    assert(fabs(halo - 0.05 * power) < 0.01 * 0.05 * power);
+
+    // Compare against an exact Gaussian of the same sigma
+    float g_norm = 0.05f * power / (TWO_PI * sigma * sigma);
+    int offsets[] = {5, 10, 20};
+    for (int k = 0; k < 3; k++) {
+        int d = offsets[k];
+        float expected = g_norm * expf(-(float)(d * d) / (2.0f * sigma * sigma));
+        float got = halo_at(img, d, 0);
+        printf("Offset %2d: %e (gaussian %e)\n", d, got, expected);
+        assert(fabsf(got - expected) < 0.15f * expected);
+        // Isotropy
+        assert(fabsf(halo_at(img, 0, d) - got) < 1e-3f * got + 1e-9f);
+    }
+    image_hdr_free(img);
+    printf("test_bloom_profile passed\n");
+}
+
+void test_bloom_resolution_independence() {
+    // Same angular bloom at two resolutions. The larger one needs a kernel far beyond
+    // the old 10 px cap; the fraction of halo energy within 1 sigma must match.
+    float sigma_frac = 0.1f;
+    int sizes[2] = {101, 401};
+    float frac[2];
+    for (int k = 0; k < 2; k++) {
+        int size = sizes[k];
+        ImageHDR* img = bloom_point(size, sigma_frac, 1000.0f);
+        float sigma_px = sigma_frac * size;
+        int c = size / 2;
+        double inner = 0, all = 0;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float v = img->pixels[y * size + x].Y;
+                if (x == c && y == c) v -= 1000.0f;
+                float r = sqrtf((float)((x - c) * (x - c) + (y - c) * (y - c)));
+                if (r <= sigma_px) inner += v;
+                all += v;
+            }
+        }
+        frac[k] = (float)(inner / all);
+        printf("Size %d: sigma %.1f px, energy within 1 sigma %.3f\n", size, sigma_px, frac[k]);
+        image_hdr_free(img);
+    }
+    // 1 - exp(-1/2) = 0.393 for a 2D Gaussian
+    assert(fabsf(frac[0] - frac[1]) < 0.03f);
+    assert(fabsf(frac[1] - 0.393f) < 0.03f);
+    printf("test_bloom_resolution_independence passed\n");
+}
+
+int main() {
+    test_bloom_profile();
+    test_bloom_resolution_independence();
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <math.h>
+#include "catalog_merge.h"
+
+#define ARCSEC (DEG2RAD / 3600.0f)
+
+static Star make_star(float ra_deg, float dec_deg, float vmag, float bv) {
+    Star s;
+    memset(&s, 0, sizeof(s));
+    s.ra = ra_deg * DEG2RAD;
+    s.dec = dec_deg * DEG2RAD;
+    s.vmag = vmag;
+    s.bv = bv;
+    return s;
+}
+
+static float frand(unsigned int* state) {
+    *state = *state * 1103515245u + 12345u;
+    return ((*state >> 8) & 0xFFFFFF) / 16777216.0f;
+}
+
+void test_merge_dedup() {
+    Star bright[2];
+    bright[0] = make_star(10.0f, 20.0f, 1.0f, 0.5f);
+    bright[1] = make_star(200.0f, -45.0f, 3.0f, 1.2f);
+
+    Star faint[4];
+    faint[0] = make_star(10.0f + 5.0f / 3600.0f, 20.0f, 1.3f, 0.7f);    // duplicate of bright[0]
+    faint[1] = make_star(200.0f, -45.0f + 40.0f / 3600.0f, 3.1f, 1.0f); // outside 30"
+    faint[2] = make_star(200.0f, -45.0f + 2.0f / 3600.0f, 8.5f, 0.3f);  // coincident but much fainter
+    faint[3] = make_star(300.0f, 60.0f, 9.0f, 0.2f);                    // isolated
+
+    Star* merged = NULL;
+    int n = merge_star_catalogs(bright, 2, faint, 4, CATALOG_MATCH_TOL_ARCSEC, &merged);
+    printf("Merged %d stars (expected 5)\n", n);
+    assert(n == 5);
+    // Bright photometry wins
+    assert(merged[0].vmag == 1.0f && merged[0].bv == 0.5f);
+    for (int i = 2; i < n; i++) assert(merged[i].vmag != 1.3f);
+    free(merged);
+    printf("test_merge_dedup passed\n");
+}
+
+void test_merge_matches_brute_force() {
+    unsigned int seed = 12345;
+    int nb = 500, nf = 4000;
+    float tol = 60.0f;
+    Star* bright = (Star*)malloc(sizeof(Star) * nb);
+    Star* faint = (Star*)malloc(sizeof(Star) * nf);
+    for (int i = 0; i < nb; i++) {
+        bright[i] = make_star(frand(&seed) * 360.0f, asinf(2.0f * frand(&seed) - 1.0f) * RAD2DEG, frand(&seed) * 6.0f, 0.5f);
+    }
+    for (int i = 0; i < nf; i++) {
+        if (i % 4 == 0) {
+            // Perturbed copy of a bright star, up to ~2x the tolerance away
+            const Star* b = &bright[(i / 4) % nb];
+            faint[i] = *b;
+            faint[i].ra += (frand(&seed) - 0.5f) * 4.0f * tol * ARCSEC / cosf(b->dec);
+            faint[i].dec += (frand(&seed) - 0.5f) * 2.0f * tol * ARCSEC;
+            faint[i].vmag += 0.3f;
+        } else {
+            faint[i] = make_star(frand(&seed) * 360.0f, asinf(2.0f * frand(&seed) - 1.0f) * RAD2DEG, 6.0f + frand(&seed) * 4.0f, 0.5f);
+        }
+    }
+
+    int expected = nb;
+    double tol_rad = tol / 3600.0 * (PI / 180.0);
+    for (int i = 0; i < nf; i++) {
+        bool dup = false;
+        for (int j = 0; j < nb && !dup; j++) {
+            double c = sin(faint[i].dec) * sin(bright[j].dec) + cos(faint[i].dec) * cos(bright[j].dec) * cos(faint[i].ra - bright[j].ra);
+            if (c > 1.0) c = 1.0;
+            if (acos(c) <= tol_rad && fabsf(faint[i].vmag - bright[j].vmag) <= 2.0f) dup = true;
+        }
+        if (!dup) expected++;
+    }
+
+    Star* merged = NULL;
+    int n = merge_star_catalogs(bright, nb, faint, nf, tol, &merged);
+    printf("Merged %d stars (brute force %d)\n", n, expected);
+    // Allow for float rounding of stars sitting exactly on the tolerance boundary
+    assert(abs(n - expected) <= 2);
+    assert(n < nb + nf);
+    free(merged);
+    free(bright);
+    free(faint);
+    printf("test_merge_matches_brute_force passed\n");
+}
+
+void test_write_roundtrip() {
+    const char* dir = "mock_merged";
+    Star stars[2];
+    stars[0] = make_star(101.2875f, -16.7161f, -1.46f, 0.0f);
+    stars[1] = make_star(359.5f, 45.25f, 8.2f, 1.1f);
+    assert(write_stars_tycho(dir, stars, 2) == 0);
+
+    Star* loaded = NULL;
+    int n = load_stars_tycho(dir, 12.0f, &loaded);
+    printf("Reloaded %d stars (expected 2)\n", n);
+    assert(n == 2);
+    for (int i = 0; i < 2; i++) {
+        printf("Star %d: RA=%.4f Dec=%.4f Mag=%.3f BV=%.3f\n", i, loaded[i].ra * RAD2DEG, loaded[i].dec * RAD2DEG, loaded[i].vmag, loaded[i].bv);
+        assert(fabsf(loaded[i].ra - stars[i].ra) < 1e-5f);
+        assert(fabsf(loaded[i].dec - stars[i].dec) < 1e-5f);
+        assert(fabsf(loaded[i].vmag - stars[i].vmag) < 0.002f);
+        assert(fabsf(loaded[i].bv - stars[i].bv) < 0.002f);
+    }
+    free(loaded);
+    remove("mock_merged/tyc2.dat.00");
+    rmdir(dir);
+    printf("test_write_roundtrip passed\n");
+}
+
+int main() {
+    test_merge_dedup();
+    test_merge_matches_brute_force();
+    test_write_roundtrip();
+    return 0;
+}
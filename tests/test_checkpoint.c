@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "checkpoint.h"
+
+#define W 5
+#define H 4
+#define PATH "test_checkpoint.ckpt"
+
+static void fill_row(XYZV* row, int y) {
+    for (int x = 0; x < W; x++) row[x] = (XYZV){(float)x, (float)y, 0.5f, 1.0f + x + y};
+}
+
+static void test_resume(void) {
+    remove(PATH);
+    XYZV row[W], expect[W];
+    Checkpoint* cp = checkpoint_open(PATH, 42, W, H, true);
+    assert(cp);
+    assert(checkpoint_rows_done(cp) == 0);
+    for (int y = 0; y < H; y += 2) {
+        fill_row(row, y);
+        checkpoint_store_row(cp, y, row);
+    }
+    checkpoint_close(cp);
+
+    // Reopened, the stored rows come back and the others are still to do
+    cp = checkpoint_open(PATH, 42, W, H, true);
+    assert(cp);
+    assert(checkpoint_rows_done(cp) == 2);
+    for (int y = 0; y < H; y++) {
+        const XYZV* saved = checkpoint_row(cp, y);
+        if (y % 2) {
+            assert(saved == NULL);
+        } else {
+            fill_row(expect, y);
+            assert(saved && memcmp(saved, expect, sizeof(expect)) == 0);
+        }
+    }
+    checkpoint_close(cp);
+
+    // Another render, another size, or no --resume starts over
+    cp = checkpoint_open(PATH, 43, W, H, true);
+    assert(cp && checkpoint_rows_done(cp) == 0);
+    fill_row(row, 1);
+    checkpoint_store_row(cp, 1, row);
+    checkpoint_close(cp);
+    cp = checkpoint_open(PATH, 43, W + 1, H, true);
+    assert(cp && checkpoint_rows_done(cp) == 0);
+    checkpoint_close(cp);
+    cp = checkpoint_open(PATH, 43, W + 1, H, false);
+    assert(cp && checkpoint_rows_done(cp) == 0);
+    checkpoint_close(cp);
+    remove(PATH);
+    printf("test_resume passed\n");
+}
+
+static void test_key(void) {
+    Config a, b;
+    config_set_defaults(&a);
+    a.year = 2026;
+    a.month = 3;
+    a.day = 1;
+    a.hour = 21.0;
+    b = a;
+    assert(checkpoint_key(&a, 2461101.375) == checkpoint_key(&b, 2461101.375));
+    assert(checkpoint_key(&a, 2461101.375) != checkpoint_key(&b, 2461101.376));
+
+    // The sky changes with the view; output and star options may change on resume
+    b.cam_az += 1.0f;
+    assert(checkpoint_key(&a, 2461101.375) != checkpoint_key(&b, 2461101.375));
+    b = a;
+    b.exposure_boost = 2.0f;
+    b.output_filename = "other.png";
+    b.star_mag_limit = 9.0f;
+    assert(checkpoint_key(&a, 2461101.375) == checkpoint_key(&b, 2461101.375));
+    printf("test_key passed\n");
+}
+
+int main() {
+    test_resume();
+    test_key();
+    return 0;
+}
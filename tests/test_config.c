@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
+#include <stdlib.h>
 #include "config.h"
 
 void test_parse_aperture() {
@@ -51,10 +52,151 @@ void test_parse_tycho() {
     printf("test_parse_tycho passed\n");
 }
 
+void test_parse_sequence() {
+    Config cfg;
+    cfg.seq_start = NULL;
+    cfg.seq_end = NULL;
+    cfg.seq_step_minutes = 5.0;
+
+    char* argv[] = {"knight", "--start", "2026-03-01T18:00", "--end", "2026-03-02 06:30:15", "--step", "90s"};
+    int argc = 7;
+
+    parse_args(argc, argv, &cfg);
+
+    assert(strcmp(cfg.seq_start, "2026-03-01T18:00") == 0);
+    assert(strcmp(cfg.seq_end, "2026-03-02 06:30:15") == 0);
+    printf("Expected step 1.5 minutes, got %.2f\n", cfg.seq_step_minutes);
+    assert(cfg.seq_step_minutes == 1.5);
+
+    int y, mo, d;
+    double h;
+    assert(parse_datetime(cfg.seq_end, &y, &mo, &d, &h));
+    assert(y == 2026 && mo == 3 && d == 2);
+    assert(h > 6.5041 && h < 6.5043);
+    assert(parse_datetime("2026-03-01", &y, &mo, &d, &h) && h == 0.0);
+    assert(!parse_datetime("2026-03-01X", &y, &mo, &d, &h));
+    assert(!parse_datetime("18:00", &y, &mo, &d, &h));
+
+    assert(parse_duration_minutes("5") == 5.0);
+    assert(parse_duration_minutes("2h") == 120.0);
+    assert(parse_duration_minutes("1d") == 1440.0);
+    assert(parse_duration_minutes("5x") < 0);
+    printf("test_parse_sequence passed\n");
+}
+
+void test_apply_request() {
+    Config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.lat = 45.0;
+    cfg.width = 640;
+    char err[256];
+    char* storage = NULL;
+
+    const char* json = "{ \"lat\": -33.9, \"date\": \"2026-06-21\", \"track\": \"jupiter\", \"bloom\": true, \"env\": false, \"width\": 320 }";
+    assert(config_apply_request(json, &cfg, &storage, err, sizeof(err)));
+    assert(cfg.lat < -33.89 && cfg.lat > -33.91);
+    assert(cfg.year == 2026 && cfg.month == 6 && cfg.day == 21);
+    assert(strcmp(cfg.track_body, "jupiter") == 0);
+    assert(cfg.bloom && !cfg.env_map && cfg.width == 320);
+    free(storage);
+
+    const char* lines = "# evening sky\nlon = 18.4\n--glare\ntime=21:30\n\n";
+    assert(config_apply_request(lines, &cfg, &storage, err, sizeof(err)));
+    assert(cfg.lon > 18.39 && cfg.lon < 18.41);
+    assert(cfg.glare);
+    assert(cfg.hour == 21.5);
+    free(storage);
+
+    // The reply format is chosen per request
+    assert(config_apply_request("format=png\npng-depth=16\n", &cfg, &storage, err, sizeof(err)));
+    assert(strcmp(cfg.output_format, "png") == 0 && cfg.png_bits == 16);
+    free(storage);
+
+    assert(!config_apply_request("bogus=1", &cfg, &storage, err, sizeof(err)));
+    printf("Rejected: %s\n", err);
+    assert(!config_apply_request("{\"tycho\": true}", &cfg, &storage, err, sizeof(err)));
+    printf("Rejected: %s\n", err);
+    assert(!config_apply_request("lat", &cfg, &storage, err, sizeof(err)));
+    assert(!config_apply_request("{\"lat\": 1", &cfg, &storage, err, sizeof(err)));
+    assert(storage == NULL);
+    printf("test_apply_request passed\n");
+}
+
+void test_batch_line() {
+    Config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.output_filename = "output.pfm";
+
+    char line[] = "  -l 51.5\t--track mars  -o frames/mars.pfm --bloom\r\n";
+    char* argv[16];
+    int argc = split_args(line, "knight", argv, 16);
+    assert(argc == 8);
+    assert(strcmp(argv[0], "knight") == 0 && strcmp(argv[7], "--bloom") == 0);
+    assert(parse_args(argc, argv, &cfg));
+    assert(cfg.lat == 51.5 && cfg.bloom);
+    assert(strcmp(cfg.track_body, "mars") == 0);
+    assert(strcmp(cfg.output_filename, "frames/mars.pfm") == 0);
+
+    // A bad job line is reported, not fatal
+    char bogus[] = "-l 10 --bogus";
+    argc = split_args(bogus, "knight", argv, 16);
+    assert(!parse_args(argc, argv, &cfg));
+    char help[] = "--help";
+    argc = split_args(help, "knight", argv, 16);
+    assert(!parse_args(argc, argv, &cfg));
+
+    char many[] = "a b c d e f";
+    assert(split_args(many, "knight", argv, 4) == 4);
+    printf("test_batch_line passed\n");
+}
+
+void test_parse_exposures() {
+    Config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    char* argv[] = {"knight", "-e", "-2,0,2.5"};
+    parse_args(3, argv, &cfg);
+    assert(config_num_exposures(&cfg) == 3);
+    assert(config_exposure(&cfg, 0) == -2.0f && cfg.exposure_boost == -2.0f);
+    assert(config_exposure(&cfg, 1) == 0.0f && config_exposure(&cfg, 2) == 2.5f);
+
+    char* single[] = {"knight", "--exposure", "1.5"};
+    parse_args(3, single, &cfg);
+    assert(config_num_exposures(&cfg) == 1 && cfg.exposure_boost == 1.5f);
+    printf("test_parse_exposures passed\n");
+}
+
+void test_parse_crop() {
+    Config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.width = 640;
+    cfg.height = 480;
+    int w, h;
+    config_image_size(&cfg, &w, &h);
+    assert(w == 640 && h == 480 && config_crop_valid(&cfg));
+
+    char* argv[] = {"knight", "--crop", "600,100,40,380"};
+    parse_args(3, argv, &cfg);
+    config_image_size(&cfg, &w, &h);
+    assert(cfg.crop_x == 600 && cfg.crop_y == 100 && w == 40 && h == 380);
+    assert(config_crop_valid(&cfg));
+    cfg.crop_width = 41; // One column past the edge
+    assert(!config_crop_valid(&cfg));
+
+    char* bad[] = {"knight", "--crop", "1,2,3"};
+    parse_args(3, bad, &cfg);
+    assert(cfg.crop_width == 41); // Unchanged
+    printf("test_parse_crop passed\n");
+}
+
 int main() {
     test_parse_aperture();
     test_parse_aperture_short();
     test_parse_tycho();
+    test_parse_sequence();
+    test_apply_request();
+    test_batch_line();
+    test_parse_exposures();
+    test_parse_crop();
     printf("All config tests passed!\n");
     return 0;
 }
@@ -19,7 +19,7 @@ int main() {
         stars[i].vmag = (float)i / 10.0f;
     }
 
-    bool ok = cuda_upload_stars(stars, num_stars);
+    bool ok = cuda_upload_stars(stars, NULL, num_stars);
     printf("cuda_upload_stars status: %d\n", ok);
     assert(ok);
 
@@ -29,7 +29,7 @@ int main() {
     for (int i = 100; i < num_stars; i++) {
         stars[i].id = i;
     }
-    ok = cuda_upload_stars(stars, num_stars);
+    ok = cuda_upload_stars(stars, NULL, num_stars);
     printf("cuda_upload_stars (realloc) status: %d\n", ok);
     assert(ok);
 
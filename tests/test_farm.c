@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include "farm.h"
+
+#define W 40
+#define H 30
+#define BAND 7
+#define DIR "test_farm_dir"
+#define OUT "test_farm_out.pfm"
+#define MARKER DIR "/failed_once"
+
+static float pixel_value(int x, int y, int channel) {
+    return (float)(y * W + x) + 0.25f * channel;
+}
+
+// Stands in for knight when started with --farm-worker: writes its --crop
+// band as a PFM to its -o, failing the band at row BAND once
+static int fake_worker(int argc, char** argv) {
+    const char* output = NULL;
+    int x0 = 0, y0 = 0, w = 0, h = 0;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0) output = argv[i + 1];
+        if (strcmp(argv[i], "--crop") == 0) sscanf(argv[i + 1], "%d,%d,%d,%d", &x0, &y0, &w, &h);
+    }
+    if (!output || w != W || h <= 0) return 2;
+    if (y0 == BAND && access(MARKER, F_OK) != 0) {
+        fclose(fopen(MARKER, "w"));
+        return 1;
+    }
+    RGB* rows = (RGB*)malloc(sizeof(RGB) * w * h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            RGB* p = &rows[y * w + x];
+            p->r = pixel_value(x0 + x, y0 + y, 0);
+            p->g = pixel_value(x0 + x, y0 + y, 1);
+            p->b = pixel_value(x0 + x, y0 + y, 2);
+        }
+    }
+    FILE* f = fopen(output, "wb");
+    bool ok = f && write_pfm_stream(f, w, h, rows);
+    if (f) fclose(f);
+    free(rows);
+    return ok ? 0 : 1;
+}
+
+static void make_config(Config* cfg, const char* dir) {
+    config_set_defaults(cfg);
+    cfg->width = W;
+    cfg->height = H;
+    cfg->output_filename = OUT;
+    cfg->farm_processes = 2;
+    cfg->farm_dir = (char*)dir;
+    cfg->tile_rows = BAND;
+}
+
+static void test_merge(const char* exe) {
+    Config cfg;
+    make_config(&cfg, DIR);
+    char* argv[] = {(char*)exe};
+    remove(MARKER);
+    assert(farm_run(&cfg, exe, 1, argv, 0) == 0);
+
+    // The band that failed ran again, and every band landed in its place
+    assert(access(MARKER, F_OK) == 0);
+    FILE* f = fopen(OUT, "rb");
+    assert(f);
+    int w, h;
+    float scale;
+    assert(fscanf(f, "PF %d %d %f", &w, &h, &scale) == 3 && fgetc(f) == '\n');
+    assert(w == W && h == H);
+    for (int y = H - 1; y >= 0; y--) {
+        RGB row[W];
+        assert(fread(row, sizeof(RGB), W, f) == W);
+        for (int x = 0; x < W; x++) {
+            assert(row[x].r == pixel_value(x, y, 0));
+            assert(row[x].g == pixel_value(x, y, 1));
+            assert(row[x].b == pixel_value(x, y, 2));
+        }
+    }
+    fclose(f);
+    remove(OUT);
+    remove(MARKER);
+    assert(rmdir(DIR) == 0); // Bands and logs of merged jobs are removed
+    printf("test_merge passed\n");
+}
+
+static void test_failing_worker(void) {
+    Config cfg;
+    make_config(&cfg, DIR);
+    char* argv[] = {"false"};
+    assert(farm_run(&cfg, "/bin/false", 1, argv, 0) != 0);
+
+    // The logs of failed jobs stay for inspection
+    char log[256];
+    int logs = 0;
+    for (int i = 0; i < (H + BAND - 1) / BAND; i++) {
+        snprintf(log, sizeof(log), "%s/job_%04d.log", DIR, i);
+        if (remove(log) == 0) logs++;
+    }
+    assert(logs > 0);
+    remove(OUT);
+    assert(rmdir(DIR) == 0);
+    printf("test_failing_worker passed\n");
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--farm-worker") == 0) return fake_worker(argc, argv);
+    }
+    test_merge(argv[0]);
+    test_failing_worker();
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include "fft.h"
+#include "glare.h"
+
+static void naive_dft(const Complex* in, Complex* out, int n) {
+    for (int k = 0; k < n; k++) {
+        double re = 0, im = 0;
+        for (int j = 0; j < n; j++) {
+            double a = -2.0 * 3.14159265358979323846 * (double)j * k / n;
+            re += in[j].re * cos(a) - in[j].im * sin(a);
+            im += in[j].re * sin(a) + in[j].im * cos(a);
+        }
+        out[k] = (Complex){re, im};
+    }
+}
+
+void test_fft_matches_dft() {
+    int sizes[] = {1, 2, 8, 12, 45, 60, 64, 98, 120};
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        int n = sizes[s];
+        Complex in[128], ref[128], data[128], scratch[128];
+        for (int i = 0; i < n; i++) in[i] = (Complex){sinf(i * 0.7f) + 0.1f * i, cosf(i * 1.3f)};
+        naive_dft(in, ref, n);
+        FFTPlan plan;
+        assert(fft_plan_init(&plan, n));
+        for (int i = 0; i < n; i++) data[i] = in[i];
+        fft_execute(&plan, data, scratch, false);
+        float max_err = 0;
+        for (int i = 0; i < n; i++) {
+            max_err = fmaxf(max_err, fabs(data[i].re - ref[i].re));
+            max_err = fmaxf(max_err, fabs(data[i].im - ref[i].im));
+        }
+        // Inverse round trip
+        fft_execute(&plan, data, scratch, true);
+        float rt_err = 0;
+        for (int i = 0; i < n; i++) {
+            rt_err = fmaxf(rt_err, fabs(data[i].re / n - in[i].re));
+            rt_err = fmaxf(rt_err, fabs(data[i].im / n - in[i].im));
+        }
+        printf("n=%3d: max error %e, round trip %e\n", n, max_err, rt_err);
+        assert(max_err < 1e-3f * n);
+        assert(rt_err < 1e-4f);
+        fft_plan_free(&plan);
+    }
+    assert(fft_good_size(1080) == 1080);
+    assert(fft_good_size(1921) == 1944);
+    printf("test_fft_matches_dft passed\n");
+}
+
+void test_glare_point_source() {
+    // 6 mm pupil; fov chosen so the PSF reaches about 30 px and fits in the frame
+    int size = 101, c = size / 2;
+    float aperture = 6.0f;
+    float reach = (GLARE_PUPIL_N / 2) * (LAMBDA_END * 1e-9f) / (2.0f * aperture * 1e-3f);
+    float fov = size * (reach / 30.0f) / DEG2RAD;
+
+    ImageHDR* img = image_hdr_create(size, size);
+    float power = 1000.0f;
+    img->pixels[c * size + c] = (XYZV){power, power, power, power};
+    GlareCache cache = {0};
+    glare_apply(&cache, img, aperture, fov);
+    assert(cache.valid && cache.radius > 0);
+
+    double total = 0;
+    for (int i = 0; i < size * size; i++) total += img->pixels[i].Y;
+    float core = img->pixels[c * size + c].Y;
+    printf("Glare: radius %d, total %f, core %f\n", cache.radius, total, core);
+    assert(fabs(total - power) < 0.01 * power);
+    assert(core > 0.5f * power && core < power);
+
+    // The PSF of a real pupil is centro-symmetric, and some energy must reach the halo
+    double halo = 0;
+    for (int dy = -20; dy <= 20; dy++) {
+        for (int dx = -20; dx <= 20; dx++) {
+            float a = img->pixels[(c + dy) * size + (c + dx)].Y;
+            float b = img->pixels[(c - dy) * size + (c - dx)].Y;
+            assert(fabsf(a - b) < 1e-3f * power * 1e-3f + 1e-3f * a);
+            if (abs(dx) > 3 || abs(dy) > 3) halo += a;
+        }
+    }
+    printf("Energy beyond 3 px: %f\n", halo);
+    assert(halo > 0);
+
+    // Second frame with the same parameters reuses the cached spectra
+    double* spec = cache.spec_a[0];
+    glare_apply(&cache, img, aperture, fov);
+    assert(cache.spec_a[0] == spec);
+
+    glare_cache_free(&cache);
+    image_hdr_free(img);
+    printf("test_glare_point_source passed\n");
+}
+
+void test_glare_dark_sky() {
+    // A bright disk on a dark sky must not change pixels beyond the PSF's reach
+    int w = 240, h = 160, cx = 60, cy = 80;
+    float aperture = 6.0f;
+    float reach = (GLARE_PUPIL_N / 2) * (LAMBDA_END * 1e-9f) / (2.0f * aperture * 1e-3f);
+    float fov = w * (reach / 30.0f) / DEG2RAD;
+    float sky = 1e-4f, disk = 1e4f;
+
+    ImageHDR* lit = image_hdr_create(w, h);
+    ImageHDR* dark = image_hdr_create(w, h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float v = (x - cx) * (x - cx) + (y - cy) * (y - cy) <= 25 ? disk : sky;
+            lit->pixels[y * w + x] = (XYZV){v, v, v, v};
+            dark->pixels[y * w + x] = (XYZV){sky, sky, sky, sky};
+        }
+    }
+    GlareCache cache = {0};
+    glare_apply(&cache, lit, aperture, fov);
+    glare_apply(&cache, dark, aperture, fov);
+    int r = cache.radius;
+    assert(r > 0 && cx + 5 + r < w - 20);
+
+    float worst = 0.0f;
+    for (int y = 0; y < h; y++) {
+        for (int x = cx + 6 + r; x < w; x++) {
+            const float* a = &lit->pixels[y * w + x].X;
+            const float* b = &dark->pixels[y * w + x].X;
+            for (int c = 0; c < 4; c++) worst = fmaxf(worst, fabsf(a[c] - b[c]) / b[c]);
+        }
+    }
+    printf("Dark sky beyond the PSF: max relative change %e\n", worst);
+    assert(worst < 1e-4f);
+
+    glare_cache_free(&cache);
+    image_hdr_free(lit);
+    image_hdr_free(dark);
+    printf("test_glare_dark_sky passed\n");
+}
+
+int main() {
+    test_fft_matches_dft();
+    test_glare_point_source();
+    test_glare_dark_sky();
+    return 0;
+}
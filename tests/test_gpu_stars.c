@@ -76,7 +76,7 @@ int main() {
     render_stars(stars, num_stars, &cam, aperture, cpu_hdr);
 
     // 4. GPU Render (accumulates on d_pixels which holds baseline)
-    cuda_upload_stars(stars, num_stars);
+    cuda_upload_stars(stars, NULL, num_stars);
     cuda_render_stars(width, height, &cam, aperture, gpu_pixels);
 
     // 6. Compare
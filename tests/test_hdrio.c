@@ -0,0 +1,149 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "hdrio.h"
+
+// Night sky radiances: black runs, faint sky, a few very bright pixels
+static ImageHDR* make_image(int w, int h) {
+    ImageHDR* img = image_hdr_create(w, h);
+    unsigned int seed = 4242;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            XYZV p = {0, 0, 0, 0};
+            if (x > w / 3) {
+                float Y = 1e-4f * (1.0f + y);
+                p = (XYZV){0.9f * Y, Y, 1.3f * Y, 2.0f * Y};
+            }
+            seed = seed * 1664525u + 1013904223u;
+            if ((seed >> 24) < 3) p = (XYZV){300.0f, 320.0f, 250.0f, 400.0f};
+            img->pixels[y * w + x] = p;
+        }
+    }
+    return img;
+}
+
+static unsigned char* read_all(FILE* f, long* size) {
+    *size = ftell(f);
+    unsigned char* data = (unsigned char*)malloc(*size);
+    rewind(f);
+    assert(fread(data, 1, *size, f) == (size_t)*size);
+    fclose(f);
+    return data;
+}
+
+// Decodes a Radiance file written by write_rgbe_stream and compares it with the
+// sRGB values of img, within the 8 bit mantissa precision
+static void check_rgbe(const ImageHDR* img) {
+    FILE* f = tmpfile();
+    assert(write_rgbe_stream(f, img));
+    long size;
+    unsigned char* data = read_all(f, &size);
+
+    char expect_res[64];
+    snprintf(expect_res, sizeof(expect_res), "\n\n-Y %d +X %d\n", img->height, img->width);
+    assert(memcmp(data, "#?RADIANCE\n", 11) == 0);
+    char* res = strstr((char*)data, expect_res);
+    assert(res);
+    const unsigned char* p = (const unsigned char*)res + strlen(expect_res);
+    const unsigned char* end = data + size;
+
+    int w = img->width;
+    unsigned char* scan = (unsigned char*)malloc((size_t)w * 4);
+    bool rle = w >= 8 && w <= 32767;
+    for (int y = 0; y < img->height; y++) {
+        if (rle) {
+            assert(p[0] == 2 && p[1] == 2 && ((p[2] << 8) | p[3]) == w);
+            p += 4;
+            for (int k = 0; k < 4; k++) {
+                int x = 0;
+                while (x < w) {
+                    int count = *p++;
+                    if (count > 128) {
+                        count -= 128;
+                        assert(x + count <= w);
+                        for (int i = 0; i < count; i++) scan[4 * (x + i) + k] = *p;
+                        p++;
+                    } else {
+                        assert(count > 0 && x + count <= w);
+                        for (int i = 0; i < count; i++) scan[4 * (x + i) + k] = *p++;
+                    }
+                    x += count;
+                }
+            }
+        } else {
+            memcpy(scan, p, (size_t)w * 4);
+            p += (size_t)w * 4;
+        }
+        for (int x = 0; x < w; x++) {
+            const unsigned char* e = scan + 4 * x;
+            XYZV v = img->pixels[y * w + x];
+            RGB c = xyz_to_srgb(v.X, v.Y, v.Z);
+            float ref[3] = {fmaxf(c.r, 0), fmaxf(c.g, 0), fmaxf(c.b, 0)};
+            float max = fmaxf(ref[0], fmaxf(ref[1], ref[2]));
+            if (e[3] == 0) {
+                assert(max < 1e-30f);
+                continue;
+            }
+            float scale = ldexpf(1.0f, e[3] - 136);
+            for (int k = 0; k < 3; k++) assert(fabsf(e[k] * scale - ref[k]) <= max / 128.0f);
+        }
+    }
+    assert(p == end);
+    free(scan);
+    free(data);
+}
+
+void test_rgbe() {
+    int widths[] = {5, 8, 129, 300};
+    for (int i = 0; i < 4; i++) {
+        ImageHDR* img = make_image(widths[i], 7);
+        check_rgbe(img);
+        image_hdr_free(img);
+    }
+    // Run-length encoding should pay off on a mostly dark sky
+    ImageHDR* img = make_image(640, 48);
+    FILE* f = tmpfile();
+    assert(write_rgbe_stream(f, img));
+    long size = ftell(f);
+    fclose(f);
+    printf("RGBE: %ld bytes for %d pixels\n", size, 640 * 48);
+    assert(size < 640 * 48 * 4 / 2);
+    image_hdr_free(img);
+    printf("test_rgbe passed\n");
+}
+
+void test_xyzv() {
+    ImageHDR* img = make_image(37, 11);
+    XyzvInfo info = {360.0f, true};
+    FILE* f = tmpfile();
+    assert(write_xyzv_stream(f, img, &info));
+    long size;
+    unsigned char* data = read_all(f, &size);
+    const char* header = "XYZV\nFOV=360\nPROJECTION=env\n37 11\n";
+    assert(memcmp(data, header, strlen(header)) == 0);
+    assert(size == (long)(strlen(header) + sizeof(XYZV) * 37 * 11));
+    assert(memcmp(data + strlen(header), img->pixels, sizeof(XYZV) * 37 * 11) == 0);
+    free(data);
+
+    const char* path = "test_hdrio.xyzv";
+    info = (XyzvInfo){47.5f, false};
+    assert(write_xyzv(path, img, &info));
+    XyzvInfo back = {0, true};
+    ImageHDR* read = read_xyzv(path, &back);
+    remove(path);
+    assert(read && read->width == 37 && read->height == 11);
+    assert(back.fov_deg == 47.5f && !back.env_map);
+    assert(memcmp(read->pixels, img->pixels, sizeof(XYZV) * 37 * 11) == 0);
+    image_hdr_free(read);
+    assert(read_xyzv(path, NULL) == NULL);
+    image_hdr_free(img);
+    printf("test_xyzv passed\n");
+}
+
+int main() {
+    test_rgbe();
+    test_xyzv();
+    return 0;
+}
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include "knight.h"
+#include "ephemerides.h"
+#include "render.h"
+
+#define W 96
+#define H 72
+#define RENDERS_PER_THREAD 3
+
+static KnightContext* ctx;
+static Config sites[2];
+static ImageRGB* reference[2];
+
+static void make_config(Config* cfg, double lat, double hour) {
+    config_set_defaults(cfg);
+    cfg->data_dir = "../data";
+    cfg->width = W;
+    cfg->height = H;
+    cfg->year = 2026;
+    cfg->month = 3;
+    cfg->day = 1;
+    cfg->hour = hour;
+    cfg->lat = lat;
+    cfg->bloom = true;
+}
+
+static void* render_thread(void* arg) {
+    int which = (int)(size_t)arg;
+    ImageRGB* img = image_rgb_create(W, H);
+    int mismatches = 0;
+    for (int i = 0; i < RENDERS_PER_THREAD; i++) {
+        int site = (which + i) % 2;
+        assert(knight_render(ctx, &sites[site], img) == 0);
+        if (memcmp(img->pixels, reference[site]->pixels, sizeof(RGB) * W * H) != 0) mismatches++;
+    }
+    image_rgb_free(img);
+    return (void*)(size_t)mismatches;
+}
+
+// Concurrent renders must match the same renders made one at a time
+void test_concurrent_renders() {
+    make_config(&sites[0], 45.0, 21.0);
+    make_config(&sites[1], -33.9, 19.5);
+    ctx = knight_context_create(&sites[0]);
+    assert(ctx);
+
+    for (int s = 0; s < 2; s++) {
+        reference[s] = image_rgb_create(W, H);
+        assert(knight_render(ctx, &sites[s], reference[s]) == 0);
+    }
+    assert(memcmp(reference[0]->pixels, reference[1]->pixels, sizeof(RGB) * W * H) != 0);
+
+    pthread_t threads[4];
+    for (int t = 0; t < 4; t++) pthread_create(&threads[t], NULL, render_thread, (void*)(size_t)t);
+    int mismatches = 0;
+    for (int t = 0; t < 4; t++) {
+        void* result;
+        pthread_join(threads[t], &result);
+        mismatches += (int)(size_t)result;
+    }
+    printf("Concurrent renders differing from the reference: %d\n", mismatches);
+    assert(mismatches == 0);
+
+    // The output must match the requested size
+    ImageRGB* small = image_rgb_create(W / 2, H / 2);
+    assert(knight_render(ctx, &sites[0], small) == -1);
+    image_rgb_free(small);
+
+    for (int s = 0; s < 2; s++) image_rgb_free(reference[s]);
+    knight_context_destroy(ctx);
+    printf("test_concurrent_renders passed\n");
+}
+
+#define STRIP 17
+
+typedef struct {
+    ImageRGB* img[2];
+    int next_row[2];
+} Strips;
+
+static bool collect_strip(const ImageRGB* rows, int row0, int exposure, void* user) {
+    Strips* s = (Strips*)user;
+    assert(rows->width == W && rows->height <= STRIP && row0 == s->next_row[exposure]);
+    memcpy(s->img[exposure]->pixels + row0 * W, rows->pixels, sizeof(RGB) * W * rows->height);
+    s->next_row[exposure] += rows->height;
+    return true;
+}
+
+// Strips with enough overlap for the optics must join into the whole frame
+void test_tiled_render() {
+    Config cfg;
+    make_config(&cfg, 45.0, 21.0);
+    cfg.exposure_bracket[0] = 2.0f;
+    cfg.num_bracket = 1;
+    cfg.bloom_size = 0.5f; // Wider than a strip
+    ctx = knight_context_create(&cfg);
+    assert(ctx);
+    ImageRGB* whole[2] = {image_rgb_create(W, H), image_rgb_create(W, H)};
+    assert(knight_render_exposures(ctx, &cfg, get_julian_day(2026, 3, 1, 21.0), whole, NULL) == 0);
+
+    Strips s = {{image_rgb_create(W, H), image_rgb_create(W, H)}, {0, 0}};
+    assert(knight_render_tiled(ctx, &cfg, get_julian_day(2026, 3, 1, 21.0), STRIP, collect_strip, &s) == 0);
+    for (int e = 0; e < 2; e++) {
+        assert(s.next_row[e] == H);
+        assert(memcmp(s.img[e]->pixels, whole[e]->pixels, sizeof(RGB) * W * H) == 0);
+        image_rgb_free(s.img[e]);
+        image_rgb_free(whole[e]);
+    }
+    knight_context_destroy(ctx);
+    printf("test_tiled_render passed\n");
+}
+
+// A crop must be its window of the whole frame, overlays included
+void test_crop_render() {
+    Config cfg;
+    make_config(&cfg, 45.0, 21.0);
+    cfg.render_outlines = true;
+    cfg.label_bodies = true;
+    ctx = knight_context_create(&cfg);
+    assert(ctx);
+    ImageRGB* whole = image_rgb_create(W, H);
+    assert(knight_render(ctx, &cfg, whole) == 0);
+
+    cfg.crop_x = 30;
+    cfg.crop_y = 20;
+    cfg.crop_width = 41;
+    cfg.crop_height = 33;
+    ImageRGB* crop = image_rgb_create(41, 33);
+    assert(knight_render(ctx, &cfg, crop) == 0);
+    for (int y = 0; y < 33; y++) {
+        assert(memcmp(crop->pixels + y * 41, whole->pixels + (y + 20) * W + 30, sizeof(RGB) * 41) == 0);
+    }
+    assert(knight_render(ctx, &cfg, whole) == -1); // Must be the crop's size
+    cfg.crop_x = W - 40;
+    assert(knight_render(ctx, &cfg, crop) == -1);  // Outside the frame
+    image_rgb_free(crop);
+    image_rgb_free(whole);
+
+    // Frames wider than the exposure pre-pass are metered on it either way
+    cfg.width = RENDER_PREPASS_WIDTH + 128;
+    cfg.height = 160;
+    cfg.crop_width = 0;
+    whole = image_rgb_create(cfg.width, cfg.height);
+    assert(knight_render(ctx, &cfg, whole) == 0);
+    cfg.crop_x = 300;
+    cfg.crop_y = 60;
+    cfg.crop_width = 64;
+    cfg.crop_height = 40;
+    crop = image_rgb_create(64, 40);
+    assert(knight_render(ctx, &cfg, crop) == 0);
+    for (int y = 0; y < 40; y++) {
+        assert(memcmp(crop->pixels + y * 64, whole->pixels + (y + 60) * cfg.width + 300, sizeof(RGB) * 64) == 0);
+    }
+
+    image_rgb_free(crop);
+    image_rgb_free(whole);
+    knight_context_destroy(ctx);
+    printf("test_crop_render passed\n");
+}
+
+#define FRAMES 4
+
+typedef struct {
+    ImageRGB* frames[FRAMES];
+    int next;
+    int stop_at;
+} Sequence;
+
+static bool collect_frame(int frame, ImageRGB* const* outs, const ImageHDR* hdr, void* user) {
+    Sequence* s = (Sequence*)user;
+    assert(frame == s->next && hdr == NULL);
+    if (frame == s->stop_at) return false;
+    memcpy(s->frames[frame]->pixels, outs[0]->pixels, sizeof(RGB) * W * H);
+    s->next++;
+    return true;
+}
+
+// A pipelined sequence must match the frames rendered one after another,
+// exposure adaptation included
+void test_sequence_render() {
+    Config cfg;
+    make_config(&cfg, 45.0, 19.0);
+    cfg.seq_start = "2026-03-01T19:00"; // Adapts the exposure
+    double start = get_julian_day(2026, 3, 1, 19.0), step = 20.0 / 1440.0;
+
+    ctx = knight_context_create(&cfg);
+    assert(ctx);
+    ImageRGB* expect[FRAMES];
+    for (int i = 0; i < FRAMES; i++) {
+        expect[i] = image_rgb_create(W, H);
+        assert(knight_render_at(ctx, &cfg, start + i * step, expect[i]) == 0);
+    }
+    knight_context_destroy(ctx);
+
+    Sequence s = {{NULL}, 0, -1};
+    for (int i = 0; i < FRAMES; i++) s.frames[i] = image_rgb_create(W, H);
+    ctx = knight_context_create(&cfg);
+    assert(ctx);
+    assert(knight_render_sequence(ctx, &cfg, start, step, 0, FRAMES, false, collect_frame, &s) == 0);
+    assert(s.next == FRAMES);
+    for (int i = 0; i < FRAMES; i++) {
+        assert(memcmp(s.frames[i]->pixels, expect[i]->pixels, sizeof(RGB) * W * H) == 0);
+    }
+
+    // Stopping in the middle fails the sequence without emitting more frames
+    s.next = 1;
+    s.stop_at = 2;
+    assert(knight_render_sequence(ctx, &cfg, start, step, 1, FRAMES, false, collect_frame, &s) == -1);
+    assert(s.next == 2);
+
+    for (int i = 0; i < FRAMES; i++) {
+        image_rgb_free(s.frames[i]);
+        image_rgb_free(expect[i]);
+    }
+    knight_context_destroy(ctx);
+    printf("test_sequence_render passed\n");
+}
+
+// A context may be destroyed while its catalogs are still loading
+void test_destroy_while_loading() {
+    Config cfg;
+    make_config(&cfg, 45.0, 21.0);
+    cfg.render_outlines = true;
+    for (int i = 0; i < 3; i++) {
+        ctx = knight_context_create(&cfg);
+        assert(ctx);
+        knight_context_destroy(ctx);
+    }
+    printf("test_destroy_while_loading passed\n");
+}
+
+int main() {
+    test_concurrent_renders();
+    test_tiled_render();
+    test_crop_render();
+    test_sequence_render();
+    test_destroy_while_loading();
+    return 0;
+}
@@ -7,10 +7,11 @@
 void test_label_offset() {
     ImageRGB* img = image_rgb_create(100, 100);
     RGB red = {1.0f, 0.0f, 0.0f};
+    DrawTarget t = draw_target_image(img);
     
     // Draw "Sun" at 50, 50 with 8px offset
     // Target position: x = 50+8 = 58, y = 50-4 = 46 (for vertical centering of 8x8 font)
-    draw_label_offset(img, 50, 50, 8, "Sun", red);
+    draw_label_offset(&t, 50, 50, 8, "Sun", red);
     
     // Check for pixels of 'S' (first char of Sun)
     // MSB of 'S' (0x3C = 00111100) at row 0 is empty.
@@ -27,20 +28,44 @@ void test_label_offset() {
 void test_label_clipping() {
     ImageRGB* img = image_rgb_create(100, 100);
     RGB red = {1.0f, 0.0f, 0.0f};
+    DrawTarget t = draw_target_image(img);
     
     // Draw label near right edge, should not crash
-    draw_label_offset(img, 95, 50, 8, "Jupiter", red);
+    draw_label_offset(&t, 95, 50, 8, "Jupiter", red);
     
     // Draw label near bottom edge
-    draw_label_offset(img, 50, 98, 8, "Moon", red);
+    draw_label_offset(&t, 50, 98, 8, "Moon", red);
     
     image_rgb_free(img);
     printf("test_label_clipping passed\n");
 }
 
+// A window of the frame gets exactly its part of the whole frame's label
+void test_label_window() {
+    ImageRGB* frame = image_rgb_create(100, 100);
+    ImageRGB* window = image_rgb_create(20, 10);
+    RGB red = {1.0f, 0.0f, 0.0f};
+    DrawTarget whole = draw_target_image(frame);
+    DrawTarget part = {window, 60, 42, 100, 100};
+    draw_label_offset(&whole, 50, 50, 8, "Sun", red);
+    draw_label_offset(&part, 50, 50, 8, "Sun", red);
+    int lit = 0;
+    for (int y = 0; y < 10; y++) {
+        for (int x = 0; x < 20; x++) {
+            assert(window->pixels[y * 20 + x].r == frame->pixels[(y + 42) * 100 + x + 60].r);
+            lit += window->pixels[y * 20 + x].r > 0;
+        }
+    }
+    assert(lit > 0);
+    image_rgb_free(frame);
+    image_rgb_free(window);
+    printf("test_label_window passed\n");
+}
+
 int main() {
     test_label_offset();
     test_label_clipping();
+    test_label_window();
     printf("All label tests passed!\n");
     return 0;
 }
\ No newline at end of file
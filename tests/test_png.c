@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <zlib.h>
+#include "png.h"
+
+#define W 173
+#define H 61
+
+static unsigned int get_be32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+}
+
+// Mostly black sky with a few stars, a gradient band and out-of-range values
+static ImageRGB* make_image(void) {
+    ImageRGB* img = image_rgb_create(W, H);
+    unsigned int seed = 777;
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            RGB p = {0, 0, 0};
+            if (y > 45) p = (RGB){x / (float)W, y / (float)H, 0.25f};
+            seed = seed * 1664525u + 1013904223u;
+            if ((seed >> 24) < 4) p = (RGB){1.2f, 0.9f, -0.1f};
+            img->pixels[y * W + x] = p;
+        }
+    }
+    return img;
+}
+
+static unsigned int expected_sample(float v, int bits) {
+    if (v < 0) v = 0;
+    if (v > 1) v = 1;
+    return (unsigned int)(v * (bits == 8 ? 255.0f : 65535.0f) + 0.5f);
+}
+
+// Encodes img, then checks every chunk CRC and decodes the pixels with zlib.
+// Returns the file size.
+static long check_roundtrip(const ImageRGB* img, int bits, int level) {
+    FILE* f = tmpfile();
+    assert(f);
+    assert(write_png_stream(f, img, bits, level));
+    long size = ftell(f);
+    unsigned char* file = (unsigned char*)malloc(size);
+    rewind(f);
+    assert(fread(file, 1, size, f) == (size_t)size);
+    fclose(f);
+
+    assert(memcmp(file, "\x89PNG\r\n\x1a\n", 8) == 0);
+    unsigned char* idat = (unsigned char*)malloc(size);
+    size_t idat_len = 0;
+    bool seen_end = false;
+    long pos = 8;
+    while (pos < size) {
+        unsigned int len = get_be32(file + pos);
+        const unsigned char* type = file + pos + 4;
+        assert(crc32(0, type, len + 4) == get_be32(file + pos + 8 + len));
+        if (memcmp(type, "IHDR", 4) == 0) {
+            assert((int)get_be32(type + 4) == img->width && (int)get_be32(type + 8) == img->height);
+            assert(type[12] == bits && type[13] == 2);
+        } else if (memcmp(type, "IDAT", 4) == 0) {
+            memcpy(idat + idat_len, type + 4, len);
+            idat_len += len;
+        } else if (memcmp(type, "IEND", 4) == 0) {
+            seen_end = true;
+        }
+        pos += 12 + len;
+    }
+    assert(seen_end && pos == size);
+
+    int bpp = 3 * bits / 8;
+    int w = img->width, h = img->height;
+    size_t stride = 1 + (size_t)w * bpp;
+    uLongf raw_len = stride * h;
+    unsigned char* raw = (unsigned char*)malloc(raw_len);
+    assert(uncompress(raw, &raw_len, idat, idat_len) == Z_OK);
+    assert(raw_len == stride * h);
+
+    for (int y = 0; y < h; y++) {
+        unsigned char* row = raw + y * stride;
+        assert(row[0] == 1); // Sub
+        unsigned char* data = row + 1;
+        for (size_t i = bpp; i < stride - 1; i++) data[i] += data[i - bpp];
+        for (int x = 0; x < w; x++) {
+            RGB p = img->pixels[y * w + x];
+            float c[3] = {p.r, p.g, p.b};
+            for (int k = 0; k < 3; k++) {
+                unsigned int v = bits == 8 ? data[x * 3 + k]
+                                           : ((unsigned int)data[x * 6 + 2 * k] << 8) | data[x * 6 + 2 * k + 1];
+                assert(v == expected_sample(c[k], bits));
+            }
+        }
+    }
+    free(raw);
+    free(idat);
+    free(file);
+    return size;
+}
+
+void test_png_roundtrip() {
+    ImageRGB* img = make_image();
+    long raw_bytes = (long)W * H * 3;
+    for (int bits = 8; bits <= 16; bits += 8) {
+        long builtin = check_roundtrip(img, bits, 0);
+        long zlib = check_roundtrip(img, bits, 6);
+        printf("%d bit: built-in %ld bytes, zlib %ld bytes, raw %ld bytes\n", bits, builtin, zlib, raw_bytes * bits / 8);
+        // The dark sky compresses well even without zlib
+        assert(builtin < raw_bytes * bits / 8 / 2);
+    }
+    image_rgb_free(img);
+    printf("test_png_roundtrip passed\n");
+}
+
+// Long runs cross the 258 byte match limit and the IDAT chunk size
+void test_png_large_flat() {
+    ImageRGB* img = image_rgb_create(4096, 64);
+    for (int i = 0; i < 4096 * 64; i++) img->pixels[i] = (RGB){(i / 4096) / 64.0f, 0.5f, 0};
+    check_roundtrip(img, 16, 0);
+
+    PngWriter* w = png_writer_open(tmpfile(), 8, 2, 8, 0);
+    RGB row[8] = {{0, 0, 0}};
+    assert(png_writer_row(w, row));
+    assert(!png_writer_close(w)); // One row short
+    assert(png_writer_open(tmpfile(), 8, 2, 12, 0) == NULL);
+    image_rgb_free(img);
+    printf("test_png_large_flat passed\n");
+}
+
+int main() {
+    test_png_roundtrip();
+    test_png_large_flat();
+    return 0;
+}
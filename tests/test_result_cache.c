@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "result_cache.h"
+#include "ephemerides.h"
+
+#define W 8
+#define H 6
+#define DIR "test_result_cache.d"
+
+static void fill(ImageRGB* img, float v) {
+    for (int i = 0; i < W * H; i++) img->pixels[i] = (RGB){v, v + i, -v};
+}
+
+static bool cached(uint64_t key) {
+    char path[256];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%016llx.kres", DIR, (unsigned long long)key);
+    return stat(path, &st) == 0;
+}
+
+static void clear(void) {
+    for (uint64_t key = 1; key <= 4; key++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%016llx.kres", DIR, (unsigned long long)key);
+        remove(path);
+    }
+    rmdir(DIR);
+}
+
+static void test_store_load(void) {
+    clear();
+    ImageRGB* imgs[2] = {image_rgb_create(W, H), image_rgb_create(W, H)};
+    ImageRGB* got[2] = {image_rgb_create(W, H), image_rgb_create(W, H)};
+    ImageHDR* hdr = image_hdr_create(W, H);
+    fill(imgs[0], 1.0f);
+    fill(imgs[1], 2.0f);
+    assert(!result_cache_load(DIR, 1, got, 2, NULL));
+    assert(result_cache_store(DIR, 1, imgs, 2, NULL, 1 << 20));
+    assert(result_cache_load(DIR, 1, got, 2, NULL));
+    for (int e = 0; e < 2; e++) assert(memcmp(got[e]->pixels, imgs[e]->pixels, sizeof(RGB) * W * H) == 0);
+
+    // Other exposures, another size, or radiance it does not hold are misses
+    assert(!result_cache_load(DIR, 1, got, 1, NULL));
+    assert(!result_cache_load(DIR, 1, got, 2, hdr));
+    ImageRGB* small = image_rgb_create(W / 2, H);
+    assert(!result_cache_load(DIR, 1, &small, 1, NULL) && cached(1));
+    image_rgb_free(small);
+
+    // A damaged entry is a miss and is removed
+    assert(truncate(DIR "/0000000000000001.kres", 100) == 0);
+    assert(!result_cache_load(DIR, 1, got, 2, NULL) && !cached(1));
+
+    for (int e = 0; e < 2; e++) {
+        image_rgb_free(imgs[e]);
+        image_rgb_free(got[e]);
+    }
+    image_hdr_free(hdr);
+    clear();
+    printf("test_store_load passed\n");
+}
+
+// Past the budget the least recently used entries go
+static void test_eviction(void) {
+    clear();
+    ImageRGB* img = image_rgb_create(W, H);
+    fill(img, 3.0f);
+    uint64_t entry = 64 + sizeof(RGB) * W * H;
+    for (uint64_t key = 1; key <= 3; key++) {
+        assert(result_cache_store(DIR, key, &img, 1, NULL, 3 * entry));
+        usleep(20000); // Distinct file times
+    }
+    assert(result_cache_load(DIR, 1, &img, 1, NULL)); // Now the most recent
+    usleep(20000);
+    assert(result_cache_store(DIR, 4, &img, 1, NULL, 3 * entry));
+    assert(cached(1) && !cached(2) && cached(3) && cached(4));
+    image_rgb_free(img);
+    clear();
+    printf("test_eviction passed\n");
+}
+
+static void test_snap_and_key(void) {
+    Config a, b;
+    config_set_defaults(&a);
+    a.cache_time_minutes = 1.0;
+    a.cache_site_deg = 0.1;
+    a.lat = 45.03;
+    a.lon = -73.56;
+    b = a;
+    b.lat = 44.98;
+    b.lon = -73.61;
+    double ja = result_cache_snap(&a, get_julian_day(2026, 3, 1, 21.0 + 20.0 / 3600.0));
+    double jb = result_cache_snap(&b, get_julian_day(2026, 3, 1, 21.0 - 10.0 / 3600.0));
+    assert(fabs(ja - get_julian_day(2026, 3, 1, 21.0)) < 1e-9 && ja == jb);
+    assert(a.lat == b.lat && a.lon == b.lon && a.hour == b.hour);
+    assert(result_cache_key(&a, ja) == result_cache_key(&b, jb));
+
+    // Output options share an entry; the view does not
+    b.output_filename = "other.jpg";
+    b.png_bits = 16;
+    assert(result_cache_key(&a, ja) == result_cache_key(&b, jb));
+    b.exposure_boost = 2.5f;
+    assert(result_cache_key(&a, ja) != result_cache_key(&b, jb));
+    b = a;
+    b.cam_az += 1.0f;
+    assert(result_cache_key(&a, ja) != result_cache_key(&b, jb));
+    printf("test_snap_and_key passed\n");
+}
+
+int main() {
+    test_store_load();
+    test_eviction();
+    test_snap_and_key();
+    return 0;
+}
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "sky_keyframes.h"
+
+#define CAM_RADIUS (EARTH_RADIUS + 10.0f)
+
+static Atmosphere atm;
+static AtmosphereLUT lut;
+static Spectrum light;
+
+static Vec3 sun_at(float alt_deg) {
+    float alt = alt_deg * DEG2RAD;
+    return (Vec3){0.0f, sinf(alt), cosf(alt)};
+}
+
+// The interpolated sky must follow the ray march, relative to each
+// direction's brightness down to a thousandth of the brightest
+static void test_accuracy(void) {
+    SkyKeyframes* keys = sky_keyframes_create(&atm, &lut, CAM_RADIUS, &light, 0.01f);
+    assert(keys);
+    Spectrum dark;
+    spectrum_zero(&dark);
+    Vec3 origin = {0.0f, CAM_RADIUS, 0.0f};
+    float alts[] = {30.0f, 2.0f, -6.0f};
+    for (int s = 0; s < 3; s++) {
+        Vec3 sun = sun_at(alts[s]), moon = {0.0f, -1.0f, 0.0f};
+        SkyKeyBody sun_key, moon_key;
+        assert(sky_keyframes_prepare(keys, sun, 1.0f, &sun_key));
+        assert(sky_keyframes_prepare(keys, moon, 0.0f, &moon_key));
+        float exact[60][13], approx[60][13], peak = 0.0f;
+        for (int i = 0; i < 60; i++) {
+            for (int j = 0; j < 13; j++) {
+                float zenith = (1.0f + 3.0f * i) * DEG2RAD, azimuth = 15.0f * j * DEG2RAD;
+                Vec3 dir = {sinf(zenith) * sinf(azimuth), cosf(zenith), sinf(zenith) * cosf(azimuth)};
+                float alpha_exact, alpha;
+                Spectrum L = atmosphere_render(&atm, &lut, origin, dir, sun, &light, moon, &dark, &alpha_exact);
+                exact[i][j] = spectrum_to_xyzv(&L).Y;
+                approx[i][j] = sky_keyframes_eval(keys, &sun_key, &moon_key, dir, &alpha).Y;
+                assert(fabsf(alpha - alpha_exact) < 0.01f);
+                if (exact[i][j] > peak) peak = exact[i][j];
+            }
+        }
+        float worst = 0.0f, mean = 0.0f;
+        for (int i = 0; i < 60; i++) {
+            for (int j = 0; j < 13; j++) {
+                float err = fabsf(approx[i][j] - exact[i][j]) / fmaxf(exact[i][j], 1e-3f * peak);
+                if (err > worst) worst = err;
+                mean += err / (60 * 13);
+            }
+        }
+        printf("Sun at %.0f deg: worst relative error %.2e, mean %.2e\n", alts[s], worst, mean);
+        assert(mean < 0.005f && worst < 0.1f);
+    }
+    sky_keyframes_free(keys);
+    printf("test_accuracy passed\n");
+}
+
+static int keyframes_over(float alt0, float alt1) {
+    SkyKeyframes* keys = sky_keyframes_create(&atm, &lut, CAM_RADIUS, &light, 0.01f);
+    assert(keys);
+    SkyKeyBody body;
+    for (float alt = alt0; alt >= alt1; alt -= 0.5f) assert(sky_keyframes_prepare(keys, sun_at(alt), 1.0f, &body));
+    int count = sky_keyframes_count(keys);
+    sky_keyframes_free(keys);
+    return count;
+}
+
+// Keyframes are sparse while the Sun is high and dense in twilight
+static void test_adaptive(void) {
+    int day = keyframes_over(50.0f, 47.0f), twilight = keyframes_over(-2.0f, -5.0f);
+    printf("Keyframes for 3 deg of Sun: %d by day, %d in twilight\n", day, twilight);
+    assert(day <= 5 && twilight > 2 * day);
+    printf("test_adaptive passed\n");
+}
+
+// The keyframes a body gets do not depend on what came before
+static void test_order(void) {
+    SkyKeyframes* a = sky_keyframes_create(&atm, &lut, CAM_RADIUS, &light, 0.01f);
+    SkyKeyframes* b = sky_keyframes_create(&atm, &lut, CAM_RADIUS, &light, 0.01f);
+    assert(a && b);
+    SkyKeyBody ka, kb, none;
+    assert(sky_keyframes_prepare(b, sun_at(20.0f), 1.0f, &kb));
+    assert(sky_keyframes_prepare(a, sun_at(-3.0f), 1.0f, &ka));
+    assert(sky_keyframes_prepare(b, sun_at(-3.0f), 1.0f, &kb));
+    assert(sky_keyframes_prepare(a, (Vec3){0.0f, -1.0f, 0.0f}, 0.0f, &none));
+    assert(ka.weight == kb.weight);
+    for (int j = 0; j < 10; j++) {
+        Vec3 dir = vec3_normalize((Vec3){0.3f * j - 1.0f, 0.2f, 0.5f});
+        float alpha_a, alpha_b;
+        XYZV pa = sky_keyframes_eval(a, &ka, &none, dir, &alpha_a);
+        XYZV pb = sky_keyframes_eval(b, &kb, &none, dir, &alpha_b);
+        assert(memcmp(&pa, &pb, sizeof(XYZV)) == 0 && alpha_a == alpha_b);
+    }
+    assert(sky_keyframes_match(a, CAM_RADIUS, &light, 0.01f));
+    assert(!sky_keyframes_match(a, CAM_RADIUS, &light, 0.02f));
+    sky_keyframes_free(a);
+    sky_keyframes_free(b);
+    printf("test_order passed\n");
+}
+
+int main() {
+    atmosphere_init_default(&atm, 1.0f);
+    assert(atmosphere_lut_open(&lut, &atm, NULL));
+    spectrum_set(&light, 100.0f);
+    test_accuracy();
+    test_adaptive();
+    test_order();
+    atmosphere_lut_close(&lut);
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "ephemerides.h"
+#include "constellation.h"
+
+#define ARCSEC (PI / (180.0 * 3600.0))
+
+static double angle_between(Vec3 a, Vec3 b) {
+    double dot = (double)a.x * b.x + (double)a.y * b.y + (double)a.z * b.z;
+    double cx = (double)a.y * b.z - (double)a.z * b.y;
+    double cy = (double)a.z * b.x - (double)a.x * b.z;
+    double cz = (double)a.x * b.y - (double)a.y * b.x;
+    return atan2(sqrt(cx * cx + cy * cy + cz * cz), dot);
+}
+
+// Double-precision horizon direction, independent of the float catalog transform
+static Vec3 exact_direction(float ra, float dec, double jd, double lat, double lon) {
+    double lmst = local_mean_sidereal_time(greenwich_mean_sidereal_time(jd), lon);
+    double ha = lmst - ra, phi = lat * DEG2RAD;
+    Vec3 d;
+    d.x = (float)(-cos(dec) * sin(ha));
+    d.y = (float)(sin(dec) * sin(phi) + cos(dec) * cos(phi) * cos(ha));
+    d.z = (float)(sin(dec) * cos(phi) - cos(dec) * sin(phi) * cos(ha));
+    return d;
+}
+
+static void random_catalog(Star* stars, int n) {
+    srand(12345);
+    for (int i = 0; i < n; i++) {
+        memset(&stars[i], 0, sizeof(Star));
+        stars[i].ra = (float)(TWO_PI * rand() / (double)RAND_MAX);
+        stars[i].dec = (float)asin(2.0 * rand() / (double)RAND_MAX - 1.0);
+    }
+}
+
+// A day of 5 minute frames: the rotated directions must stay within an
+// arcsecond of the exact position at every frame.
+void test_star_drift() {
+    int n = 2000;
+    Star* stars = (Star*)malloc(sizeof(Star) * n);
+    random_catalog(stars, n);
+
+    double lat = 45.0, lon = -122.0;
+    double jd0 = get_julian_day(2026, 3, 1, 4.0);
+    SkyRotation rot = {0}, dirs_rot = {0};
+    Vec3* dirs = (Vec3*)malloc(sizeof(Vec3) * n);
+    int rotated_frames = 0;
+    double worst = 0.0;
+    for (int f = 0; f < 288; f++) {
+        double jd = jd0 + f * 5.0 / 1440.0;
+        if (rot.valid && rot.frames_since_anchor < SKY_REANCHOR_FRAMES) rotated_frames++;
+        star_horizon_advance(&rot, jd, lat, lon, stars, n);
+        // The shared-catalog form must give the same directions
+        star_directions_advance(&dirs_rot, jd, lat, lon, stars, dirs, n);
+        for (int i = 0; i < n; i++) {
+            Vec3 exact = exact_direction(stars[i].ra, stars[i].dec, jd, lat, lon);
+            double err = angle_between(stars[i].direction, exact);
+            if (err > worst) worst = err;
+            assert(memcmp(&dirs[i], &stars[i].direction, sizeof(Vec3)) == 0);
+        }
+    }
+    free(dirs);
+    printf("Worst drift over 24h: %.4f arcsec (%d rotated frames)\n", worst / ARCSEC, rotated_frames);
+    assert(rotated_frames > 250);
+    assert(worst < 1.0 * ARCSEC);
+    free(stars);
+    printf("test_star_drift passed\n");
+}
+
+// Changing the site must fall back to a full transform
+void test_reanchor_on_site_change() {
+    Star s[2];
+    random_catalog(s, 2);
+    SkyRotation rot = {0};
+    double R[9];
+    double jd = get_julian_day(2026, 3, 1, 4.0);
+    assert(!sky_rotation_step(&rot, jd, 45.0, 0.0, s, 2, R));
+    assert(sky_rotation_step(&rot, jd + 0.01, 45.0, 0.0, s, 2, R));
+    assert(!sky_rotation_step(&rot, jd + 0.02, 40.0, 0.0, s, 2, R));
+    assert(!sky_rotation_step(&rot, jd + 0.03, 40.0, 0.0, s, 1, R));
+
+    // A zero time step is the identity
+    assert(sky_rotation_step(&rot, jd + 0.03, 40.0, 0.0, s, 1, R));
+    for (int i = 0; i < 9; i++) assert(fabs(R[i] - (i % 4 == 0 ? 1.0 : 0.0)) < 1e-12);
+    printf("test_reanchor_on_site_change passed\n");
+}
+
+void test_constellation_drift() {
+    ConstellationBoundary b, ref;
+    memset(&b, 0, sizeof(b));
+    int n = 500;
+    b.vertices = (ConstellationVertex*)calloc(n, sizeof(ConstellationVertex));
+    b.count = n;
+    b.label_count = 88;
+    srand(777);
+    for (int i = 0; i < n; i++) {
+        b.vertices[i].ra = (float)(TWO_PI * rand() / (double)RAND_MAX);
+        b.vertices[i].dec = (float)asin(2.0 * rand() / (double)RAND_MAX - 1.0);
+    }
+    for (int i = 0; i < b.label_count; i++) {
+        b.labels[i].ra = b.vertices[i].ra;
+        b.labels[i].dec = b.vertices[i].dec;
+    }
+    ref = b;
+    ref.vertices = (ConstellationVertex*)malloc(sizeof(ConstellationVertex) * n);
+    memcpy(ref.vertices, b.vertices, sizeof(ConstellationVertex) * n);
+
+    double lat = -33.9, lon = 18.4;
+    double jd0 = get_julian_day(2026, 6, 21, 18.0);
+    SkyRotation rot = {0};
+    double worst = 0.0, worst_alt = 0.0;
+    for (int f = 0; f < 288; f++) {
+        double jd = jd0 + f * 5.0 / 1440.0;
+        constellation_horizon_advance(&rot, jd, lat, lon, &b);
+        constellation_equ_to_horizon(jd, lat, lon, &ref);
+        for (int i = 0; i < n; i++) {
+            double err = angle_between(b.vertices[i].direction, ref.vertices[i].direction);
+            if (err > worst) worst = err;
+        }
+        for (int i = 0; i < b.label_count; i++) {
+            double err = fabs((double)b.labels[i].alt - ref.labels[i].alt);
+            if (err > worst_alt) worst_alt = err;
+        }
+    }
+    printf("Constellation drift: %.4f arcsec, label altitude %.4f arcsec\n", worst / ARCSEC, worst_alt / ARCSEC);
+    assert(worst < 1.0 * ARCSEC);
+    assert(worst_alt < 2.0 * ARCSEC);
+    free(b.vertices);
+    free(ref.vertices);
+    printf("test_constellation_drift passed\n");
+}
+
+int main() {
+    test_star_drift();
+    test_reanchor_on_site_change();
+    test_constellation_drift();
+    return 0;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include "tonemap.h"
+
+// Serial reference: the original per-pixel mapping with powf gamma
+static void reference_tonemap(const ImageHDR* src, ImageRGB* dst, float L_avg, float key) {
+    int count = src->width * src->height;
+    for (int i = 0; i < count; i++) {
+        XYZV p = src->pixels[i];
+        if (p.Y <= 0) { dst->pixels[i] = (RGB){0, 0, 0}; continue; }
+        float t = (log10f(p.Y + 1e-9f) + 2.0f) / 2.6f;
+        t = t < 0 ? 0 : (t > 1 ? 1 : t);
+        float s = t * t * (3.0f - 2.0f * t);
+        float sum = p.X + p.Y + p.Z;
+        float x = (1 - s) * 0.25f + s * p.X / sum;
+        float y = (1 - s) * 0.25f + s * p.Y / sum;
+        float Ym = 0.4468f * (1 - s) * p.V + s * p.Y;
+        if (y < 1e-4f) y = 1e-4f;
+        float ns = Ym / y;
+        float L = Ym * key / L_avg;
+        float Yt = (L * (1 + L / 1e6f)) / (1 + L);
+        float k = Yt / (Ym + 1e-9f);
+        RGB rgb = xyz_to_srgb(x * ns * k, Ym * k, (1 - x - y) * ns * k);
+        float c[3] = {rgb.r, rgb.g, rgb.b};
+        for (int j = 0; j < 3; j++) c[j] = powf(fminf(fmaxf(c[j], 0.0f), 1.0f), 1.0f / 2.2f);
+        dst->pixels[i] = (RGB){c[0], c[1], c[2]};
+    }
+}
+
+static ImageHDR* make_scene(int w, int h) {
+    ImageHDR* img = image_hdr_create(w, h);
+    unsigned int seed = 12345;
+    for (int i = 0; i < w * h; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        // Luminance spread over ~12 decades, from starlit sky to the moon
+        float Y = powf(10.0f, -9.0f + 12.0f * (seed >> 8) / 16777216.0f);
+        seed = seed * 1664525u + 1013904223u;
+        float tint = 0.8f + 0.4f * (seed >> 8) / 16777216.0f;
+        img->pixels[i] = (XYZV){Y * tint, Y, Y * (2.0f - tint), Y * 1.3f};
+    }
+    return img;
+}
+
+void test_tonemap_matches_reference() {
+    int w = 173, h = 91;
+    ImageHDR* hdr = make_scene(w, h);
+    ImageRGB* out = image_rgb_create(w, h);
+    ImageRGB* ref = image_rgb_create(w, h);
+    ToneParams params;
+    tonemap_compute_params(hdr, 1.0f, &params);
+    tonemap_apply(hdr, out, &params);
+    reference_tonemap(hdr, ref, params.L_avg, params.key);
+    float max_err = 0;
+    for (int i = 0; i < w * h; i++) {
+        max_err = fmaxf(max_err, fabsf(out->pixels[i].r - ref->pixels[i].r));
+        max_err = fmaxf(max_err, fabsf(out->pixels[i].g - ref->pixels[i].g));
+        max_err = fmaxf(max_err, fabsf(out->pixels[i].b - ref->pixels[i].b));
+    }
+    printf("Max difference from reference: %e\n", max_err);
+    assert(max_err < 1e-4f);
+    image_rgb_free(out);
+    image_rgb_free(ref);
+    image_hdr_free(hdr);
+    printf("test_tonemap_matches_reference passed\n");
+}
+
+void test_tonemap_thread_determinism() {
+    int w = 640, h = 333;
+    ImageHDR* hdr = make_scene(w, h);
+    ToneParams p1, p7;
+    ImageRGB* o1 = image_rgb_create(w, h);
+    ImageRGB* o7 = image_rgb_create(w, h);
+
+    setenv("KNIGHT_THREADS", "1", 1);
+    tonemap_compute_params(hdr, 0.0f, &p1);
+    tonemap_apply(hdr, o1, &p1);
+    setenv("KNIGHT_THREADS", "7", 1);
+    tonemap_compute_params(hdr, 0.0f, &p7);
+    tonemap_apply(hdr, o7, &p7);
+    unsetenv("KNIGHT_THREADS");
+
+    assert(memcmp(&p1, &p7, sizeof(ToneParams)) == 0);
+    assert(memcmp(o1->pixels, o7->pixels, sizeof(RGB) * w * h) == 0);
+    image_rgb_free(o1);
+    image_rgb_free(o7);
+    image_hdr_free(hdr);
+    printf("test_tonemap_thread_determinism passed\n");
+}
+
+static void write_sky(int begin, int end, LumHistogram* hist, void* ctx) {
+    ImageHDR* img = (ImageHDR*)ctx;
+    for (int i = begin; i < end; i++) {
+        float Y = 1e-7f * (1 + i % 1000);
+        img->pixels[i] = (XYZV){Y, Y, Y, Y};
+        if (hist) lum_hist_add(hist, Y);
+    }
+}
+
+void test_fused_histogram() {
+    int w = 300, h = 200;
+    ImageHDR* img = image_hdr_create(w, h);
+    image_hdr_track_histogram(img);
+    setenv("KNIGHT_THREADS", "3", 1);
+    parallel_for_hist(w * h, 1000, img->hist, write_sky, img);
+    unsetenv("KNIGHT_THREADS");
+    // Point sources added on top, as render_stars does
+    for (int k = 0; k < 500; k++) {
+        int idx = (k * 7919) % (w * h);
+        float old_Y = img->pixels[idx].Y;
+        img->pixels[idx].Y += 0.01f * k;
+        lum_hist_update(img->hist, old_Y, img->pixels[idx].Y);
+    }
+    LumHistogram rebuilt;
+    lum_hist_from_image(&rebuilt, img);
+    assert(rebuilt.count == img->hist->count);
+    assert(rebuilt.max_Y == img->hist->max_Y);
+    assert(memcmp(rebuilt.bins, img->hist->bins, sizeof(rebuilt.bins)) == 0);
+    image_hdr_free(img);
+    printf("test_fused_histogram passed\n");
+}
+
+void test_exposure_ignores_highlights() {
+    // Uniform twilight sky with a small, very bright sun disk
+    int w = 500, h = 200;
+    float sky = 1.3e-3f;
+    ImageHDR* img = image_hdr_create(w, h);
+    for (int i = 0; i < w * h; i++) img->pixels[i] = (XYZV){sky, sky, sky, sky};
+    for (int i = 0; i < w * h / 250; i++) img->pixels[i * 250].Y = 1e6f;
+    ToneParams params;
+    tonemap_compute_params(img, 0.0f, &params);
+    printf("L_avg with sun: %e (sky %e)\n", params.L_avg, sky);
+    assert(fabsf(params.L_avg - sky) < 0.02f * sky);
+    assert(params.max_Y == 1e6f);
+    image_hdr_free(img);
+    printf("test_exposure_ignores_highlights passed\n");
+}
+
+void test_exposure_adaptation() {
+    ExposureState st;
+    exposure_state_init(&st, 60.0f, 300.0f);
+
+    // First frame adopts the metered value
+    float L = exposure_adapt(&st, 1000.0, 1e-2f);
+    assert(fabsf(L - 1e-2f) < 1e-6f);
+
+    // Darkening by 2 decades: after one tau, 1 - 1/e of the way in log space
+    L = exposure_adapt(&st, 1300.0, 1e-4f);
+    float expected = -2.0f - 2.0f * (1.0f - expf(-1.0f));
+    printf("Adapted after one tau: %f (expected %f)\n", log10f(L), expected);
+    assert(fabsf(log10f(L) - expected) < 1e-4f);
+
+    // Same result whether the interval is taken in one step or ten
+    ExposureState a, b;
+    exposure_state_init(&a, 60.0f, 300.0f);
+    exposure_state_init(&b, 60.0f, 300.0f);
+    exposure_adapt(&a, 0.0, 1e-5f);
+    exposure_adapt(&b, 0.0, 1e-5f);
+    float la = exposure_adapt(&a, 120.0, 1.0f);
+    float lb = 0;
+    for (int k = 1; k <= 10; k++) lb = exposure_adapt(&b, 12.0 * k, 1.0f);
+    assert(fabsf(log10f(la) - log10f(lb)) < 1e-4f);
+    // Brightening uses the shorter constant
+    assert(fabsf(log10f(la) - (-5.0f + 5.0f * (1.0f - expf(-2.0f)))) < 1e-4f);
+
+    // Going back in time resets
+    L = exposure_adapt(&st, 0.0, 0.5f);
+    assert(fabsf(L - 0.5f) < 1e-6f);
+
+    // File round trip
+    const char* path = "test_exposure.state";
+    assert(exposure_state_save(&st, path));
+    ExposureState loaded;
+    exposure_state_init(&loaded, 60.0f, 300.0f);
+    assert(exposure_state_load(&loaded, path));
+    assert(loaded.valid && loaded.time == st.time && fabsf(loaded.log_L - st.log_L) < 1e-6f);
+    remove(path);
+    exposure_state_init(&loaded, 60.0f, 300.0f);
+    assert(!exposure_state_load(&loaded, path));
+    assert(!loaded.valid);
+    printf("test_exposure_adaptation passed\n");
+}
+
+int main() {
+    test_tonemap_matches_reference();
+    test_tonemap_thread_determinism();
+    test_fused_histogram();
+    test_exposure_ignores_highlights();
+    test_exposure_adaptation();
+    return 0;
+}
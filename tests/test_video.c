@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <jpeglib.h>
+#include "jpeg.h"
+#include "avi.h"
+
+#define W 64
+#define H 48
+#define FRAMES 3
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Flat colour per frame, so decoded pixels can be checked despite JPEG loss
+static RGB frame_colour(int frame) {
+    return (RGB){0.2f + 0.3f * frame, 0.5f, 0.9f - 0.4f * frame};
+}
+
+static ImageRGB* make_frame(int frame) {
+    ImageRGB* img = image_rgb_create(W, H);
+    for (int i = 0; i < W * H; i++) img->pixels[i] = frame_colour(frame);
+    return img;
+}
+
+// Decodes a JPEG and checks its size and that every pixel is near colour
+static void check_jpeg(const unsigned char* data, size_t size, RGB colour) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, (unsigned char*)data, size);
+    assert(jpeg_read_header(&cinfo, TRUE) == JPEG_HEADER_OK);
+    jpeg_start_decompress(&cinfo);
+    assert(cinfo.output_width == W && cinfo.output_height == H && cinfo.output_components == 3);
+    unsigned char row[W * 3];
+    int expected[3] = {(int)(colour.r * 255 + 0.5f), (int)(colour.g * 255 + 0.5f), (int)(colour.b * 255 + 0.5f)};
+    while (cinfo.output_scanline < cinfo.output_height) {
+        JSAMPROW rows[1] = {row};
+        jpeg_read_scanlines(&cinfo, rows, 1);
+        for (int i = 0; i < W * 3; i++) assert(abs(row[i] - expected[i % 3]) <= 3);
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+}
+
+void test_jpeg_encode() {
+    ImageRGB* img = make_frame(1);
+    unsigned char* data;
+    unsigned long size;
+    assert(encode_jpeg(img, 90, &data, &size));
+    assert(size > 0 && size < W * H * 3);
+    check_jpeg(data, size, frame_colour(1));
+    free(data);
+    image_rgb_free(img);
+    printf("test_jpeg_encode passed\n");
+}
+
+void test_avi_mjpeg() {
+    const char* path = "test_video.avi";
+    AviWriter* avi = avi_open(path, W, H, 12.5);
+    assert(avi);
+    unsigned long sizes[FRAMES];
+    for (int f = 0; f < FRAMES; f++) {
+        ImageRGB* img = make_frame(f);
+        unsigned char* data;
+        assert(encode_jpeg(img, 90, &data, &sizes[f]));
+        assert(avi_add_frame(avi, data, sizes[f]));
+        free(data);
+        image_rgb_free(img);
+    }
+    assert(avi_close(avi));
+
+    FILE* fp = fopen(path, "rb");
+    assert(fp);
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+    unsigned char* file = (unsigned char*)malloc(size);
+    assert(fread(file, 1, size, fp) == (size_t)size);
+    fclose(fp);
+    remove(path);
+
+    assert(memcmp(file, "RIFF", 4) == 0 && memcmp(file + 8, "AVI ", 4) == 0);
+    assert(get_u32(file + 4) == (uint32_t)size - 8);
+    assert(memcmp(file + 24, "avih", 4) == 0);
+    assert(get_u32(file + 32) == 80000);        // Microseconds per frame
+    assert(get_u32(file + 48) == FRAMES);
+    assert(get_u32(file + 64) == W && get_u32(file + 68) == H);
+    assert(memcmp(file + 108, "vids", 4) == 0 && memcmp(file + 112, "MJPG", 4) == 0);
+    assert(get_u32(file + 132) / (double)get_u32(file + 128) == 12.5);
+    assert(get_u32(file + 140) == FRAMES);
+
+    // Walk to the movi list and the index after it
+    assert(memcmp(file + 212, "LIST", 4) == 0 && memcmp(file + 220, "movi", 4) == 0);
+    long movi = 220;
+    long idx1 = movi + get_u32(file + 216);
+    assert(memcmp(file + idx1, "idx1", 4) == 0);
+    assert(get_u32(file + idx1 + 4) == 16 * FRAMES);
+    for (int f = 0; f < FRAMES; f++) {
+        const unsigned char* entry = file + idx1 + 8 + 16 * f;
+        assert(memcmp(entry, "00dc", 4) == 0);
+        const unsigned char* chunk = file + movi + get_u32(entry + 8);
+        assert(memcmp(chunk, "00dc", 4) == 0);
+        assert(get_u32(chunk + 4) == sizes[f] && get_u32(entry + 12) == sizes[f]);
+        check_jpeg(chunk + 8, sizes[f], frame_colour(f));
+    }
+    assert(idx1 + 8 + 16 * FRAMES == size);
+    free(file);
+    printf("test_avi_mjpeg passed\n");
+}
+
+int main() {
+    test_jpeg_encode();
+    test_avi_mjpeg();
+    return 0;
+}
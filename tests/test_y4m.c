@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "y4m.h"
+
+static unsigned char* read_all(FILE* f, long* size) {
+    *size = ftell(f);
+    unsigned char* data = (unsigned char*)malloc(*size);
+    rewind(f);
+    assert(fread(data, 1, *size, f) == (size_t)*size);
+    fclose(f);
+    return data;
+}
+
+// Known BT.601 studio range values of flat colours, on an odd sized frame so
+// the last chroma row and column cover a single pixel row or column
+void test_yuv_colours() {
+    struct {
+        RGB rgb;
+        unsigned char y, u, v;
+    } cases[] = {
+        {{0, 0, 0}, 16, 128, 128},
+        {{1, 1, 1}, 235, 128, 128},
+        {{1, 0, 0}, 81, 90, 240},
+        {{0, 0, 1}, 41, 240, 110},
+        {{2.0f, -1.0f, 0}, 81, 90, 240}, // Clamped to red
+    };
+    int w = 5, h = 3;
+    size_t size = y4m_frame_size(w, h);
+    assert(size == 15 + 2 * 3 * 2);
+    unsigned char* yuv = (unsigned char*)malloc(size);
+    ImageRGB* img = image_rgb_create(w, h);
+    for (int c = 0; c < 5; c++) {
+        for (int i = 0; i < w * h; i++) img->pixels[i] = cases[c].rgb;
+        assert(rgb_to_yuv420(img, yuv));
+        for (int i = 0; i < w * h; i++) assert(yuv[i] == cases[c].y);
+        for (int i = 0; i < 6; i++) assert(yuv[15 + i] == cases[c].u && yuv[21 + i] == cases[c].v);
+    }
+
+    // Chroma is the mean of each 2x2 block: half white, half black is grey
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) img->pixels[y * w + x] = (x + y) % 2 ? (RGB){1, 1, 1} : (RGB){0, 0, 0};
+    }
+    assert(rgb_to_yuv420(img, yuv));
+    assert(yuv[0] == 16 && yuv[1] == 235);
+    for (int i = 0; i < 6; i++) assert(yuv[15 + i] == 128 && yuv[21 + i] == 128);
+    free(yuv);
+    image_rgb_free(img);
+    printf("test_yuv_colours passed\n");
+}
+
+void test_y4m_stream() {
+    int w = 6, h = 4;
+    ImageRGB* img = image_rgb_create(w, h);
+    for (int i = 0; i < w * h; i++) img->pixels[i] = (RGB){1, 1, 1};
+    unsigned char* yuv = (unsigned char*)malloc(y4m_frame_size(w, h));
+    FILE* f = tmpfile();
+    assert(write_y4m_header(f, w, h, 29.97));
+    assert(write_y4m_frame(f, img, yuv));
+    assert(write_y4m_frame(f, img, yuv));
+    long size;
+    unsigned char* data = read_all(f, &size);
+    const char* header = "YUV4MPEG2 W6 H4 F2997:100 Ip A1:1 C420jpeg\n";
+    size_t frame = 6 + y4m_frame_size(w, h);
+    assert(memcmp(data, header, strlen(header)) == 0);
+    assert(size == (long)(strlen(header) + 2 * frame));
+    assert(memcmp(data + strlen(header) + frame, "FRAME\n", 6) == 0);
+    free(data);
+
+    f = tmpfile();
+    assert(write_y4m_header(f, w, h, 24));
+    data = read_all(f, &size);
+    assert(strncmp((char*)data, "YUV4MPEG2 W6 H4 F24:1 ", 22) == 0);
+    free(data);
+    free(yuv);
+    image_rgb_free(img);
+    printf("test_y4m_stream passed\n");
+}
+
+void test_ppm_frame() {
+    ImageRGB* img = image_rgb_create(3, 2);
+    for (int i = 0; i < 6; i++) img->pixels[i] = (RGB){i / 5.0f, 1.5f, -0.5f};
+    unsigned char rgb[18];
+    FILE* f = tmpfile();
+    assert(write_ppm_frame(f, img, rgb));
+    assert(write_ppm_frame(f, img, rgb));
+    long size;
+    unsigned char* data = read_all(f, &size);
+    const char* header = "P6\n3 2\n255\n";
+    size_t frame = strlen(header) + 18;
+    assert(size == (long)(2 * frame));
+    assert(memcmp(data + frame, header, strlen(header)) == 0);
+    const unsigned char* p = data + strlen(header);
+    for (int i = 0; i < 6; i++) {
+        assert(p[3 * i] == (unsigned char)(i / 5.0f * 255.0f + 0.5f));
+        assert(p[3 * i + 1] == 255 && p[3 * i + 2] == 0);
+    }
+    free(data);
+    image_rgb_free(img);
+    printf("test_ppm_frame passed\n");
+}
+
+int main() {
+    test_yuv_colours();
+    test_y4m_stream();
+    test_ppm_frame();
+    return 0;
+}
@@ -1,18 +1,13 @@
-import os
 import subprocess
 import datetime
 import sys
 
 def run_timelapse():
     # Configuration
-    output_dir = "timelapse_frames"
     video_name = "day_night_cycle.mp4"
     interval_minutes = 5
     fps = 24
     
-    if not os.path.exists(output_dir):
-        os.makedirs(output_dir)
-    
     # Get current date
     now = datetime.datetime.utcnow()
     date_str = now.strftime("%Y-%m-%d")
@@ -32,75 +27,73 @@ def run_timelapse():
     except Exception:
         print("Could not check GPU availability. Defaulting to CPU mode.")
 
-    frames = []
     # 24 hours * 60 minutes / interval
     total_steps = (24 * 60) // interval_minutes
-    
-    for i in range(total_steps):
-        total_minutes = i * interval_minutes
-        h = total_minutes // 60
-        m = total_minutes % 60
-        time_str = f"{h:02d}:{m:02d}:00"
-        
-        frame_filename = os.path.join(output_dir, f"frame_{i:04d}.pfm")
-        png_filename = os.path.join(output_dir, f"frame_{i:04d}.png")
-        
-        # We use -c to get PNGs directly. 
-        # We track the sun to see the movement across the sky
-        cmd = [
-            "./knight",
-            "-f", "90.",
-            "-d", date_str,
-            "-t", time_str,
-            "-w", "1280",
-            "-h", "720",
-            "-o", frame_filename,
-            "-c", # Convert to PNG
-            "--exposure", "1.0" # Slight boost for visibility
-        ]
-        
-        if gpu_available:
-            cmd += ["--mode", "gpu"]
-        
-        # If you want a fixed view (e.g. looking South), uncomment these and remove tracking logic if desired
-        cmd += ["-a", "20", "-z", "180"]
-        
-        print(f"[{i+1}/{total_steps}] Rendering {time_str}...", end="\r")
-        sys.stdout.flush()
-        
-        result = subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
-        if result.returncode != 0:
-            print(f"\nError rendering frame {i}: {result.stderr.decode()}")
-            return
+    last_minutes = (total_steps - 1) * interval_minutes
 
-        # Clean up the PFM files to save space, keeping only PNGs
-        if os.path.exists(frame_filename):
-            os.remove(frame_filename)
-            
-    print("\nRendering complete. Assembling video with ffmpeg...")
+    # One knight process renders the whole sequence: catalogs, textures and the
+    # atmosphere are loaded once, and exposure adapts smoothly from frame to frame.
+    # Frames stream to stdout as YUV4MPEG2 and straight into ffmpeg, so no
+    # temporary files are written; knight's messages arrive on stderr.
+    cmd = [
+        "./knight",
+        "-f", "90.",
+        "--start", f"{date_str}T00:00",
+        "--end", f"{date_str}T{last_minutes // 60:02d}:{last_minutes % 60:02d}",
+        "--step", f"{interval_minutes}m",
+        "-w", "1280",
+        "-h", "720",
+        "-o", "-",
+        "--format", "y4m",
+        "--fps", str(fps),
+        "--exposure", "1.0" # Slight boost for visibility
+    ]
+    
+    if gpu_available:
+        cmd += ["--mode", "gpu"]
+    
+    # If you want a fixed view (e.g. looking South), uncomment these and remove tracking logic if desired
+    cmd += ["-a", "20", "-z", "180"]
     
     # FFmpeg command
     # -y: overwrite output
-    # -framerate: input fps
-    # -i: input pattern
+    # -loglevel error: keep stderr short, it is only read once knight is done
+    # -f yuv4mpegpipe -i -: read frames (size and rate included) from the pipe
     # -c:v: codec
     # -pix_fmt: pixel format for compatibility
     ffmpeg_cmd = [
         "ffmpeg", "-y",
-        "-framerate", str(fps),
-        "-i", os.path.join(output_dir, "frame_%04d.png"),
+        "-loglevel", "error",
+        "-f", "yuv4mpegpipe",
+        "-i", "-",
         "-c:v", "libx264",
         "-crf", "18",
         "-pix_fmt", "yuv420p",
         video_name
     ]
+
+    print(f"Rendering {total_steps} frames and encoding {video_name}...")
+    sys.stdout.flush()
     
-    result = subprocess.run(ffmpeg_cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
-    if result.returncode == 0:
-        print(f"Success! Video saved as {video_name}")
-        print(f"To clean up frames, run: rm -rf {output_dir}")
+    process = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE, text=True)
+    encoder = subprocess.Popen(ffmpeg_cmd, stdin=process.stdout, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    process.stdout.close() # ffmpeg owns the pipe now
+    errors = []
+    for line in process.stderr:
+        if line.startswith("Frame "):
+            print(f"[{line.split()[1]}] Rendering...", end="\r")
+            sys.stdout.flush()
+        elif line.startswith("Error"):
+            errors.append(line)
+    knight_status = process.wait()
+    ffmpeg_stderr = encoder.stderr.read().decode()
+    if knight_status != 0:
+        print(f"\nError rendering sequence: {''.join(errors)}")
+        return
+    if encoder.wait() == 0:
+        print(f"\nSuccess! Video saved as {video_name}")
     else:
-        print(f"FFmpeg Error: {result.stderr.decode()}")
+        print(f"\nFFmpeg Error: {ffmpeg_stderr}")
 
 if __name__ == "__main__":
     run_timelapse()